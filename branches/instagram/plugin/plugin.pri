@@ -15,6 +15,8 @@ SOURCES += \
 
 INCLUDEPATH += $$PWD/src
 
+include($$PWD/../../../plugin/common.pri)
+
 # Smoke (base debugging implementation)
 DEFINES += ENABLE_SMOKE_CONNECTION
 HEADERS += $$PWD/src/smoke/smokeconnection.h
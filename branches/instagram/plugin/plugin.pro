@@ -17,6 +17,10 @@ SOURCES += \
 
 INCLUDEPATH += src
 
+# Shared with the plugin on the main line. socialconnection.cpp stays a copy:
+# it has to be built against the socialconnection.h of this branch.
+include(../../../plugin/common.pri)
+
 # Smoke (base debugging implementation)
 DEFINES += ENABLE_SMOKE_CONNECTION
 HEADERS += src/smoke/smokeconnection.h
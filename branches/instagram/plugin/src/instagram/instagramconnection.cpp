@@ -1,20 +1,96 @@
 #include "instagramconnection.h"
 
+#include <QDateTime>
 #include <QDebug>
 #include <QMap>
 #include <QNetworkReply>
 #include <QSettings>
 #include <QStringList>
-#include <QScriptEngine>
-#include <QScriptValue>
-#include <QScriptValueIterator>
+#include <QTimer>
 #include <QUrl>
+#include <QtConcurrentRun>
 
 #include "instagramconstants.h"
 #include "instagramrequest.h"
+#include "networktransport.h"
+#include "parsequeue.h"
 #include "webinterface.h"
 #include "socialconnectionerror.h"
 
+// Endpoint table, indexed by EndpointId. The URL templates take the path
+// arguments of the call; the named parameters are sent in the query of GET
+// and DELETE requests and in the form encoded body of POST requests.
+const InstagramConnection::Endpoint InstagramConnection::Endpoints[] = {
+    { OAUTH_ACCESSTOKEN_URL, HttpPost, false,
+      "client_id,client_secret,grant_type,redirect_uri,code,scope",
+      &InstagramConnection::parseRetrievedAuthorization, "retrieveAuthorizationCompleted" },
+
+    // Users
+    { INSTAGRAM_USERS_URL "%1", HttpGet, true, "",
+      &InstagramConnection::parseRetrievedUser, "retrieveUserCompleted" },
+    { INSTAGRAM_USERS_SELF_FEED_URL, HttpGet, true, "count,min_id,max_id",
+      &InstagramConnection::parseRetrievedMedias, "retrieveUserSelfFeedCompleted" },
+    { INSTAGRAM_USERS_URL "%1/media/recent/", HttpGet, true,
+      "count,min_id,max_id,min_timestamp,max_timestamp",
+      &InstagramConnection::parseRetrievedMedias, "retrieveUserMediaRecentCompleted" },
+    { INSTAGRAM_USERS_SELF_MEDIA_LIKED_URL, HttpGet, true, "count,max_like_id",
+      &InstagramConnection::parseRetrievedMedias, "retrieveUserSelfMediaLikedCompleted" },
+    { INSTAGRAM_USERS_SEARCH_URL, HttpGet, true, "q,count",
+      &InstagramConnection::parseRetrievedUsers, "retrieveUserSearchCompleted" },
+
+    // Relationships
+    { INSTAGRAM_USERS_URL "%1/follows", HttpGet, true, "",
+      &InstagramConnection::parseRetrievedUsers, "retrieveUserFollowsCompleted" },
+    { INSTAGRAM_USERS_URL "%1/followed-by", HttpGet, true, "",
+      &InstagramConnection::parseRetrievedUsers, "retrieveUserFollowedByCompleted" },
+    { INSTAGRAM_USERS_REQUESTEDBY_URL, HttpGet, true, "",
+      &InstagramConnection::parseRetrievedUsers, "retrieveUserSelfRequestedByCompleted" },
+    { INSTAGRAM_USERS_URL "%1/relationship", HttpGet, true, "",
+      &InstagramConnection::parseRetrievedUserRelationship, "retrieveUserRelationshipCompleted" },
+    { INSTAGRAM_USERS_URL "%1/relationship", HttpPost, true, "action",
+      &InstagramConnection::parseSetUserRelationship, "setUserRelationshipCompleted" },
+
+    // Media
+    { INSTAGRAM_MEDIA_URL "%1", HttpGet, true, "",
+      &InstagramConnection::parseRetrievedMedia, "retrieveMediaCompleted" },
+    { INSTAGRAM_MEDIA_SEARCH_URL, HttpGet, true, "lat,lng,min_timestamp,max_timestamp,distance",
+      &InstagramConnection::parseRetrievedMedias, "retrieveMediaSearchCompleted" },
+    { INSTAGRAM_MEDIA_POPULAR_URL, HttpGet, true, "",
+      &InstagramConnection::parseRetrievedMedias, "retrieveMediaPopularCompleted" },
+
+    // Comments
+    { INSTAGRAM_MEDIA_URL "%1/comments", HttpGet, true, "",
+      &InstagramConnection::parseRetrievedComments, "retrieveCommentsCompleted" },
+    { INSTAGRAM_MEDIA_URL "%1/comments", HttpPost, true, "text",
+      &InstagramConnection::parsePostedComment, "postCommentCompleted" },
+    { INSTAGRAM_MEDIA_URL "%1/comments/%2", HttpDelete, true, "",
+      &InstagramConnection::parseDeletedComment, "deleteCommentCompleted" },
+
+    // Likes
+    { INSTAGRAM_MEDIA_URL "%1/likes", HttpGet, true, "",
+      &InstagramConnection::parseRetrievedLikes, "retrieveLikesCompleted" },
+    { INSTAGRAM_MEDIA_URL "%1/likes", HttpPost, true, "",
+      &InstagramConnection::parsePostedLike, "postLikeCompleted" },
+    { INSTAGRAM_MEDIA_URL "%1/likes", HttpDelete, true, "",
+      &InstagramConnection::parseDeletedLike, "deleteLikeCompleted" },
+
+    // Tags
+    { INSTAGRAM_TAGS_URL "%1", HttpGet, true, "",
+      &InstagramConnection::parseTag, "getTagCompleted" },
+    { INSTAGRAM_TAGS_URL "%1/media/recent", HttpGet, true, "min_tag_id,max_tag_id",
+      &InstagramConnection::parseRetrievedMedias, "getTagMediaRecentCompleted" },
+    { INSTAGRAM_TAGS_SEARCH_URL, HttpGet, true, "q",
+      &InstagramConnection::parseTags, "getTagsSearchCompleted" },
+
+    // Locations
+    { INSTAGRAM_LOCATIONS_URL "%1", HttpGet, true, "",
+      &InstagramConnection::parseLocation, "getLocationCompleted" },
+    { INSTAGRAM_LOCATIONS_URL "%1/media/recent", HttpGet, true, "",
+      &InstagramConnection::parseRetrievedMedias, "getLocationMediaRecentCompleted" },
+    { INSTAGRAM_LOCATIONS_SEARCH_URL, HttpGet, true, "lat,lng,foursquare_v2_id,distance",
+      &InstagramConnection::parseLocations, "getLocationSearchCompleted" }
+};
+
 /*!
     \class InstagramConnection
 
@@ -73,18 +149,173 @@
     {Twitter authentication documentation} for further details.
  */
 
+/*!
+    \property InstagramConnection::minPollInterval
+
+    This property holds the shortest time in milliseconds between two polls
+    of a feed that keeps receiving new media. The default value is 15000.
+ */
+
+/*!
+    \property InstagramConnection::maxPollInterval
+
+    This property holds the longest time in milliseconds between two polls
+    of a quiet feed. The default value is 600000.
+ */
+
+/*!
+    \enum InstagramConnection::Feed
+
+    This enum specifies a feed polled with startPolling().
+
+    \value UserSelfFeed
+           The feed of the user.
+    \value UserMediaRecent
+           The recent media of the user given as the argument.
+    \value TagMediaRecent
+           The recent media tagged with the tag given as the argument.
+ */
+
 InstagramConnection::InstagramConnection(QObject *parent) :
     SocialConnection(parent),
     m_instagramRequest(new InstagramRequest(this)),
-    m_ongoingRequest(0),
+    m_parseQueue(new ParseQueue(this)),
+    m_feedParseQueue(new ParseQueue(this)),
+    m_pollTimer(new QTimer(this)),
+    m_feedGeneration(0),
+    m_minPollInterval(MIN_POLL_INTERVAL),
+    m_maxPollInterval(MAX_POLL_INTERVAL),
+    m_userProjection(JsonProjection::StringValues),
+    m_usersProjection(JsonProjection::StringValues),
+    m_relationshipProjection(JsonProjection::StringValues),
+    m_mediaProjection(JsonProjection::StringValues),
+    m_commentProjection(JsonProjection::StringValues),
+    m_likeProjection(JsonProjection::StringValues),
+    m_likesProjection(JsonProjection::StringValues),
+    m_tagProjection(JsonProjection::StringValues),
+    m_locationProjection(JsonProjection::StringValues),
+    m_authorizationProjection(JsonProjection::StringValues),
+    m_errorProjection(JsonProjection::StringValues),
+    m_paginationProjection(JsonProjection::StringValues),
     m_state(NotLogged)
 {
+    m_pollTimer->setSingleShot(true);
+    connect(m_pollTimer, SIGNAL(timeout()), this, SLOT(pollFeeds()));
+    connect(m_parseQueue, SIGNAL(finished(QVariant,QVariantList)),
+            this, SLOT(onReplyParsed(QVariant,QVariantList)));
+    connect(m_feedParseQueue, SIGNAL(finished(QVariant,QVariantList)),
+            this, SLOT(onFeedParsed(QVariant,QVariantList)));
+
+    initProjections();
 }
 
 InstagramConnection::~InstagramConnection()
 {
+    // Waits for the parsers still running on this object.
+    delete m_parseQueue;
+    delete m_feedParseQueue;
     delete m_instagramRequest;
-    delete m_ongoingRequest;
+}
+
+void InstagramConnection::initProjections()
+{
+    // Key paths read from user objects.
+    m_usersProjection.addField("username", "user_username");
+    m_usersProjection.addField("full_name", "user_full_name");
+    m_usersProjection.addField("profile_picture", "user_profile_picture");
+    m_usersProjection.addField("id", "user_id");
+    m_usersProjection.addField("bio", "user_bio");
+    m_usersProjection.addField("website", "user_website");
+
+    m_userProjection = m_usersProjection;
+    m_userProjection.addField("counts.media", "user_counts_media");
+    m_userProjection.addField("counts.follows", "user_counts_follows");
+    m_userProjection.addField("counts.followed_by", "user_counts_followed_by");
+
+    m_relationshipProjection.addField("outgoing_status", "outgoing_status");
+    m_relationshipProjection.addField("target_user_is_private", "target_user_is_private");
+    m_relationshipProjection.addField("incoming_status", "incoming_status");
+
+    // Key paths read from comment and like objects.
+    m_commentProjection.addField("created_time", "comment_created_time");
+    m_commentProjection.addField("text", "comment_text");
+    m_commentProjection.addField("id", "comment_id");
+    m_commentProjection.addField("from.username", "comment_from_username");
+    m_commentProjection.addField("from.profile_picture", "comment_from_profile_picture");
+    m_commentProjection.addField("from.id", "comment_from_id");
+    m_commentProjection.addField("from.full_name", "comment_from_full_name");
+
+    m_likeProjection.addField("username", "like_username");
+    m_likeProjection.addField("full_name", "like_full_name");
+    m_likeProjection.addField("id", "like_id");
+    m_likeProjection.addField("profile_picture", "like_profile_picture");
+
+    m_likesProjection = m_likeProjection;
+    m_likesProjection.addField("bio", "like_bio");
+    m_likesProjection.addField("website", "like_website");
+
+    // Key paths read from media objects.
+    m_mediaProjection.addField("images.low_resolution.url", "image_low_resolution");
+    m_mediaProjection.addField("images.low_resolution.width", "image_low_resolution_width");
+    m_mediaProjection.addField("images.low_resolution.height", "image_low_resolution_height");
+    m_mediaProjection.addField("images.standard_resolution.url", "image_standard_resolution");
+    m_mediaProjection.addField("images.standard_resolution.width", "image_standard_resolution_width");
+    m_mediaProjection.addField("images.standard_resolution.height", "image_standard_resolution_height");
+    m_mediaProjection.addField("images.thumbnail.url", "image_thumbnail");
+    m_mediaProjection.addField("images.thumbnail.width", "image_thumbnail_width");
+    m_mediaProjection.addField("images.thumbnail.height", "image_thumbnail_height");
+    m_mediaProjection.addField("location.id", "location_id");
+    m_mediaProjection.addField("location.latitude", "location_latitude");
+    m_mediaProjection.addField("location.longitude", "location_longitude");
+    m_mediaProjection.addField("location.name", "location_name");
+    m_mediaProjection.addField("user.username", "user_username");
+    m_mediaProjection.addField("user.full_name", "user_full_name");
+    m_mediaProjection.addField("user.profile_picture", "user_profile_picture");
+    m_mediaProjection.addField("user.id", "user_id");
+    m_mediaProjection.addField("id", "image_id");
+    m_mediaProjection.addField("type", "image_type");
+    m_mediaProjection.addField("filter", "image_filter");
+    m_mediaProjection.addField("link", "image_link");
+    m_mediaProjection.addField("created_time", "created_time");
+    m_mediaProjection.addField("caption.created_time", "caption_created_time");
+    m_mediaProjection.addField("caption.text", "caption_text");
+    m_mediaProjection.addField("caption.id", "caption_id");
+    m_mediaProjection.addField("caption.from.username", "caption_from_username");
+    m_mediaProjection.addField("caption.from.full_name", "caption_from_full_name");
+    m_mediaProjection.addField("caption.from.type", "caption_from_type");
+    m_mediaProjection.addField("caption.from.id", "caption_from_id");
+    m_mediaProjection.addField("comments.count", "comments_count");
+    m_mediaProjection.addList("comments.data", "comments", m_commentProjection);
+    m_mediaProjection.addField("likes.count", "likes_count");
+    m_mediaProjection.addList("likes.data", "likes", m_likeProjection);
+
+    // Key paths read from tag and location objects.
+    m_tagProjection.addField("media_count", "tag_media_count");
+    m_tagProjection.addField("name", "tag_name");
+
+    m_locationProjection.addField("id", "location_id");
+    m_locationProjection.addField("name", "location_name");
+    m_locationProjection.addField("latitude", "location_latitude");
+    m_locationProjection.addField("longitude", "location_longitude");
+
+    // Key paths read from the access token reply.
+    m_authorizationProjection.addField("access_token", "access_token");
+    m_authorizationProjection.addField("user.username", "user_username");
+    m_authorizationProjection.addField("user.bio", "user_bio");
+    m_authorizationProjection.addField("user.website", "user_website");
+    m_authorizationProjection.addField("user.profile_picture", "user_profile_picture");
+    m_authorizationProjection.addField("user.full_name", "user_full_name");
+    m_authorizationProjection.addField("user.id", "user_id");
+
+    // Key paths read from the meta object of an error reply.
+    m_errorProjection.addField("error_type", "error_type");
+    m_errorProjection.addField("code", "code");
+    m_errorProjection.addField("error_message", "error_message");
+
+    // Cursors of a paged reply. Tag feeds have cursors of their own.
+    m_paginationProjection.addField("next_max_id", "next_max_id");
+    m_paginationProjection.addField("next_max_tag_id", "next_max_tag_id");
+    m_paginationProjection.addField("min_tag_id", "min_tag_id");
 }
 
 QString InstagramConnection::consumerKey() const
@@ -156,6 +387,32 @@ void InstagramConnection::setRequestToken(const QString &token)
     }
 }
 
+int InstagramConnection::minPollInterval() const
+{
+    return m_minPollInterval;
+}
+
+void InstagramConnection::setMinPollInterval(int minPollInterval)
+{
+    if (m_minPollInterval != minPollInterval) {
+        m_minPollInterval = minPollInterval;
+        emit minPollIntervalChanged(m_minPollInterval);
+    }
+}
+
+int InstagramConnection::maxPollInterval() const
+{
+    return m_maxPollInterval;
+}
+
+void InstagramConnection::setMaxPollInterval(int maxPollInterval)
+{
+    if (m_maxPollInterval != maxPollInterval) {
+        m_maxPollInterval = maxPollInterval;
+        emit maxPollIntervalChanged(m_maxPollInterval);
+    }
+}
+
 InstagramConnection::State InstagramConnection::state() const
 {
     return m_state;
@@ -172,14 +429,12 @@ bool InstagramConnection::authenticate()
 {
     bool ret = false;
 
-    if (authenticated() || state() != NotLogged || busy()) {
+    if (authenticated() || state() != NotLogged) {
         ret = authenticated();
-        qWarning() << "State already logged / busy. Skipping. Authenticated:" << ret;
+        qWarning() << "State already logged / authenticating. Skipping. Authenticated:" << ret;
     }
     else  {
         setState(AcquiringRequestToken);
-        setBusy(true);
-        setTransmitting(true);
 
         QUrl url(OAUTH_AUTH_URL);
         url.addEncodedQueryItem(OAUTH_CLIENT_ID, consumerKey().toUtf8());
@@ -198,7 +453,7 @@ bool InstagramConnection::authenticate()
         qDebug() << "URL: " + url.toString();
 
         setState(Authorizing);
-        setTransmitting(false);     // Not anymore transmitting, but still "Busy"!
+        updateActivity();           // Not transmitting, but still "Busy"!
         setAuthenticated(false);    // TODO: Is this in the right place??
         WebInterface *webInterface = qobject_cast<WebInterface*>(SocialConnection::webInterface());
         webInterface->setActive(true);
@@ -213,6 +468,10 @@ bool InstagramConnection::authenticate()
 bool InstagramConnection::deauthenticate()
 {
     clearAllMembers();
+
+    // The feeds were polled on behalf of the user signing out.
+    m_feeds.clear();
+    m_pollTimer->stop();
     setState(NotLogged);
     setName("");
     setAuthenticated(false);
@@ -240,20 +499,49 @@ bool InstagramConnection::retrieveMessages(const QString &from, const QString &t
 
 void InstagramConnection::cancel()
 {
-    if (m_ongoingRequest != 0 && m_ongoingRequest->isRunning()) {
-        qWarning() << "Request ongoing, aborting!";
-        m_ongoingRequest->abort();
+    foreach (QNetworkReply *reply, m_replies.keys()) {
+        if (reply->isRunning()) {
+            qWarning() << "Request ongoing, aborting!";
+            reply->abort();
+        }
+    }
+
+    // The replies still being parsed are dropped, and their calls fail.
+    const QVariantList parsing = m_parseQueue->cancel();
+    const QVariantList feedParsing = m_feedParseQueue->cancel();
+
+    if (!parsing.isEmpty() || !feedParsing.isEmpty()) {
+        updateActivity();
+        setCompletionStatus(Canceled);
+    }
+
+    foreach (const QVariant &context, parsing) {
+        const QVariantList reply = context.toList();
+        const Endpoint &endpoint = Endpoints[reply.at(0).toInt()];
+
+        for (int i = reply.at(1).toInt(); i > 0; i--) {
+            QMetaObject::invokeMethod(this, endpoint.signal,
+                                      Q_ARG(bool, false), Q_ARG(QVariantList, QVariantList()));
+        }
+    }
+
+    foreach (const QVariant &context, feedParsing) {
+        const QVariantList reply = context.toList();
+        FeedReply feedReply;
+        feedReply.key = reply.at(0).toString();
+        feedReply.generation = reply.at(1).toInt();
+        feedReply.older = reply.at(2).toBool();
+        onFeedReply(feedReply, false, QVariantMap(), QVariantList());
     }
-    // Not busy or transmitting anymore
-    setTransmitting(false);
-    setBusy(false);
 
     // If we were in the middle of authentication process, reset the state
     if (state() != Logged && state() != NotLogged) {
         clearAllMembers();
         setState(NotLogged);
+        updateActivity();
         WebInterface *webInterface = qobject_cast<WebInterface*>(SocialConnection::webInterface());
         webInterface->setActive(false);
+        setCompletionStatus(Canceled);
         emit authenticateCompleted(false);
     }
 }
@@ -270,7 +558,7 @@ void InstagramConnection::onUrlChanged(const QUrl &url)
 {
     SocialConnection::onUrlChanged(url);
 
-    if (busy() && !url.isEmpty() && url.toString().startsWith(m_callbackUrl)) {
+    if (state() == Authorizing && !url.isEmpty() && url.toString().startsWith(m_callbackUrl)) {
         WebInterface *webInterface = qobject_cast<WebInterface*>(SocialConnection::webInterface());
         webInterface->setActive(false);
 
@@ -284,7 +572,6 @@ void InstagramConnection::onUrlChanged(const QUrl &url)
         else
         {
             setRequestToken(url.queryItemValue(OAUTH_CODE));
-            qDebug() << m_requestToken;
             acquireAccessToken();
         }
     }
@@ -302,9 +589,9 @@ void InstagramConnection::authenticationFailed(const QString &errorMsg, const in
     qWarning() << errorMsg << (errorCode ? QString::number(errorCode) : QString(""));
 
     clearAllMembers();
-    setTransmitting(false);
-    setBusy(false);
     setState(NotLogged);
+    updateActivity();
+    setCompletionStatus(Failed);
     emit authenticateCompleted(false);
 }
 
@@ -318,856 +605,652 @@ void InstagramConnection::setAuthorizationScope(const QString &scope)
     m_authScope = scope;
 }
 
-bool InstagramConnection::getUser(QString userId)
+bool InstagramConnection::startRequest(EndpointId id,
+                                       const QStringList &arguments,
+                                       const QStringList &values)
 {
-    bool ret = false;
+    return sendRequest(id, arguments, values, true) != 0;
+}
+
+QNetworkReply *InstagramConnection::sendRequest(EndpointId id,
+                                                const QStringList &arguments,
+                                                const QStringList &values,
+                                                bool coalesce)
+{
+    const Endpoint &endpoint = Endpoints[id];
+
+    if (endpoint.authorized && (!authenticated() || state() != Logged)) {
+        qWarning() << "Cannot send request while not authenticated/logged";
+        return 0;
+    }
+
+    QString urlString(endpoint.url);
+
+    if (arguments.count() == 1) {
+        urlString = urlString.arg(arguments.at(0));
+    }
+    else if (arguments.count() == 2) {
+        urlString = urlString.arg(arguments.at(0), arguments.at(1));
+    }
+
+    // Empty parameter values are left out of the request.
+    QUrl params;
+    const QStringList names = QString(endpoint.parameters).split(',', QString::SkipEmptyParts);
+
+    if (endpoint.authorized) {
+        params.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
+    }
+
+    for (int i = 0; i < names.count() && i < values.count(); i++) {
+        if (!values.at(i).isEmpty()) {
+            params.addQueryItem(names.at(i), values.at(i));
+        }
+    }
+
+    QUrl url(urlString);
+    NetworkTransport *transport = NetworkTransport::instance();
+    QNetworkReply *reply = 0;
+    QString inflightKey;
 
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
+    if (endpoint.method == HttpPost) {
+        QNetworkRequest req(url);
+        req.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+        applyRequestTimeout(req);
+        reply = transport->post(req, params.encodedQuery());
     }
     else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
+        url.setQueryItems(params.queryItems());
 
-        QUrl url(INSTAGRAM_USERS_URL + userId);
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
+        // A GET identical to one in flight waits for the same reply, unless
+        // it is made with another cache policy or timeout.
+        inflightKey = QString("%1 %2 %3").arg(cachePolicy()).arg(callTimeout())
+                .arg(url.toString());
 
-        qDebug() << url.toString();
+        if (endpoint.method == HttpGet && coalesce && m_inflightGets.contains(inflightKey)) {
+            QNetworkReply *inflight = m_inflightGets.value(inflightKey);
+            m_coalescedCallers[inflight]++;
+            return inflight;
+        }
 
         QNetworkRequest req(url);
+        req.setAttribute(QNetworkRequest::CacheLoadControlAttribute, cachePolicy());
+        applyRequestTimeout(req);
+        reply = endpoint.method == HttpGet ? transport->get(req)
+                                           : transport->deleteResource(req);
+    }
 
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onGetUserReply()));
+    // The query carries the access token, so only the path is logged.
+    qDebug() << "InstagramConnection: request" << url.path();
+
+    if (endpoint.method == HttpGet && coalesce) {
+        m_inflightGets.insert(inflightKey, reply);
     }
 
-    return ret;
-}
+    m_replies.insert(reply, id);
+    connect(reply, SIGNAL(finished()), this, SLOT(onReplyFinished()));
 
-void InstagramConnection::onGetUserReply()
-{
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
+    // The progress is reported as the operation named after its signal.
+    QString operation(endpoint.signal);
+    operation.chop(qstrlen("Completed"));
+    trackProgress(reply, operation);
 
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
+    updateActivity();
 
-        setBusy(false);
-        emit retrieveUserCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedUser(data));
-    }
-    else
-        emitError();
+    return reply;
 }
 
-QVariantList InstagramConnection::parseRetrievedUser(const QByteArray &result)
+void InstagramConnection::onReplyFinished()
 {
-    QVariantList list;
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("[" + QString(result) + "]");
-    QScriptValueIterator it(scValue);
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (!reply || !m_replies.contains(reply)) {
+        return;
+    }
 
-    while (it.hasNext()) {
-        it.next();
+    const EndpointId id = m_replies.take(reply);
+    const Endpoint &endpoint = Endpoints[id];
+    const int callers = 1 + m_coalescedCallers.take(reply);
+    const bool polled = m_feedReplies.contains(reply);
+    const FeedReply feedReply = m_feedReplies.take(reply);
+    const int requestError = reply->error();
+    const CompletionStatus status = replyStatus(reply);
+    const QString errorString = reply->errorString();
+    const QByteArray data = reply->readAll();
 
-        QVariantMap message;
+    const QString inflightKey = m_inflightGets.key(reply);
 
-        qDebug() << it.value().property("data").property("username").toString();
+    if (!inflightKey.isEmpty()) {
+        m_inflightGets.remove(inflightKey);
+    }
 
-        message.insert("user_username", it.value().property("data").property("username").toString());
-        message.insert("user_id", it.value().property("data").property("id").toString());
-        message.insert("user_full_name", it.value().property("data").property("full_name").toString());
-        message.insert("user_profile_picture", it.value().property("data").property("profile_picture").toString());
-        message.insert("user_bio", it.value().property("data").property("bio").toString());
-        message.insert("user_website", it.value().property("data").property("website").toString());
-        message.insert("user_counts_media", it.value().property("data").property("counts").property("media").toString());
-        message.insert("user_counts_follows", it.value().property("data").property("counts").property("follows").toString());
-        message.insert("user_counts_followed_by", it.value().property("data").property("counts").property("followed_by").toString());
+    deleteReply(reply);
 
-        list.append(message);
+    // The reply is parsed once and the result given to every caller in
+    // onReplyParsed(). The access token is parsed here, since completing
+    // the authentication changes the state of the connection.
+    if (!polled && requestError == QNetworkReply::NoError && id != AccessTokenEndpoint) {
+        m_parseQueue->enqueue(QtConcurrent::run(this, endpoint.parser, data),
+                              QVariantList() << id << callers);
+        updateActivity();
+        return;
     }
 
-    return list;
-}
+    // The pages of a polled feed are parsed on a worker thread too, and
+    // handled in onFeedParsed().
+    if (polled && requestError == QNetworkReply::NoError) {
+        m_feedParseQueue->enqueue(QtConcurrent::run(this, &InstagramConnection::parseFeedPage,
+                                                    data),
+                                  QVariantList() << feedReply.key << feedReply.generation
+                                                 << feedReply.older);
+        updateActivity();
+        return;
+    }
 
-bool InstagramConnection::getUserSelfFeed(const QString &count, const QString &min_id, const QString &max_id)
-{
-    bool ret = false;
+    updateActivity();
+    setCompletionStatus(status);
+
+    if (polled) {
+        onFeedReply(feedReply, false, QVariantMap(), QVariantList());
+    }
+    else if (requestError == QNetworkReply::NoError) {
+        const QVariantList messages = (this->*endpoint.parser)(data);
 
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
+        for (int i = 0; i < callers; i++) {
+            QMetaObject::invokeMethod(this, endpoint.signal,
+                                      Q_ARG(bool, true), Q_ARG(QVariantList, messages));
+        }
+    }
+    else if (status == TimedOut) {
+        // A stalled request has no error response to parse.
+        emit error("TimeoutException", QString::number(requestError), errorString);
     }
     else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
+        emitError(data);
+    }
+}
 
-        QUrl url(INSTAGRAM_USERS_SELF_FEED_URL);
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
+void InstagramConnection::onReplyParsed(const QVariant &context, const QVariantList &messages)
+{
+    const QVariantList reply = context.toList();
+    const Endpoint &endpoint = Endpoints[reply.at(0).toInt()];
 
-        if(!count.isEmpty())
-            url.addQueryItem("count", count);
-        if(!min_id.isEmpty())
-            url.addQueryItem("min_id", min_id);
-        if(!max_id.isEmpty())
-            url.addQueryItem("max_id", max_id);
+    updateActivity();
+    setCompletionStatus(Succeeded);
 
-        qDebug() << url.toString();
+    for (int i = reply.at(1).toInt(); i > 0; i--) {
+        QMetaObject::invokeMethod(this, endpoint.signal,
+                                  Q_ARG(bool, true), Q_ARG(QVariantList, messages));
+    }
+}
 
-        QNetworkRequest req(url);
+void InstagramConnection::onFeedParsed(const QVariant &context, const QVariantList &page)
+{
+    const QVariantList reply = context.toList();
+    FeedReply feedReply;
+    feedReply.key = reply.at(0).toString();
+    feedReply.generation = reply.at(1).toInt();
+    feedReply.older = reply.at(2).toBool();
 
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onGetUserSelfFeedReply()));
-    }
+    updateActivity();
+    setCompletionStatus(Succeeded);
 
-    return ret;
+    onFeedReply(feedReply, true, page.at(0).toMap(), page.at(1).toList());
 }
 
-void InstagramConnection::onGetUserSelfFeedReply()
+void InstagramConnection::updateActivity()
 {
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
+    const bool authenticating = state() != Logged && state() != NotLogged;
+    setBusy(authenticating || !m_replies.isEmpty() || m_parseQueue->isActive() ||
+            m_feedParseQueue->isActive());
+    setTransmitting(!m_replies.isEmpty());
+}
 
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
+bool InstagramConnection::getUser(QString userId)
+{
+    return startRequest(UserEndpoint, QStringList() << userId);
+}
 
-        setBusy(false);
-        emit retrieveUserSelfFeedCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedMedias(data));
-    }
-    else
-        emitError();
+bool InstagramConnection::getUserSelfFeed(const QString &count, const QString &min_id, const QString &max_id)
+{
+    return startRequest(UserSelfFeedEndpoint, QStringList(),
+                        QStringList() << count << min_id << max_id);
 }
 
 bool InstagramConnection::getUserMediaRecent(const QString &user, const QString &count,
                                              const QString &min_id, const QString &max_id,
                                              const QString &min_timestamp, const QString &max_timestamp)
 {
-    bool ret = false;
+    return startRequest(UserMediaRecentEndpoint, QStringList() << user,
+                        QStringList() << count << min_id << max_id
+                                      << min_timestamp << max_timestamp);
+}
 
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
+bool InstagramConnection::getUserSelfMediaLiked(const QString &count, const QString &max_like_id)
+{
+    return startRequest(UserSelfMediaLikedEndpoint, QStringList(),
+                        QStringList() << count << max_like_id);
+}
 
-        QUrl url(INSTAGRAM_USERS_URL + user + "/media/recent/");
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
+bool InstagramConnection::getUserSearch(const QString &key, const QString &count)
+{
+    return startRequest(UserSearchEndpoint, QStringList(), QStringList() << key << count);
+}
 
-        if(!count.isEmpty())
-            url.addQueryItem("count", count);
-        if(!min_id.isEmpty())
-            url.addQueryItem("min_id", min_id);
-        if(!max_id.isEmpty())
-            url.addQueryItem("max_id", max_id);
-        if(!min_timestamp.isEmpty())
-            url.addQueryItem("min_timestamp", min_timestamp);
-        if(!max_timestamp.isEmpty())
-            url.addQueryItem("max_timestamp", max_timestamp);
+bool InstagramConnection::getUserFollows(const QString &user)
+{
+    return startRequest(UserFollowsEndpoint, QStringList() << user);
+}
 
-        qDebug() << url.toString();
+bool InstagramConnection::getUserFollowedBy(const QString &user)
+{
+    return startRequest(UserFollowedByEndpoint, QStringList() << user);
+}
 
-        QNetworkRequest req(url);
+bool InstagramConnection::getUserSelfRequestedBy()
+{
+    return startRequest(UserSelfRequestedByEndpoint);
+}
 
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onGetUserMediaRecentReply()));
-    }
+bool InstagramConnection::getUserRelationship(const QString &user)
+{
+    return startRequest(UserRelationshipEndpoint, QStringList() << user);
+}
 
-    return ret;
+bool InstagramConnection::setUserRelationship(const QString &user, const QString &action)
+{
+    qDebug() << "ACTION: " + action;
+
+    return startRequest(SetUserRelationshipEndpoint, QStringList() << user,
+                        QStringList() << action);
 }
 
-void InstagramConnection::onGetUserMediaRecentReply()
+bool InstagramConnection::getMedia(const QString &media)
 {
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
+    return startRequest(MediaEndpoint, QStringList() << media);
+}
 
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
+bool InstagramConnection::getMediaSearch(const QString &lat, const QString &lng,
+                                         const QString &min_timestamp, const QString &max_timestamp, const QString &distance)
+{
+    return startRequest(MediaSearchEndpoint, QStringList(),
+                        QStringList() << lat << lng << min_timestamp
+                                      << max_timestamp << distance);
+}
 
-        setBusy(false);
-        emit retrieveUserMediaRecentCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedMedias(data));
-    }
-    else
-        emitError();
+bool InstagramConnection::getMediaPopular()
+{
+    return startRequest(MediaPopularEndpoint);
 }
 
-bool InstagramConnection::getUserSelfMediaLiked(const QString &count, const QString &max_like_id)
+bool InstagramConnection::getComments(const QString &media)
 {
-    bool ret = false;
+    return startRequest(CommentsEndpoint, QStringList() << media);
+}
 
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
+bool InstagramConnection::postComment(const QString &media, const QString &text)
+{
+    return startRequest(PostCommentEndpoint, QStringList() << media, QStringList() << text);
+}
 
-        QUrl url(INSTAGRAM_USERS_SELF_MEDIA_LIKED_URL);
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
+bool InstagramConnection::deleteComment(const QString &media, const QString &comment)
+{
+    return startRequest(DeleteCommentEndpoint, QStringList() << media << comment);
+}
 
-        if(!count.isEmpty())
-            url.addQueryItem("count", count);
-        if(!max_like_id.isEmpty())
-            url.addQueryItem("max_like_id", max_like_id);
+bool InstagramConnection::getLikes(const QString &media)
+{
+    return startRequest(LikesEndpoint, QStringList() << media);
+}
 
-        qDebug() << url.toString();
+bool InstagramConnection::postLike(const QString &media)
+{
+    return startRequest(PostLikeEndpoint, QStringList() << media);
+}
 
-        QNetworkRequest req(url);
+bool InstagramConnection::deleteLike(const QString &media)
+{
+    return startRequest(DeleteLikeEndpoint, QStringList() << media);
+}
 
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onGetUserSelfMediaLikedReply()));
-    }
+bool InstagramConnection::getTag(const QString &tag)
+{
+    return startRequest(TagEndpoint, QStringList() << tag);
+}
 
-    return ret;
+bool InstagramConnection::getTagMediaRecent(const QString &tag, const QString &min_id, const QString &max_id)
+{
+    return startRequest(TagMediaRecentEndpoint, QStringList() << tag,
+                        QStringList() << min_id << max_id);
 }
 
-void InstagramConnection::onGetUserSelfMediaLikedReply()
+bool InstagramConnection::getTagsSearch(const QString &tag)
 {
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
+    return startRequest(TagsSearchEndpoint, QStringList(), QStringList() << tag);
+}
 
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
+bool InstagramConnection::getLocation(const QString &location)
+{
+    return startRequest(LocationEndpoint, QStringList() << location);
+}
 
-        setBusy(false);
-        emit retrieveUserSelfMediaLikedCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedMedias(data));
-    }
-    else
-        emitError();
+bool InstagramConnection::getLocationMediaRecent(const QString &location)
+{
+    return startRequest(LocationMediaRecentEndpoint, QStringList() << location);
 }
 
-bool InstagramConnection::getUserSearch(const QString &key, const QString &count)
+bool InstagramConnection::getLocationSearch(const QString &lat, const QString &lng, const QString &foursquare_v2_id, const QString &distance)
 {
-    bool ret = false;
+    return startRequest(LocationSearchEndpoint, QStringList(),
+                        QStringList() << lat << lng << foursquare_v2_id << distance);
+}
 
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
+/*!
+    Starts polling \a feed for new media. \a argument is the user id of
+    UserMediaRecent and the tag name of TagMediaRecent.
+
+    The first poll retrieves the latest page of the feed; later polls ask
+    only for the media newer than the newest one seen so far, following the
+    pages down to it when there is more new media than fits a page. The
+    media not delivered before is reported with pollCompleted(); a poll
+    without new media is not reported. The feed is polled again after an
+    interval between minPollInterval and maxPollInterval, which is halved
+    whenever new media arrives and doubled whenever it does not.
 
-        QUrl url(INSTAGRAM_USERS_SEARCH_URL);
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
+    Returns true if the feed is being polled; otherwise returns false.
+*/
+bool InstagramConnection::startPolling(int feed, const QString &argument)
+{
+    if (feed < UserSelfFeed || feed > TagMediaRecent) {
+        qWarning() << "Unknown feed" << feed;
+        return false;
+    }
 
-        if(!key.isEmpty())
-            url.addQueryItem("q", key);
-        if(!count.isEmpty())
-            url.addQueryItem("count", count);
+    const QString key = feedKey(feed, argument);
 
-        qDebug() << url.toString();
+    if (m_feeds.contains(key)) {
+        return true;
+    }
 
-        QNetworkRequest req(url);
+    PolledFeed polled;
+    polled.feed = Feed(feed);
+    polled.argument = argument;
+    polled.generation = ++m_feedGeneration;
+    polled.interval = qBound(m_minPollInterval, POLL_INTERVAL, m_maxPollInterval);
+    m_feeds.insert(key, polled);
 
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onGetUserSearchReply()));
+    if (!requestFeed(key, false)) {
+        m_feeds.remove(key);
+        return false;
     }
 
-    return ret;
+    return true;
 }
 
-void InstagramConnection::onGetUserSearchReply()
+/*!
+    Stops polling \a feed. A poll in flight is not reported.
+*/
+void InstagramConnection::stopPolling(int feed, const QString &argument)
 {
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit retrieveUserSearchCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedUsers(data));
-    }
-    else
-        emitError();
+    m_feeds.remove(feedKey(feed, argument));
+    schedulePolling();
 }
 
-bool InstagramConnection::getUserFollows(const QString &user)
+/*!
+    Retrieves the page of \a feed older than the pages retrieved so far,
+    following the pagination.next_max_id cursor Instagram returned. The feed
+    must be polled with startPolling(). The media is reported with
+    getOlderMediaCompleted().
+
+    Returns true if the request was successfully sent; otherwise, for
+    example if there are no older pages, returns false.
+*/
+bool InstagramConnection::getOlderMedia(int feed, const QString &argument)
 {
-    bool ret = false;
+    const QString key = feedKey(feed, argument);
+    const PolledFeed polled = m_feeds.value(key);
 
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
+    if (!m_feeds.contains(key) || polled.nextMaxId.isEmpty() || polled.loadingOlder) {
+        return false;
     }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
 
-        QUrl url(INSTAGRAM_USERS_URL + user + "/follows");
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
+    return requestFeed(key, true);
+}
 
-        qDebug() << url.toString();
+void InstagramConnection::pollFeeds()
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
 
-        QNetworkRequest req(url);
+    foreach (const QString &key, m_feeds.keys()) {
+        PolledFeed &polled = m_feeds[key];
 
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onGetUserFollowsReply()));
+        if (!polled.polling && polled.nextPoll <= now && !requestFeed(key, false)) {
+            polled.nextPoll = now + polled.interval;
+        }
     }
 
-    return ret;
+    schedulePolling();
 }
 
-void InstagramConnection::onGetUserFollowsReply()
+void InstagramConnection::schedulePolling()
 {
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
+    qint64 next = 0;
 
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
+    foreach (const PolledFeed &polled, m_feeds) {
+        if (!polled.polling && (next == 0 || polled.nextPoll < next)) {
+            next = polled.nextPoll;
+        }
+    }
 
-        setBusy(false);
-        emit retrieveUserFollowsCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedUsers(data));
+    if (next == 0) {
+        m_pollTimer->stop();
+    }
+    else {
+        m_pollTimer->start(qMax(qint64(0), next - QDateTime::currentMSecsSinceEpoch()));
     }
-    else
-        emitError();
 }
 
-QVariantList InstagramConnection::parseRetrievedUsers(const QByteArray &result)
+QString InstagramConnection::feedKey(int feed, const QString &argument)
 {
-    QVariantList list;
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("[" + QString(result) + "]");
+    return QString("%1/%2").arg(feed).arg(argument);
+}
 
-    QScriptValueIterator it(scValue);
-    it.next();
+bool InstagramConnection::requestFeed(const QString &key, bool older)
+{
+    PolledFeed &polled = m_feeds[key];
+    const QString minId = older ? QString() : polled.minId;
+    const QString maxId = older ? polled.nextMaxId : polled.pollMaxId;
+    QNetworkReply *reply = 0;
 
-    QVariantList datalist = it.value().property("data").toVariant().toList();
-    int lenght = datalist.length();
+    switch (polled.feed) {
+    case UserSelfFeed:
+        reply = sendRequest(UserSelfFeedEndpoint, QStringList(),
+                            QStringList() << "" << minId << maxId, false);
+        break;
+    case UserMediaRecent:
+        reply = sendRequest(UserMediaRecentEndpoint, QStringList() << polled.argument,
+                            QStringList() << "" << minId << maxId, false);
+        break;
+    case TagMediaRecent:
+        reply = sendRequest(TagMediaRecentEndpoint, QStringList() << polled.argument,
+                            QStringList() << minId << maxId, false);
+        break;
+    }
 
-    for(int index = 0; index < lenght; index++) {
-        QVariantMap message;
+    if (!reply) {
+        return false;
+    }
 
-        message.insert("user_username", it.value().property("data").property(index).property("username").toString());
-        message.insert("user_full_name", it.value().property("data").property(index).property("full_name").toString());
-        message.insert("user_profile_picture", it.value().property("data").property(index).property("profile_picture").toString());
-        message.insert("user_id", it.value().property("data").property(index).property("id").toString());
-        message.insert("user_bio", it.value().property("data").property(index).property("bio").toString());
-        message.insert("user_website", it.value().property("data").property(index).property("website").toString());
+    FeedReply feedReply;
+    feedReply.key = key;
+    feedReply.generation = polled.generation;
+    feedReply.older = older;
+    m_feedReplies.insert(reply, feedReply);
 
-        list.append(message);
+    if (older) {
+        polled.loadingOlder = true;
+    }
+    else {
+        polled.polling = true;
     }
 
-    return list;
+    return true;
 }
 
-bool InstagramConnection::getUserFollowedBy(const QString &user)
+void InstagramConnection::onFeedReply(const FeedReply &feedReply, bool success,
+                                      const QVariantMap &pagination,
+                                      const QVariantList &medias)
 {
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
+    // The feed may have been stopped, or stopped and started again, while
+    // the reply was in flight.
+    if (!m_feeds.contains(feedReply.key) ||
+        m_feeds.value(feedReply.key).generation != feedReply.generation) {
+        return;
     }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
 
-        QUrl url(INSTAGRAM_USERS_URL + user + "/followed-by");
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
+    PolledFeed &polled = m_feeds[feedReply.key];
+    const int feed = polled.feed;
+    const QString argument = polled.argument;
 
-        qDebug() << url.toString();
+    // Tag feeds page by tag ids of their own, the other feeds by media ids.
+    QString nextMaxId = pagination.value("next_max_tag_id").toString();
 
-        QNetworkRequest req(url);
+    if (nextMaxId.isEmpty()) {
+        nextMaxId = pagination.value("next_max_id").toString();
+    }
+
+    if (feedReply.older) {
+        polled.loadingOlder = false;
+
+        if (!success) {
+            emit getOlderMediaCompleted(false, feed, argument, QVariantList(), true);
+            return;
+        }
 
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onGetUserFollowedByReply()));
+        polled.nextMaxId = nextMaxId;
+        emit getOlderMediaCompleted(true, feed, argument, medias, !nextMaxId.isEmpty());
+        return;
     }
 
-    return ret;
-}
+    const bool first = polled.minId.isEmpty();
+    const bool firstPage = polled.pollMaxId.isEmpty();
+    bool caughtUp = true;
 
-void InstagramConnection::onGetUserFollowedByReply()
-{
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
+    if (success) {
+        QSet<QString> ids;
+        bool reachedCursor = false;
 
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
+        // The media at the cursor may be returned again. A page holding
+        // media seen before has reached the cursor.
+        foreach (const QVariant &media, medias) {
+            const QString id = media.toMap().value("image_id").toString();
+            ids.insert(id);
 
-        setBusy(false);
-        emit retrieveUserFollowedByCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedUsers(data));
-    }
-    else
-        emitError();
-}
+            if (polled.latestIds.contains(id)) {
+                reachedCursor = true;
+            }
+            else {
+                polled.pollMedia.append(media);
+            }
+        }
 
-bool InstagramConnection::getUserSelfRequestedBy()
-{
-    bool ret = false;
+        // The cursor moves to the newest page once the poll has caught up.
+        if (firstPage && !medias.isEmpty()) {
+            const QString minTagId = pagination.value("min_tag_id").toString();
+            polled.pollMinId = minTagId.isEmpty()
+                    ? medias.first().toMap().value("image_id").toString() : minTagId;
+            polled.pollIds = ids;
+        }
 
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
+        if (first) {
+            polled.nextMaxId = nextMaxId;
+        }
+        else if (!nextMaxId.isEmpty() && !medias.isEmpty() && !reachedCursor) {
+            // More new media than fits a page: the next page is older, but
+            // may still be newer than minId.
+            caughtUp = false;
+            polled.pollMaxId = nextMaxId;
+        }
     }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
 
-        QUrl url(INSTAGRAM_USERS_REQUESTEDBY_URL);
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
+    if (!caughtUp) {
+        // The pages are reported together once the poll has caught up.
+        if (requestFeed(feedReply.key, false)) {
+            return;
+        }
 
-        qDebug() << url.toString();
+        success = false;
+    }
 
-        QNetworkRequest req(url);
+    const QVariantList messages = success ? polled.pollMedia : QVariantList();
 
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onGetUserSelfRequestedByReply()));
+    // A failed poll leaves the cursor, so the next one retrieves the same
+    // media again.
+    if (success && !messages.isEmpty()) {
+        polled.minId = polled.pollMinId;
+        polled.latestIds = polled.pollIds;
     }
 
-    return ret;
-}
+    polled.pollMaxId.clear();
+    polled.pollMinId.clear();
+    polled.pollIds.clear();
+    polled.pollMedia.clear();
+    polled.polling = false;
 
-void InstagramConnection::onGetUserSelfRequestedByReply()
-{
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
+    // A busy feed is polled more often, a quiet or failing one less often.
+    if (!success || messages.isEmpty()) {
+        polled.interval = qMin(m_maxPollInterval, polled.interval * 2);
+    }
+    else if (!first) {
+        polled.interval = qMax(m_minPollInterval, polled.interval / 2);
+    }
 
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
+    polled.nextPoll = QDateTime::currentMSecsSinceEpoch() + polled.interval;
+    schedulePolling();
 
-        setBusy(false);
-        emit retrieveUserSelfRequestedByCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedUsers(data));
+    if (!success || !messages.isEmpty()) {
+        emit pollCompleted(success, feed, argument, messages);
     }
-    else
-        emitError();
 }
 
-bool InstagramConnection::getUserRelationship(const QString &user)
+QVariantList InstagramConnection::parseRetrievedUser(const QByteArray &result)
 {
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_USERS_URL + user + "/relationship");
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onGetUserRelationshipReply()));
-    }
+    QVariantList list;
+    list.append(m_userProjection.projectObject(result, "data"));
 
-    return ret;
+    return list;
 }
 
-void InstagramConnection::onGetUserRelationshipReply()
+QVariantList InstagramConnection::parseRetrievedUsers(const QByteArray &result)
 {
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit retrieveUserRelationshipCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedUserRelationship(data));
-    }
-    else
-        emitError();
+    return m_usersProjection.projectList(result, "data");
 }
 
 QVariantList InstagramConnection::parseRetrievedUserRelationship(const QByteArray &result)
 {
     QVariantList list;
-
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("[" + QString(result) + "]");
-
-    QScriptValueIterator it(scValue);
-    it.next();
-
-    QVariantMap message;
-
-    message.insert("outgoing_status", it.value().property("data").property("outgoing_status").toString());
-    message.insert("target_user_is_private", it.value().property("data").property("target_user_is_private").toString());
-    message.insert("incoming_status", it.value().property("data").property("incoming_status").toString());
-
-    list.append(message);
+    list.append(m_relationshipProjection.projectObject(result, "data"));
 
     return list;
 }
 
-bool InstagramConnection::setUserRelationship(const QString &user, const QString &action)
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_USERS_URL + user + "/relationship");
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-        req.setHeader(QNetworkRequest::ContentTypeHeader,"application/x-www-form-urlencoded");
-
-        QUrl params;
-        params.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-        params.addQueryItem("action", action);
-        qDebug() << "ACTION: " + action;
-
-        QByteArray data;
-        data = params.encodedQuery();
-
-        m_ongoingRequest = m_networkManager.post(req, data);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onSetUserRelationshipReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onSetUserRelationshipReply()
-{
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit setUserRelationshipCompleted(requestError == QNetworkReply::NoError,
-                                       parseSetUserRelationship(data));
-    }
-    else
-        emitError();
-}
-
 QVariantList InstagramConnection::parseSetUserRelationship(const QByteArray &result)
 {
-    QVariantList list;
-
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("[" + QString(result) + "]");
-
-    QScriptValueIterator it(scValue);
-    it.next();
-
     QVariantMap message;
+    message.insert("outgoing_status",
+                   m_relationshipProjection.projectObject(result, "data").value("outgoing_status"));
 
-    message.insert("outgoing_status", it.value().property("data").property("outgoing_status").toString());
-
+    QVariantList list;
     list.append(message);
 
     return list;
 }
 
-bool InstagramConnection::getMedia(const QString &media)
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_MEDIA_URL + media);
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onGetMediaReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onGetMediaReply()
-{
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit retrieveMediaCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedMedia(data));
-    }
-    else
-        emitError();
-}
-
-bool InstagramConnection::getMediaSearch(const QString &lat, const QString &lng,
-                                         const QString &min_timestamp, const QString &max_timestamp, const QString &distance)
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_MEDIA_SEARCH_URL);
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-
-        if(!lat.isEmpty())
-            url.addQueryItem("lat", lat);
-        if(!lng.isEmpty())
-            url.addQueryItem("lng", lng);
-        if(!min_timestamp.isEmpty())
-            url.addQueryItem("min_timestamp", min_timestamp);
-        if(!max_timestamp.isEmpty())
-            url.addQueryItem("max_timestamp", max_timestamp);
-        if(!distance.isEmpty())
-            url.addQueryItem("distance", distance);
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onGetMediaSearchReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onGetMediaSearchReply()
-{
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit retrieveMediaSearchCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedMedias(data));
-    }
-    else
-        emitError();
-}
-
-bool InstagramConnection::getMediaPopular()
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_MEDIA_POPULAR_URL);
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onGetMediaPopularReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onGetMediaPopularReply()
-{
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit retrieveMediaPopularCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedMedias(data));
-    }
-    else
-        emitError();
-}
-
-bool InstagramConnection::postComment(const QString &media, const QString &text)
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_MEDIA_URL + media + "/comments");
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-        req.setHeader(QNetworkRequest::ContentTypeHeader,"application/x-www-form-urlencoded");
-
-        QUrl params;
-        params.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-        params.addQueryItem("text", text);
-
-        QByteArray data;
-        data = params.encodedQuery();
-
-        m_ongoingRequest = m_networkManager.post(req, data);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onPostCommentReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onPostCommentReply()
-{
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit postCommentCompleted(requestError == QNetworkReply::NoError,
-                                       parsePostedComment(data));
-    }
-    else
-        emitError();
-}
-
 QVariantList InstagramConnection::parsePostedComment(const QByteArray &result)
 {
     QVariantList comments;
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("[" + QString(result) + "]");
-
-    QScriptValueIterator it(scValue);
-    it.next();
-
-    QVariantMap comment;
-    comment.insert("comment_created_time", it.value().property("data").property("created_time").toString());
-    comment.insert("comment_text", it.value().property("data").property("text").toString());
-    comment.insert("comment_id", it.value().property("data").property("id").toString());
-    comment.insert("comment_from_username", it.value().property("data").property("from").property("username").toString());
-    comment.insert("comment_from_profile_picture", it.value().property("data").property("from").property("profile_picture").toString());
-    comment.insert("comment_from_id", it.value().property("data").property("from").property("id").toString());
-    comment.insert("comment_from_full_name", it.value().property("data").property("from").property("full_name").toString());
-
-    comments.append(comment);
-    return comments;
-}
-
-bool InstagramConnection::deleteComment(const QString &media, const QString &comment)
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_MEDIA_URL + media + "/comments/" + comment);
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-
-        qDebug() << url.toString();
+    comments.append(m_commentProjection.projectObject(result, "data"));
 
-        QNetworkRequest req(url);
-
-        m_ongoingRequest = m_networkManager.deleteResource(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onDeleteCommentReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onDeleteCommentReply()
-{
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit deleteCommentCompleted(requestError == QNetworkReply::NoError,
-                                       parseDeletedComment(data));
-    }
-    else
-        emitError();
+    return comments;
 }
 
 QVariantList InstagramConnection::parseDeletedComment(const QByteArray &result)
@@ -1176,135 +1259,9 @@ QVariantList InstagramConnection::parseDeletedComment(const QByteArray &result)
     return comments;
 }
 
-bool InstagramConnection::getLikes(const QString &media)
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_MEDIA_URL + media + "/likes");
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onGetLikesReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onGetLikesReply()
-{
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit retrieveLikesCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedLikes(data));
-    }
-    else
-        emitError();
-}
-
 QVariantList InstagramConnection::parseRetrievedLikes(const QByteArray &result)
 {
-    QVariantList likes;
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("[" + QString(result) + "]");
-
-    QScriptValueIterator it(scValue);
-    it.next();
-
-    QVariantList likeslist = it.value().property("data").toVariant().toList();
-    int likeslistLenght = likeslist.length();
-
-    if(likeslistLenght > 0) {
-        for(int like_index = 0; like_index < likeslistLenght; like_index++) {
-            QVariantMap like;
-            like.insert("like_username", it.value().property("data").property(like_index)
-                           .property("username").toString());
-            like.insert("like_bio", it.value().property("data").property(like_index)
-                           .property("bio").toString());
-            like.insert("like_website", it.value().property("data").property(like_index)
-                           .property("website").toString());
-            like.insert("like_profile_picture", it.value().property("data").property(like_index)
-                           .property("profile_picture").toString());
-            like.insert("like_full_name", it.value().property("data").property(like_index)
-                           .property("full_name").toString());
-            like.insert("like_id", it.value().property("data").property(like_index)
-                           .property("id").toString());
-
-            likes.append(like);
-        }
-    }
-
-    return likes;
-}
-
-bool InstagramConnection::postLike(const QString &media)
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_MEDIA_URL + media + "/likes");
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-        req.setHeader(QNetworkRequest::ContentTypeHeader,"application/x-www-form-urlencoded");
-
-        QUrl params;
-        params.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-
-        QByteArray data;
-        data = params.encodedQuery();
-
-        m_ongoingRequest = m_networkManager.post(req, data);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onPostLikeReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onPostLikeReply()
-{
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit postLikeCompleted(requestError == QNetworkReply::NoError,
-                                       parsePostedLike(data));
-    }
-    else
-        emitError();
+    return m_likesProjection.projectList(result, "data");
 }
 
 QVariantList InstagramConnection::parsePostedLike(const QByteArray &result)
@@ -1313,767 +1270,71 @@ QVariantList InstagramConnection::parsePostedLike(const QByteArray &result)
     return like;
 }
 
-bool InstagramConnection::deleteLike(const QString &media)
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_MEDIA_URL + media + "/likes");
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-
-        m_ongoingRequest = m_networkManager.deleteResource(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onDeleteLikeReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onDeleteLikeReply()
-{
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit deleteLikeCompleted(requestError == QNetworkReply::NoError,
-                                       parseDeletedLike(data));
-    }
-    else
-        emitError();
-}
-
 QVariantList InstagramConnection::parseDeletedLike(const QByteArray &result)
 {
     QVariantList like;
     return like;
 }
 
-bool InstagramConnection::getComments(const QString &media)
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_MEDIA_URL + media + "/comments");
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onGetCommentsReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onGetCommentsReply()
-{
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit retrieveCommentsCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedComments(data));
-    }
-    else
-        emitError();
-}
-
 QVariantList InstagramConnection::parseRetrievedComments(const QByteArray &result)
 {
-    QVariantList comments;
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("[" + QString(result) + "]");
-
-    QScriptValueIterator it(scValue);
-    it.next();
-
-    QVariantList commentslist = it.value().property("data").toVariant().toList();
-    int commentslistLenght = commentslist.length();
-
-    if(commentslistLenght > 0) {
-        for(int comment_index = 0; comment_index < commentslistLenght; comment_index++) {
-            QVariantMap comment;
-            comment.insert("comment_created_time", it.value().property("data").property(comment_index)
-                           .property("created_time").toString());
-            comment.insert("comment_text", it.value().property("data").property(comment_index)
-                           .property("text").toString());
-            comment.insert("comment_id", it.value().property("data").property(comment_index)
-                           .property("id").toString());
-            comment.insert("comment_from_username", it.value().property("data").property(comment_index)
-                           .property("from").property("username").toString());
-            comment.insert("comment_from_profile_picture", it.value().property("data").property(comment_index)
-                           .property("from").property("profile_picture").toString());
-            comment.insert("comment_from_id", it.value().property("data").property(comment_index)
-                           .property("from").property("id").toString());
-            comment.insert("comment_from_full_name", it.value().property("data").property(comment_index)
-                           .property("from").property("full_name").toString());
-
-            comments.append(comment);
-        }
-    }
-
-    return comments;
-}
-
-bool InstagramConnection::getTag(const QString &tag)
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_TAGS_URL + tag);
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()), this, SLOT(onGetTagReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onGetTagReply()
-{
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit getTagCompleted(requestError == QNetworkReply::NoError,
-                                       parseTag(data));
-    }
-    else
-        emitError();
+    return m_commentProjection.projectList(result, "data");
 }
 
 QVariantList InstagramConnection::parseTag(const QByteArray &result)
 {
     QVariantList tags;
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("[" + QString(result) + "]");
-
-    QScriptValueIterator it(scValue);
-    it.next();
-
-    QVariantMap tag;
-    tag.insert("tag_media_count", it.value().property("data").property("media_count").toString());
-    tag.insert("tag_name", it.value().property("data").property("name").toString());
+    tags.append(m_tagProjection.projectObject(result, "data"));
 
-    tags.append(tag);
     return tags;
 }
 
-bool InstagramConnection::getTagMediaRecent(const QString &tag, const QString &min_id, const QString &max_id)
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_TAGS_URL + tag + "/media/recent");
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-
-        if(!min_id.isEmpty())
-            url.addQueryItem("min_id", min_id);
-
-        if(!max_id.isEmpty())
-            url.addQueryItem("max_id", max_id);
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()), this, SLOT(onGetTagMediaRecentReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onGetTagMediaRecentReply()
-{
-    const int requestError = m_ongoingRequest->error();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit getTagMediaRecentCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedMedias(data));
-    }
-    else
-        emitError();
-}
-
-bool InstagramConnection::getTagsSearch(const QString &tag)
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_TAGS_SEARCH_URL);
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-        url.addQueryItem("q", tag);
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()), this, SLOT(onGetTagsSearchReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onGetTagsSearchReply()
-{
-    const int requestError = m_ongoingRequest->error();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit getTagsSearchCompleted(requestError == QNetworkReply::NoError,
-                                       parseTags(data));
-    }
-    else
-        emitError();
-}
-
 QVariantList InstagramConnection::parseTags(const QByteArray &result)
 {
-    QVariantList tags;
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("[" + QString(result) + "]");
-
-    QScriptValueIterator it(scValue);
-    it.next();
-
-    QVariantList tagslist = it.value().property("data").toVariant().toList();
-    int tagslistLenght = tagslist.length();
-
-    if(tagslistLenght > 0) {
-        for(int tag_index = 0; tag_index < tagslistLenght; tag_index++) {
-            QVariantMap tag;
-            tag.insert("tag_media_count", it.value().property("data").property(tag_index)
-                           .property("media_count").toString());
-            tag.insert("tag_name", it.value().property("data").property(tag_index)
-                           .property("name").toString());
-            tags.append(tag);
-        }
-    }
-
-    return tags;
-}
-
-bool InstagramConnection::getLocation(const QString &location)
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_LOCATIONS_URL + location);
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()), this, SLOT(onGetLocationReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onGetLocationReply()
-{
-    const int requestError = m_ongoingRequest->error();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit getLocationCompleted(requestError == QNetworkReply::NoError,
-                                       parseLocation(data));
-    }
-    else
-        emitError();
+    return m_tagProjection.projectList(result, "data");
 }
 
 QVariantList InstagramConnection::parseLocation(const QByteArray &result)
 {
     QVariantList locations;
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("[" + QString(result) + "]");
-
-    QScriptValueIterator it(scValue);
-    it.next();
+    locations.append(m_locationProjection.projectObject(result, "data"));
 
-    QVariantMap location;
-    location.insert("location_id", it.value().property("data").property("id").toString());
-    location.insert("location_name", it.value().property("data").property("name").toString());
-    location.insert("location_latitude", it.value().property("data").property("latitude").toString());
-    location.insert("location_longitude", it.value().property("data").property("longitude").toString());
-
-    locations.append(location);
     return locations;
 }
 
-bool InstagramConnection::getLocationSearch(const QString &lat, const QString &lng, const QString &foursquare_v2_id, const QString &distance)
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_LOCATIONS_SEARCH_URL);
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-
-        if(!lat.isEmpty())
-            url.addQueryItem("lat", lat);
-        if(!lng.isEmpty())
-            url.addQueryItem("lng", lng);
-        if(!foursquare_v2_id.isEmpty())
-            url.addQueryItem("foursquare_v2_id", foursquare_v2_id);
-        if(!distance.isEmpty())
-            url.addQueryItem("distance", distance);
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()), this, SLOT(onGetLocationSearchReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onGetLocationSearchReply()
-{
-    const int requestError = m_ongoingRequest->error();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit getLocationCompleted(requestError == QNetworkReply::NoError,
-                                       parseLocations(data));
-    }
-    else
-        emitError();
-}
-
 QVariantList InstagramConnection::parseLocations(const QByteArray &result)
 {
-    QVariantList locations;
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("[" + QString(result) + "]");
-
-    QScriptValueIterator it(scValue);
-    it.next();
-
-    QVariantList locationsList = it.value().property("data").toVariant().toList();
-    int locationsListLenght = locationsList.length();
-
-    if(locationsListLenght > 0) {
-        for(int location_index = 0; location_index < locationsListLenght; location_index++) {
-            QVariantMap location;
-
-            location.insert("location_id", it.value().property("data").property(location_index).property("id").toString());
-            location.insert("location_name", it.value().property("data").property(location_index).property("name").toString());
-            location.insert("location_latitude", it.value().property("data").property(location_index).property("latitude").toString());
-            location.insert("location_longitude", it.value().property("data").property(location_index).property("longitude").toString());
-
-            locations.append(location);
-        }
-    }
-
-    return locations;
-}
-
-bool InstagramConnection::getLocationMediaRecent(const QString &location)
-{
-    bool ret = false;
-
-    if (!authenticated() || state() != Logged || busy() ) {
-        qWarning() << "Cannot get User while not authenticated/logged";
-    }
-    else {
-        ret = true;
-        setBusy(true);
-        setTransmitting(true);
-
-        QUrl url(INSTAGRAM_LOCATIONS_URL + location + "/media/recent");
-        url.addQueryItem(OAUTH_ACCESS_TOKEN, m_accessToken);
-
-        qDebug() << url.toString();
-
-        QNetworkRequest req(url);
-
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()), this, SLOT(onGetLocationMediaRecentReply()));
-    }
-
-    return ret;
-}
-
-void InstagramConnection::onGetLocationMediaRecentReply()
-{
-    const int requestError = m_ongoingRequest->error();
-
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit getLocationMediaRecentCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedMedias(data));
-    }
-    else
-        emitError();
+    return m_locationProjection.projectList(result, "data");
 }
 
 QVariantList InstagramConnection::parseRetrievedMedia(const QByteArray &result)
 {
     QVariantList list;
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("[" + QString(result) + "]");
-
-    QScriptValueIterator it(scValue);
-    it.next();
-
-    QVariantMap message;
-
-    message.insert("image_low_resolution", it.value().property("data")
-                   .property("images").property("low_resolution")
-                   .property("url").toString());
-    message.insert("image_low_resolution_width", it.value().property("data")
-                   .property("images").property("low_resolution")
-                   .property("width").toString());
-    message.insert("image_low_resolution_height", it.value().property("data")
-                   .property("images").property("low_resolution")
-                   .property("height").toString());
-
-    message.insert("image_standard_resolution", it.value().property("data")
-                   .property("images").property("standard_resolution")
-                   .property("url").toString());
-    message.insert("image_standard_resolution_width", it.value().property("data")
-                   .property("images").property("standard_resolution")
-                   .property("width").toString());
-    message.insert("image_standard_resolution_height", it.value().property("data")
-                   .property("images").property("standard_resolution")
-                   .property("height").toString());
-
-    message.insert("image_thumbnail", it.value().property("data")
-                   .property("images").property("thumbnail")
-                   .property("url").toString());
-    message.insert("image_thumbnail_width", it.value().property("data")
-                   .property("images").property("thumbnail")
-                   .property("width").toString());
-    message.insert("image_thumbnail_height", it.value().property("data")
-                   .property("images").property("thumbnail")
-                   .property("height").toString());
-
-    message.insert("location_id", it.value().property("data")
-                   .property("location").property("id").toString());
-    message.insert("location_latitude", it.value().property("data")
-                   .property("location").property("latitude").toString());
-    message.insert("location_longitude", it.value().property("data")
-                   .property("location").property("longitude").toString());
-    message.insert("location_name", it.value().property("data")
-                   .property("location").property("name").toString());
-
-    message.insert("user_username", it.value().property("data")
-                   .property("user").property("username").toString());
-    message.insert("user_full_name", it.value().property("data")
-                   .property("user").property("full_name").toString());
-    message.insert("user_profile_picture", it.value().property("data")
-                   .property("user").property("profile_picture").toString());
-    message.insert("user_id", it.value().property("data")
-                   .property("user").property("id").toString());
-
-    message.insert("image_id", it.value().property("data").property("id").toString());
-    message.insert("image_type", it.value().property("data").property("type").toString());
-    message.insert("image_filter", it.value().property("data").property("filter").toString());
-    message.insert("image_link", it.value().property("data").property("link").toString());
-    message.insert("created_time", it.value().property("data").property("created_time").toString());
-
-    message.insert("caption_created_time", it.value().property("data")
-                   .property("caption").property("created_time").toString());
-    message.insert("caption_text", it.value().property("data")
-                   .property("caption").property("text").toString());
-    message.insert("caption_id", it.value().property("data")
-                   .property("caption").property("id").toString());
-
-    message.insert("caption_from_username", it.value().property("data")
-                   .property("caption").property("from").property("username").toString());
-    message.insert("caption_from_full_name", it.value().property("data")
-                   .property("caption").property("from").property("full_name").toString());
-    message.insert("caption_from_type", it.value().property("data")
-                   .property("caption").property("from").property("type").toString());
-    message.insert("caption_from_id", it.value().property("data")
-                   .property("caption").property("from").property("id").toString());
-
-    message.insert("comments_count", it.value().property("data").property("comments").property("count").toString());    
-    message.insert("comments", parseComments(it));
-
-    message.insert("likes_count", it.value().property("data")
-                   .property("likes").property("count").toString());
-    message.insert("likes", parseLikes(it));
+    list.append(m_mediaProjection.projectObject(result, "data"));
 
-    list.append(message);
     return list;
 }
 
 QVariantList InstagramConnection::parseRetrievedMedias(const QByteArray &result)
 {
-    QVariantList list;
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("[" + QString(result) + "]");
-
-    QScriptValueIterator it(scValue);
-    it.next();
-
-    QVariantList datalist = it.value().property("data").toVariant().toList();
-    int lenght = datalist.length();
-
-    for(int index = 0; index < lenght; index++) {
-        QVariantMap message;
-
-        message.insert("image_low_resolution", it.value().property("data")
-                       .property(index).property("images").property("low_resolution")
-                       .property("url").toString());
-        message.insert("image_low_resolution_width", it.value().property("data")
-                       .property(index).property("images").property("low_resolution")
-                       .property("width").toString());
-        message.insert("image_low_resolution_height", it.value().property("data")
-                       .property(index).property("images").property("low_resolution")
-                       .property("height").toString());
-
-        message.insert("image_standard_resolution", it.value().property("data")
-                       .property(index).property("images").property("standard_resolution")
-                       .property("url").toString());
-        message.insert("image_standard_resolution_width", it.value().property("data")
-                       .property(index).property("images").property("standard_resolution")
-                       .property("width").toString());
-        message.insert("image_standard_resolution_height", it.value().property("data")
-                       .property(index).property("images").property("standard_resolution")
-                       .property("height").toString());
-
-        message.insert("image_thumbnail", it.value().property("data")
-                       .property(index).property("images").property("thumbnail")
-                       .property("url").toString());
-        message.insert("image_thumbnail_width", it.value().property("data")
-                       .property(index).property("images").property("thumbnail")
-                       .property("width").toString());
-        message.insert("image_thumbnail_height", it.value().property("data")
-                       .property(index).property("images").property("thumbnail")
-                       .property("height").toString());
-
-        message.insert("location_id", it.value().property("data")
-                       .property(index).property("location").property("id").toString());
-        message.insert("location_latitude", it.value().property("data")
-                       .property(index).property("location").property("latitude").toString());
-        message.insert("location_longitude", it.value().property("data")
-                       .property(index).property("location").property("longitude").toString());
-        message.insert("location_name", it.value().property("data")
-                       .property(index).property("location").property("name").toString());
-
-        message.insert("user_username", it.value().property("data")
-                       .property(index).property("user").property("username").toString());
-        message.insert("user_full_name", it.value().property("data")
-                       .property(index).property("user").property("full_name").toString());
-        message.insert("user_profile_picture", it.value().property("data")
-                       .property(index).property("user").property("profile_picture").toString());
-        message.insert("user_id", it.value().property("data")
-                       .property(index).property("user").property("id").toString());
-
-        message.insert("image_id", it.value().property("data").property(index).property("id").toString());
-        message.insert("image_type", it.value().property("data").property(index).property("type").toString());
-        message.insert("image_filter", it.value().property("data").property(index).property("filter").toString());
-        message.insert("image_link", it.value().property("data").property(index).property("link").toString());
-        message.insert("created_time", it.value().property("data").property(index).property("created_time").toString());
-
-        message.insert("caption_created_time", it.value().property("data")
-                       .property(index).property("caption").property("created_time").toString());
-        message.insert("caption_text", it.value().property("data")
-                       .property(index).property("caption").property("text").toString());
-        message.insert("caption_id", it.value().property("data")
-                       .property(index).property("caption").property("id").toString());
-
-        message.insert("caption_from_username", it.value().property("data")
-                       .property(index).property("caption").property("from").property("username").toString());
-        message.insert("caption_from_full_name", it.value().property("data")
-                       .property(index).property("caption").property("from").property("full_name").toString());
-        message.insert("caption_from_type", it.value().property("data")
-                       .property(index).property("caption").property("from").property("type").toString());
-        message.insert("caption_from_id", it.value().property("data")
-                       .property(index).property("caption").property("from").property("id").toString());
-
-        message.insert("comments_count", it.value().property("data").property(index).property("comments").property("count").toString());
-        message.insert("comments", parseComments(it));
-
-        message.insert("likes_count", it.value().property("data").property(index).property("likes").property("count").toString());
-        message.insert("likes", parseLikes(it));
-
-        list.append(message);
-    }
-
-    return list;
+    return m_mediaProjection.projectList(result, "data");
 }
 
-QVariantList InstagramConnection::parseComments(const QScriptValueIterator &it)
+QVariantList InstagramConnection::parseFeedPage(const QByteArray &result)
 {
-    QVariantList comments;
-
-    QVariantList commentslist = it.value().property("data").property("comments").property("data").toVariant().toList();
-    int commentslistLenght = commentslist.length();
-
-    if(commentslistLenght > 0) {
-        for(int comment_index = 0; comment_index < commentslistLenght; comment_index++) {
-            QVariantMap comment;
-            comment.insert("comment_created_time", it.value().property("data")
-                           .property("comments").property("data")
-                           .property(comment_index).property("created_time").toString());
-            comment.insert("comment_text", it.value().property("data")
-                           .property("comments").property("data")
-                           .property(comment_index).property("text").toString());
-            comment.insert("comment_id", it.value().property("data")
-                           .property("comments").property("data")
-                           .property(comment_index).property("id").toString());
-            comment.insert("comment_from_username", it.value().property("data")
-                           .property("comments").property("data")
-                           .property(comment_index).property("from").property("username").toString());
-            comment.insert("comment_from_profile_picture", it.value().property("data")
-                           .property("comments").property("data")
-                           .property(comment_index).property("from").property("profile_picture").toString());
-            comment.insert("comment_from_id", it.value().property("data")
-                           .property("comments").property("data")
-                           .property(comment_index).property("from").property("id").toString());
-            comment.insert("comment_from_full_name", it.value().property("data")
-                           .property("comments").property("data")
-                           .property(comment_index).property("from").property("full_name").toString());
-
-            comments.append(comment);
-        }
-    }
-
-    return comments;
-}
-
-QVariantList InstagramConnection::parseLikes(const QScriptValueIterator &it)
-{
-    QVariantList likes;
-    QVariantList likeslist = it.value().property("data").property("likes").property("data").toVariant().toList();
-    int likeslistLenght = likeslist.length();
-
-    if(likeslistLenght > 0) {
-        for(int like_index = 0; like_index < likeslistLenght; like_index++) {
-            QVariantMap like;
-            like.insert("like_username", it.value().property("data")
-                           .property("likes").property("data")
-                           .property(like_index).property("username").toString());
-            like.insert("like_full_name", it.value().property("data")
-                           .property("likes").property("data")
-                           .property(like_index).property("full_name").toString());
-            like.insert("like_id", it.value().property("data")
-                           .property("likes").property("data")
-                           .property(like_index).property("id").toString());
-            like.insert("like_profile_picture", it.value().property("data")
-                           .property("likes").property("data")
-                           .property(like_index).property("profile_picture").toString());
-
-            likes.append(like);
-        }
-    }
+    QVariantList page;
+    page.append(m_paginationProjection.projectObject(result, "pagination"));
+    page.append(QVariant(parseRetrievedMedias(result)));
 
-    return likes;
+    return page;
 }
 
 void InstagramConnection::authenticationSucceeded()
 {
-    setTransmitting(false);
-    setBusy(false);
     setState(Logged);
+    updateActivity();
     setAuthenticated(true);
+    setCompletionStatus(Succeeded);
     emit authenticateCompleted(true);
 }
 
@@ -2100,113 +1361,45 @@ bool InstagramConnection::restoreCredentials()
 void InstagramConnection::acquireAccessToken()
 {
     setState(AcquiringAccessToken);
-    setBusy(true);
-    setTransmitting(true);
-
-    QUrl params;
-    params.addQueryItem(OAUTH_CLIENT_ID, m_consumerKey);
-    params.addQueryItem(OAUTH_CLIENT_SECRET, m_consumerSecret);
-    params.addQueryItem(OAUTH_GRANT_TYPE, OAUTH_GRANT_TYPE_VALUE);
-    params.addQueryItem(OAUTH_REDIRECT_URI, m_callbackUrl);
-    params.addQueryItem(OAUTH_CODE, m_requestToken);
-    params.addQueryItem("scope", "likes+comments+relationship");
-
-    QByteArray data;
-    data = params.encodedQuery();
-
-    QNetworkRequest req(QUrl(OAUTH_ACCESSTOKEN_URL));
-    req.setHeader(QNetworkRequest::ContentTypeHeader,"application/x-www-form-urlencoded");
-
-    m_ongoingRequest = m_networkManager.post(req, data);
-    connect(m_ongoingRequest, SIGNAL(finished()),
-            this, SLOT(onAccessTokenReply()));
-}
-
-void InstagramConnection::onAccessTokenReply()
-{
-    m_accessToken.clear();
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
 
-    if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
-        qDebug() << data;
-        deleteReply();
-
-        setBusy(false);
-        emit retrieveAuthorizationCompleted(requestError == QNetworkReply::NoError,
-                                       parseRetrievedAuthorization(data));
-    }
-    else
-        emitError();
+    startRequest(AccessTokenEndpoint, QStringList(),
+                 QStringList() << m_consumerKey << m_consumerSecret
+                               << OAUTH_GRANT_TYPE_VALUE << m_callbackUrl
+                               << m_requestToken << "likes+comments+relationship");
 }
 
 QVariantList InstagramConnection::parseRetrievedAuthorization(const QByteArray &result)
 {
     QVariantList list;
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("[" + QString(result) + "]");
-    QScriptValueIterator it(scValue);
-
-    bool authorized = false;
-
-    while (it.hasNext() && authorized == false) {
-        it.next();
-
-        QVariantMap message;
-
-        qDebug() << it.value().property("access_token").toString();
-        qDebug() << it.value().property("user").property("username").toString();
+    const QVariantMap message = m_authorizationProjection.projectObject(result);
 
-        message.insert("access_token", it.value().property("access_token").toString());
-        m_accessToken = it.value().property("access_token").toString();
-
-        message.insert("user_username", it.value().property("user").property("username").toString());
-        message.insert("user_bio", it.value().property("user").property("bio").toString());
-        message.insert("user_website", it.value().property("user").property("website").toString());
-        message.insert("user_profile_picture", it.value().property("user").property("profile_picture").toString());
-        message.insert("user_full_name", it.value().property("user").property("full_name").toString());
-        message.insert("user_id", it.value().property("user").property("id").toString());
-
-        list.append(message);
-
-        if (!m_accessToken.isEmpty())
-            authorized = true;
-    }
+    list.append(message);
+    m_accessToken = message.value("access_token").toString();
 
-    if (authorized == true)
+    if (!m_accessToken.isEmpty())
         authenticationSucceeded();
 
     return list;
 }
 
-void InstagramConnection::deleteReply()
+void InstagramConnection::deleteReply(QNetworkReply *reply)
 {
-    m_ongoingRequest->close();
-    m_ongoingRequest->deleteLater();
-    m_ongoingRequest = 0;
+    reply->close();
+    reply->deleteLater();
 }
 
 SocialConnectionError* InstagramConnection::parseError(const QByteArray &result)
 {
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("[" + QString(result) + "]");
-
-    QScriptValueIterator it(scValue);
-    it.next();
+    const QVariantMap meta = m_errorProjection.projectObject(result, "meta");
 
-    SocialConnectionError *err = new SocialConnectionError(it.value().property("meta").property("error_type").toString(),
-                                                          it.value().property("meta").property("code").toString(),
-                                                          it.value().property("meta").property("error_message").toString());
+    SocialConnectionError *err = new SocialConnectionError(meta.value("error_type").toString(),
+                                                          meta.value("code").toString(),
+                                                          meta.value("error_message").toString());
     return err;
 }
 
-void InstagramConnection::emitError()
+void InstagramConnection::emitError(const QByteArray &data)
 {
-    QByteArray data = m_ongoingRequest->readAll();
-    qDebug() << data;
-    deleteReply();
-    setBusy(false);
     SocialConnectionError *err = parseError(data);
     emit error(err->errorType(), err->errorCode(), err->errorMessage());
     delete err;
@@ -1,26 +1,35 @@
 #ifndef INSTAGRAMCONNECTION_H
 #define INSTAGRAMCONNECTION_H
 
-#include <QNetworkAccessManager>
+#include <QHash>
+#include <QPair>
+#include <QSet>
 #include <QString>
+#include <QStringList>
 #include <QVariantMap>
-#include <QScriptValueIterator>
 
+#include "jsonprojection.h"
 #include "socialconnection.h"
 #include "socialconnectionerror.h"
 
 class InstagramRequest;
+class ParseQueue;
+class QNetworkReply;
+class QTimer;
 
 class InstagramConnection : public SocialConnection
 {
     Q_OBJECT
     Q_ENUMS(AuthorizationMethod)
+    Q_ENUMS(Feed)
 
     Q_PROPERTY(QString consumerKey READ consumerKey WRITE setConsumerKey NOTIFY consumerKeyChanged)
     Q_PROPERTY(QString consumerSecret READ consumerSecret WRITE setConsumerSecret NOTIFY consumerSecretChanged)
     Q_PROPERTY(QString accessToken READ accessToken WRITE setAccessToken NOTIFY accessTokenChanged)
     Q_PROPERTY(QString callbackUrl READ callbackUrl WRITE setCallbackUrl NOTIFY callbackUrlChanged)
     Q_PROPERTY(QString requestToken READ requestToken WRITE setRequestToken NOTIFY requestTokenChanged)
+    Q_PROPERTY(int minPollInterval READ minPollInterval WRITE setMinPollInterval NOTIFY minPollIntervalChanged)
+    Q_PROPERTY(int maxPollInterval READ maxPollInterval WRITE setMaxPollInterval NOTIFY maxPollIntervalChanged)
 
 public:
     explicit InstagramConnection(QObject *parent = 0);
@@ -42,6 +51,19 @@ public:
     QString requestToken() const;
     void setRequestToken(const QString &token);
 
+    int minPollInterval() const;
+    void setMinPollInterval(int minPollInterval);
+
+    int maxPollInterval() const;
+    void setMaxPollInterval(int maxPollInterval);
+
+    // The feeds that can be polled for new media.
+    enum Feed {
+        UserSelfFeed = 0,
+        UserMediaRecent,
+        TagMediaRecent
+    };
+
     enum AuthorizationMethod {
         Code,
         Token
@@ -109,12 +131,19 @@ public slots:
     bool getLocationSearch(const QString &lat, const QString &lng,
                            const QString &foursquare_v2_id, const QString &distance);
 
+    // Polling
+    bool startPolling(int feed, const QString &argument = "");
+    void stopPolling(int feed, const QString &argument = "");
+    bool getOlderMedia(int feed, const QString &argument = "");
+
 signals:
     void consumerKeyChanged(const QString &consumerKey);
     void consumerSecretChanged(const QString &consumerSecret);
     void accessTokenChanged(const QString &accessToken);
     void callbackUrlChanged(const QString &callbackUrl);
     void requestTokenChanged(const QString &token);
+    void minPollIntervalChanged(int minPollInterval);
+    void maxPollIntervalChanged(int maxPollInterval);
 
     void retrieveAuthorizationCompleted(bool success, const QVariantList &messages);
     void retrieveUserCompleted(bool success, const QVariantList &messages);
@@ -142,40 +171,133 @@ signals:
     void getLocationCompleted(bool success, const QVariantList &messages);
     void getLocationMediaRecentCompleted(bool success, const QVariantList &messages);
     void getLocationSearchCompleted(bool success, const QVariantList &messages);
+    void pollCompleted(bool success, int feed, const QString &argument, const QVariantList &messages);
+    void getOlderMediaCompleted(bool success, int feed, const QString &argument,
+                                const QVariantList &messages, bool more);
 
 protected slots:
     void onUrlChanged(const QUrl &url);
 
 private slots:
-    void onAccessTokenReply();
-    void onGetUserReply();
-    void onGetUserSelfFeedReply();
-    void onGetUserMediaRecentReply();
-    void onGetUserSelfMediaLikedReply();
-    void onGetUserSearchReply();
-    void onGetUserFollowsReply();
-    void onGetUserFollowedByReply();
-    void onGetUserSelfRequestedByReply();
-    void onGetUserRelationshipReply();
-    void onSetUserRelationshipReply();
-    void onGetMediaReply();
-    void onGetMediaSearchReply();
-    void onGetMediaPopularReply();
-    void onGetCommentsReply();
-    void onPostCommentReply();
-    void onDeleteCommentReply();
-    void onGetLikesReply();
-    void onPostLikeReply();
-    void onDeleteLikeReply();
-    void onGetTagReply();
-    void onGetTagMediaRecentReply();
-    void onGetTagsSearchReply();
-    void onGetLocationReply();
-    void onGetLocationMediaRecentReply();
-    void onGetLocationSearchReply();
+    void onReplyFinished();
+    void onReplyParsed(const QVariant &context, const QVariantList &messages);
+    void onFeedParsed(const QVariant &context, const QVariantList &page);
+    void pollFeeds();
 
 private:    // Members
 
+    // The Instagram API endpoints, indexes to the Endpoints table.
+    enum EndpointId {
+        AccessTokenEndpoint = 0,
+        UserEndpoint,
+        UserSelfFeedEndpoint,
+        UserMediaRecentEndpoint,
+        UserSelfMediaLikedEndpoint,
+        UserSearchEndpoint,
+        UserFollowsEndpoint,
+        UserFollowedByEndpoint,
+        UserSelfRequestedByEndpoint,
+        UserRelationshipEndpoint,
+        SetUserRelationshipEndpoint,
+        MediaEndpoint,
+        MediaSearchEndpoint,
+        MediaPopularEndpoint,
+        CommentsEndpoint,
+        PostCommentEndpoint,
+        DeleteCommentEndpoint,
+        LikesEndpoint,
+        PostLikeEndpoint,
+        DeleteLikeEndpoint,
+        TagEndpoint,
+        TagMediaRecentEndpoint,
+        TagsSearchEndpoint,
+        LocationEndpoint,
+        LocationMediaRecentEndpoint,
+        LocationSearchEndpoint
+    };
+
+    enum HttpMethod {
+        HttpGet,
+        HttpPost,
+        HttpDelete
+    };
+
+    typedef QVariantList (InstagramConnection::*ReplyParser)(const QByteArray &result);
+
+    // Describes how to request an endpoint and how to complete the request.
+    struct Endpoint {
+        const char *url;            // URL template taking the path arguments.
+        HttpMethod method;
+        bool authorized;            // Requires login & sends the access token.
+        const char *parameters;     // Comma separated parameter names.
+        ReplyParser parser;
+        const char *signal;         // Completion signal name.
+    };
+
+    static const Endpoint Endpoints[];
+
+    // A polled feed. The cursors are the ones Instagram returns: the newest
+    // media seen so far, and the page after the oldest one retrieved. The
+    // interval shortens while new media keeps arriving and grows while the
+    // feed is quiet. A poll that finds more new media than fits a page
+    // follows the pages down to minId before it moves the cursor.
+    struct PolledFeed {
+        PolledFeed() : feed(UserSelfFeed), generation(0), interval(0), nextPoll(0),
+                       polling(false), loadingOlder(false) {}
+
+        Feed feed;
+        QString argument;           // The user id or the tag name.
+        int generation;             // Tells the replies of a restarted feed apart.
+        QString minId;
+        QString nextMaxId;
+        QSet<QString> latestIds;    // The media of the latest new page.
+        QString pollMaxId;          // The next page of the poll in progress.
+        QString pollMinId;          // minId once the poll has caught up.
+        QSet<QString> pollIds;      // latestIds once the poll has caught up.
+        QVariantList pollMedia;     // The new media of the poll so far.
+        int interval;
+        qint64 nextPoll;            // Milliseconds since the epoch.
+        bool polling;
+        bool loadingOlder;
+    };
+
+    // The polled feed a reply in flight belongs to.
+    struct FeedReply {
+        FeedReply() : generation(0), older(false) {}
+
+        QString key;
+        int generation;
+        bool older;
+    };
+
+    // Starts a request to the endpoint id. Several requests can be in
+    // flight at the same time; each reply is parsed with the parser of its
+    // endpoint and reported through the endpoint's completion signal.
+    bool startRequest(EndpointId id,
+                      const QStringList &arguments = QStringList(),
+                      const QStringList &values = QStringList());
+
+    // Sends a request to the endpoint id and returns its reply, or 0 if the
+    // request could not be sent. A GET identical to one in flight, and made
+    // with the same cache policy and timeout, returns that reply instead if
+    // coalesce is true.
+    QNetworkReply *sendRequest(EndpointId id,
+                               const QStringList &arguments,
+                               const QStringList &values,
+                               bool coalesce);
+
+    // Polling: each polled feed is requested when it is due, and only the
+    // media not delivered before is reported.
+    static QString feedKey(int feed, const QString &argument);
+    bool requestFeed(const QString &key, bool older);
+    void onFeedReply(const FeedReply &feedReply, bool success,
+                     const QVariantMap &pagination, const QVariantList &medias);
+    void schedulePolling();
+
+    // Updates busy & transmitting to reflect the authentication state and
+    // the requests in flight.
+    void updateActivity();
+
     // Instagram login internal state tracking and setters & getters for it.
     enum State {
         NotLogged = 0,
@@ -200,9 +322,9 @@ private:    // Members
     // "401 Unauthorized" by setting the state to NotLogged & unauthenticated.
     int checkReplyErrors();
 
-    // Closes the QNetworkReply & nullifies the pointer. Should be called
-    // always after each request completed signal handler.
-    void deleteReply();
+    // Closes the QNetworkReply. Should be called always after each request
+    // completed signal handler.
+    void deleteReply(QNetworkReply *reply);
 
     // Traverses the retrieveMessages reply and creates a messagelist in the
     // specified format. See socialconnection.h for details.
@@ -213,6 +335,7 @@ private:    // Members
     QVariantList parseSetUserRelationship(const QByteArray &result);
     QVariantList parseRetrievedMedia(const QByteArray &result);
     QVariantList parseRetrievedMedias(const QByteArray &result);
+    QVariantList parseFeedPage(const QByteArray &result);
     QVariantList parseRetrievedComments(const QByteArray &result);
     QVariantList parsePostedComment(const QByteArray &result);
     QVariantList parseDeletedComment(const QByteArray &result);
@@ -220,9 +343,6 @@ private:    // Members
     QVariantList parsePostedLike(const QByteArray &result);
     QVariantList parseDeletedLike(const QByteArray &result);
 
-    QVariantList parseComments(const QScriptValueIterator &it);
-    QVariantList parseLikes(const QScriptValueIterator &it);
-
     QVariantList parseTag(const QByteArray &result);
     QVariantList parseTags(const QByteArray &result);
 
@@ -230,17 +350,55 @@ private:    // Members
     QVariantList parseLocations(const QByteArray &result);
 
     SocialConnectionError* parseError(const QByteArray &result);
-    void emitError();
+    void emitError(const QByteArray &data);
 
     // A helper method for clearing the XXXToken etc. QString members.
     void clearAllMembers();
 
+    // Compiles the key paths read by the parse methods above.
+    void initProjections();
+
 private:    // Data
 
     InstagramRequest *m_instagramRequest;
 
-    QNetworkReply *m_ongoingRequest;
-    QNetworkAccessManager m_networkManager;
+    // Parses the replies on worker threads. The parsers only read the
+    // projections, which are not modified after construction.
+    ParseQueue *m_parseQueue; // Owned
+
+    // Parses the pages of the polled feeds on worker threads.
+    ParseQueue *m_feedParseQueue; // Owned
+
+    // The endpoints of the replies in flight.
+    QHash<QNetworkReply*, EndpointId> m_replies;
+
+    // The GET replies in flight by URL, and the number of further callers
+    // waiting for each of them.
+    QHash<QString, QNetworkReply*> m_inflightGets;
+    QHash<QNetworkReply*, int> m_coalescedCallers;
+
+    // The polled feeds by key, and the feed and direction of the replies
+    // in flight for them.
+    QHash<QString, PolledFeed> m_feeds;
+    QHash<QNetworkReply*, FeedReply> m_feedReplies;
+    QTimer *m_pollTimer;
+    int m_feedGeneration;
+    int m_minPollInterval;
+    int m_maxPollInterval;
+
+    // Compiled key paths of the fields read from the replies.
+    JsonProjection m_userProjection;
+    JsonProjection m_usersProjection;
+    JsonProjection m_relationshipProjection;
+    JsonProjection m_mediaProjection;
+    JsonProjection m_commentProjection;
+    JsonProjection m_likeProjection;
+    JsonProjection m_likesProjection;
+    JsonProjection m_tagProjection;
+    JsonProjection m_locationProjection;
+    JsonProjection m_authorizationProjection;
+    JsonProjection m_errorProjection;
+    JsonProjection m_paginationProjection;
 
     QString m_consumerKey;
     QString m_consumerSecret;
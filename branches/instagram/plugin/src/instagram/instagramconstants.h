@@ -36,4 +36,9 @@
 #define INSTAGRAM_LOCATIONS_URL "https://api.instagram.com/v1/locations/"
 #define INSTAGRAM_LOCATIONS_SEARCH_URL "https://api.instagram.com/v1/locations/search"
 
+// Polling defaults, in milliseconds.
+#define POLL_INTERVAL 60000
+#define MIN_POLL_INTERVAL 15000
+#define MAX_POLL_INTERVAL 600000
+
 #endif // INSTAGRAMCONSTANTS_H
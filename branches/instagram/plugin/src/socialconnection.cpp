@@ -5,10 +5,21 @@
 #define QT_NO_DEBUG_OUTPUT
 
 #include <QtCore/QDebug>
+#include <QtNetwork/QNetworkReply>
 
+#include "imageprocessor.h"
+#include "messagemodel.h"
+#include "networktransport.h"
+#include "progressmonitor.h"
+#include "responsecache.h"
 #include "webinterface.h"
 #include "socialconnection.h"
 
+// Constants
+namespace {
+    const int DefaultRequestTimeout = 30000; // ms
+}
+
 /*!
     \class SocialConnection
 
@@ -82,6 +93,100 @@
     be used in a UI.
  */
 
+/*!
+    \property SocialConnection::cachePolicy
+
+    This property holds how the responses cached on disk are used by the GET
+    requests started after setting it. The value applies to each request as
+    it is started, so it can be changed between requests.
+
+    \list
+        \li \c AlwaysNetwork : the response is always downloaded
+        \li \c PreferNetwork (default) : a fresh cached response is used; a
+            stale one is revalidated with its ETag or Last-Modified date and
+            only downloaded again if it has changed
+        \li \c PreferCache : a cached response is used even if it is stale
+        \li \c AlwaysCache : only a cached response is used; the request
+            fails if there is none
+    \endlist
+ */
+
+/*!
+    \property SocialConnection::maximumCacheSize
+
+    This property holds the limit of the on-disk response cache in bytes.
+    The cache is shared by all the connections. When the limit is exceeded,
+    the least recently used responses are removed.
+ */
+
+/*!
+    \property SocialConnection::progressInterval
+
+    This property holds the minimum time in milliseconds between two
+    transferProgress() signals of a request. The final progress of a request
+    is always reported. The default value is 250; with 0 every change is
+    reported.
+ */
+
+/*!
+    \property SocialConnection::maximumImageSize
+
+    This property holds the largest width and height in pixels of a photo
+    posted with postMessage(). A larger photo is scaled down on a worker
+    thread and recompressed as a JPEG of \c imageQuality before it is
+    uploaded. The Exif data and other metadata, such as the location, are
+    left out of every posted photo, also of the ones small enough already.
+    The default value is 0, which uploads photos as they are.
+ */
+
+/*!
+    \property SocialConnection::imageQuality
+
+    This property holds the JPEG quality, from 0 to 100, of the photos scaled
+    down to \c maximumImageSize. The default value is 85.
+ */
+
+/*!
+    \property SocialConnection::requestTimeout
+
+    This property holds the time in milliseconds a request may take before
+    it is aborted, counted from the call that made it and including the time
+    it waits in a queue. The operation then completes with
+    \c completionStatus set to \c TimedOut. A request uploading a file is
+    only aborted once it has sent and received nothing for that long, since
+    its duration depends on the size of the file. The value is read as the
+    request is made; postMessage(), retrieveMessageCount() and
+    retrieveMessages() also take a timeout of their own for a single call.
+    The default value is 30000; with 0 requests never time out.
+ */
+
+/*!
+    \property SocialConnection::completionStatus
+
+    This property holds how the operation whose completion signal is being
+    handled ended. It is set before the completion signal is emitted.
+
+    \list
+        \li \c Succeeded : the operation succeeded
+        \li \c Failed : the operation failed
+        \li \c TimedOut : a request of the operation did not finish within
+            its timeout
+        \li \c Canceled : the operation was cancelled
+    \endlist
+ */
+
+/*!
+    \property SocialConnection::messageModel
+
+    This property holds a list model of the messages retrieved so far,
+    newest first, for a QML view. Its roles are "id", "text", "time" (Unix
+    time), "url" and "user". The model is filled only while its \c active
+    property is true. The messages are then added to it before the
+    completion signal of the operation that retrieved them is emitted, and
+    that signal carries no messages, so that they are not kept twice. The
+    model is kept until its clear() method is called.
+ */
+
 /*!
     \fn virtual bool SocialConnection::authenticate() = 0
 
@@ -185,6 +290,34 @@
     not affected.
  */
 
+/*!
+    \fn QVariantMap SocialConnection::networkStatistics() const
+
+    Returns the statistics of the network transport shared by all the
+    connections. The members/keys of the returned object are:
+    \list
+        \li "requests" : number of requests sent
+        \li "handshakes" : estimated number of TCP/TLS connection setups
+        \li "retries" : number of requests sent again after a transient
+            error or a rate limit
+        \li "bytesSent" : number of request body bytes sent
+        \li "bytesReceived" : number of reply bytes received
+        \li "cacheHits" : number of GET requests answered from the cache,
+            also after revalidation
+        \li "cacheMisses" : number of GET requests downloaded
+        \li "bytesSaved" : number of reply bytes read from the cache
+        \li "hosts" : the "requests" and "handshakes" of each host, together
+            with the "peak" number of requests in flight at once
+    \endlist
+ */
+
+/*!
+    \fn void SocialConnection::resetNetworkStatistics()
+
+    Resets the statistics of the shared network transport, so that the
+    network cost of a single workload can be measured.
+ */
+
 /*!
     \fn void SocialConnection::authenticateCompleted(bool success)
 
@@ -237,7 +370,8 @@
 
     Retrieve messages operation has been completed. Success of the operation is
     indicated by \a success. If the operation was completed successfully then
-    \a messages contains an array of message objects.
+    \a messages contains an array of message objects, unless the
+    \c messageModel is active and holds them instead.
 
     The members/keys of the message object are:
     \list
@@ -253,14 +387,60 @@
     credential properties in derived implementations have been kept intact.
  */
 
+/*!
+    \fn void SocialConnection::transferProgress(const QVariant &requestId, const QVariantMap &progress)
+
+    Reports the progress of a request in flight, at most once per
+    \c progressInterval. \a requestId is the id given to the request, or the
+    name of the operation, such as "postMessage", if it has none.
+
+    The members/keys of the \a progress object are:
+    \list
+        \li "bytesSent" : number of request body bytes sent
+        \li "bytesToSend" : size of the request body, -1 if not known
+        \li "bytesReceived" : number of reply bytes received
+        \li "bytesToReceive" : size of the reply, -1 if not known
+        \li "throughput" : bytes per second transferred since the previous
+            report
+        \li "averageThroughput" : bytes per second transferred since the
+            request was started
+        \li "finished" : true in the last report of the request
+    \endlist
+ */
+
+/*!
+    \fn void SocialConnection::messagesReceived(const QVariantList &messages)
+
+    Reports the \a messages of a retrieveMessages() reply that have arrived
+    so far, in the format of retrieveMessagesCompleted(). Derived
+    implementations that read their replies incrementally emit this signal
+    zero or more times before the completion signal, as each batch of
+    messages has been parsed; the batches may be reported out of order. The
+    completion signal repeats all the messages in order. Messages received
+    before a failure should be discarded. The signal is not emitted while
+    the \c messageModel is active.
+ */
+
 SocialConnection::SocialConnection(QObject *parent) :
     QObject(parent),
     m_webInterface(0),
+    m_progressMonitor(new ProgressMonitor(this)),
+    m_imageProcessor(new ImageProcessor(this)),
+    m_messageModel(new MessageModel(this)),
     m_busy(false),
     m_transmitting(false),
-    m_authenticated(false)
+    m_authenticated(false),
+    m_cachePolicy(PreferNetwork),
+    m_requestTimeout(DefaultRequestTimeout),
+    m_callTimeout(-1),
+    m_completionStatus(Succeeded)
 {
     qDebug() << "SocialConnection::SocialConnection";
+
+    connect(m_progressMonitor, SIGNAL(progress(QVariant,QVariantMap)),
+            this, SIGNAL(transferProgress(QVariant,QVariantMap)));
+    connect(m_imageProcessor, SIGNAL(finished(QVariant,QString)),
+            this, SLOT(onImageFinished(QVariant,QString)));
 }
     
 SocialConnection::~SocialConnection()
@@ -336,6 +516,166 @@ QString SocialConnection::name() const
     return m_name;
 }
 
+SocialConnection::CachePolicy SocialConnection::cachePolicy() const
+{
+    return m_cachePolicy;
+}
+
+void SocialConnection::setCachePolicy(CachePolicy cachePolicy)
+{
+    qDebug() << "SocialConnection::setCachePolicy" << cachePolicy;
+
+    if (cachePolicy != m_cachePolicy) {
+        m_cachePolicy = cachePolicy;
+        emit cachePolicyChanged(cachePolicy);
+    }
+}
+
+int SocialConnection::maximumCacheSize() const
+{
+    return NetworkTransport::instance()->cache()->maximumCacheSize();
+}
+
+void SocialConnection::setMaximumCacheSize(int maximumCacheSize)
+{
+    qDebug() << "SocialConnection::setMaximumCacheSize" << maximumCacheSize;
+
+    ResponseCache *cache = NetworkTransport::instance()->cache();
+
+    if (maximumCacheSize != cache->maximumCacheSize()) {
+        cache->setMaximumCacheSize(maximumCacheSize);
+        emit maximumCacheSizeChanged(maximumCacheSize);
+    }
+}
+
+int SocialConnection::progressInterval() const
+{
+    return m_progressMonitor->interval();
+}
+
+void SocialConnection::setProgressInterval(int progressInterval)
+{
+    qDebug() << "SocialConnection::setProgressInterval" << progressInterval;
+
+    if (progressInterval != m_progressMonitor->interval()) {
+        m_progressMonitor->setInterval(progressInterval);
+        emit progressIntervalChanged(m_progressMonitor->interval());
+    }
+}
+
+int SocialConnection::maximumImageSize() const
+{
+    return m_imageProcessor->maximumSize();
+}
+
+void SocialConnection::setMaximumImageSize(int maximumImageSize)
+{
+    qDebug() << "SocialConnection::setMaximumImageSize" << maximumImageSize;
+
+    if (maximumImageSize != m_imageProcessor->maximumSize()) {
+        m_imageProcessor->setMaximumSize(maximumImageSize);
+        emit maximumImageSizeChanged(m_imageProcessor->maximumSize());
+    }
+}
+
+int SocialConnection::imageQuality() const
+{
+    return m_imageProcessor->quality();
+}
+
+void SocialConnection::setImageQuality(int imageQuality)
+{
+    qDebug() << "SocialConnection::setImageQuality" << imageQuality;
+
+    if (imageQuality != m_imageProcessor->quality()) {
+        m_imageProcessor->setQuality(imageQuality);
+        emit imageQualityChanged(m_imageProcessor->quality());
+    }
+}
+
+int SocialConnection::requestTimeout() const
+{
+    return m_requestTimeout;
+}
+
+void SocialConnection::setRequestTimeout(int requestTimeout)
+{
+    qDebug() << "SocialConnection::setRequestTimeout" << requestTimeout;
+
+    requestTimeout = qMax(0, requestTimeout);
+
+    if (requestTimeout != m_requestTimeout) {
+        m_requestTimeout = requestTimeout;
+        emit requestTimeoutChanged(requestTimeout);
+    }
+}
+
+SocialConnection::CompletionStatus SocialConnection::completionStatus() const
+{
+    return m_completionStatus;
+}
+
+MessageModel *SocialConnection::messageModel() const
+{
+    return m_messageModel;
+}
+
+QVariantMap SocialConnection::networkStatistics() const
+{
+    return NetworkTransport::instance()->statistics();
+}
+
+void SocialConnection::resetNetworkStatistics()
+{
+    NetworkTransport::instance()->resetStatistics();
+}
+
+/*!
+    Posts \a message as postMessage() does, with the requests of the
+    operation given \a timeout in milliseconds instead of
+    \c requestTimeout. With 0 they never time out.
+ */
+bool SocialConnection::postMessage(const QVariantMap &message, int timeout)
+{
+    const int previous = m_callTimeout;
+    m_callTimeout = qMax(0, timeout);
+    const bool started = postMessage(message);
+    m_callTimeout = previous;
+
+    return started;
+}
+
+/*!
+    Retrieves the message count as retrieveMessageCount() does, with the
+    requests of the operation given \a timeout in milliseconds instead of
+    \c requestTimeout. With 0 they never time out.
+ */
+bool SocialConnection::retrieveMessageCount(int timeout)
+{
+    const int previous = m_callTimeout;
+    m_callTimeout = qMax(0, timeout);
+    const bool started = retrieveMessageCount();
+    m_callTimeout = previous;
+
+    return started;
+}
+
+/*!
+    Retrieves messages as retrieveMessages() does, with the requests of the
+    operation given \a timeout in milliseconds instead of
+    \c requestTimeout. With 0 they never time out.
+ */
+bool SocialConnection::retrieveMessages(const QString &from, const QString &to, int max,
+                                        int timeout)
+{
+    const int previous = m_callTimeout;
+    m_callTimeout = qMax(0, timeout);
+    const bool started = retrieveMessages(from, to, max);
+    m_callTimeout = previous;
+
+    return started;
+}
+
 void SocialConnection::setBusy(bool busy)
 {
     qDebug() << "SocialConnection::setBusy" << busy;
@@ -366,7 +706,138 @@ void SocialConnection::setName(const QString &name)
     }
 }
 
+void SocialConnection::setCompletionStatus(CompletionStatus completionStatus)
+{
+    qDebug() << "SocialConnection::setCompletionStatus" << completionStatus;
+
+    if (completionStatus != m_completionStatus) {
+        m_completionStatus = completionStatus;
+        emit completionStatusChanged(completionStatus);
+    }
+}
+
+/*!
+    \internal
+
+    Returns the timeout of the requests made now: the one given to the call
+    in progress, or \c requestTimeout.
+*/
+int SocialConnection::callTimeout() const
+{
+    return m_callTimeout >= 0 ? m_callTimeout : m_requestTimeout;
+}
+
+/*!
+    \internal
+
+    Gives \a request the callTimeout() as its deadline, or as its inactivity
+    timeout if it is an \a upload of a file.
+*/
+void SocialConnection::applyRequestTimeout(QNetworkRequest &request, bool upload) const
+{
+    const NetworkTransport::Attribute attribute = upload ? NetworkTransport::TimeoutAttribute
+                                                         : NetworkTransport::DeadlineAttribute;
+    request.setAttribute(QNetworkRequest::Attribute(attribute), callTimeout());
+}
+
+/*!
+    \internal
+
+    Returns the completion status of an operation ended by \a reply.
+*/
+SocialConnection::CompletionStatus SocialConnection::replyStatus(const QNetworkReply *reply)
+{
+    if (!reply) {
+        return Failed;
+    }
+
+    switch (reply->error()) {
+    case QNetworkReply::NoError:
+        return Succeeded;
+    case QNetworkReply::TimeoutError:
+        return TimedOut;
+    case QNetworkReply::OperationCanceledError:
+        return Canceled;
+    default:
+        return Failed;
+    }
+}
+
+/*!
+    \internal
+
+    Reports the progress of \a reply with transferProgress() signals for the
+    request \a requestId.
+*/
+void SocialConnection::trackProgress(QNetworkReply *reply, const QVariant &requestId)
+{
+    m_progressMonitor->track(reply, requestId);
+}
+
+/*!
+    \internal
+
+    Starts scaling down the photo \a fileUrl on a worker thread.
+    onImageProcessed() is called later with \a context and the file to
+    upload. Returns false if \c maximumImageSize is 0 or the file is not a
+    still image; the file is then uploaded as it is.
+*/
+bool SocialConnection::processImage(const QUrl &fileUrl, const QVariant &context)
+{
+    return fileUrl.isValid() && m_imageProcessor->process(fileUrl.toLocalFile(), context);
+}
+
+/*!
+    \internal
+
+    Returns true while photos are being scaled down.
+*/
+bool SocialConnection::processingImages() const
+{
+    return m_imageProcessor->isActive();
+}
+
+/*!
+    \internal
+
+    Cancels the photos being scaled down. onImageProcessed() is called for
+    each of them with an empty URL.
+*/
+void SocialConnection::cancelImageProcessing()
+{
+    m_imageProcessor->cancel();
+}
+
+/*!
+    \internal
+
+    Removes the scaled down photo \a fileUrl once \a owner, such as the
+    reply or device uploading it, is destroyed, or at once if \a owner is 0.
+    Does nothing for the photos uploaded as they are.
+*/
+void SocialConnection::releaseImage(const QUrl &fileUrl, QObject *owner)
+{
+    m_imageProcessor->release(fileUrl.toLocalFile(), owner);
+}
+
 void SocialConnection::onUrlChanged(const QUrl &url)
 {
     qDebug() << "SocialConnection::urlChanged" << url;
 }
+
+/*!
+    \internal
+
+    Called when a photo started with processImage() is ready to be uploaded
+    from \a fileUrl. An empty \a fileUrl means that it was cancelled.
+*/
+void SocialConnection::onImageProcessed(const QVariant &context, const QUrl &fileUrl)
+{
+    Q_UNUSED(context)
+    releaseImage(fileUrl);
+}
+
+void SocialConnection::onImageFinished(const QVariant &context, const QString &fileName)
+{
+    onImageProcessed(context, fileName.isEmpty() ? QUrl() : QUrl::fromLocalFile(fileName));
+}
@@ -9,8 +9,13 @@
 #include <QtCore/QUrl>
 #include <QtCore/QVariantList>
 #include <QtCore/QVariantMap>
+#include <QtNetwork/QNetworkRequest>
 #include "socialconnectionerror.h"
 
+class ImageProcessor;
+class MessageModel;
+class ProgressMonitor;
+class QNetworkReply;
 class WebInterface;
 
 class SocialConnection : public QObject
@@ -22,9 +27,33 @@ class SocialConnection : public QObject
     Q_PROPERTY(bool busy READ busy NOTIFY busyChanged)
     Q_PROPERTY(bool transmitting READ transmitting NOTIFY transmittingChanged)
     Q_PROPERTY(QString name READ name NOTIFY nameChanged)
+    Q_PROPERTY(CachePolicy cachePolicy READ cachePolicy WRITE setCachePolicy NOTIFY cachePolicyChanged)
+    Q_PROPERTY(int maximumCacheSize READ maximumCacheSize WRITE setMaximumCacheSize NOTIFY maximumCacheSizeChanged)
+    Q_PROPERTY(int progressInterval READ progressInterval WRITE setProgressInterval NOTIFY progressIntervalChanged)
+    Q_PROPERTY(int maximumImageSize READ maximumImageSize WRITE setMaximumImageSize NOTIFY maximumImageSizeChanged)
+    Q_PROPERTY(int imageQuality READ imageQuality WRITE setImageQuality NOTIFY imageQualityChanged)
+    Q_PROPERTY(int requestTimeout READ requestTimeout WRITE setRequestTimeout NOTIFY requestTimeoutChanged)
+    Q_PROPERTY(CompletionStatus completionStatus READ completionStatus NOTIFY completionStatusChanged)
+    Q_PROPERTY(QObject* messageModel READ messageModel CONSTANT)
+    Q_ENUMS(CachePolicy)
+    Q_ENUMS(CompletionStatus)
 
 public:
 
+    enum CachePolicy {
+        AlwaysNetwork = QNetworkRequest::AlwaysNetwork,
+        PreferNetwork = QNetworkRequest::PreferNetwork,
+        PreferCache = QNetworkRequest::PreferCache,
+        AlwaysCache = QNetworkRequest::AlwaysCache
+    };
+
+    enum CompletionStatus {
+        Succeeded,
+        Failed,
+        TimedOut,
+        Canceled
+    };
+
     explicit SocialConnection(QObject *parent = 0);
     ~SocialConnection();
 
@@ -37,6 +66,20 @@ public: // property access
     bool busy() const;
     bool transmitting() const;
     QString name() const;
+    CachePolicy cachePolicy() const;
+    void setCachePolicy(CachePolicy cachePolicy);
+    int maximumCacheSize() const;
+    void setMaximumCacheSize(int maximumCacheSize);
+    int progressInterval() const;
+    void setProgressInterval(int progressInterval);
+    int maximumImageSize() const;
+    void setMaximumImageSize(int maximumImageSize);
+    int imageQuality() const;
+    void setImageQuality(int imageQuality);
+    int requestTimeout() const;
+    void setRequestTimeout(int requestTimeout);
+    CompletionStatus completionStatus() const;
+    MessageModel *messageModel() const;
 
 public slots: // common network operations
 
@@ -47,22 +90,47 @@ public slots: // common network operations
     virtual bool retrieveMessages(const QString &from, const QString &to, int max) = 0;
     virtual void cancel() = 0;
 
+public slots: // common network operations with a timeout of their own
+
+    bool postMessage(const QVariantMap &message, int timeout);
+    bool retrieveMessageCount(int timeout);
+    bool retrieveMessages(const QString &from, const QString &to, int max, int timeout);
+
 public slots: // common local operations
 
     virtual bool storeCredentials() = 0;
     virtual bool restoreCredentials() = 0;
     virtual bool removeCredentials() = 0;
 
+public: // network statistics
+
+    Q_INVOKABLE QVariantMap networkStatistics() const;
+    Q_INVOKABLE void resetNetworkStatistics();
+
 protected:
 
     void setAuthenticated(bool authenticated);
     void setBusy(bool busy);
     void setTransmitting(bool transmitting);
     void setName(const QString &name);
+    void setCompletionStatus(CompletionStatus completionStatus);
+    int callTimeout() const;
+    void applyRequestTimeout(QNetworkRequest &request, bool upload = false) const;
+    static CompletionStatus replyStatus(const QNetworkReply *reply);
+    void trackProgress(QNetworkReply *reply, const QVariant &requestId);
+    bool processImage(const QUrl &fileUrl, const QVariant &context);
+    bool processingImages() const;
+    void cancelImageProcessing();
+    void releaseImage(const QUrl &fileUrl, QObject *owner = 0);
 
 protected slots:
 
     virtual void onUrlChanged(const QUrl &url);
+    virtual void onImageProcessed(const QVariant &context, const QUrl &fileUrl);
+
+private slots:
+
+    void onImageFinished(const QVariant &context, const QString &fileName);
 
 signals: // property notifications
 
@@ -71,6 +139,13 @@ signals: // property notifications
     void transmittingChanged(bool transmitting);
     void authenticatedChanged(bool authenticated);
     void nameChanged(const QString &name);
+    void cachePolicyChanged(CachePolicy cachePolicy);
+    void maximumCacheSizeChanged(int maximumCacheSize);
+    void progressIntervalChanged(int progressInterval);
+    void maximumImageSizeChanged(int maximumImageSize);
+    void imageQualityChanged(int imageQuality);
+    void requestTimeoutChanged(int requestTimeout);
+    void completionStatusChanged(CompletionStatus completionStatus);
 
 signals: // operation notifications
 
@@ -79,6 +154,11 @@ signals: // operation notifications
     void postMessageCompleted(bool success);
     void retrieveMessageCountCompleted(bool success, int count);
     void retrieveMessagesCompleted(bool success, const QVariantList &messages);
+
+signals: // progress notifications
+
+    void transferProgress(const QVariant &requestId, const QVariantMap &progress);
+    void messagesReceived(const QVariantList &messages);
     void error(const QString &errorType, const QString &errorCode, const QString &errorMessage);
     
 private:
@@ -86,10 +166,17 @@ private:
     Q_DISABLE_COPY(SocialConnection)
 
     WebInterface *m_webInterface; // not own
+    ProgressMonitor *m_progressMonitor; // own
+    ImageProcessor *m_imageProcessor; // own
+    MessageModel *m_messageModel; // own
     bool m_busy;
     bool m_transmitting;
     bool m_authenticated;
     QString m_name;
+    CachePolicy m_cachePolicy;
+    int m_requestTimeout;
+    int m_callTimeout; // The timeout of the call in progress, -1 if none.
+    CompletionStatus m_completionStatus;
 };
 
 #endif // SOCIALCONNECTION_H
@@ -0,0 +1,30 @@
+# Copyright (c) 2012-2014 Microsoft Mobile.
+#
+# The transport, parsing and model classes that do not depend on the
+# connections. Included by the plugin and by the branches built from it, so
+# that they are not copied into each branch.
+
+HEADERS += \
+    $$PWD/src/jsonreader.h \
+    $$PWD/src/imageprocessor.h \
+    $$PWD/src/parsequeue.h \
+    $$PWD/src/messagemodel.h \
+    $$PWD/src/jsonprojection.h \
+    $$PWD/src/networktransport.h \
+    $$PWD/src/progressmonitor.h \
+    $$PWD/src/responsecache.h \
+    $$PWD/src/transportreply.h
+
+SOURCES += \
+    $$PWD/src/jsonreader.cpp \
+    $$PWD/src/imageprocessor.cpp \
+    $$PWD/src/parsequeue.cpp \
+    $$PWD/src/messagemodel.cpp \
+    $$PWD/src/jsonprojection.cpp \
+    $$PWD/src/networktransport.cpp \
+    $$PWD/src/progressmonitor.cpp \
+    $$PWD/src/responsecache.cpp \
+    $$PWD/src/transportreply.cpp
+
+# Appended, so that a branch finds its own headers of the same name first.
+INCLUDEPATH += $$PWD/src
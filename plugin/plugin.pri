@@ -1,20 +1,26 @@
 # Copyright (c) 2012-2014 Microsoft Mobile.
 
-QT += declarative network script
+QT += declarative network
 CONFIG += qt plugin
 
 HEADERS += \
     $$PWD/src/socialconnectplugin.h \
     $$PWD/src/socialconnection.h \
-    $$PWD/src/webinterface.h
+    $$PWD/src/webinterface.h \
+    $$PWD/src/jsonrecordsplitter.h \
+    $$PWD/src/multipartdevice.h
 
 SOURCES += \
     $$PWD/src/socialconnectplugin.cpp \
     $$PWD/src/socialconnection.cpp \
-    $$PWD/src/webinterface.cpp
+    $$PWD/src/webinterface.cpp \
+    $$PWD/src/jsonrecordsplitter.cpp \
+    $$PWD/src/multipartdevice.cpp
 
 INCLUDEPATH += $$PWD/src
 
+include($$PWD/common.pri)
+
 # Smoke (base debugging implementation)
 DEFINES += ENABLE_SMOKE_CONNECTION
 HEADERS += $$PWD/src/smoke/smokeconnection.h
@@ -25,6 +31,8 @@ HEADERS += \
     $$PWD/src/facebook/facebookconnection.h \
     $$PWD/src/facebook/facebook.h \
     $$PWD/src/facebook/facebookrequest.h \
+    $$PWD/src/facebook/facebookvideoupload.h \
+    $$PWD/src/facebook/facebookpager.h \
     $$PWD/src/facebook/facebookreply.h \
     $$PWD/src/facebook/facebookdatamanager.h
 
@@ -32,6 +40,8 @@ SOURCES += \
     $$PWD/src/facebook/facebookconnection.cpp \
     $$PWD/src/facebook/facebook.cpp \
     $$PWD/src/facebook/facebookrequest.cpp \
+    $$PWD/src/facebook/facebookvideoupload.cpp \
+    $$PWD/src/facebook/facebookpager.cpp \
     $$PWD/src/facebook/facebookreply.cpp \
     $$PWD/src/facebook/facebookdatamanager.cpp
 
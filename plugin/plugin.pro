@@ -1,22 +1,28 @@
 # Copyright (c) 2012-2014 Microsoft Mobile.
 
 TEMPLATE = lib
-QT += declarative network script
+QT += declarative network
 TARGET = socialconnect
 CONFIG += qt plugin
 
 HEADERS += \
     src/socialconnectplugin.h \
     src/socialconnection.h \
-    src/webinterface.h
+    src/webinterface.h \
+    src/jsonrecordsplitter.h \
+    src/multipartdevice.h
 
 SOURCES += \
     src/socialconnectplugin.cpp \
     src/socialconnection.cpp \
-    src/webinterface.cpp
+    src/webinterface.cpp \
+    src/jsonrecordsplitter.cpp \
+    src/multipartdevice.cpp
 
 INCLUDEPATH += src
 
+include(common.pri)
+
 # Smoke (base debugging implementation)
 DEFINES += ENABLE_SMOKE_CONNECTION
 HEADERS += src/smoke/smokeconnection.h
@@ -27,6 +33,8 @@ HEADERS += \
     src/facebook/facebookconnection.h \
     src/facebook/facebook.h \
     src/facebook/facebookrequest.h \
+    src/facebook/facebookvideoupload.h \
+    src/facebook/facebookpager.h \
     src/facebook/facebookreply.h \
     src/facebook/facebookdatamanager.h
 
@@ -34,6 +42,8 @@ SOURCES += \
     src/facebook/facebookconnection.cpp \
     src/facebook/facebook.cpp \
     src/facebook/facebookrequest.cpp \
+    src/facebook/facebookvideoupload.cpp \
+    src/facebook/facebookpager.cpp \
     src/facebook/facebookreply.cpp \
     src/facebook/facebookdatamanager.cpp
 
@@ -11,17 +11,54 @@
 #include "facebookreply.h"
 #include <QDebug>
 #include <QCoreApplication>
-#include <QNetworkAccessManager>
 #include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QTimer>
+#include <QUrl>
+#include "jsonreader.h"
+#include "networktransport.h"
 
 // Constants
 namespace {
     const char *AccessTokenQueryString = "access_token";
+    const char *BatchQueryString = "batch";
+    const char *GraphUrl = "https://graph.facebook.com/";
+
+    // The Graph API accepts at most this many operations in one batch.
+    const int MaxBatchSize = 50;
+
+    // Parameters carrying files, which cannot be sent in a batch.
+    const char *ImageParameter = "picture";
+    const char *VideoParameter = "video";
     const char *AccessTokenString = "facebook_access_token";
     const char *ExpirationDateTimeString = "facebook_token_expiration";
     const char *ScreenNameString = "screen_name";
 }
 
+// Inline utility functions definitions.
+namespace Util {
+
+    /*!
+     \internal
+
+      Returns true if the JSON error response \a body tells that the request
+      was rate limited.
+    */
+    inline bool isRateLimited(const QByteArray &body)
+    {
+        JsonReader reader(body);
+
+        if (!JsonProjection::findPath(reader, "error.code")) {
+            return false;
+        }
+
+        const int code = reader.value().toInt();
+
+        return code == FacebookReply::OAuthApplicationRateLimit ||
+               code == FacebookReply::OAuthUserRateLimit;
+    }
+} // namespace Util
+
 /*!
   \class Facebook
   \brief The Facebook class is the internal implementation for communicating
@@ -35,8 +72,17 @@ namespace {
 */
 Facebook::Facebook(QObject *parent)
     : QObject(parent),
-      m_networkAccess(new QNetworkAccessManager(this))
+      m_graphUrl(GraphUrl),
+      m_transport(NetworkTransport::instance()),
+      m_batchTimer(new QTimer(this)),
+      m_batchWindow(0),
+      m_batchDepth(0)
 {
+    m_batchTimer->setSingleShot(true);
+    connect(m_batchTimer, SIGNAL(timeout()), this, SLOT(flushBatch()));
+
+    m_batchResponse.addField("code", "code");
+    m_batchResponse.addField("body", "body");
 }
 
 /*!
@@ -46,7 +92,16 @@ Facebook::Facebook(QObject *parent)
 */
 Facebook::~Facebook()
 {
+    // Aborting the replies of the deleted requests must not dispatch them.
+    m_pendingReplies.clear();
     qDeleteAll(m_activeRequests);
+
+    const QList<QNetworkReply *> batchReplies = m_batchReplies.keys();
+    m_batchReplies.clear();
+
+    foreach (QNetworkReply *reply, batchReplies) {
+        reply->abort();
+    }
 }
 
 /*!
@@ -134,15 +189,136 @@ void Facebook::authorize(const QString &accessToken, const int expirationTime)
              << accessToken << "and expiration time:" << m_expirationDateTime;
 }
 
+/*!
+  \internal
+
+  Returns the URL the Graph API requests are sent to.
+*/
+QString Facebook::graphUrl() const
+{
+    return m_graphUrl;
+}
+
+/*!
+  \internal
+
+  Sets the URL the Graph API requests are sent to. Meant for testing against
+  a stand-in server; applies to the requests sent after the call.
+*/
+void Facebook::setGraphUrl(const QString &graphUrl)
+{
+    m_graphUrl = graphUrl;
+}
+
+/*!
+  \internal
+
+  Returns the time in milliseconds requests are collected into a batch.
+*/
+int Facebook::batchWindow() const
+{
+    return m_batchWindow;
+}
+
+/*!
+  \internal
+
+  Sets the time in milliseconds requests are collected into a batch before
+  it is sent. Zero disables the collection outside beginBatch() and
+  endBatch().
+*/
+void Facebook::setBatchWindow(int batchWindow)
+{
+    m_batchWindow = qMax(0, batchWindow);
+
+    if (m_batchWindow == 0 && m_batchDepth == 0) {
+        flushBatch();
+    }
+}
+
+/*!
+  \internal
+
+  Starts collecting the requests into a batch. Calls can be nested.
+*/
+void Facebook::beginBatch()
+{
+    m_batchDepth++;
+    m_batchTimer->stop();
+}
+
+/*!
+  \internal
+
+  Ends collecting the requests started by the matching beginBatch() call.
+  The collected requests are sent when the outermost batch ends.
+*/
+void Facebook::endBatch()
+{
+    if (m_batchDepth == 0) {
+        return;
+    }
+
+    if (--m_batchDepth == 0) {
+        flushBatch();
+    }
+}
+
 /*!
   \internal
 
   Makes a request with graph path, parameters and HTTP method defined.
+  While a batch is being collected, the request is queued and sent later as
+  a part of a batch request. \a cacheLoadControl tells how a GET request
+  uses the response cache; batch requests are never cached. \a timeout is
+  the time in milliseconds the request may take in all before it is
+  aborted, or for an upload of a file, the time it may go without sending
+  or receiving data. 0 for none.
 */
 bool Facebook::request(const QVariant &requestId,
                        const QString &graphPath,
                        const FacebookConnection::HTTPMethod method,
-                       const QVariantMap &parameters)
+                       const QVariantMap &parameters,
+                       const QNetworkRequest::CacheLoadControl cacheLoadControl,
+                       const int timeout)
+{
+    // Requests uploading files are always sent on their own.
+    if ((m_batchDepth > 0 || m_batchWindow > 0) && !graphPath.isEmpty() &&
+        !parameters.contains(ImageParameter) && !parameters.contains(VideoParameter)) {
+        BatchEntry entry;
+        entry.requestId = requestId;
+        entry.graphPath = graphPath;
+        entry.method = method;
+        entry.parameters = parameters;
+        entry.cacheLoadControl = cacheLoadControl;
+        entry.timeout = timeout;
+        m_batchQueue.append(entry);
+        emit requestLoading(requestId);
+
+        if (m_batchQueue.count() >= MaxBatchSize) {
+            flushBatch();
+        }
+        else if (m_batchDepth == 0 && !m_batchTimer->isActive()) {
+            m_batchTimer->start(m_batchWindow);
+        }
+
+        return true;
+    }
+
+    return sendRequest(requestId, graphPath, method, parameters, cacheLoadControl, timeout);
+}
+
+/*!
+  \internal
+
+  Sends a single request.
+*/
+bool Facebook::sendRequest(const QVariant &requestId,
+                           const QString &graphPath,
+                           const FacebookConnection::HTTPMethod method,
+                           const QVariantMap &parameters,
+                           const QNetworkRequest::CacheLoadControl cacheLoadControl,
+                           const int timeout)
 {
     qDebug() << "Facebook::request - Params: " << parameters;
     QVariantMap tempParams(parameters);
@@ -154,25 +330,253 @@ bool Facebook::request(const QVariant &requestId,
     }
 
     FacebookRequest *newRequest = new FacebookRequest(requestId,
-                                                      m_networkAccess,
+                                                      m_transport,
                                                       tempParams,
                                                       method,
                                                       graphPath);
+    newRequest->setGraphUrl(m_graphUrl);
+    newRequest->setCacheLoadControl(cacheLoadControl);
+    newRequest->setTimeout(timeout);
     m_activeRequests.append(newRequest);
     QObject::connect(newRequest, 
 					 SIGNAL(requestFinished(FacebookRequest*, FacebookReply*)),
 					 this, 
                      SLOT(onRequestFinished(FacebookRequest*, FacebookReply*)));
+    connect(newRequest, SIGNAL(dataReceived(FacebookRequest*,QByteArray)),
+            this, SLOT(onRequestDataReceived(FacebookRequest*,QByteArray)));
 
     bool ret = newRequest->executeRequest();
 
     if (ret) {
+        QNetworkReply *networkReply = newRequest->networkReply();
+        m_pendingReplies.insert(networkReply, newRequest);
+        connect(networkReply, SIGNAL(finished()), this, SLOT(onReplyFinished()));
         emit requestLoading(requestId);
+        emit requestStarted(requestId, networkReply);
     }
 
     return ret;
 }
 
+/*!
+  \internal
+
+  Sends the queued requests, at most MaxBatchSize of them in a single batch
+  request. A lone request is sent as it is.
+*/
+void Facebook::flushBatch()
+{
+    m_batchTimer->stop();
+
+    while (!m_batchQueue.isEmpty()) {
+        const QList<BatchEntry> entries = m_batchQueue.mid(0, MaxBatchSize);
+        m_batchQueue = m_batchQueue.mid(entries.count());
+
+        if (entries.count() == 1) {
+            const BatchEntry &entry = entries.first();
+            sendRequest(entry.requestId, entry.graphPath, entry.method, entry.parameters,
+                        entry.cacheLoadControl, entry.timeout);
+        }
+        else {
+            sendBatch(entries);
+        }
+    }
+}
+
+/*!
+  \internal
+
+  Sends \a entries as the operations of a single Graph API batch request.
+  The access token is given once for the whole batch.
+*/
+void Facebook::sendBatch(const QList<BatchEntry> &entries)
+{
+    QByteArray batch("[");
+
+    for (int i = 0; i < entries.count(); i++) {
+        if (i > 0) {
+            batch.append(',');
+        }
+
+        batch.append(batchOperation(entries.at(i)));
+    }
+
+    batch.append(']');
+
+    QUrl body;
+
+    if (!m_accessToken.isEmpty()) {
+        body.addEncodedQueryItem(AccessTokenQueryString,
+                                 QUrl::toPercentEncoding(m_accessToken));
+    }
+
+    body.addEncodedQueryItem(BatchQueryString, QUrl::toPercentEncoding(batch));
+
+    // The batch may take as long as the most patient of its operations,
+    // and without a limit if one of them has none.
+    int timeout = 0;
+    bool unlimited = false;
+
+    foreach (const BatchEntry &entry, entries) {
+        timeout = qMax(timeout, entry.timeout);
+        unlimited = unlimited || entry.timeout <= 0;
+    }
+
+    QNetworkRequest request((QUrl(m_graphUrl)));
+    request.setHeader(QNetworkRequest::ContentTypeHeader,
+                      "application/x-www-form-urlencoded");
+    request.setAttribute(QNetworkRequest::Attribute(NetworkTransport::DeadlineAttribute),
+                         unlimited ? 0 : timeout);
+    qDebug() << "Facebook::sendBatch - Operations:" << entries.count();
+
+    QNetworkReply *reply = m_transport->post(request, body.encodedQuery());
+    m_batchReplies.insert(reply, entries);
+    connect(reply, SIGNAL(finished()), this, SLOT(onReplyFinished()));
+
+    foreach (const BatchEntry &entry, entries) {
+        emit requestStarted(entry.requestId, reply);
+    }
+}
+
+/*!
+  \internal
+
+  Returns the JSON description of \a entry as a batch operation. The URL and
+  the body are percent-encoded, so they need no escaping in the JSON strings.
+*/
+QByteArray Facebook::batchOperation(const BatchEntry &entry) const
+{
+    QUrl relativeUrl;
+    relativeUrl.setPath(entry.graphPath);
+    QUrl body;
+
+    QMapIterator<QString, QVariant> i(entry.parameters);
+
+    while (i.hasNext()) {
+        i.next();
+        const QByteArray key = QUrl::toPercentEncoding(i.key());
+        const QByteArray value = QUrl::toPercentEncoding(i.value().toString());
+
+        if (entry.method == FacebookConnection::HTTPPost) {
+            body.addEncodedQueryItem(key, value);
+        }
+        else {
+            relativeUrl.addEncodedQueryItem(key, value);
+        }
+    }
+
+    QByteArray operation("{\"method\":\"");
+
+    switch (entry.method) {
+    case FacebookConnection::HTTPPost:
+        operation.append("POST");
+        break;
+    case FacebookConnection::HTTPDelete:
+        operation.append("DELETE");
+        break;
+    default:
+        operation.append("GET");
+        break;
+    }
+
+    operation.append("\",\"relative_url\":\"");
+    operation.append(relativeUrl.toEncoded());
+    operation.append('"');
+
+    if (!body.encodedQuery().isEmpty()) {
+        operation.append(",\"body\":\"");
+        operation.append(body.encodedQuery());
+        operation.append('"');
+    }
+
+    operation.append('}');
+
+    return operation;
+}
+
+/*!
+  \internal
+
+  Fans the responses of a finished batch \a reply out to the requests in
+  \a entries. The responses are in the order of the operations; an
+  operation Facebook could not complete has a null response.
+
+  The transport only sees the batch request, which succeeds even if some of
+  its operations were rate limited. Such an operation is sent again on its
+  own, so that the transport retries it with a backoff like any other
+  request.
+*/
+void Facebook::onBatchFinished(QNetworkReply *reply, const QList<BatchEntry> &entries)
+{
+    const QByteArray result = reply->readAll();
+    int index = 0;
+
+    if (reply->error() == QNetworkReply::NoError) {
+        JsonReader reader(result);
+
+        if (reader.readNext() == JsonReader::BeginArray) {
+            while (index < entries.count() && reader.readNext() != JsonReader::EndArray &&
+                   !reader.hasError()) {
+                const BatchEntry &entry = entries.at(index++);
+                QVariantMap response;
+
+                if (!m_batchResponse.project(reader, &response)) {
+                    emit requestFailed(entry.requestId, "Facebook error. Operation not completed.");
+                    continue;
+                }
+
+                const int code = response.value("code").toInt();
+                const QByteArray body = response.value("body").toString().toUtf8();
+
+                if (code >= 200 && code < 300) {
+                    emit requestCompleted(entry.requestId, body);
+                }
+                else if (Util::isRateLimited(body)) {
+                    qDebug() << "Facebook::onBatchFinished - Operation rate limited, sending alone";
+                    sendRequest(entry.requestId, entry.graphPath, entry.method, entry.parameters,
+                                entry.cacheLoadControl, entry.timeout);
+                }
+                else {
+                    failBatchEntry(entry, body, QString("Facebook error. HTTP status %1.").arg(code));
+                }
+            }
+        }
+    }
+
+    // The whole batch has failed, or the response is missing operations.
+    while (index < entries.count()) {
+        failBatchEntry(entries.at(index++), result, reply->error() != QNetworkReply::NoError
+                       ? reply->errorString() : QString("Facebook error. Invalid batch response."));
+    }
+}
+
+/*!
+  \internal
+
+  Reports the failure of a batched request. The error in the JSON response
+  \a body is used if present, otherwise \a reason.
+*/
+void Facebook::failBatchEntry(const BatchEntry &entry, const QByteArray &body, const QString &reason)
+{
+    QString errorString(reason);
+    JsonReader reader(body);
+
+    if (JsonProjection::findPath(reader, "error")) {
+        const QVariantMap error = reader.readCurrent().toMap();
+
+        if (error.value("code").toInt() == FacebookReply::OAuthAuthError) {
+            qDebug() << "Error. Authentication needed.";
+            emit authorizedChanged(false);
+        }
+
+        if (error.contains("message")) {
+            errorString = error.value("message").toString();
+        }
+    }
+
+    emit requestFailed(entry.requestId, errorString);
+}
+
 /*!
   \internal
 
@@ -203,6 +607,44 @@ void Facebook::onRequestFinished(FacebookRequest *request, FacebookReply *reply)
     reply->deleteLater();
 }
 
+/*!
+  \internal
+
+  Passes on a part of the response of \a request as it arrives. The
+  responses of a batch are only fanned out once it has finished.
+*/
+void Facebook::onRequestDataReceived(FacebookRequest *request, const QByteArray &data)
+{
+    emit requestDataReceived(request->requestId(), data);
+}
+
+/*!
+  \internal
+
+  Dispatches a finished network reply to the request that started it.
+*/
+void Facebook::onReplyFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+
+    if (!reply) {
+        return;
+    }
+
+    if (m_batchReplies.contains(reply)) {
+        onBatchFinished(reply, m_batchReplies.take(reply));
+    }
+    else {
+        FacebookRequest *request = m_pendingReplies.take(reply);
+
+        if (request) {
+            request->onFinished(reply);
+        }
+    }
+
+    reply->deleteLater();
+}
+
 /*!
   \internal
 
@@ -291,12 +733,24 @@ bool Facebook::restoreCredentials()
 /*!
   \internal
 
-  Cancels all ongoing Facebook requests.
+  Cancels all ongoing Facebook requests, including the batched ones.
 */
 void Facebook::cancelRequests()
 {
     foreach (FacebookRequest *request, m_activeRequests) {
         request->cancelRequest();
     }
+
+    foreach (QNetworkReply *reply, m_batchReplies.keys()) {
+        reply->abort();
+    }
+
+    const QList<BatchEntry> queued = m_batchQueue;
+    m_batchQueue.clear();
+    m_batchTimer->stop();
+
+    foreach (const BatchEntry &entry, queued) {
+        emit requestFailed(entry.requestId, "Operation canceled");
+    }
 }
 
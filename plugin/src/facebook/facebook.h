@@ -13,13 +13,17 @@
 #include <QDateTime>
 #include <QSettings>
 #include <QStringList>
+#include <QHash>
+#include <QNetworkRequest>
 #include "facebookconnection.h"
+#include "jsonprojection.h"
 
 // Forward declarations
 class FacebookRequest;
 class FacebookReply;
 class QNetworkReply;
-class QNetworkAccessManager;
+class NetworkTransport;
+class QTimer;
 
 class Facebook : public QObject
 {
@@ -45,6 +49,12 @@ public:
 
     bool isAuthorized();
 
+    int batchWindow() const;
+    void setBatchWindow(int batchWindow);
+
+    QString graphUrl() const;
+    void setGraphUrl(const QString &graphUrl);
+
 public:
 
     void authorize(const QString &accessToken, const int expirationTime);
@@ -52,7 +62,10 @@ public:
     bool request(const QVariant &requestId,
                  const QString &graphPath,
                  const FacebookConnection::HTTPMethod method,
-                 const QVariantMap &parameters);
+                 const QVariantMap &parameters,
+                 const QNetworkRequest::CacheLoadControl cacheLoadControl =
+                     QNetworkRequest::PreferNetwork,
+                 const int timeout = 0);
 
     bool removeCredentials();
 
@@ -62,9 +75,38 @@ public:
 
     void cancelRequests();
 
+    void beginBatch();
+    void endBatch();
+
 private slots:
 
     void onRequestFinished(FacebookRequest *request, FacebookReply *reply);
+    void onRequestDataReceived(FacebookRequest *request, const QByteArray &data);
+    void onReplyFinished();
+    void flushBatch();
+
+private:
+
+    // A request waiting to be sent as a part of a batch.
+    struct BatchEntry {
+        QVariant requestId;
+        QString graphPath;
+        FacebookConnection::HTTPMethod method;
+        QVariantMap parameters;
+        QNetworkRequest::CacheLoadControl cacheLoadControl;
+        int timeout;
+    };
+
+    bool sendRequest(const QVariant &requestId,
+                     const QString &graphPath,
+                     const FacebookConnection::HTTPMethod method,
+                     const QVariantMap &parameters,
+                     const QNetworkRequest::CacheLoadControl cacheLoadControl,
+                     const int timeout);
+    void sendBatch(const QList<BatchEntry> &entries);
+    QByteArray batchOperation(const BatchEntry &entry) const;
+    void onBatchFinished(QNetworkReply *reply, const QList<BatchEntry> &entries);
+    void failBatchEntry(const BatchEntry &entry, const QByteArray &body, const QString &reason);
 
 signals:
 
@@ -103,13 +145,33 @@ signals:
      */
     void requestLoading(const QVariant &requestId);
 
+    /*!
+       \internal
+     */
+    void requestStarted(const QVariant &requestId, QNetworkReply *reply);
+
+    /*!
+       \internal
+     */
+    void requestDataReceived(const QVariant &requestId, const QByteArray &data);
+
 private: // Data
+    friend class tst_Facebook;
+
     QString m_clientId;
     QString m_screenName;
     QString m_accessToken;
-    QNetworkAccessManager *m_networkAccess; // Not owned.
+    QString m_graphUrl;
+    NetworkTransport *m_transport; // Not owned.
     QDateTime m_expirationDateTime;
     QList<FacebookRequest *> m_activeRequests;
+    QHash<QNetworkReply *, FacebookRequest *> m_pendingReplies;
+    QTimer *m_batchTimer; // Owned.
+    int m_batchWindow;
+    int m_batchDepth;
+    QList<BatchEntry> m_batchQueue;
+    QHash<QNetworkReply *, QList<BatchEntry> > m_batchReplies;
+    JsonProjection m_batchResponse;
 };
 
 #endif // FACEBOOK_H
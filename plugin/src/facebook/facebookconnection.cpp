@@ -3,19 +3,31 @@
  */
 
 #include <QtCore/QDebug>
+#include <QtCore/QtConcurrentRun>
 #include <QDateTime>
-#include <QtScript/QScriptEngine>
-#include <QtScript/QScriptValueIterator>
 #include "facebook.h"
 #include "facebookconnection.h"
 #include "facebookdatamanager.h"
+#include "facebookpager.h"
 #include "facebookrequest.h"
+#include "facebookvideoupload.h"
+#include "messagemodel.h"
+#include "parsequeue.h"
 #include "webinterface.h"
 
 /*!
     \class FacebookConnection
 
     FacebookConnection is an interface to Facebook.
+
+    Unlike the generic \c SocialConnection contract, FacebookConnection does
+    not require an operation to complete before the next one is requested.
+    Any number of operations can be in flight at the same time; \c busy and
+    \c transmitting stay true until all of them have completed.
+
+    A GET request identical to one already in flight is not sent again. It
+    waits for the reply of the earlier request, and both complete with the
+    same result.
  */
 
 /*!
@@ -51,6 +63,88 @@
     {Facebook permissions documentation} for further details.
 */
 
+/*!
+    \property FacebookConnection::batchWindow
+
+    This property holds the time in milliseconds requests are collected
+    before they are sent together as a single Graph API batch request. Up to
+    50 requests are combined into one HTTP round trip, and the response of
+    each of them is delivered with its own completion signal as usual.
+    Requests uploading a picture or a video are never batched.
+
+    The default value is 0, meaning that requests are batched only between
+    beginBatch() and endBatch().
+
+    See \l {https://developers.facebook.com/docs/graph-api/making-multiple-requests/}
+    {Facebook batch request documentation} for further details.
+*/
+
+/*!
+    \property FacebookConnection::videoChunkSize
+
+    This property holds the largest number of bytes uploadVideo() sends in
+    one request. A failed chunk is sent again, so a smaller chunk wastes
+    less of a slow or unreliable uplink. The server may ask for smaller
+    chunks. The default value is 4 MB; the smallest accepted value is 64 kB.
+*/
+
+/*!
+    \property FacebookConnection::videoUploadUrl
+
+    This property holds the URL uploadVideo() posts to. The default value is
+    https://graph-video.facebook.com/me/videos. Set it to upload to a page
+    or to a local server standing in for Facebook.
+*/
+
+/*!
+    \property FacebookConnection::prefetchPages
+
+    This property holds whether the next page of a paginated request started
+    with requestPages() is retrieved as soon as the previous page has been
+    received. The page is then delivered right away when requestNextPage()
+    is called, while the application is still consuming the previous one.
+    The default value is false.
+*/
+
+/*!
+    \property FacebookConnection::messageCount
+
+    This property holds the number of messages counted by the last
+    retrieveMessageCount(), or -1 if they have not been counted. Messages
+    newer than the count that are received with retrieveMessages() are
+    added to it, so it stays current without counting the messages again.
+    With a \c cachePolicy of PreferCache or AlwaysCache,
+    retrieveMessageCount() completes with this count once it is known.
+*/
+
+/*!
+    \fn void FacebookConnection::pageReceived(bool success, const QVariant &requestId,
+    const QVariantList &items, bool more)
+
+    A page of the paginated request \a requestId started with requestPages()
+    has been received. Success of the operation is indicated by \a success.
+    \a items holds the elements of the \c data array of the page. If
+    \a more is true, the next page can be requested with requestNextPage();
+    otherwise the request has been completed.
+ */
+
+/*!
+    \fn void FacebookConnection::uploadVideoCompleted(bool success, const QString &videoId,
+    const QString &errorMessage)
+
+    The video upload started with uploadVideo() has been completed. Success
+    of the operation is indicated by \a success. If the video was published,
+    \a videoId is the id of the video; otherwise \a errorMessage tells why
+    the upload failed.
+ */
+
+/*!
+    \fn void FacebookConnection::videoUploadProgress(qreal bytesSent, qreal bytesTotal)
+
+    Emitted while uploadVideo() is in progress. \a bytesSent of the
+    \a bytesTotal bytes of the video file have been sent.
+ */
+
 /*!
     \fn void FacebookConnection::requestCompleted(bool success, const QVariant &requestId,
     const QVariant &result)
@@ -88,6 +182,11 @@ namespace {
     const char *AccessTokenStr = "access_token";
     const char *ExpiresInStr = "expires_in";
     const char *ErrorStr = "error";
+    const char *UrlStr = "url";
+
+    // The seconds a message count is used with PreferCache before the
+    // messages are counted again.
+    const int MessageCountMaxAge = 300;
 } // Constants
 
 /*!
@@ -97,12 +196,21 @@ FacebookConnection::FacebookConnection(QObject *parent) :
     SocialConnection(parent),
     m_facebook(new Facebook(this)),
     m_manager(new FacebookDataManager(this)),
-    m_apiCall(Undefined)
+    m_videoUpload(new FacebookVideoUpload(this)),
+    m_parseQueue(new ParseQueue(this)),
+    m_streamParseQueue(new ParseQueue(this)),
+    m_nextTicket(0),
+    m_authenticating(false),
+    m_prefetchPages(false)
 {
     connect(m_facebook, SIGNAL(requestCompleted(QVariant,QByteArray)),
             this, SLOT(onRequestCompleted(QVariant,QByteArray)));
     connect(m_facebook, SIGNAL(requestFailed(QVariant,QString)),
             this, SLOT(onRequestFailed(QVariant,QString)));
+    connect(m_facebook, SIGNAL(requestStarted(QVariant,QNetworkReply*)),
+            this, SLOT(onRequestStarted(QVariant,QNetworkReply*)));
+    connect(m_facebook, SIGNAL(requestDataReceived(QVariant,QByteArray)),
+            this, SLOT(onRequestDataReceived(QVariant,QByteArray)));
     connect(m_facebook, SIGNAL(clientIdChanged(QString)),
             this, SIGNAL(clientIdChanged(QString)));
     connect(m_facebook, SIGNAL(accessTokenChanged(QString)),
@@ -111,6 +219,32 @@ FacebookConnection::FacebookConnection(QObject *parent) :
             this, SLOT(onAuthenticationChanged(bool)));
     connect(m_facebook, SIGNAL(screenNameChanged(QString)),
             this, SLOT(onNameChanged(QString)));
+    connect(m_videoUpload, SIGNAL(progress(qint64,qint64)),
+            this, SLOT(onVideoUploadProgress(qint64,qint64)));
+    connect(m_videoUpload, SIGNAL(finished(bool,QString,QString)),
+            this, SLOT(onVideoUploadFinished(bool,QString,QString)));
+    connect(m_videoUpload, SIGNAL(requestStarted(QNetworkReply*)),
+            this, SLOT(onVideoUploadStarted(QNetworkReply*)));
+    connect(m_parseQueue, SIGNAL(finished(QVariant,QVariantList)),
+            this, SLOT(onReplyParsed(QVariant,QVariantList)));
+    connect(m_streamParseQueue, SIGNAL(finished(QVariant,QVariantList)),
+            this, SLOT(onPostRecordsParsed(QVariant,QVariantList)));
+
+    // The retrieved posts kept for the views. The link of a post is the
+    // href of its attachment, projected as "url"; posts have no user name.
+    messageModel()->setRoleKey(MessageModel::UrlRole, UrlStr);
+    messageModel()->setRoleKey(MessageModel::UserNameRole, QString());
+}
+
+/*!
+    Destructor
+ */
+FacebookConnection::~FacebookConnection()
+{
+    // The posts may still be parsed with the data manager.
+    delete m_parseQueue;
+    delete m_streamParseQueue;
+    qDeleteAll(m_pagers);
 }
 
 // Property accessors
@@ -148,6 +282,63 @@ void FacebookConnection::setPermissions(const QStringList &permissions)
     }
 }
 
+int FacebookConnection::batchWindow() const
+{
+    return m_facebook->batchWindow();
+}
+
+void FacebookConnection::setBatchWindow(int batchWindow)
+{
+    if (m_facebook->batchWindow() != batchWindow) {
+        m_facebook->setBatchWindow(batchWindow);
+        emit batchWindowChanged(m_facebook->batchWindow());
+    }
+}
+
+int FacebookConnection::videoChunkSize() const
+{
+    return m_videoUpload->chunkSize();
+}
+
+void FacebookConnection::setVideoChunkSize(int videoChunkSize)
+{
+    if (m_videoUpload->chunkSize() != videoChunkSize) {
+        m_videoUpload->setChunkSize(videoChunkSize);
+        emit videoChunkSizeChanged(m_videoUpload->chunkSize());
+    }
+}
+
+QString FacebookConnection::videoUploadUrl() const
+{
+    return m_videoUpload->graphVideoUrl();
+}
+
+void FacebookConnection::setVideoUploadUrl(const QString &videoUploadUrl)
+{
+    if (m_videoUpload->graphVideoUrl() != videoUploadUrl) {
+        m_videoUpload->setGraphVideoUrl(videoUploadUrl);
+        emit videoUploadUrlChanged(videoUploadUrl);
+    }
+}
+
+bool FacebookConnection::prefetchPages() const
+{
+    return m_prefetchPages;
+}
+
+void FacebookConnection::setPrefetchPages(bool prefetchPages)
+{
+    if (m_prefetchPages != prefetchPages) {
+        m_prefetchPages = prefetchPages;
+        emit prefetchPagesChanged(prefetchPages);
+    }
+}
+
+int FacebookConnection::messageCount() const
+{
+    return m_manager->postCount();
+}
+
 // Common operations
 
 /*!
@@ -165,14 +356,13 @@ bool FacebookConnection::authenticate()
 {
     bool ret = m_facebook->isAuthorized();
 
-    if (!busy() && !ret) {
-        m_apiCall = Authenticate;
-
+    if (!m_authenticating && !ret) {
         WebInterface *webInterface = qobject_cast<WebInterface*>(SocialConnection::webInterface());
 
         if (webInterface) {
             webInterface->setActive(true);
-            setBusy(true);
+            m_authenticating = true;
+            updateActivity();
             setAccessToken("");
             setAuthenticated(false);
 
@@ -192,6 +382,7 @@ bool FacebookConnection::authenticate()
     }
     else if (ret){
         setAuthenticated(true);
+        setCompletionStatus(Succeeded);
         QMetaObject::invokeMethod(this, "authenticateCompleted", Qt::QueuedConnection, Q_ARG(bool, true));
     }
 
@@ -208,7 +399,13 @@ bool FacebookConnection::authenticate()
 */
 bool FacebookConnection::deauthenticate()
 {
+    if (m_manager->postCount() >= 0) {
+        m_manager->resetPostCount();
+        emit messageCountChanged(-1);
+    }
+
     setAuthenticated(false);
+    setCompletionStatus(Succeeded);
     QMetaObject::invokeMethod(this, "deauthenticateCompleted", Qt::QueuedConnection, Q_ARG(bool, true));
 
     return true;
@@ -243,6 +440,9 @@ bool FacebookConnection::deauthenticate()
         \li "url" (mandatory) : "file:///path/to/your/picture.png"
         \li "description" (n/a)
     \endlist
+
+    A picture larger than \c maximumImageSize is scaled down before it is
+    uploaded.
 */
 bool FacebookConnection::postMessage(const QVariantMap &message)
 {    
@@ -273,9 +473,13 @@ bool FacebookConnection::postMessage(const QVariantMap &message)
         return false;
     }
 
-    m_apiCall = PostMessage;
+    // The picture is uploaded once it has been scaled down.
+    if (graphPath == "me/photos" && processImage(parameters.value("picture").toUrl(), parameters)) {
+        updateActivity();
+        return true;
+    }
 
-    return doRequest("", graphPath, HTTPPost, parameters);
+    return doRequest(PostMessage, "", graphPath, HTTPPost, parameters);
 }
 
 /*!
@@ -284,6 +488,12 @@ bool FacebookConnection::postMessage(const QVariantMap &message)
     Retrieves the amount of retrievable messages from Facebook. Message count is
     limited to 2000 messages at maximum.
 
+    The count is kept current with the messages retrieved later, but the
+    messages deleted meanwhile are not noticed. With \c AlwaysCache, the
+    operation completes with \c messageCount once the messages have been
+    counted. With \c PreferCache, it does so only for five minutes after the
+    messages were counted, and counts them again after that.
+
     Returns true if the operation was successfully started and there will be a
     retrieveMessageCountCompleted() signal emitted later; otherwise returns false.
 */
@@ -293,7 +503,15 @@ bool FacebookConnection::retrieveMessageCount()
         return false;
     }
 
-    m_apiCall = RetrieveMessageCount;
+    const int age = m_manager->postCountAge();
+
+    if (age >= 0 && (cachePolicy() == AlwaysCache ||
+                     (cachePolicy() == PreferCache && age <= MessageCountMaxAge))) {
+        setCompletionStatus(Succeeded);
+        QMetaObject::invokeMethod(this, "retrieveMessageCountCompleted", Qt::QueuedConnection,
+                                  Q_ARG(bool, true), Q_ARG(int, m_manager->postCount()));
+        return true;
+    }
 
     return getMessageCount();
 }
@@ -316,29 +534,76 @@ bool FacebookConnection::retrieveMessages(const QString &from, const QString &to
         return false;
     }
 
-    m_apiCall = RetrieveMessages;
-
     return getMessagesOnline(from, to, max);
 }
 
 /*!
     \fn void FacebookConnection::cancel()
 
-    Attempts to cancel the currently active request. The result of the operation
-    success, failure (one reason of which may be the cancellation) is available
-    in the completion signal of the operation in question.
+    Attempts to cancel all the currently active requests. The result of each
+    operation success, failure (one reason of which may be the cancellation) is
+    available in the completion signal of the operation in question.
 */
 void FacebookConnection::cancel()
 {
-    if (m_apiCall == Authenticate) {
+    if (m_authenticating) {
+        setCompletionStatus(Canceled);
         QMetaObject::invokeMethod(this, "authenticateCompleted", Qt::QueuedConnection, Q_ARG(bool, false));
-        setBusy(false);
-        setTransmitting(false);
+        m_authenticating = false;
         setWebInterfaceActive(false);
-        m_apiCall = Undefined;
+        updateActivity();
     }
-    else {
-        m_facebook->cancelRequests();
+
+    m_facebook->cancelRequests();
+    m_videoUpload->cancel();
+    cancelImageProcessing();
+
+    // The replies still being parsed are dropped, and their calls fail.
+    const QVariantList parsing = m_parseQueue->cancel();
+    QList<int> streamCalls;
+
+    foreach (const QVariant &context, m_streamParseQueue->cancel()) {
+        streamCalls.append(m_postStreams.take(context.toList().at(0).toInt()).callCount);
+    }
+
+    if (!parsing.isEmpty() || !streamCalls.isEmpty()) {
+        updateActivity();
+        setCompletionStatus(Canceled);
+    }
+
+    // A stream whose reply is still being read fails with the reply.
+    foreach (int callCount, streamCalls) {
+        for (int i = callCount; i > 0; i--) {
+            emit retrieveMessagesCompleted(false, QVariantList());
+        }
+    }
+
+    foreach (const QVariant &context, parsing) {
+        const QVariantList parsed = context.toList();
+
+        if (parsed.at(0).toInt() == RetrieveMessages) {
+            for (int i = parsed.at(1).toInt(); i > 0; i--) {
+                emit retrieveMessagesCompleted(false, QVariantList());
+            }
+        }
+        else {
+            foreach (const QVariant &requestId, parsed.at(1).toList()) {
+                handlePageFailure(requestId);
+            }
+        }
+    }
+
+    // A page being requested completes with its own failure, and a page
+    // asked for but not yet delivered fails when it is delivered.
+    foreach (const QString &key, m_pagers.keys()) {
+        FacebookPager *pager = m_pagers.value(key);
+
+        if (pager->isRequested()) {
+            pager->setFailed(true);
+        }
+        else if (!pager->isFetching()) {
+            delete m_pagers.take(key);
+        }
     }
 }
 
@@ -432,6 +697,9 @@ bool FacebookConnection::request(const QVariant &requestId,
     See \l {https://developers.facebook.com/docs/reference/api/} {Facebook Graph API
     documentation} for further details.
 
+    Any number of requests can be in flight at the same time, each of them
+    completing with its own requestCompleted() signal.
+
     Returns true if the request was successfully sent; otherwise returns false.
 */
 bool FacebookConnection::request(const QVariant &requestId,
@@ -439,9 +707,158 @@ bool FacebookConnection::request(const QVariant &requestId,
                                  const HTTPMethod method,
                                  const QVariantMap &parameters)
 {
-    m_apiCall = CustomRequest;
+    return doRequest(CustomRequest, requestId, graphPath, method, parameters);
+}
+
+/*!
+    \fn bool FacebookConnection::requestPages(const QVariant &requestId,
+    const QString &graphPath, const QVariantMap &parameters, int maxItems)
+
+    Requests the first page of the Graph API edge \a graphPath, such as
+    me/feed, with optional \a parameters. The page is delivered with
+    pageReceived(), and the following pages are requested with
+    requestNextPage(), which follows the \c paging.next cursor of the
+    previous page.
+
+    The request is completed once \a maxItems items have been received, or
+    when Facebook has no more pages. A value of 0 means no limit. Giving the
+    \c since and \c until parameters as Unix times limits the items to that
+    range of \c created_time.
+
+    \a requestId identifies the request until it has been completed; only
+    one paginated request with the same id can be in progress at a time.
+
+    Returns true if the request was successfully sent; otherwise returns false.
+*/
+bool FacebookConnection::requestPages(const QVariant &requestId,
+                                      const QString &graphPath,
+                                      const QVariantMap &parameters,
+                                      int maxItems)
+{
+    const QString key = requestId.toString();
 
-    return doRequest(requestId, graphPath, method, parameters);
+    if (m_pagers.contains(key)) {
+        qWarning() << "FacebookConnection::requestPages - Request already in progress:" << key;
+        return false;
+    }
+
+    FacebookPager *pager = new FacebookPager(graphPath, parameters, maxItems);
+    pager->setRequested(true);
+
+    if (!fetchPage(requestId, pager)) {
+        delete pager;
+        return false;
+    }
+
+    m_pagers.insert(key, pager);
+    return true;
+}
+
+/*!
+    \fn bool FacebookConnection::requestNextPage(const QVariant &requestId)
+
+    Requests the next page of the paginated request \a requestId started
+    with requestPages(). The page is delivered with pageReceived(); if
+    \c prefetchPages is true, it may already have been received.
+
+    Returns true if there will be a pageReceived() signal emitted later;
+    otherwise, for example if the request has already been completed,
+    returns false.
+*/
+bool FacebookConnection::requestNextPage(const QVariant &requestId)
+{
+    const QString key = requestId.toString();
+    FacebookPager *pager = m_pagers.value(key);
+
+    if (!pager || pager->isRequested()) {
+        return false;
+    }
+
+    pager->setRequested(true);
+
+    if (pager->hasPrefetched() || pager->hasFailed()) {
+        QMetaObject::invokeMethod(this, "deliverPage", Qt::QueuedConnection,
+                                  Q_ARG(QVariant, requestId));
+    }
+    else if (!pager->isFetching() && !fetchPage(requestId, pager)) {
+        delete m_pagers.take(key);
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+    \fn void FacebookConnection::beginBatch()
+
+    Starts collecting the following requests into a batch. The requests are
+    sent as Graph API batch requests when the matching endBatch() is called.
+    Calls can be nested, in which case the requests are sent when the
+    outermost batch ends.
+*/
+void FacebookConnection::beginBatch()
+{
+    m_facebook->beginBatch();
+}
+
+/*!
+    \fn void FacebookConnection::endBatch()
+
+    Ends the batch started with beginBatch() and sends the collected
+    requests.
+*/
+void FacebookConnection::endBatch()
+{
+    m_facebook->endBatch();
+}
+
+/*!
+    \fn bool FacebookConnection::uploadVideo(const QUrl &fileUrl)
+
+    Convenience method for FacebookConnection::uploadVideo(const QUrl &fileUrl,
+    const QVariantMap &parameters)
+
+    Returns true if the upload was successfully started; otherwise returns false.
+*/
+bool FacebookConnection::uploadVideo(const QUrl &fileUrl)
+{
+    return uploadVideo(fileUrl, QVariantMap());
+}
+
+/*!
+    \fn bool FacebookConnection::uploadVideo(const QUrl &fileUrl,
+    const QVariantMap &parameters)
+
+    Uploads the local video file \a fileUrl in chunks of videoChunkSize
+    bytes. Optional \a parameters, such as \c title and \c description, are
+    published with the video. Progress is reported with
+    videoUploadProgress() and the result with uploadVideoCompleted().
+
+    A chunk that fails is sent again a few times. If the upload still fails
+    or is canceled, calling uploadVideo() later with the same unmodified
+    file continues from the last chunk the server received, also after the
+    application has been restarted.
+
+    See \l {https://developers.facebook.com/docs/graph-api/video-uploads/}
+    {Facebook video upload documentation} for further details.
+
+    Only one video upload can be in progress at a time. Returns true if the
+    upload was successfully started; otherwise returns false.
+*/
+bool FacebookConnection::uploadVideo(const QUrl &fileUrl, const QVariantMap &parameters)
+{
+    if (!sessionValidated()) {
+        return false;
+    }
+
+    m_videoUpload->setTimeout(callTimeout());
+
+    if (!m_videoUpload->start(m_facebook->accessToken(), fileUrl.toLocalFile(), parameters)) {
+        return false;
+    }
+
+    updateActivity();
+    return true;
 }
 
 // Internal implementation methods
@@ -450,7 +867,7 @@ void FacebookConnection::onUrlChanged(const QUrl &url)
 {
     SocialConnection::onUrlChanged(url);
 
-    if (m_apiCall == Authenticate) {
+    if (m_authenticating) {
         // TODO: check that active, transimmiting and busy properties are true through
         // the whole authentication - getscreenname process.
 
@@ -467,99 +884,651 @@ void FacebookConnection::onNameChanged(const QString &name)
 
 void FacebookConnection::onRequestCompleted(const QVariant &requestId, const QByteArray &result)
 {
-    Q_UNUSED(requestId)
+    const QList<PendingCall> calls = takeCalls(requestId);
+    const int ticket = requestId.toInt();
 
-    setBusy(false);
-    setTransmitting(false);
+    if (calls.isEmpty()) {
+        m_postStreams.remove(ticket);
+        return;
+    }
 
-    APICall c = m_apiCall;
-    m_apiCall = Undefined;
+    // Coalesced calls are of the same kind, so the result is parsed once.
+    // The posts are being parsed as they arrived if the whole "data" array
+    // was read, and the calls are completed once the last batch has been
+    // parsed. Otherwise the whole reply is parsed on a worker thread and the
+    // calls are completed in onPostsParsed().
+    if (calls.first().apiCall == RetrieveMessages &&
+        m_postStreams.value(ticket).splitter.isComplete()) {
+        m_postStreams[ticket].callCount = calls.count();
+
+        if (m_postStreams.value(ticket).pendingBatches == 0) {
+            completePostStream(ticket);
+        }
+        else {
+            updateActivity();
+        }
 
-    switch (c) {
-    case PostMessage:
-        emit postMessageCompleted(true);
-        break;
-    case RetrieveMessages:
-        m_manager->handleRetrievedMessages(result);
-        emit retrieveMessagesCompleted(true, m_manager->posts());
-        break;
+        return;
+    }
+
+    m_postStreams.remove(ticket);
+
+    if (calls.first().apiCall == RetrieveMessages) {
+        m_parseQueue->enqueue(QtConcurrent::run(m_manager, &FacebookDataManager::parsePosts,
+                                                result),
+                              QVariantList() << RetrieveMessages << calls.count());
+        updateActivity();
+        return;
+    }
+
+    // A page is parsed on a worker thread too, and delivered to the pagers
+    // of the calls in onReplyParsed().
+    if (calls.first().apiCall == PagedRequest) {
+        QVariantList requestIds;
+
+        foreach (const PendingCall &call, calls) {
+            requestIds.append(call.requestId);
+        }
+
+        m_parseQueue->enqueue(QtConcurrent::run(&FacebookPager::parsePage, result),
+                              QVariantList() << PagedRequest << QVariant(requestIds));
+        updateActivity();
+        return;
+    }
+
+    updateActivity();
+    setCompletionStatus(Succeeded);
+
+    switch (calls.first().apiCall) {
     case RetrieveMessageCount:
         m_manager->handleRetrieveMessageCount(result);
-        emit retrieveMessageCountCompleted(true, m_manager->postCount());
-        break;
-    case GetScreenName:
-        // At this point web interface is not needed anymore.
-        setWebInterfaceActive(false);
-        // After getting the screen name authentication is completed.
-        m_facebook->setScreenName(m_manager->handleScreenName(result));
-        setAuthenticated(true);
-        emit authenticateCompleted(true);
-        break;
-    case CustomRequest:
-        emit requestCompleted(true, requestId, result);
+        emit messageCountChanged(m_manager->postCount());
         break;
     default:
         break;
     }
+
+    foreach (const PendingCall &call, calls) {
+        switch (call.apiCall) {
+        case PostMessage:
+            emit postMessageCompleted(true);
+            break;
+        case RetrieveMessageCount:
+            emit retrieveMessageCountCompleted(true, m_manager->postCount());
+            break;
+        case GetScreenName:
+            // At this point web interface is not needed anymore.
+            setWebInterfaceActive(false);
+            // After getting the screen name authentication is completed.
+            m_facebook->setScreenName(m_manager->handleScreenName(result));
+            setAuthenticated(true);
+            emit authenticateCompleted(true);
+            break;
+        case CustomRequest:
+            emit requestCompleted(true, call.requestId, result);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/*!
+    \internal
+
+    Completes the calls of a reply parsed on a worker thread: the posts of
+    retrieveMessages calls, or a page of paginated requests.
+*/
+void FacebookConnection::onReplyParsed(const QVariant &context, const QVariantList &result)
+{
+    const QVariantList parsed = context.toList();
+
+    if (parsed.at(0).toInt() == RetrieveMessages) {
+        onPostsParsed(parsed.at(1).toInt(), result);
+        return;
+    }
+
+    updateActivity();
+    setCompletionStatus(Succeeded);
+
+    foreach (const QVariant &requestId, parsed.at(1).toList()) {
+        handlePage(requestId, result.value(0).toMap());
+    }
+}
+
+void FacebookConnection::onPostsParsed(int callCount, const QVariantList &posts)
+{
+    updateActivity();
+    setCompletionStatus(Succeeded);
+
+    if (m_manager->addRetrievedPosts(posts)) {
+        emit messageCountChanged(m_manager->postCount());
+    }
+
+    // An active model holds the posts instead of the completion signal.
+    const bool active = messageModel()->isActive();
+
+    if (active) {
+        messageModel()->addMessages(posts);
+    }
+
+    for (int i = callCount; i > 0; i--) {
+        emit retrieveMessagesCompleted(true, active ? QVariantList() : posts);
+    }
+}
+
+/*!
+    \internal
+
+    Completes \a callCount retrieveMessages calls whose posts have been
+    parsed into \a rows for the active model.
+*/
+void FacebookConnection::onPostRowsParsed(int callCount, const MessageModel::Rows &rows)
+{
+    updateActivity();
+    setCompletionStatus(Succeeded);
+
+    if (m_manager->addRetrievedPosts(rows)) {
+        emit messageCountChanged(m_manager->postCount());
+    }
+
+    messageModel()->addRows(rows);
+
+    for (int i = callCount; i > 0; i--) {
+        emit retrieveMessagesCompleted(true, QVariantList());
+    }
+}
+
+/*!
+    \internal
+
+    Completes the calls of the retrieveMessages reply \a ticket with the
+    posts of every batch parsed from it.
+*/
+void FacebookConnection::completePostStream(int ticket)
+{
+    const PostStream stream = m_postStreams.take(ticket);
+    MessageModel::Rows rows;
+    QVariantList posts;
+
+    // The batches may be parsed out of order; the calls get the posts in
+    // the order of the reply.
+    foreach (const QVariantList &batch, stream.batches) {
+        if (stream.rows) {
+            rows.append(batch.value(0).value<MessageModel::Rows>());
+        }
+        else {
+            posts += batch;
+        }
+    }
+
+    if (stream.rows) {
+        onPostRowsParsed(stream.callCount, rows);
+    }
+    else {
+        onPostsParsed(stream.callCount, posts);
+    }
+}
+
+/*!
+    \internal
+
+    Reports the posts of a batch of the retrieveMessages reply in
+    \a context with messagesReceived(), and completes the calls once the
+    reply has been read and every batch parsed.
+*/
+void FacebookConnection::onPostRecordsParsed(const QVariant &context, const QVariantList &posts)
+{
+    const QVariantList batch = context.toList();
+    const int ticket = batch.at(0).toInt();
+
+    // The calls have already failed if the reply did.
+    if (!m_postStreams.contains(ticket)) {
+        updateActivity();
+        return;
+    }
+
+    PostStream &stream = m_postStreams[ticket];
+    stream.batches.insert(batch.at(1).toInt(), posts);
+    stream.pendingBatches--;
+
+    if (!stream.rows && !posts.isEmpty()) {
+        emit messagesReceived(posts);
+    }
+
+    if (stream.callCount > 0 && stream.pendingBatches == 0) {
+        completePostStream(ticket);
+    }
+}
+
+/*!
+    \internal
+
+    Cuts the posts of a retrieveMessages reply that have arrived in \a data
+    out of the reply, and sends them to be parsed on a worker thread.
+*/
+void FacebookConnection::onRequestDataReceived(const QVariant &requestId, const QByteArray &data)
+{
+    const int ticket = requestId.toInt();
+
+    if (!m_pendingCalls.contains(ticket) ||
+        m_pendingCalls.value(ticket).apiCall != RetrieveMessages) {
+        return;
+    }
+
+    PostStream &stream = m_postStreams[ticket];
+    const QList<QByteArray> records = stream.splitter.append(data);
+
+    if (records.isEmpty()) {
+        return;
+    }
+
+    // The whole reply is parsed in the same form as its first batch.
+    if (stream.batchCount == 0) {
+        stream.rows = messageModel()->isActive();
+    }
+
+    const QVariantList context = QVariantList() << ticket << stream.batchCount;
+
+    if (stream.rows) {
+        m_streamParseQueue->enqueue(QtConcurrent::run(m_manager,
+                                                      &FacebookDataManager::parsePostRows,
+                                                      records, messageModel()->roleKeys()),
+                                    context);
+    }
+    else {
+        m_streamParseQueue->enqueue(QtConcurrent::run(m_manager,
+                                                      &FacebookDataManager::parsePostRecords,
+                                                      records),
+                                    context);
+    }
+
+    stream.batchCount++;
+    stream.pendingBatches++;
 }
 
 void FacebookConnection::onRequestFailed(const QVariant &requestId, const QString &reason)
 {
-    Q_UNUSED(requestId)
+    const QList<PendingCall> calls = takeCalls(requestId);
+    m_postStreams.remove(requestId.toInt());
+
+    if (calls.isEmpty()) {
+        return;
+    }
+
+    updateActivity();
+    setCompletionStatus(replyStatus(calls.first().reply));
+
+    foreach (const PendingCall &call, calls) {
+        switch (call.apiCall) {
+        case PostMessage:
+            emit postMessageCompleted(false);
+            break;
+        case RetrieveMessages:
+            emit retrieveMessagesCompleted(false, QVariantList());
+            break;
+        case RetrieveMessageCount:
+            emit retrieveMessageCountCompleted(false, 0);
+            break;
+        case GetScreenName:
+            // At this point web interface is not needed anymore.
+            setWebInterfaceActive(false);
+            // Authentication is completed even the screen name fetching fails.
+            setName("");
+            setAuthenticated(true);
+            setCompletionStatus(Succeeded);
+            emit authenticateCompleted(true);
+            break;
+        case CustomRequest:
+            emit requestCompleted(false, call.requestId, QByteArray());
+            break;
+        case PagedRequest:
+            handlePageFailure(call.requestId);
+            break;
+        default:
+            break;
+        }
+    }
+
+    qDebug() << "FacebookConnection::requestFailed - Reason:" << reason;
+}
+
+void FacebookConnection::onAuthenticationChanged(const bool authenticated)
+{
+    setAuthenticated(authenticated);
+}
+
+/*!
+    \internal
+
+    Reports the progress of the reply of the request \a requestId with the
+    id the caller gave, or with the name of the operation.
+*/
+void FacebookConnection::onRequestStarted(const QVariant &requestId, QNetworkReply *reply)
+{
+    const int ticket = requestId.toInt();
 
-    setBusy(false);
-    setTransmitting(false);
+    if (!m_pendingCalls.contains(ticket)) {
+        return;
+    }
 
-    APICall c = m_apiCall;
-    m_apiCall = Undefined;
+    // The reply tells later whether the call timed out.
+    m_pendingCalls[ticket].reply = reply;
+    const PendingCall call = m_pendingCalls.value(ticket);
 
-    switch (c) {
+    switch (call.apiCall) {
+    case Authenticate:
+    case GetScreenName:
+        trackProgress(reply, "authenticate");
+        break;
     case PostMessage:
-        emit postMessageCompleted(false);
+        trackProgress(reply, "postMessage");
+
+        // The scaled down picture is removed with the reply uploading it.
+        if (m_uploadedImage.isValid()) {
+            releaseImage(m_uploadedImage, reply);
+        }
         break;
     case RetrieveMessages:
-        emit retrieveMessagesCompleted(false, QVariantList());
+        trackProgress(reply, "retrieveMessages");
         break;
     case RetrieveMessageCount:
-        emit retrieveMessageCountCompleted(false, 0);
-        break;
-    case GetScreenName:
-        // At this point web interface is not needed anymore.
-        setWebInterfaceActive(false);
-        // Authentication is completed even the screen name fetching fails.
-        setName("");
-        setAuthenticated(true);
-        emit authenticateCompleted(true);
-        break;
-    case CustomRequest:
-        emit requestCompleted(false, requestId, QByteArray());
+        trackProgress(reply, "retrieveMessageCount");
         break;
     default:
+        trackProgress(reply, call.requestId);
         break;
     }
+}
 
-    qDebug() << "FacebookConnection::requestFailed - Reason:" << reason;
+/*!
+    \internal
+
+    Uploads the picture of a message posted with postMessage() once it has
+    been scaled down to \a fileUrl.
+*/
+void FacebookConnection::onImageProcessed(const QVariant &context, const QUrl &fileUrl)
+{
+    if (fileUrl.isEmpty()) {
+        updateActivity();
+        setCompletionStatus(Canceled);
+        emit postMessageCompleted(false);
+        return;
+    }
+
+    QVariantMap parameters = context.toMap();
+    parameters.insert("picture", fileUrl);
+
+    m_uploadedImage = fileUrl;
+    const bool started = doRequest(PostMessage, "", "me/photos", HTTPPost, parameters);
+    m_uploadedImage.clear();
+
+    if (!started) {
+        releaseImage(fileUrl);
+        updateActivity();
+        setCompletionStatus(Failed);
+        emit postMessageCompleted(false);
+    }
 }
 
-void FacebookConnection::onAuthenticationChanged(const bool authenticated)
+void FacebookConnection::onVideoUploadStarted(QNetworkReply *reply)
 {
-    setAuthenticated(authenticated);
+    trackProgress(reply, "uploadVideo");
 }
 
-bool FacebookConnection::doRequest(const QVariant &requestId,
+void FacebookConnection::onVideoUploadProgress(qint64 bytesSent, qint64 bytesTotal)
+{
+    emit videoUploadProgress(bytesSent, bytesTotal);
+}
+
+void FacebookConnection::onVideoUploadFinished(bool success, const QString &videoId,
+                                               const QString &errorMessage)
+{
+    updateActivity();
+    setCompletionStatus(success ? Succeeded : Failed);
+    emit uploadVideoCompleted(success, videoId, errorMessage);
+}
+
+/*!
+    \internal
+
+    Starts a request for \a apiCall. Facebook is given an internal ticket as
+    the request id, so that the completion can be routed to the right
+    operation while other requests are in flight. A request which fails to
+    start is not tracked; the caller reports the failure by returning false.
+    A GET identical to one in flight is attached to the earlier request
+    instead of being sent.
+*/
+bool FacebookConnection::doRequest(const APICall apiCall,
+                                   const QVariant &requestId,
                                    const QString &graphPath,
                                    const HTTPMethod method,
                                    const QVariantMap &parameters)
 {
-    if (busy() && m_apiCall != GetScreenName) {
-        qWarning() << "FacebookConnection busy.";
+    PendingCall call;
+    call.apiCall = apiCall;
+    call.requestId = requestId;
+
+    if (method == HTTPGet) {
+        call.key = requestKey(apiCall, graphPath, parameters);
+
+        if (m_inflightGets.contains(call.key)) {
+            m_coalescedCalls[m_inflightGets.value(call.key)].append(call);
+            return true;
+        }
+    }
+
+    if (graphPath.isEmpty()) {
+        qWarning() << "FacebookConnection::doRequest - Empty graph path.";
+        return false;
+    }
+
+    // The call is known before the request starts, so that its reply can be
+    // tracked as it is sent.
+    const int ticket = m_nextTicket++;
+    m_pendingCalls.insert(ticket, call);
+
+    if (!m_facebook->request(ticket, graphPath, method, parameters,
+                             QNetworkRequest::CacheLoadControl(cachePolicy()),
+                             callTimeout())) {
+        m_pendingCalls.remove(ticket);
+        return false;
+    }
+
+    if (!call.key.isEmpty()) {
+        m_inflightGets.insert(call.key, ticket);
+    }
+
+    updateActivity();
+
+    return true;
+}
+
+/*!
+    \internal
+
+    Removes and returns the call completed with the ticket \a requestId,
+    followed by the calls coalesced into it.
+*/
+QList<FacebookConnection::PendingCall> FacebookConnection::takeCalls(const QVariant &requestId)
+{
+    QList<PendingCall> calls;
+    const int ticket = requestId.toInt();
+
+    if (!m_pendingCalls.contains(ticket)) {
+        return calls;
+    }
+
+    const PendingCall call = m_pendingCalls.take(ticket);
+    calls.append(call);
+    calls += m_coalescedCalls.take(ticket);
+
+    if (!call.key.isEmpty()) {
+        m_inflightGets.remove(call.key);
+    }
+
+    return calls;
+}
+
+/*!
+    \internal
+
+    Requests the next page of \a pager for the paginated request
+    \a requestId.
+*/
+bool FacebookConnection::fetchPage(const QVariant &requestId, FacebookPager *pager)
+{
+    if (!doRequest(PagedRequest, requestId, pager->graphPath(), HTTPGet, pager->parameters())) {
         return false;
     }
 
-    setBusy(true);
-    setTransmitting(true);
+    pager->setFetching(true);
+    return true;
+}
+
+/*!
+    \internal
+
+    Delivers the parsed \a page of the paginated request \a requestId, or
+    keeps it until it is asked for if it was requested ahead of time.
+*/
+void FacebookConnection::handlePage(const QVariant &requestId, const QVariantMap &page)
+{
+    const QString key = requestId.toString();
+    FacebookPager *pager = m_pagers.value(key);
+
+    if (!pager) {
+        return;
+    }
+
+    pager->setFetching(false);
+    const QVariantList items = pager->addPage(page);
+
+    if (!pager->isRequested()) {
+        pager->setPrefetched(items);
+        return;
+    }
+
+    emitPage(requestId, true, items);
+}
+
+/*!
+    \internal
+
+    Reports the failure of a page of the paginated request \a requestId. A
+    page requested ahead of time fails when it is asked for.
+*/
+void FacebookConnection::handlePageFailure(const QVariant &requestId)
+{
+    FacebookPager *pager = m_pagers.value(requestId.toString());
+
+    if (!pager) {
+        return;
+    }
+
+    pager->setFetching(false);
+    pager->setFailed(true);
+
+    if (pager->isRequested()) {
+        emitPage(requestId, false, QVariantList());
+    }
+}
+
+/*!
+    \internal
+
+    Delivers the page of the paginated request \a requestId that was
+    retrieved, or failed, before it was asked for.
+*/
+void FacebookConnection::deliverPage(const QVariant &requestId)
+{
+    FacebookPager *pager = m_pagers.value(requestId.toString());
+
+    if (!pager || !pager->isRequested()) {
+        return;
+    }
+
+    if (pager->hasFailed()) {
+        setCompletionStatus(Failed);
+        emitPage(requestId, false, QVariantList());
+    }
+    else {
+        setCompletionStatus(Succeeded);
+        emitPage(requestId, true, pager->takePrefetched());
+    }
+}
+
+/*!
+    \internal
 
-    return m_facebook->request(requestId, graphPath, method, parameters);
+    Emits pageReceived() for the paginated request \a requestId, removing
+    the request once it has been completed. With prefetchPages the page
+    after \a items is requested once the signal has been handled, so that
+    busy is clear while the page is delivered.
+*/
+void FacebookConnection::emitPage(const QVariant &requestId, bool success,
+                                  const QVariantList &items)
+{
+    const QString key = requestId.toString();
+    FacebookPager *pager = m_pagers.value(key);
+    const bool more = success && !pager->hasFailed() && pager->hasMore();
+
+    pager->setRequested(false);
+
+    if (!more) {
+        delete m_pagers.take(key);
+    }
+
+    emit pageReceived(success, requestId, items, more);
+
+    // The page may have been asked for, or the request canceled, meanwhile.
+    pager = m_pagers.value(key);
+
+    if (pager && m_prefetchPages && !pager->isRequested() && !pager->isFetching() &&
+        !pager->hasPrefetched() && !pager->hasFailed() && !fetchPage(requestId, pager)) {
+        pager->setFailed(true);
+    }
+}
+
+/*!
+    \internal
+
+    Returns the key identifying identical GET requests for \a apiCall. Calls
+    of different kinds are never coalesced, since their results are handled
+    differently. Neither are calls made with another cache policy or
+    timeout, so that each caller gets the request it asked for.
+*/
+QString FacebookConnection::requestKey(const APICall apiCall,
+                                       const QString &graphPath,
+                                       const QVariantMap &parameters) const
+{
+    QUrl url;
+    url.setPath(graphPath);
+
+    QMapIterator<QString, QVariant> i(parameters);
+
+    while (i.hasNext()) {
+        i.next();
+        url.addQueryItem(i.key(), i.value().toString());
+    }
+
+    return QString("%1 %2 %3 %4").arg(apiCall).arg(cachePolicy()).arg(callTimeout())
+            .arg(url.toString());
+}
+
+/*!
+    \internal
+
+    Updates busy and transmitting to reflect the authentication, the
+    pictures being scaled down, the requests in flight, the video upload and
+    the posts being parsed.
+*/
+void FacebookConnection::updateActivity()
+{
+    const bool transmitting = !m_pendingCalls.isEmpty() || m_videoUpload->isActive();
+    setBusy(m_authenticating || processingImages() || transmitting ||
+            m_parseQueue->isActive() || m_streamParseQueue->isActive());
+    setTransmitting(transmitting);
 }
 
 void FacebookConnection::setWebInterfaceActive(const bool active)
@@ -577,11 +1546,6 @@ bool FacebookConnection::sessionValidated()
         return false;
     }
 
-    if (busy()) {
-        qWarning() << "FacebookConnection busy.";
-        return false;
-    }
-
     return true;
 }
 
@@ -608,8 +1572,11 @@ void FacebookConnection::checkAuthenticationUrl(const QUrl &url)
         // At this point web interface is not needed anymore.
         setWebInterfaceActive(false);
 
-        // Get an user screen name after getting the access token.
+        // Get an user screen name after getting the access token. The
+        // pending screen name request keeps the connection busy.
+        m_authenticating = false;
         getScreenName();
+        updateActivity();
     }
     // TODO: Error handling to be improved later if we will to pass error
     // strings to the user in the future.
@@ -618,9 +1585,9 @@ void FacebookConnection::checkAuthenticationUrl(const QUrl &url)
         // At this point web interface is not needed anymore.
         setWebInterfaceActive(false);
 
-        m_apiCall = Undefined;
-        setBusy(false);
-        setTransmitting(false);
+        m_authenticating = false;
+        updateActivity();
+        setCompletionStatus(Failed);
         emit authenticateCompleted(false);
     }
 }
@@ -644,7 +1611,7 @@ bool FacebookConnection::getMessagesOnline(const QString &from, const QString &t
     // Send FQL query request.
     parameters.insert("q", query);
 
-    return doRequest("", "fql", HTTPGet, parameters);
+    return doRequest(RetrieveMessages, "", "fql", HTTPGet, parameters);
 }
 
 bool FacebookConnection::getMessageCount()
@@ -655,16 +1622,13 @@ bool FacebookConnection::getMessageCount()
 
     // Send FQL query request.
     parameters.insert("q", query);
-    setBusy(true);
-    setTransmitting(true);
 
-    return doRequest("", "fql", HTTPGet, parameters);
+    return doRequest(RetrieveMessageCount, "", "fql", HTTPGet, parameters);
 }
 
 bool FacebookConnection::getScreenName()
 {
-    m_apiCall = GetScreenName;
     qDebug() << "Getting screen name.";
 
-    return doRequest("", "me", HTTPGet, QVariantMap());
+    return doRequest(GetScreenName, "", "me", HTTPGet, QVariantMap());
 }
@@ -8,12 +8,20 @@
 #include <QtCore/QObject>
 #include <QtCore/QUrl>
 #include <QtCore/QStringList>
-#include <QtScript/QScriptValue>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QPointer>
+#include "jsonrecordsplitter.h"
+#include "messagemodel.h"
 #include "socialconnection.h"
 
 class Facebook;
 class FacebookRequest;
 class FacebookDataManager;
+class FacebookPager;
+class FacebookVideoUpload;
+class ParseQueue;
+class QNetworkReply;
 
 class FacebookConnection : public SocialConnection
 {
@@ -22,6 +30,11 @@ class FacebookConnection : public SocialConnection
     Q_PROPERTY(QString clientId READ clientId WRITE setClientId NOTIFY clientIdChanged)
     Q_PROPERTY(QString accessToken READ accessToken WRITE setAccessToken NOTIFY accessTokenChanged)
     Q_PROPERTY(QStringList permissions READ permissions WRITE setPermissions NOTIFY permissionsChanged)
+    Q_PROPERTY(int batchWindow READ batchWindow WRITE setBatchWindow NOTIFY batchWindowChanged)
+    Q_PROPERTY(int videoChunkSize READ videoChunkSize WRITE setVideoChunkSize NOTIFY videoChunkSizeChanged)
+    Q_PROPERTY(QString videoUploadUrl READ videoUploadUrl WRITE setVideoUploadUrl NOTIFY videoUploadUrlChanged)
+    Q_PROPERTY(bool prefetchPages READ prefetchPages WRITE setPrefetchPages NOTIFY prefetchPagesChanged)
+    Q_PROPERTY(int messageCount READ messageCount NOTIFY messageCountChanged)
     Q_ENUMS(HTTPMethod)
 
 
@@ -33,7 +46,32 @@ class FacebookConnection : public SocialConnection
         RetrieveMessages,
         RetrieveMessageCount,
         GetScreenName,
-        CustomRequest
+        CustomRequest,
+        PagedRequest
+    };
+
+    // A request in flight, keyed by the ticket passed to Facebook. GET
+    // requests have a key identifying identical requests.
+    struct PendingCall {
+        APICall apiCall;
+        QVariant requestId;
+        QString key;
+        QPointer<QNetworkReply> reply;
+    };
+
+    // The posts of a retrieveMessages reply read so far, cut out of the
+    // "data" array as the reply arrives and parsed on a worker thread a
+    // batch at a time, into MessageModel::Rows if the model is active.
+    struct PostStream {
+        PostStream() : splitter("data"), batchCount(0), pendingBatches(0), callCount(0),
+                       rows(false) {}
+
+        JsonRecordSplitter splitter;
+        QMap<int, QVariantList> batches;    // Parsed batches by index
+        int batchCount;
+        int pendingBatches;                 // Batches being parsed
+        int callCount;                      // Calls of the finished reply
+        bool rows;                          // The batches are Rows
     };
 
 public:
@@ -45,6 +83,7 @@ public:
     };
 
     explicit FacebookConnection(QObject *parent = 0);
+    virtual ~FacebookConnection();
 
 public: // Property accessors unique to FacebookConnection.
 
@@ -54,6 +93,15 @@ public: // Property accessors unique to FacebookConnection.
     void setAccessToken(const QString &accessToken);
     QStringList permissions() const;
     void setPermissions(const QStringList &permissions);
+    int batchWindow() const;
+    void setBatchWindow(int batchWindow);
+    int videoChunkSize() const;
+    void setVideoChunkSize(int videoChunkSize);
+    QString videoUploadUrl() const;
+    void setVideoUploadUrl(const QString &videoUploadUrl);
+    bool prefetchPages() const;
+    void setPrefetchPages(bool prefetchPages);
+    int messageCount() const;
 
 public: // Reimplementation of SocialConnection base class operations.
 
@@ -80,34 +128,78 @@ public slots: // Operations unique to FacebookConnection.
                  const QString &graphPath,
                  const HTTPMethod method,
                  const QVariantMap &parameters);
-    
+
+    bool requestPages(const QVariant &requestId,
+                      const QString &graphPath,
+                      const QVariantMap &parameters,
+                      int maxItems);
+    bool requestNextPage(const QVariant &requestId);
+
+    void beginBatch();
+    void endBatch();
+
+    bool uploadVideo(const QUrl &fileUrl);
+    bool uploadVideo(const QUrl &fileUrl, const QVariantMap &parameters);
+
 signals:
 
     // Property notifications unique to FacebookConnection.
     void clientIdChanged(const QString &clientId);
     void accessTokenChanged(const QString &accessToken);
     void permissionsChanged(const QStringList &permissions);
+    void batchWindowChanged(int batchWindow);
+    void videoChunkSizeChanged(int videoChunkSize);
+    void videoUploadUrlChanged(const QString &videoUploadUrl);
+    void prefetchPagesChanged(bool prefetchPages);
+    void messageCountChanged(int messageCount);
 
     // Completion notification signals unique to FacebookConnection.
     void requestCompleted(bool success, const QVariant &requestId, const QVariant &result);
+    void uploadVideoCompleted(bool success, const QString &videoId, const QString &errorMessage);
+    void pageReceived(bool success, const QVariant &requestId, const QVariantList &items, bool more);
+
+    // Progress notification signals unique to FacebookConnection.
+    void videoUploadProgress(qreal bytesSent, qreal bytesTotal);
 
 protected slots:
 
     void onUrlChanged(const QUrl &url);
+    void onImageProcessed(const QVariant &context, const QUrl &fileUrl);
 
 private slots:
 
     void onNameChanged(const QString &name);
     void onRequestCompleted(const QVariant& requestId, const QByteArray &result);
     void onRequestFailed(const QVariant& requestId, const QString &reason);
+    void onRequestStarted(const QVariant &requestId, QNetworkReply *reply);
+    void onRequestDataReceived(const QVariant &requestId, const QByteArray &data);
+    void onVideoUploadStarted(QNetworkReply *reply);
     void onAuthenticationChanged(const bool authenticated);
+    void onVideoUploadProgress(qint64 bytesSent, qint64 bytesTotal);
+    void onVideoUploadFinished(bool success, const QString &videoId, const QString &errorMessage);
+    void deliverPage(const QVariant &requestId);
+    void onReplyParsed(const QVariant &context, const QVariantList &result);
+    void onPostRecordsParsed(const QVariant &context, const QVariantList &posts);
 
 private:
 
-    bool doRequest(const QVariant &requestId,
-                 const QString &graphPath,
-                 const HTTPMethod method,
-                 const QVariantMap &parameters);
+    bool doRequest(const APICall apiCall,
+                   const QVariant &requestId,
+                   const QString &graphPath,
+                   const HTTPMethod method,
+                   const QVariantMap &parameters);
+    QList<PendingCall> takeCalls(const QVariant &requestId);
+    bool fetchPage(const QVariant &requestId, FacebookPager *pager);
+    void onPostsParsed(int callCount, const QVariantList &posts);
+    void onPostRowsParsed(int callCount, const MessageModel::Rows &rows);
+    void completePostStream(int ticket);
+    void handlePage(const QVariant &requestId, const QVariantMap &page);
+    void handlePageFailure(const QVariant &requestId);
+    void emitPage(const QVariant &requestId, bool success, const QVariantList &items);
+    QString requestKey(const APICall apiCall,
+                       const QString &graphPath,
+                       const QVariantMap &parameters) const;
+    void updateActivity();
     void setWebInterfaceActive(const bool active);
     bool sessionValidated();
     void checkAuthenticationUrl(const QUrl &url);
@@ -121,7 +213,18 @@ private:
 
     Facebook *m_facebook; // Owned
     FacebookDataManager *m_manager; // Owned
-    APICall m_apiCall;
+    FacebookVideoUpload *m_videoUpload; // Owned
+    ParseQueue *m_parseQueue; // Owned
+    ParseQueue *m_streamParseQueue; // Owned
+    QHash<int, PendingCall> m_pendingCalls;
+    QHash<int, QList<PendingCall> > m_coalescedCalls;
+    QHash<QString, int> m_inflightGets;
+    QHash<QString, FacebookPager *> m_pagers; // Owned
+    QHash<int, PostStream> m_postStreams;
+    int m_nextTicket;
+    QUrl m_uploadedImage;
+    bool m_authenticating;
+    bool m_prefetchPages;
     QStringList m_permissions;
 };
 
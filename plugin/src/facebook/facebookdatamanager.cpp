@@ -1,6 +1,8 @@
 #include "facebookdatamanager.h"
-#include <QScriptEngine>
-#include <QScriptValueIterator>
+#include "jsonreader.h"
+#include "jsonprojection.h"
+#include "jsonrecordsplitter.h"
+#include <QDateTime>
 #include <QDebug>
 
 // Constants
@@ -15,6 +17,11 @@ namespace {
     const QString DescriptionStr("description");
     const QString AttachmentStr("attachment");
     const QString HrefStr("href");
+    const QString DataStr("data");
+    const QString NameStr("name");
+
+    // The count query is limited to the most recent posts.
+    const int MaxPostCount = 2000;
 }
 
 /*!
@@ -23,56 +30,93 @@ namespace {
   Constructor.
 */
 FacebookDataManager::FacebookDataManager(QObject *parent) :
-    QObject(parent)
+    QObject(parent),
+    m_postCount(-1),
+    m_postCountTime(0)
 {
+    // Fields of a stream post that end up in the retrieved messages.
+    m_postProjection.addField(MessageStr, TextStr);
+    m_postProjection.addField(PostIdStr, IdStr);
+    m_postProjection.addField(CreatedTimeStr, TimeStr);
+    m_postProjection.addField(AttachmentStr + "." + HrefStr, UrlStr);
+    m_postProjection.addField(AttachmentStr + "." + DescriptionStr, DescriptionStr);
 }
 
 /*!
   \internal
 
-  Parses retrieved messages from JSON string.
+  Parses retrieved messages from JSON string and returns the posts. The
+  projection is not modified after construction, so this is safe to call on
+  a worker thread.
 */
-void FacebookDataManager::handleRetrievedMessages(const QByteArray &result)
+QVariantList FacebookDataManager::parsePosts(const QByteArray &result) const
 {
-    // Evaluate string to JSON object.
-    QScriptEngine engine;
-    QScriptValue value = engine.evaluate("(" + QString(result) + ")");
+    QVariantList posts;
 
-    m_lastPosts.clear();
+    foreach (const QVariant &post, m_postProjection.projectList(result, DataStr)) {
+        if (isValidPost(post.toMap())) {
+            posts.append(post);
+        }
+    }
 
-    if (value.property("data").isArray()) {
-        QScriptValueIterator it(value.property("data"));
+    return posts;
+}
 
-        while (it.hasNext()) {
-            it.next();
-            addValue(it.value());
+/*!
+  \internal
+
+  Parses the posts in \a records, the elements of the "data" array of a
+  reply cut out as they arrive.
+*/
+QVariantList FacebookDataManager::parsePostRecords(const QList<QByteArray> &records) const
+{
+    QVariantList posts;
+
+    foreach (const QByteArray &record, records) {
+        const QVariantMap post = m_postProjection.projectObject(record);
+
+        if (isValidPost(post)) {
+            posts.append(post);
         }
     }
+
+    return posts;
 }
 
 /*!
   \internal
 
-  Parses retrieved message count from JSON string.
+  Parses the posts in \a records like parsePostRecords(), but returns them
+  reduced to the fields read with \a keys, as the only item of the list.
+  The posts are not kept as message objects.
 */
-void FacebookDataManager::handleRetrieveMessageCount(const QByteArray &result)
+QVariantList FacebookDataManager::parsePostRows(const QList<QByteArray> &records,
+                                                const MessageModel::RoleKeys &keys) const
 {
-    // Evaluate string to JSON object.
-    QScriptEngine engine;
-    QScriptValue value = engine.evaluate("(" + QString(result) + ")");
+    MessageModel::Rows rows;
 
-    int count = 0;
+    foreach (const QByteArray &record, records) {
+        const QVariantMap post = m_postProjection.projectObject(record);
 
-    if (value.property("data").isArray()) {
-        QScriptValueIterator it(value.property("data"));
-
-        while (it.hasNext()) {
-            it.next();
-            count++;
+        if (isValidPost(post)) {
+            rows.append(post, keys);
         }
     }
 
-    m_postCount = count;
+    return QVariantList() << QVariant::fromValue(rows);
+}
+
+/*!
+  \internal
+
+  Parses retrieved message count from JSON string. Only the elements of the
+  "data" array are counted; no values are built for them.
+*/
+void FacebookDataManager::handleRetrieveMessageCount(const QByteArray &result)
+{
+    m_postCount = JsonRecordSplitter::count(result, DataStr);
+    m_postCountTime = QDateTime::currentDateTime().toTime_t();
+    m_countedPosts.clear();
 }
 
 /*!
@@ -82,62 +126,126 @@ void FacebookDataManager::handleRetrieveMessageCount(const QByteArray &result)
 */
 QString FacebookDataManager::handleScreenName(const QByteArray &result)
 {
-    QScriptEngine engine;
-    QScriptValue value = engine.evaluate("(" + QString(result) + ")");
+    JsonReader reader(result);
 
-    return value.property("name").toString();
+    if (reader.readNext() == JsonReader::BeginObject &&
+        reader.findMember(NameStr) && reader.isScalar()) {
+        return reader.text();
+    }
+
+    return QString();
 }
 
 /*!
   \internal
 
-  Helper function for parsing information from a message object.
+  Helper function for checking a projected message object before it is
+  added to the posts.
 */
-void FacebookDataManager::addValue(const QScriptValue &value)
+bool FacebookDataManager::isValidPost(const QVariantMap &post)
 {
-    QVariant message = value.property(MessageStr).toVariant();
-    QVariant postId = value.property(PostIdStr).toVariant();
-    QVariant created = value.property(CreatedTimeStr).toVariant();
-    QVariant url = value.property(AttachmentStr).property(HrefStr).toVariant();
-    QVariant description = value.property(AttachmentStr).property(DescriptionStr).toVariant();
+    const QVariant message = post.value(TextStr);
+    const QVariant postId = post.value(IdStr);
+    const QVariant created = post.value(TimeStr);
 
     // Add only valid entries. All mandatory properties must be found.
     if (message.isValid() && postId.isValid() && created.isValid()) {
-
-        // Insert all the needed data to last posts.
-        QVariantMap messageMap;
-        messageMap.insert(TextStr, message);
-        messageMap.insert(IdStr, postId);
-        messageMap.insert(UrlStr, url);
-        messageMap.insert(DescriptionStr, description);
-        messageMap.insert(TimeStr, created);
-        m_lastPosts.append(messageMap);
-
         qDebug() << "Status:"  << message.toString()
                  << "Post-id:" << postId.toString()
                  << "Created:" << created.toInt()
-                 << "Url:" << url.toString()
-                 << "Description:" << description.toString();
+                 << "Url:" << post.value(UrlStr).toString()
+                 << "Description:" << post.value(DescriptionStr).toString();
+        return true;
     }
+
+    return false;
 }
 
 /*!
   \internal
 
-  Returns posts.
+  Returns post count, or -1 if the posts have not been counted.
 */
-QVariantList FacebookDataManager::posts() const
+int FacebookDataManager::postCount() const
 {
-    return m_lastPosts;
+    return m_postCount;
 }
 
 /*!
   \internal
 
-  Returns post count.
+  Returns the seconds since the posts were counted, or -1 if they have not
+  been counted.
 */
-int FacebookDataManager::postCount() const
+int FacebookDataManager::postCountAge() const
 {
-    return m_postCount;
+    if (m_postCount < 0) {
+        return -1;
+    }
+
+    return int(QDateTime::currentDateTime().toTime_t() - m_postCountTime);
+}
+
+/*!
+  \internal
+
+  Adds the \a posts created after the posts were counted to the post count,
+  so that it stays current without counting them again. Returns true if the
+  count changed.
+*/
+bool FacebookDataManager::addRetrievedPosts(const QVariantList &posts)
+{
+    if (m_postCount < 0) {
+        return false;
+    }
+
+    const int count = m_postCount;
+
+    foreach (const QVariant &post, posts) {
+        const QVariantMap map = post.toMap();
+        countPost(map.value(IdStr).toString(), map.value(TimeStr).toUInt());
+    }
+
+    return m_postCount != count;
+}
+
+/*!
+  \internal
+
+  Adds the posts of \a rows like addRetrievedPosts() adds message objects.
+*/
+bool FacebookDataManager::addRetrievedPosts(const MessageModel::Rows &rows)
+{
+    if (m_postCount < 0) {
+        return false;
+    }
+
+    const int count = m_postCount;
+
+    for (int i = 0; i < rows.count(); i++) {
+        countPost(rows.ids.at(i), rows.times.at(i));
+    }
+
+    return m_postCount != count;
+}
+
+void FacebookDataManager::countPost(const QString &id, uint time)
+{
+    if (time > m_postCountTime && !m_countedPosts.contains(id)) {
+        m_countedPosts.insert(id);
+        m_postCount = qMin(m_postCount + 1, MaxPostCount);
+    }
+}
+
+/*!
+  \internal
+
+  Forgets the post count, for example when the user changes.
+*/
+void FacebookDataManager::resetPostCount()
+{
+    m_postCount = -1;
+    m_postCountTime = 0;
+    m_countedPosts.clear();
 }
 
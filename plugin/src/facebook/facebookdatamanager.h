@@ -2,8 +2,10 @@
 #define FACEBOOKDATAMANAGER_H
 
 #include <QObject>
+#include <QSet>
 #include <QVariant>
-#include <QScriptValue>
+#include "jsonprojection.h"
+#include "messagemodel.h"
 
 class FacebookDataManager : public QObject
 {
@@ -14,23 +16,34 @@ public:
     explicit FacebookDataManager(QObject *parent = 0);
 
     // Methods
-    void handleRetrievedMessages(const QByteArray &result);
+    QVariantList parsePosts(const QByteArray &result) const;
+    QVariantList parsePostRecords(const QList<QByteArray> &records) const;
+    QVariantList parsePostRows(const QList<QByteArray> &records,
+                               const MessageModel::RoleKeys &keys) const;
     void handleRetrieveMessageCount(const QByteArray &result);
     QString handleScreenName(const QByteArray &result);
 
-    QVariantList posts() const;
     int postCount() const;
+    int postCountAge() const;
+    bool addRetrievedPosts(const QVariantList &posts);
+    bool addRetrievedPosts(const MessageModel::Rows &rows);
+    void resetPostCount();
 
 private:
 
-    void addValue(const QScriptValue &value);
+    static bool isValidPost(const QVariantMap &post);
+    void countPost(const QString &id, uint time);
 
 private:
 
     QString m_lastError;
-    QVariantList m_lastPosts;
+    JsonProjection m_postProjection;
 
+    // The count of the last retrieveMessageCount, -1 if none, the time it
+    // was received and the posts newer than it counted since.
     int m_postCount;
+    uint m_postCountTime;
+    QSet<QString> m_countedPosts;
 };
 
 #endif // FACEBOOKDATAMANAGER_H
@@ -0,0 +1,268 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include "facebookpager.h"
+#include "jsonreader.h"
+#include <QtCore/QDateTime>
+#include <QtCore/QPair>
+#include <QtCore/QUrl>
+
+// Constants
+namespace {
+    const QString DataStr("data");
+    const QString PagingStr("paging");
+    const QString NextStr("next");
+    const QString CreatedTimeStr("created_time");
+    const QString SinceStr("since");
+    const QString UntilStr("until");
+    const QString AccessTokenStr("access_token");
+}
+
+/*!
+  \class FacebookPager
+  \brief The FacebookPager class follows the paging cursors of a Graph API
+         edge, such as me/feed, one page at a time.
+
+  Each page of an edge ends with a "paging.next" URL that requests the page
+  after it. The pager keeps that cursor and turns it back into a graph path
+  and parameters, so that the next page is sent like any other request. The
+  access token of the URL is dropped, since it is added to every request.
+
+  The pager stops once \c maxItems items have been returned, when an item is
+  older than the "since" parameter of the first request, or when Facebook
+  returns a page without items or without a next cursor. Items newer than
+  the "until" parameter are skipped. The times are Unix times; other forms
+  accepted by Facebook are left for the server to apply.
+*/
+
+/*!
+  \internal
+
+  Constructor. The first page is requested with \a graphPath and
+  \a parameters. At most \a maxItems items are returned in total; 0 means
+  no limit.
+*/
+FacebookPager::FacebookPager(const QString &graphPath,
+                             const QVariantMap &parameters,
+                             int maxItems)
+    : m_graphPath(graphPath),
+      m_parameters(parameters),
+      m_maxItems(qMax(0, maxItems)),
+      m_itemCount(0),
+      m_since(unixTime(parameters.value(SinceStr))),
+      m_until(unixTime(parameters.value(UntilStr))),
+      m_more(true),
+      m_fetching(false),
+      m_requested(false),
+      m_failed(false),
+      m_prefetched(false)
+{
+}
+
+/*!
+  \internal
+
+  Returns the graph path of the next page.
+*/
+QString FacebookPager::graphPath() const
+{
+    return m_graphPath;
+}
+
+/*!
+  \internal
+
+  Returns the parameters of the next page.
+*/
+QVariantMap FacebookPager::parameters() const
+{
+    return m_parameters;
+}
+
+/*!
+  \internal
+
+  Returns the number of items returned so far.
+*/
+int FacebookPager::itemCount() const
+{
+    return m_itemCount;
+}
+
+/*!
+  \internal
+
+  Returns true if there is a page after the ones added so far.
+*/
+bool FacebookPager::hasMore() const
+{
+    return m_more;
+}
+
+/*!
+  \internal
+
+  Parses the page in \a result and returns it as the only item of the
+  list, or an empty list if it is not an object. Reads no state of a pager,
+  so it runs on a worker thread.
+*/
+QVariantList FacebookPager::parsePage(const QByteArray &result)
+{
+    QVariantList pages;
+    JsonReader reader(result);
+
+    if (reader.readNext() == JsonReader::BeginObject) {
+        pages.append(reader.readCurrent());
+    }
+
+    return pages;
+}
+
+/*!
+  \internal
+
+  Advances to the page after \a page, parsed with parsePage(), and returns
+  the items of the page that are within the limits of the pager. An empty
+  page ends the pager.
+*/
+QVariantList FacebookPager::addPage(const QVariantMap &page)
+{
+    QVariantList items;
+    const QVariantList data = page.value(DataStr).toList();
+    const QUrl next(page.value(PagingStr).toMap().value(NextStr).toString());
+
+    m_more = !data.isEmpty() && next.isValid() && !next.path().isEmpty();
+
+    foreach (const QVariant &item, data) {
+        const qint64 created = unixTime(item.toMap().value(CreatedTimeStr));
+
+        if (created >= 0 && m_until >= 0 && created > m_until) {
+            continue;
+        }
+
+        // The items come newest first, so the rest are older still.
+        if (created >= 0 && m_since >= 0 && created < m_since) {
+            m_more = false;
+            break;
+        }
+
+        items.append(item);
+        m_itemCount++;
+
+        if (m_maxItems > 0 && m_itemCount >= m_maxItems) {
+            m_more = false;
+            break;
+        }
+    }
+
+    if (m_more) {
+        m_graphPath = next.path().mid(1);
+        m_parameters.clear();
+
+        QPair<QString, QString> item;
+
+        foreach (item, next.queryItems()) {
+            if (item.first != AccessTokenStr) {
+                m_parameters.insert(item.first, item.second);
+            }
+        }
+    }
+
+    return items;
+}
+
+/*!
+  \internal
+
+  Returns true while a page is being requested.
+*/
+bool FacebookPager::isFetching() const
+{
+    return m_fetching;
+}
+
+void FacebookPager::setFetching(bool fetching)
+{
+    m_fetching = fetching;
+}
+
+/*!
+  \internal
+
+  Returns true if the page being requested is delivered as soon as it
+  arrives, rather than kept until it is asked for.
+*/
+bool FacebookPager::isRequested() const
+{
+    return m_requested;
+}
+
+void FacebookPager::setRequested(bool requested)
+{
+    m_requested = requested;
+}
+
+/*!
+  \internal
+
+  Returns true if a page requested ahead of time could not be retrieved.
+*/
+bool FacebookPager::hasFailed() const
+{
+    return m_failed;
+}
+
+void FacebookPager::setFailed(bool failed)
+{
+    m_failed = failed;
+}
+
+/*!
+  \internal
+
+  Returns true if a page has been retrieved ahead of time.
+*/
+bool FacebookPager::hasPrefetched() const
+{
+    return m_prefetched;
+}
+
+void FacebookPager::setPrefetched(const QVariantList &items)
+{
+    m_prefetched = true;
+    m_prefetchedItems = items;
+}
+
+QVariantList FacebookPager::takePrefetched()
+{
+    const QVariantList items = m_prefetchedItems;
+    m_prefetched = false;
+    m_prefetchedItems.clear();
+    return items;
+}
+
+/*!
+  \internal
+
+  Returns \a value, a Unix time or an ISO 8601 time in UTC as used by the
+  Graph API, in seconds since the epoch, or -1 if it is neither.
+*/
+qint64 FacebookPager::unixTime(const QVariant &value)
+{
+    bool ok = false;
+    const qint64 seconds = value.toString().toLongLong(&ok);
+
+    if (ok) {
+        return seconds;
+    }
+
+    QDateTime time = QDateTime::fromString(value.toString().left(19), Qt::ISODate);
+
+    if (!time.isValid()) {
+        return -1;
+    }
+
+    time.setTimeSpec(Qt::UTC);
+    return time.toTime_t();
+}
@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#ifndef FACEBOOKPAGER_H
+#define FACEBOOKPAGER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QVariant>
+#include <QtCore/QVariantMap>
+
+class FacebookPager
+{
+public:
+
+    explicit FacebookPager(const QString &graphPath,
+                           const QVariantMap &parameters,
+                           int maxItems);
+
+public:
+
+    QString graphPath() const;
+    QVariantMap parameters() const;
+    int itemCount() const;
+    bool hasMore() const;
+
+    static QVariantList parsePage(const QByteArray &result);
+    QVariantList addPage(const QVariantMap &page);
+
+    // State of the page requests, kept by FacebookConnection.
+    bool isFetching() const;
+    void setFetching(bool fetching);
+    bool isRequested() const;
+    void setRequested(bool requested);
+    bool hasFailed() const;
+    void setFailed(bool failed);
+    bool hasPrefetched() const;
+    void setPrefetched(const QVariantList &items);
+    QVariantList takePrefetched();
+
+private:
+
+    static qint64 unixTime(const QVariant &value);
+
+private: // Data
+
+    QString m_graphPath;
+    QVariantMap m_parameters;
+    int m_maxItems;
+    int m_itemCount;
+    qint64 m_since;
+    qint64 m_until;
+    bool m_more;
+    bool m_fetching;
+    bool m_requested;
+    bool m_failed;
+    bool m_prefetched;
+    QVariantList m_prefetchedItems;
+};
+
+#endif // FACEBOOKPAGER_H
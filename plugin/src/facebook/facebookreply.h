@@ -3,7 +3,6 @@
 
 #include <QObject>
 #include <QVariant>
-#include <QtScript/QScriptValue>
 #include <QNetworkReply>
 
 class FacebookReply : public QObject
@@ -15,6 +14,8 @@ public:
     enum OAuthError {
         OAuthNoError = 0,
         OAuthGeneralError,
+        OAuthApplicationRateLimit = 4,
+        OAuthUserRateLimit = 17,
         OAuthAuthError = 2500
     };
 
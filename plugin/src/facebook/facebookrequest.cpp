@@ -5,12 +5,14 @@
 #include "facebookrequest.h"
 #include "facebookreply.h"
 #include <QStringList>
-#include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QNetworkRequest>
-#include <QScriptEngine>
+#include "jsonprojection.h"
+#include "jsonreader.h"
+#include "networktransport.h"
+#include "multipartdevice.h"
 #include <QDebug>
-#include <QFile>
+#include <QFileInfo>
 
 // Constants
 namespace {
@@ -22,6 +24,7 @@ namespace {
     const QString ContentTypeFormat("Content-Type: %1/%2\r\n\r\n");
     const QString ContentDispositionFilename("Content-Disposition: form-data; filename=\"%1\"\r\n");
     const QString ContentDispositionOther("Content-Disposition: form-data; name=\"%@\"\r\n\r\n");
+    const QString AccessTokenStr("access_token");
 }
 
 // Inline utility functions definitions.
@@ -58,32 +61,34 @@ namespace Util {
     */
     inline FacebookReply::OAuthError parseOAuthError(const QByteArray &result)
     {
-        // Evaluate string to JSON object.
-        QScriptEngine engine;
-        QScriptValue value = engine.evaluate("(" + QString(result) + ")");
+        JsonReader reader(result);
 
-        return (FacebookReply::OAuthError)value.property("error").property("code").toInt32();
+        if (!JsonProjection::findPath(reader, "error.code")) {
+            return FacebookReply::OAuthNoError;
+        }
+
+        return (FacebookReply::OAuthError)reader.value().toInt();
     }
 
 
     /*!
      \internal
 
-      Helper function for reading file raw data to array.
+      Helper function for checking that a file can be uploaded.
     */
-    inline QByteArray handleFile(const QUrl &fileUrl)
+    inline bool isReadableFile(const QUrl &fileUrl)
     {
-        QFile file(fileUrl.toLocalFile());
-        if (!file.exists()) {
+        QFileInfo info(fileUrl.toLocalFile());
+        if (!info.exists()) {
             qWarning() << "File not found:" << fileUrl.toLocalFile();
-            return QByteArray();
+            return false;
         }
-        if (!file.open(QIODevice::ReadOnly)) {
+        if (!info.isReadable()) {
             qWarning() << "Cannot open file:" << fileUrl.toLocalFile();
-            return QByteArray();
+            return false;
         }
 
-        return file.readAll();
+        return info.size() > 0;
     }
 
 
@@ -92,9 +97,10 @@ namespace Util {
 
       Helper function for constructing an URL.
     */
-    inline QUrl generateUrl(const QString &graphPath, const QVariantMap &parameters)
+    inline QUrl generateUrl(const QString &graphUrl, const QString &graphPath,
+                            const QVariantMap &parameters)
     {
-        QUrl url(GraphURL);
+        QUrl url(graphUrl);
         url.setPath(graphPath);
 
         QMapIterator<QString, QVariant> i(parameters);
@@ -114,55 +120,59 @@ namespace Util {
     /*!
      \internal
 
-     Helper function for generating body for POST request.
+     Helper function for generating body for POST request. The files are
+     not read into memory; \a body reads them while the request is sent.
+     Returns false if a file cannot be opened.
     */
-    inline QByteArray generateBody(const QVariantMap &parameters)
+    inline bool generateBody(const QVariantMap &parameters, MultipartDevice *body)
     {
         QVariantMap data(parseData(parameters));
-        QByteArray body;
-        body.append(QString("--%1\r\n").arg(Boundary).toAscii());
+        body->addData(QString("--%1\r\n").arg(Boundary).toAscii());
         const QByteArray endLine(QString(EndLine).arg(Boundary).toAscii());
 
         QMapIterator<QString, QVariant> iter(data);
 
         while (iter.hasNext()) {
             iter.next();
-            QByteArray bytes;
 
             if (iter.key().compare(Image) == 0) {
                 QUrl url(iter.value().toString());
 
-                if (url.scheme().compare("file") == 0) {
-                    bytes = Util::handleFile(url);
-
-                    if (!bytes.isEmpty()) {
-                        // Strip file type from file name for Content-Type part of the body.
-                        QString fileType = url.path().section(".", -1);
-                        qDebug() << "Filetype:" << fileType;
-                        body.append(QString(ContentDispositionFilename).arg(iter.value().toString()));
-                        body.append(QString(ContentTypeFormat).arg("image").arg(fileType));
-                        body.append(bytes);
+                if (url.scheme().compare("file") == 0 && Util::isReadableFile(url)) {
+                    // Strip file type from file name for Content-Type part of the body.
+                    QString fileType = url.path().section(".", -1);
+                    qDebug() << "Filetype:" << fileType;
+                    QByteArray header;
+                    header.append(QString(ContentDispositionFilename).arg(iter.value().toString()));
+                    header.append(QString(ContentTypeFormat).arg("image").arg(fileType));
+                    body->addData(header);
+
+                    if (!body->addFile(url.toLocalFile())) {
+                        qWarning() << "Cannot open file:" << url.toLocalFile();
+                        return false;
                     }
                 }
             }
             else if (iter.key().compare(Video) == 0) {
                 QUrl url(iter.value().toString());
 
-                if (url.scheme().compare("file") == 0) {
-                    bytes = Util::handleFile(url);
+                if (url.scheme().compare("file") == 0 && Util::isReadableFile(url)) {
+                    QByteArray header;
+                    header.append(QString(ContentDispositionFilename).arg(iter.value().toString()));
+                    header.append(QString(ContentTypeFormat).arg(parameters.value("contentType").toString()));
+                    body->addData(header);
 
-                    if (!bytes.isEmpty()) {
-                        body.append(QString(ContentDispositionFilename).arg(iter.value().toString()));
-                        body.append(QString(ContentTypeFormat).arg(parameters.value("contentType").toString()));
-                        body.append(bytes);
+                    if (!body->addFile(url.toLocalFile())) {
+                        qWarning() << "Cannot open file:" << url.toLocalFile();
+                        return false;
                     }
                 }
             }
 
-            body.append(endLine);
+            body->addData(endLine);
         }
 
-        return body;
+        return true;
     }
 } // namespace Util
 
@@ -181,20 +191,22 @@ namespace Util {
   Constructor.
 */
 FacebookRequest::FacebookRequest(const QVariant &requestId,
-                                 QNetworkAccessManager *networkAccess,
+                                 NetworkTransport *transport,
                                  const QVariantMap &parameters,
                                  const FacebookConnection::HTTPMethod method,
                                  const QString &graphPath,
                                  QObject *parent)
     : QObject(parent),
-      m_networkAccess(networkAccess),
+      m_transport(transport),
       m_ongoingRequest(0),
       m_requestId(requestId),
       m_parameters(parameters),
       m_method(method),
+      m_cacheLoadControl(QNetworkRequest::PreferNetwork),
+      m_timeout(0),
+      m_graphUrl(GraphURL),
       m_graphPath(graphPath)
 {
-    connect(m_networkAccess, SIGNAL(finished(QNetworkReply*)), this, SLOT(onFinished(QNetworkReply*)));
 }
 
 /*!
@@ -224,21 +236,55 @@ bool FacebookRequest::executeRequest()
 
     bool ret = true;
 
-    QNetworkRequest request(Util::generateUrl(m_graphPath, m_parameters));
+    QNetworkRequest request(Util::generateUrl(m_graphUrl, m_graphPath, m_parameters));
     qDebug() << "FacebookRequest::executeRequest - URL:" << request.url();
 
+    // Facebook reports its rate limits as errors in the response body. The
+    // transport retries the requests failing with them.
+    QVariantList rateLimitCodes;
+    rateLimitCodes << int(FacebookReply::OAuthApplicationRateLimit)
+                   << int(FacebookReply::OAuthUserRateLimit);
+    request.setAttribute(QNetworkRequest::Attribute(NetworkTransport::RateLimitCodesAttribute),
+                         rateLimitCodes);
+
+    // An upload takes as long as its files need, so it is only kept from
+    // stalling.
+    const bool upload = !Util::parseData(m_parameters).isEmpty();
+    request.setAttribute(QNetworkRequest::Attribute(upload ? NetworkTransport::TimeoutAttribute
+                                                           : NetworkTransport::DeadlineAttribute),
+                         m_timeout);
+
     switch (m_method) {
-    case FacebookConnection::HTTPPost:
+    case FacebookConnection::HTTPPost: {
         request.setRawHeader("Content-Type",
                              QString("multipart/form-data; boundary=%1")
                              .arg(Boundary).toAscii());
-        m_ongoingRequest = m_networkAccess->post(request, Util::generateBody(m_parameters));
+        MultipartDevice *body = new MultipartDevice(this);
+
+        if (!Util::generateBody(m_parameters, body)) {
+            delete body;
+            FacebookReply *facebookReply =
+                    new FacebookReply(QByteArray(), true,
+                                      FacebookReply::OAuthGeneralError,
+                                      "Facebook error. Cannot read the file to upload.",
+                                      this);
+            emit requestFinished(this, facebookReply);
+            ret = false;
+            break;
+        }
+
+        body->open(QIODevice::ReadOnly);
+        m_ongoingRequest = m_transport->post(request, body);
         break;
+    }
     case FacebookConnection::HTTPGet:
-        m_ongoingRequest = m_networkAccess->get(request);
+        request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, m_cacheLoadControl);
+        request.setAttribute(QNetworkRequest::Attribute(NetworkTransport::CacheScopeAttribute),
+                             m_parameters.value(AccessTokenStr));
+        m_ongoingRequest = m_transport->get(request);
         break;
     case FacebookConnection::HTTPDelete:
-        m_ongoingRequest = m_networkAccess->deleteResource(request);
+        m_ongoingRequest = m_transport->deleteResource(request);
         break;
     default: {
         FacebookReply *facebookReply =
@@ -251,6 +297,10 @@ bool FacebookRequest::executeRequest()
     }
     }
 
+    if (ret) {
+        connect(m_ongoingRequest, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    }
+
     return ret;
 }
 
@@ -283,11 +333,57 @@ QVariant FacebookRequest::requestId() const
 /*!
   \internal
 
-  Handles the response for the request.
+  Returns the network reply of the executed request.
+*/
+QNetworkReply *FacebookRequest::networkReply() const
+{
+    return m_ongoingRequest;
+}
+
+/*!
+  \internal
+
+  Sets the URL of the Graph API the request is sent to. Must be called
+  before executeRequest().
+*/
+void FacebookRequest::setGraphUrl(const QString &graphUrl)
+{
+    m_graphUrl = graphUrl;
+}
+
+/*!
+  \internal
+
+  Sets how a GET request uses the response cache. Must be called before
+  executeRequest().
+*/
+void FacebookRequest::setCacheLoadControl(QNetworkRequest::CacheLoadControl cacheLoadControl)
+{
+    m_cacheLoadControl = cacheLoadControl;
+}
+
+/*!
+  \internal
+
+  Sets the time in milliseconds the request may take before it is aborted,
+  or stall if it uploads a file, 0 for none. Must be called before
+  executeRequest().
+*/
+void FacebookRequest::setTimeout(int timeout)
+{
+    m_timeout = timeout;
+}
+
+/*!
+  \internal
+
+  Handles the response for the request. Called by Facebook with the reply
+  this request started.
 */
 void FacebookRequest::onFinished(QNetworkReply *reply)
 {
-    const QByteArray result = reply->readAll();
+    const QByteArray result = m_response + reply->readAll();
+    m_response.clear();
 
     FacebookReply::OAuthError oauthError = FacebookReply::OAuthNoError;
 
@@ -307,4 +403,22 @@ void FacebookRequest::onFinished(QNetworkReply *reply)
     emit requestFinished(this, facebookReply);
 }
 
+/*!
+  \internal
+
+  Reads the part of the response that has arrived, and reports it with
+  dataReceived() unless it is an error response.
+*/
+void FacebookRequest::onReadyRead()
+{
+    if (m_ongoingRequest.isNull()) {
+        return;
+    }
+
+    const QByteArray data = m_ongoingRequest->readAll();
+    m_response.append(data);
 
+    if (m_ongoingRequest->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() < 400) {
+        emit dataReceived(this, data);
+    }
+}
@@ -7,11 +7,11 @@
 
 #include <QVariantMap>
 #include <QPointer>
+#include <QNetworkRequest>
 #include "facebookconnection.h"
 
 class QNetworkReply;
-class QNetworkRequest;
-class QNetworkAccessManager;
+class NetworkTransport;
 class FacebookReply;
 
 class FacebookRequest : public QObject
@@ -20,7 +20,7 @@ class FacebookRequest : public QObject
 
 public:
     explicit FacebookRequest(const QVariant &requestId,
-                             QNetworkAccessManager *networkAccess,
+                             NetworkTransport *transport,
                              const QVariantMap &parameters,
                              const FacebookConnection::HTTPMethod method,
                              const QString &graphPath,
@@ -31,6 +31,10 @@ public:
     bool executeRequest();
     void cancelRequest();
     QVariant requestId() const;
+    QNetworkReply *networkReply() const;
+    void setGraphUrl(const QString &graphUrl);
+    void setCacheLoadControl(QNetworkRequest::CacheLoadControl cacheLoadControl);
+    void setTimeout(int timeout);
 
 signals:
 
@@ -38,20 +42,32 @@ signals:
        \internal
      */
     void requestFinished(FacebookRequest *request, FacebookReply *reply);
+
+    /*!
+       \internal
+     */
+    void dataReceived(FacebookRequest *request, const QByteArray &data);
     
 public slots:
     void onFinished(QNetworkReply *reply);
 
+private slots:
+    void onReadyRead();
+
 private: // Member data
 
-    // Reference to network access manager. Owned by FacebookConnection.
-    QNetworkAccessManager *m_networkAccess;
+    // Reference to the shared network transport.
+    NetworkTransport *m_transport;
     QPointer<QNetworkReply> m_ongoingRequest; // Not owned
 
     QVariant m_requestId;
     QVariantMap m_parameters;
     FacebookConnection::HTTPMethod m_method;
+    QNetworkRequest::CacheLoadControl m_cacheLoadControl;
+    int m_timeout;
+    QString m_graphUrl;
     QString m_graphPath;
+    QByteArray m_response; // The part of the response read so far.
 };
 
 #endif // FACEBOOKREQUEST_H
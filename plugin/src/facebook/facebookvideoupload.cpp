@@ -0,0 +1,638 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include "facebookvideoupload.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QSettings>
+#include <QTimer>
+#include <QUrl>
+#include <QDebug>
+#include "multipartdevice.h"
+#include "networktransport.h"
+
+// Constants
+namespace {
+    const char *GraphVideoUrl = "https://graph-video.facebook.com/me/videos";
+    const char *Boundary = "8mVq2TzRkCw4HbXoLs7YfNeGu1PaJd3S";
+    const char *SessionGroup = "facebook_video_uploads";
+    const char *ChunkFileName = "chunk";
+    const char *UploadPhase = "upload_phase";
+    const char *UploadSessionId = "upload_session_id";
+    const char *StartOffset = "start_offset";
+    const char *EndOffset = "end_offset";
+    const char *VideoId = "video_id";
+    const char *FileSize = "file_size";
+    const char *LastModified = "last_modified";
+    const char *VideoFileChunk = "video_file_chunk";
+    const int DefaultChunkSize = 4 * 1024 * 1024;
+    const int MinimumChunkSize = 64 * 1024;
+    const int MaxRetries = 5;
+    const int InitialRetryDelay = 1000; // ms
+}
+
+
+/*!
+  \class FacebookVideoUpload
+  \brief The FacebookVideoUpload class uploads a video file to Facebook in
+         chunks using the resumable upload protocol. Do not use this class
+         directly. Use FacebookConnection::uploadVideo() instead.
+
+  The upload runs in three phases. The start phase opens an upload session,
+  the transfer phase sends the file one chunk at a time at the offsets the
+  server asks for, and the finish phase publishes the video. The session and
+  the offset of the next chunk are stored in QSettings after every chunk, so
+  an upload of the same unmodified file continues from where it stopped,
+  also after the application is restarted.
+
+  A chunk that fails because of the network or a server error is sent again
+  after an exponentially growing delay. The transport does not retry the
+  requests of the upload on its own, so a chunk is sent at most MaxRetries
+  times more. An upload that runs out of retries keeps its session for a
+  later attempt; an upload rejected by the server forgets it. A stored
+  session the server rejects, because it has expired, is replaced with a
+  new one once.
+
+  The sessions are stored for each account and upload URL, so the session
+  of one account is never continued with another.
+*/
+
+
+/*!
+  \internal
+
+  Constructor.
+*/
+FacebookVideoUpload::FacebookVideoUpload(QObject *parent)
+    : QObject(parent),
+      m_transport(NetworkTransport::instance()),
+      m_retryTimer(new QTimer(this)),
+      m_graphVideoUrl(GraphVideoUrl),
+      m_chunkSize(DefaultChunkSize),
+      m_timeout(0),
+      m_retries(0),
+      m_phase(Idle),
+      m_fileSize(0),
+      m_startOffset(0),
+      m_endOffset(0),
+      m_chunkLength(0),
+      m_resumed(false)
+{
+    m_retryTimer->setSingleShot(true);
+    connect(m_retryTimer, SIGNAL(timeout()), this, SLOT(sendCurrentPhase()));
+
+    m_response.addField(UploadSessionId, UploadSessionId);
+    m_response.addField(VideoId, VideoId);
+    m_response.addField(StartOffset, StartOffset);
+    m_response.addField(EndOffset, EndOffset);
+    m_response.addField("success", "success");
+    m_response.addField("error.message", "errorMessage");
+}
+
+/*!
+  \internal
+
+  Destructor. An upload in progress is aborted; its session is kept.
+*/
+FacebookVideoUpload::~FacebookVideoUpload()
+{
+    if (!m_reply.isNull()) {
+        QNetworkReply *reply = m_reply;
+        m_reply = 0;
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+}
+
+/*!
+  \internal
+
+  Returns the URL the upload requests are posted to.
+*/
+QString FacebookVideoUpload::graphVideoUrl() const
+{
+    return m_graphVideoUrl;
+}
+
+/*!
+  \internal
+
+  Sets the URL the upload requests are posted to. Takes effect from the next
+  request.
+*/
+void FacebookVideoUpload::setGraphVideoUrl(const QString &graphVideoUrl)
+{
+    m_graphVideoUrl = graphVideoUrl;
+}
+
+/*!
+  \internal
+
+  Returns the largest number of bytes sent in one chunk.
+*/
+int FacebookVideoUpload::chunkSize() const
+{
+    return m_chunkSize;
+}
+
+/*!
+  \internal
+
+  Sets the largest number of bytes sent in one chunk. The server may ask for
+  smaller chunks. Takes effect from the next chunk.
+*/
+void FacebookVideoUpload::setChunkSize(int chunkSize)
+{
+    m_chunkSize = qMax(chunkSize, MinimumChunkSize);
+}
+
+/*!
+  \internal
+
+  Returns the time in milliseconds a request of the upload may stall before
+  it is aborted, 0 for none.
+*/
+int FacebookVideoUpload::timeout() const
+{
+    return m_timeout;
+}
+
+/*!
+  \internal
+
+  Sets the time in milliseconds a request of the upload may stall before it
+  is aborted. Takes effect from the next request.
+*/
+void FacebookVideoUpload::setTimeout(int timeout)
+{
+    m_timeout = qMax(0, timeout);
+}
+
+/*!
+  \internal
+
+  Returns true if an upload is in progress.
+*/
+bool FacebookVideoUpload::isActive() const
+{
+    return m_phase != Idle;
+}
+
+/*!
+  \internal
+
+  Starts uploading the file \a fileName, or continues a stored session of
+  it. The \a parameters, such as title and description, are sent in the
+  finish phase. Returns false if an upload is already in progress or the
+  file cannot be read; otherwise finished() is emitted later.
+*/
+bool FacebookVideoUpload::start(const QString &accessToken,
+                                const QString &fileName,
+                                const QVariantMap &parameters)
+{
+    if (isActive()) {
+        qWarning() << "FacebookVideoUpload::start - Upload already in progress.";
+        return false;
+    }
+
+    QFileInfo info(fileName);
+
+    if (!info.isFile() || !info.isReadable() || info.size() <= 0) {
+        qWarning() << "FacebookVideoUpload::start - Cannot read file:" << fileName;
+        return false;
+    }
+
+    m_accessToken = accessToken;
+    m_fileName = info.absoluteFilePath();
+    m_fileSize = info.size();
+    m_lastModified = info.lastModified().toString(Qt::ISODate);
+    m_parameters = parameters;
+    m_retries = 0;
+
+    m_resumed = restoreSession();
+
+    if (m_resumed) {
+        qDebug() << "FacebookVideoUpload::start - Resuming at" << m_startOffset
+                 << "of" << m_fileSize;
+        m_phase = m_startOffset < m_fileSize ? TransferPhase : FinishPhase;
+        sendCurrentPhase();
+    }
+    else {
+        sendStart();
+    }
+
+    return true;
+}
+
+/*!
+  \internal
+
+  Cancels the upload in progress. The session is kept so that the upload can
+  be continued later.
+*/
+void FacebookVideoUpload::cancel()
+{
+    if (!isActive()) {
+        return;
+    }
+
+    if (!m_reply.isNull()) {
+        QNetworkReply *reply = m_reply;
+        m_reply = 0;
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+
+    complete(false, "Operation canceled");
+}
+
+/*!
+  \internal
+
+  Handles the response of the current phase and sends the next request.
+*/
+void FacebookVideoUpload::onReplyFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (!reply || reply != m_reply) {
+        return;
+    }
+
+    m_reply = 0;
+    reply->deleteLater();
+
+    const QVariantMap response = m_response.projectObject(reply->readAll());
+
+    if (reply->error() != QNetworkReply::NoError) {
+        QString errorMessage = response.value("errorMessage").toString();
+
+        if (errorMessage.isEmpty()) {
+            errorMessage = reply->errorString();
+        }
+
+        qWarning() << "FacebookVideoUpload - Phase" << m_phase << "failed:" << errorMessage;
+
+        // A bad request means the session is not usable any more; other
+        // errors are worth another try. A stored session may just have
+        // expired, so the upload starts over with a new one.
+        if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 400) {
+            removeSession();
+
+            if (m_resumed && m_phase != StartPhase) {
+                qDebug() << "FacebookVideoUpload - Stored session rejected, starting over.";
+                m_retries = 0;
+                sendStart();
+            }
+            else {
+                complete(false, errorMessage);
+            }
+        }
+        else if (!retry()) {
+            complete(false, errorMessage);
+        }
+
+        return;
+    }
+
+    m_retries = 0;
+
+    switch (m_phase) {
+    case StartPhase:
+        m_sessionId = response.value(UploadSessionId).toString();
+        m_videoId = response.value(VideoId).toString();
+
+        if (m_sessionId.isEmpty()) {
+            complete(false, "Facebook error. No upload session.");
+            return;
+        }
+        // Fall through, the start response carries the first chunk offsets.
+    case TransferPhase: {
+        bool startOk = false;
+        bool endOk = false;
+        const qint64 startOffset = response.value(StartOffset).toLongLong(&startOk);
+        const qint64 endOffset = response.value(EndOffset).toLongLong(&endOk);
+
+        if (!startOk || !endOk || startOffset < 0 || endOffset < startOffset ||
+            startOffset > m_fileSize) {
+            removeSession();
+            complete(false, "Facebook error. Invalid upload offsets.");
+            return;
+        }
+
+        m_startOffset = startOffset;
+        m_endOffset = qMin(endOffset, m_fileSize);
+        storeSession();
+        emit progress(m_startOffset, m_fileSize);
+
+        if (m_startOffset < m_fileSize) {
+            m_phase = TransferPhase;
+            sendTransfer();
+        }
+        else {
+            m_phase = FinishPhase;
+            sendFinish();
+        }
+        break;
+    }
+    case FinishPhase:
+        removeSession();
+
+        if (!response.value("success").toBool()) {
+            complete(false, "Facebook error. Video not published.");
+            return;
+        }
+
+        complete(true);
+        break;
+    default:
+        break;
+    }
+}
+
+/*!
+  \internal
+
+  Reports the bytes of the file sent so far, estimated from the progress of
+  the chunk in flight.
+*/
+void FacebookVideoUpload::onUploadProgress(qint64 bytesSent, qint64 bytesTotal)
+{
+    if (m_phase == TransferPhase && bytesTotal > 0) {
+        emit progress(m_startOffset + m_chunkLength * bytesSent / bytesTotal, m_fileSize);
+    }
+}
+
+/*!
+  \internal
+
+  Sends the request of the current phase.
+*/
+void FacebookVideoUpload::sendCurrentPhase()
+{
+    switch (m_phase) {
+    case StartPhase:
+        sendStart();
+        break;
+    case TransferPhase:
+        sendTransfer();
+        break;
+    case FinishPhase:
+        sendFinish();
+        break;
+    default:
+        break;
+    }
+}
+
+/*!
+  \internal
+
+  Opens an upload session.
+*/
+void FacebookVideoUpload::sendStart()
+{
+    m_phase = StartPhase;
+    m_resumed = false;
+    m_sessionId.clear();
+    m_videoId.clear();
+    m_startOffset = 0;
+    m_endOffset = 0;
+
+    QVariantMap fields;
+    fields.insert(UploadPhase, "start");
+    fields.insert(FileSize, QString::number(m_fileSize));
+    post(createBody(fields));
+}
+
+/*!
+  \internal
+
+  Sends the chunk starting from the current offset.
+*/
+void FacebookVideoUpload::sendTransfer()
+{
+    // A resumed session does not know the end offset the server asked for.
+    qint64 endOffset = m_endOffset > m_startOffset ? m_endOffset : m_fileSize;
+    m_chunkLength = qMin(endOffset - m_startOffset, (qint64)m_chunkSize);
+
+    QVariantMap fields;
+    fields.insert(UploadPhase, "transfer");
+    fields.insert(UploadSessionId, m_sessionId);
+    fields.insert(StartOffset, QString::number(m_startOffset));
+
+    MultipartDevice *body = createBody(fields, m_chunkLength);
+
+    if (!body) {
+        complete(false, "Cannot read file.");
+        return;
+    }
+
+    post(body);
+}
+
+/*!
+  \internal
+
+  Closes the session and publishes the video.
+*/
+void FacebookVideoUpload::sendFinish()
+{
+    QVariantMap fields(m_parameters);
+    fields.insert(UploadPhase, "finish");
+    fields.insert(UploadSessionId, m_sessionId);
+    post(createBody(fields));
+}
+
+/*!
+  \internal
+
+  Posts \a body to the graph video URL. The body is deleted with the reply.
+*/
+void FacebookVideoUpload::post(MultipartDevice *body)
+{
+    QNetworkRequest request((QUrl(m_graphVideoUrl)));
+    request.setRawHeader("Content-Type",
+                         QString("multipart/form-data; boundary=%1")
+                         .arg(Boundary).toAscii());
+    request.setHeader(QNetworkRequest::ContentLengthHeader, body->size());
+    request.setAttribute(QNetworkRequest::Attribute(NetworkTransport::TimeoutAttribute),
+                         m_timeout);
+
+    // The phases are retried by retry(), not by the transport as well.
+    request.setAttribute(QNetworkRequest::Attribute(NetworkTransport::MaxRetriesAttribute), 0);
+
+    m_reply = m_transport->post(request, body);
+    body->setParent(m_reply);
+
+    connect(m_reply, SIGNAL(finished()), this, SLOT(onReplyFinished()));
+    connect(m_reply, SIGNAL(uploadProgress(qint64,qint64)),
+            this, SLOT(onUploadProgress(qint64,qint64)));
+    emit requestStarted(m_reply);
+}
+
+/*!
+  \internal
+
+  Creates a multipart/form-data body of the access token and \a fields. A
+  positive \a chunkLength appends that many bytes of the file from the
+  current offset. Returns 0 if the file cannot be read.
+*/
+MultipartDevice *FacebookVideoUpload::createBody(const QVariantMap &fields,
+                                                 qint64 chunkLength) const
+{
+    MultipartDevice *body = new MultipartDevice;
+    QVariantMap form(fields);
+    form.insert("access_token", m_accessToken);
+
+    QMapIterator<QString, QVariant> i(form);
+
+    while (i.hasNext()) {
+        i.next();
+        body->addData(QString("--%1\r\nContent-Disposition: form-data; name=\"%2\"\r\n\r\n")
+                      .arg(Boundary).arg(i.key()).toUtf8());
+        body->addData(i.value().toString().toUtf8());
+        body->addData("\r\n");
+    }
+
+    if (chunkLength > 0) {
+        body->addData(QString("--%1\r\nContent-Disposition: form-data; name=\"%2\"; "
+                              "filename=\"%3\"\r\n"
+                              "Content-Type: application/octet-stream\r\n\r\n")
+                      .arg(Boundary).arg(VideoFileChunk).arg(ChunkFileName).toAscii());
+
+        if (!body->addFile(m_fileName, m_startOffset, chunkLength)) {
+            delete body;
+            return 0;
+        }
+
+        body->addData("\r\n");
+    }
+
+    body->addData(QString("--%1--\r\n").arg(Boundary).toAscii());
+    body->open(QIODevice::ReadOnly);
+    return body;
+}
+
+/*!
+  \internal
+
+  Schedules the current phase to be sent again. Returns false if the
+  retries have run out.
+*/
+bool FacebookVideoUpload::retry()
+{
+    if (m_retries >= MaxRetries) {
+        return false;
+    }
+
+    const int delay = InitialRetryDelay << m_retries;
+    ++m_retries;
+    qDebug() << "FacebookVideoUpload - Retry" << m_retries << "in" << delay << "ms";
+    m_retryTimer->start(delay);
+    return true;
+}
+
+/*!
+  \internal
+
+  Ends the upload and emits finished().
+*/
+void FacebookVideoUpload::complete(bool success, const QString &errorMessage)
+{
+    const QString videoId = m_videoId;
+
+    m_retryTimer->stop();
+    m_phase = Idle;
+    m_accessToken.clear();
+    m_parameters.clear();
+    m_sessionId.clear();
+    m_videoId.clear();
+
+    emit finished(success, success ? videoId : QString(), errorMessage);
+}
+
+/*!
+  \internal
+
+  Returns the settings key of the session of the current file. The access
+  token stands for the account, which is not known otherwise.
+*/
+QString FacebookVideoUpload::sessionKey() const
+{
+    const QString key = m_accessToken + '\n' + m_graphVideoUrl + '\n' + m_fileName;
+
+    return QString(QCryptographicHash::hash(key.toUtf8(),
+                                            QCryptographicHash::Sha1).toHex());
+}
+
+/*!
+  \internal
+
+  Restores the stored session of the current file. Returns false if there
+  is none or the file has changed since.
+*/
+bool FacebookVideoUpload::restoreSession()
+{
+    QSettings settings;
+    settings.beginGroup(SessionGroup);
+    const QVariantMap session = settings.value(sessionKey()).toMap();
+    settings.endGroup();
+
+    if (session.isEmpty()) {
+        return false;
+    }
+
+    if (session.value(FileSize).toLongLong() != m_fileSize ||
+        session.value(LastModified).toString() != m_lastModified ||
+        session.value(UploadSessionId).toString().isEmpty()) {
+        removeSession();
+        return false;
+    }
+
+    m_sessionId = session.value(UploadSessionId).toString();
+    m_videoId = session.value(VideoId).toString();
+    m_startOffset = qBound((qint64)0, session.value(StartOffset).toLongLong(), m_fileSize);
+    m_endOffset = qBound(m_startOffset, session.value(EndOffset).toLongLong(), m_fileSize);
+    return true;
+}
+
+/*!
+  \internal
+
+  Stores the session and the offset of the next chunk.
+*/
+void FacebookVideoUpload::storeSession() const
+{
+    QVariantMap session;
+    session.insert(FileSize, m_fileSize);
+    session.insert(LastModified, m_lastModified);
+    session.insert(UploadSessionId, m_sessionId);
+    session.insert(VideoId, m_videoId);
+    session.insert(StartOffset, m_startOffset);
+    session.insert(EndOffset, m_endOffset);
+
+    QSettings settings;
+    settings.beginGroup(SessionGroup);
+    settings.setValue(sessionKey(), session);
+    settings.endGroup();
+}
+
+/*!
+  \internal
+
+  Removes the stored session of the current file.
+*/
+void FacebookVideoUpload::removeSession() const
+{
+    QSettings settings;
+    settings.beginGroup(SessionGroup);
+    settings.remove(sessionKey());
+    settings.endGroup();
+}
@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#ifndef FACEBOOKVIDEOUPLOAD_H
+#define FACEBOOKVIDEOUPLOAD_H
+
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtCore/QString>
+#include <QtCore/QVariantMap>
+#include "jsonprojection.h"
+
+// Forward declarations
+class MultipartDevice;
+class NetworkTransport;
+class QNetworkReply;
+class QTimer;
+
+class FacebookVideoUpload : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit FacebookVideoUpload(QObject *parent = 0);
+    virtual ~FacebookVideoUpload();
+
+public:
+
+    QString graphVideoUrl() const;
+    void setGraphVideoUrl(const QString &graphVideoUrl);
+
+    int chunkSize() const;
+    void setChunkSize(int chunkSize);
+
+    int timeout() const;
+    void setTimeout(int timeout);
+
+    bool isActive() const;
+
+    bool start(const QString &accessToken,
+               const QString &fileName,
+               const QVariantMap &parameters);
+    void cancel();
+
+signals:
+
+    void progress(qint64 bytesSent, qint64 bytesTotal);
+    void finished(bool success, const QString &videoId, const QString &errorMessage);
+    void requestStarted(QNetworkReply *reply);
+
+private slots:
+
+    void onReplyFinished();
+    void onUploadProgress(qint64 bytesSent, qint64 bytesTotal);
+    void sendCurrentPhase();
+
+private:
+
+    enum Phase {
+        Idle,
+        StartPhase,
+        TransferPhase,
+        FinishPhase
+    };
+
+    void sendStart();
+    void sendTransfer();
+    void sendFinish();
+    void post(MultipartDevice *body);
+    MultipartDevice *createBody(const QVariantMap &fields, qint64 chunkLength = 0) const;
+    bool retry();
+    void complete(bool success, const QString &errorMessage = QString());
+
+    QString sessionKey() const;
+    bool restoreSession();
+    void storeSession() const;
+    void removeSession() const;
+
+private: // Data
+
+    NetworkTransport *m_transport; // Not owned
+    QPointer<QNetworkReply> m_reply;
+    QTimer *m_retryTimer; // Owned
+    JsonProjection m_response;
+    QString m_graphVideoUrl;
+    int m_chunkSize;
+    int m_timeout;
+    int m_retries;
+
+    // The upload in progress.
+    Phase m_phase;
+    QString m_accessToken;
+    QString m_fileName;
+    qint64 m_fileSize;
+    QString m_lastModified;
+    QVariantMap m_parameters;
+    QString m_sessionId;
+    QString m_videoId;
+    qint64 m_startOffset;
+    qint64 m_endOffset;
+    qint64 m_chunkLength;
+    bool m_resumed; // The session was restored, not opened by this upload.
+};
+
+#endif // FACEBOOKVIDEOUPLOAD_H
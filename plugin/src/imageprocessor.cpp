@@ -0,0 +1,479 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include "imageprocessor.h"
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QtConcurrentRun>
+#include <QtCore/QDebug>
+#include <QtGui/QImage>
+#include <QtGui/QImageReader>
+#include <QtGui/QImageWriter>
+#include <QtGui/QTransform>
+
+// Constants
+namespace {
+    const int DefaultQuality = 85;
+    const char *TemporaryFileTemplate = "socialconnect-XXXXXX.%1";
+
+    // The Exif data is in the APP1 segment near the start of a JPEG file.
+    const int ExifSearchLength = 64 * 1024;
+    const quint16 OrientationTag = 0x0112;
+
+    // The JPEG markers of the start of scan, after which the image data
+    // follows, and of the segments holding metadata: APP1 for Exif and XMP,
+    // APP13 for IPTC, and comments.
+    const uchar StartOfScanMarker = 0xDA;
+    const uchar App1Marker = 0xE1;
+    const uchar App13Marker = 0xED;
+    const uchar CommentMarker = 0xFE;
+
+    // Reads an Exif integer of \a size bytes.
+    inline quint32 readExif(const uchar *data, int size, bool bigEndian)
+    {
+        quint32 value = 0;
+
+        for (int i = 0; i < size; i++) {
+            value |= quint32(data[i]) << (8 * (bigEndian ? size - 1 - i : i));
+        }
+
+        return value;
+    }
+}
+
+/*!
+  \class ImageProcessor
+  \brief The ImageProcessor class scales down and recompresses photos before
+         they are uploaded.
+
+  Photos are decoded, scaled and encoded on a worker thread of the global
+  QThreadPool, so the UI stays responsive. The JPEG decoder scales a photo
+  down while decoding it, so a 12 MP photo is never fully decoded in memory.
+
+  A photo larger than maximumSize() in either dimension is scaled down to fit
+  it, turned upright according to its Exif orientation and written as a JPEG
+  of quality() into a temporary file. Images with transparency are written as
+  PNG instead. The Exif data and any other metadata, such as the location the
+  photo was taken at, are not written.
+
+  No processed photo keeps its metadata, even if it is small enough already.
+  An upright JPEG photo is copied without its metadata segments, leaving the
+  compressed image untouched; any other photo is encoded again at its own
+  size. Only a BMP image, which carries no metadata, is uploaded as it is.
+
+  The temporary files are removed with release() once the upload no longer
+  needs them, and at the latest when the processor is destroyed.
+*/
+
+/*!
+  \internal
+
+  Constructor.
+*/
+ImageProcessor::ImageProcessor(QObject *parent)
+    : QObject(parent),
+      m_maximumSize(0),
+      m_quality(DefaultQuality)
+{
+}
+
+/*!
+  \internal
+
+  Destructor. Waits for the images being processed and removes the
+  temporary files.
+*/
+ImageProcessor::~ImageProcessor()
+{
+    foreach (QObject *object, m_jobs.keys()) {
+        QFutureWatcher<Result> *watcher = static_cast<QFutureWatcher<Result> *>(object);
+        watcher->waitForFinished();
+
+        if (watcher->result().temporary) {
+            QFile::remove(watcher->result().fileName);
+        }
+    }
+
+    foreach (const QString &fileName, m_temporaryFiles) {
+        QFile::remove(fileName);
+    }
+}
+
+/*!
+  \internal
+
+  Returns the largest width and height of an uploaded photo, or 0 if photos
+  are uploaded as they are.
+*/
+int ImageProcessor::maximumSize() const
+{
+    return m_maximumSize;
+}
+
+/*!
+  \internal
+*/
+void ImageProcessor::setMaximumSize(int maximumSize)
+{
+    m_maximumSize = qMax(0, maximumSize);
+}
+
+/*!
+  \internal
+
+  Returns the JPEG quality, from 0 to 100, of a scaled photo.
+*/
+int ImageProcessor::quality() const
+{
+    return m_quality;
+}
+
+/*!
+  \internal
+*/
+void ImageProcessor::setQuality(int quality)
+{
+    m_quality = qBound(0, quality, 100);
+}
+
+/*!
+  \internal
+
+  Returns true while images are being processed.
+*/
+bool ImageProcessor::isActive() const
+{
+    return !m_jobs.isEmpty();
+}
+
+/*!
+  \internal
+
+  Starts processing the image file \a fileName. finished() is emitted later
+  with \a context and the file to upload. Returns false if photos are not
+  scaled or the file is not a still image; the file is then uploaded as it
+  is.
+*/
+bool ImageProcessor::process(const QString &fileName, const QVariant &context)
+{
+    if (m_maximumSize <= 0) {
+        return false;
+    }
+
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+
+    if (suffix != "jpg" && suffix != "jpeg" && suffix != "png" && suffix != "bmp") {
+        return false;
+    }
+
+    QFutureWatcher<Result> *watcher = new QFutureWatcher<Result>(this);
+    Job job;
+    job.context = context;
+    job.canceled = false;
+    m_jobs.insert(watcher, job);
+
+    connect(watcher, SIGNAL(finished()), this, SLOT(onJobFinished()));
+    watcher->setFuture(QtConcurrent::run(&ImageProcessor::processFile,
+                                         fileName, m_maximumSize, m_quality));
+
+    return true;
+}
+
+/*!
+  \internal
+
+  Cancels the images being processed. finished() is emitted for each of them
+  with an empty file name.
+*/
+void ImageProcessor::cancel()
+{
+    QHash<QObject *, Job>::iterator i = m_jobs.begin();
+
+    for (; i != m_jobs.end(); ++i) {
+        i->canceled = true;
+    }
+}
+
+/*!
+  \internal
+
+  Removes \a fileName when \a owner is destroyed, or at once if \a owner is
+  0, if it is a temporary file written by the processor.
+*/
+void ImageProcessor::release(const QString &fileName, QObject *owner)
+{
+    if (!m_temporaryFiles.contains(fileName)) {
+        return;
+    }
+
+    if (!owner) {
+        m_temporaryFiles.remove(fileName);
+        QFile::remove(fileName);
+        return;
+    }
+
+    if (!m_owners.contains(owner)) {
+        connect(owner, SIGNAL(destroyed(QObject*)), this, SLOT(onOwnerDestroyed(QObject*)));
+    }
+
+    m_owners[owner].append(fileName);
+}
+
+/*!
+  \internal
+*/
+void ImageProcessor::onJobFinished()
+{
+    QFutureWatcher<Result> *watcher = static_cast<QFutureWatcher<Result> *>(sender());
+    const Job job = m_jobs.take(watcher);
+    const Result result = watcher->result();
+    watcher->deleteLater();
+
+    if (result.temporary) {
+        m_temporaryFiles.insert(result.fileName);
+    }
+
+    if (job.canceled) {
+        release(result.fileName);
+        emit finished(job.context, QString());
+    }
+    else {
+        emit finished(job.context, result.fileName);
+    }
+}
+
+/*!
+  \internal
+*/
+void ImageProcessor::onOwnerDestroyed(QObject *owner)
+{
+    foreach (const QString &fileName, m_owners.take(owner)) {
+        release(fileName);
+    }
+}
+
+/*!
+  \internal
+
+  Scales down and recompresses the image \a fileName, and removes its
+  metadata. Runs on a worker thread. Returns the original file if it has no
+  metadata to remove or cannot be processed.
+*/
+ImageProcessor::Result ImageProcessor::processFile(const QString &fileName,
+                                                   int maximumSize,
+                                                   int quality)
+{
+    Result result;
+    result.fileName = fileName;
+    result.originalSize = QFileInfo(fileName).size();
+    result.size = result.originalSize;
+
+    QImageReader reader(fileName);
+    const QSize size = reader.size();
+    const QByteArray sourceFormat = reader.format();
+    const int orientation = exifOrientation(fileName);
+    const bool small = size.width() <= maximumSize && size.height() <= maximumSize;
+
+    if (!size.isValid() || (small && sourceFormat == "bmp")) {
+        return result;
+    }
+
+    if (small && sourceFormat == "jpeg" && orientation <= 1) {
+        // Only the metadata is dropped; the image is not encoded again.
+        QTemporaryFile file(QDir::temp().filePath(QString(TemporaryFileTemplate).arg("jpg")));
+        file.setAutoRemove(false);
+
+        if (file.open()) {
+            const bool copied = copyWithoutMetadata(fileName, &file);
+            file.close();
+
+            if (copied) {
+                result.fileName = file.fileName();
+                result.temporary = true;
+                result.size = file.size();
+                return result;
+            }
+
+            file.remove();
+        }
+    }
+
+    // Let the decoder do the scaling; a JPEG is decoded straight to the
+    // smaller size.
+    if (!small) {
+        reader.setScaledSize(size.scaled(maximumSize, maximumSize, Qt::KeepAspectRatio));
+    }
+
+    QImage image = reader.read();
+
+    if (image.isNull()) {
+        qWarning() << "ImageProcessor - Cannot read" << fileName << reader.errorString();
+        return result;
+    }
+
+    // The orientation is lost with the Exif data, so the pixels are turned
+    // instead.
+    QTransform transform;
+    bool mirror = false;
+
+    switch (orientation) {
+    case 2: mirror = true; break;
+    case 3: transform.rotate(180); break;
+    case 4: transform.rotate(180); mirror = true; break;
+    case 5: transform.rotate(90); mirror = true; break;
+    case 6: transform.rotate(90); break;
+    case 7: transform.rotate(270); mirror = true; break;
+    case 8: transform.rotate(270); break;
+    default: break;
+    }
+
+    if (!transform.isIdentity()) {
+        image = image.transformed(transform);
+    }
+
+    if (mirror) {
+        image = image.mirrored(true, false);
+    }
+
+    const QString format = image.hasAlphaChannel() ? "png" : "jpg";
+    QTemporaryFile file(QDir::temp().filePath(QString(TemporaryFileTemplate).arg(format)));
+    file.setAutoRemove(false);
+
+    if (!file.open()) {
+        qWarning() << "ImageProcessor - Cannot create a temporary file";
+        return result;
+    }
+
+    QImageWriter writer(&file, format.toAscii());
+    writer.setQuality(quality);
+    const bool written = writer.write(image);
+    file.close();
+
+    // The result is used even if it is not smaller, since the original
+    // still has its metadata.
+    if (!written) {
+        file.remove();
+        return result;
+    }
+
+    result.fileName = file.fileName();
+    result.temporary = true;
+    result.size = QFileInfo(result.fileName).size();
+
+    return result;
+}
+
+/*!
+  \internal
+
+  Writes the JPEG file \a fileName to \a device without its Exif, XMP and
+  IPTC segments and comments. Returns false if the file cannot be read or
+  its structure is not understood.
+*/
+bool ImageProcessor::copyWithoutMetadata(const QString &fileName, QIODevice *device)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QByteArray data = file.readAll();
+    const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+    const int length = data.size();
+
+    if (length < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8) {
+        return false;
+    }
+
+    device->write(data.constData(), 2);
+    int pos = 2;
+
+    // The segments before the start of scan each tell their length.
+    while (pos + 4 <= length && bytes[pos] == 0xFF && bytes[pos + 1] != StartOfScanMarker) {
+        const uchar marker = bytes[pos + 1];
+        const int segmentLength = 2 + ((bytes[pos + 2] << 8) | bytes[pos + 3]);
+
+        if (pos + segmentLength > length) {
+            return false;
+        }
+
+        if (marker != App1Marker && marker != App13Marker && marker != CommentMarker) {
+            device->write(data.constData() + pos, segmentLength);
+        }
+
+        pos += segmentLength;
+    }
+
+    if (pos + 2 > length || bytes[pos] != 0xFF || bytes[pos + 1] != StartOfScanMarker) {
+        return false;
+    }
+
+    return device->write(data.constData() + pos, length - pos) == length - pos;
+}
+
+/*!
+  \internal
+
+  Returns the Exif orientation, from 1 to 8, of the JPEG file \a fileName, or
+  0 if it has none.
+*/
+int ImageProcessor::exifOrientation(const QString &fileName)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+
+    const QByteArray data = file.read(ExifSearchLength);
+    const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+    const int length = data.size();
+
+    if (length < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8) {
+        return 0;
+    }
+
+    // Find the APP1 segment holding the Exif data.
+    int pos = 2;
+    bool found = false;
+
+    while (!found && pos + 4 <= length && bytes[pos] == 0xFF && bytes[pos + 1] != 0xDA) {
+        found = bytes[pos + 1] == 0xE1 && data.mid(pos + 4, 6) == QByteArray("Exif\0\0", 6);
+
+        if (!found) {
+            pos += 2 + ((bytes[pos + 2] << 8) | bytes[pos + 3]);
+        }
+    }
+
+    // The TIFF header follows the Exif identifier.
+    const int tiff = pos + 10;
+
+    if (!found || tiff + 8 > length) {
+        return 0;
+    }
+
+    const bool bigEndian = bytes[tiff] == 'M';
+    const int ifd = tiff + readExif(bytes + tiff + 4, 4, bigEndian);
+
+    if (ifd < tiff || ifd + 2 > length) {
+        return 0;
+    }
+
+    const int entries = readExif(bytes + ifd, 2, bigEndian);
+
+    for (int i = 0; i < entries && ifd + 2 + (i + 1) * 12 <= length; i++) {
+        const uchar *entry = bytes + ifd + 2 + i * 12;
+
+        if (readExif(entry, 2, bigEndian) == OrientationTag) {
+            const int orientation = readExif(entry + 8, 2, bigEndian);
+            return orientation >= 1 && orientation <= 8 ? orientation : 0;
+        }
+    }
+
+    return 0;
+}
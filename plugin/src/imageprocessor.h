@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#ifndef IMAGEPROCESSOR_H
+#define IMAGEPROCESSOR_H
+
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVariant>
+
+class QIODevice;
+
+class ImageProcessor : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit ImageProcessor(QObject *parent = 0);
+    virtual ~ImageProcessor();
+
+public:
+
+    // The outcome of processing a single image.
+    struct Result {
+        Result() : temporary(false), originalSize(0), size(0) {}
+
+        QString fileName;       // The file to upload.
+        bool temporary;         // True if fileName was written by the processor.
+        qint64 originalSize;
+        qint64 size;
+    };
+
+    int maximumSize() const;
+    void setMaximumSize(int maximumSize);
+
+    int quality() const;
+    void setQuality(int quality);
+
+    bool isActive() const;
+
+    bool process(const QString &fileName, const QVariant &context);
+    void cancel();
+    void release(const QString &fileName, QObject *owner = 0);
+
+    static Result processFile(const QString &fileName, int maximumSize, int quality);
+
+signals:
+
+    void finished(const QVariant &context, const QString &fileName);
+
+private slots:
+
+    void onJobFinished();
+    void onOwnerDestroyed(QObject *owner);
+
+private:
+
+    static int exifOrientation(const QString &fileName);
+    static bool copyWithoutMetadata(const QString &fileName, QIODevice *device);
+
+    struct Job {
+        QVariant context;
+        bool canceled;
+    };
+
+private: // Data
+
+    QHash<QObject *, Job> m_jobs; // Keyed by the owned future watchers.
+    QSet<QString> m_temporaryFiles;
+    QHash<QObject *, QStringList> m_owners;
+    int m_maximumSize;
+    int m_quality;
+};
+
+#endif // IMAGEPROCESSOR_H
@@ -0,0 +1,307 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include "jsonprojection.h"
+#include "jsonreader.h"
+
+#include <QtCore/QDebug>
+
+/*!
+  \class JsonProjection
+  \brief The JsonProjection class extracts a fixed set of fields from JSON
+         records in a single pass.
+
+  A projection is compiled from key paths such as "user.name" or
+  "attachment.href", each mapped to a key of the output record. Running the
+  projection over a JsonReader writes only the requested fields into the
+  output record; every member that is not on a requested path is skipped
+  without being decoded, so the cost of projecting depends on the requested
+  fields rather than on the size of the payload.
+
+  Nested arrays of records (for example the comments of a media object) are
+  projected with addList() using a projection of their own.
+
+  In StringValues mode every field is converted to its textual form and
+  fields missing from the record are inserted as empty strings, so that the
+  output records always have the same set of keys. In NativeValues mode the
+  values keep their JSON type and missing fields are left out.
+*/
+
+/*!
+  \internal
+
+  Constructor.
+*/
+JsonProjection::JsonProjection(ValueMode mode)
+    : m_mode(mode)
+{
+    m_nodes.append(Node());
+}
+
+/*!
+  \internal
+
+  Adds the field at dot separated \a path to the projection. The value is
+  written to the output record with \a key.
+
+  A field cannot be the prefix of another path of the projection, since the
+  walk either descends into an object or reads it whole. Such a field, or a
+  path below it, is ignored with a warning.
+*/
+void JsonProjection::addField(const QString &path, const QString &key)
+{
+    if (overlaps(path, false)) {
+        qWarning() << "JsonProjection: ignoring field" << path
+                   << "that overlaps another path";
+        return;
+    }
+
+    const int node = compilePath(path);
+    m_nodes[node].field = m_fieldKeys.count();
+    m_fieldKeys.append(key);
+}
+
+/*!
+  \internal
+
+  Adds the array at dot separated \a path to the projection. Each object in
+  the array is projected with \a element and the resulting list is written to
+  the output record with \a key. As with addField(), a list that overlaps
+  another path is ignored with a warning.
+*/
+void JsonProjection::addList(const QString &path, const QString &key,
+                             const JsonProjection &element)
+{
+    if (overlaps(path, true)) {
+        qWarning() << "JsonProjection: ignoring list" << path
+                   << "that overlaps another path";
+        return;
+    }
+
+    const int node = compilePath(path);
+    m_nodes[node].list = m_listKeys.count();
+    m_listKeys.append(key);
+    m_listElements.append(QSharedPointer<JsonProjection>(new JsonProjection(element)));
+}
+
+/*!
+  \internal
+
+  Projects the object the \a reader is positioned on into \a record. The
+  reader is left on the end of the object. Returns false if the reader is
+  not positioned on an object or the object is malformed.
+*/
+bool JsonProjection::project(JsonReader &reader, QVariantMap *record) const
+{
+    if (reader.tokenType() != JsonReader::BeginObject) {
+        reader.skipCurrent();
+        return false;
+    }
+
+    insertDefaults(record);
+    walk(reader, 0, record);
+
+    return !reader.hasError();
+}
+
+/*!
+  \internal
+
+  Projects the object found at \a path in the JSON document \a data. An empty
+  path denotes the top-level value.
+*/
+QVariantMap JsonProjection::projectObject(const QByteArray &data, const QString &path) const
+{
+    QVariantMap record;
+    JsonReader reader(data);
+
+    if (findPath(reader, path)) {
+        project(reader, &record);
+    }
+
+    return record;
+}
+
+/*!
+  \internal
+
+  Projects each object of the array found at \a path in the JSON document
+  \a data. An empty path denotes the top-level value. Elements that are not
+  objects are skipped.
+*/
+QVariantList JsonProjection::projectList(const QByteArray &data, const QString &path) const
+{
+    QVariantList list;
+    JsonReader reader(data);
+
+    if (!findPath(reader, path) || reader.tokenType() != JsonReader::BeginArray) {
+        return list;
+    }
+
+    while (reader.readNext() != JsonReader::EndArray && !reader.hasError()) {
+        QVariantMap record;
+
+        if (project(reader, &record)) {
+            list.append(record);
+        }
+    }
+
+    return list;
+}
+
+/*!
+  \internal
+
+  Projects each of \a records, the JSON objects cut out of a document as it
+  arrives, such as by JsonRecordSplitter.
+*/
+QVariantList JsonProjection::projectRecords(const QList<QByteArray> &records) const
+{
+    QVariantList list;
+
+    foreach (const QByteArray &record, records) {
+        list.append(projectObject(record));
+    }
+
+    return list;
+}
+
+/*!
+  \internal
+
+  Advances a freshly created \a reader to the value at dot separated \a path.
+  Returns false if the path does not exist in the document.
+*/
+bool JsonProjection::findPath(JsonReader &reader, const QString &path)
+{
+    reader.readNext();
+
+    if (path.isEmpty()) {
+        return !reader.atEnd();
+    }
+
+    foreach (const QString &segment, path.split(QLatin1Char('.'))) {
+        if (reader.tokenType() != JsonReader::BeginObject ||
+            !reader.findMember(segment)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*!
+  \internal
+
+  Returns true if \a path runs through a field or list of the projection, or
+  if a field or list (depending on \a list) at \a path would also be the
+  prefix of another path or hold the other kind of value.
+*/
+bool JsonProjection::overlaps(const QString &path, bool list) const
+{
+    const QStringList segments = path.split(QLatin1Char('.'));
+    int node = 0;
+
+    for (int i = 0; i < segments.count(); ++i) {
+        node = m_nodes.at(node).children.value(segments.at(i), -1);
+
+        if (node < 0) {
+            return false;
+        }
+
+        const Node &current = m_nodes.at(node);
+
+        if (i < segments.count() - 1 && (current.field >= 0 || current.list >= 0)) {
+            return true;
+        }
+    }
+
+    const Node &target = m_nodes.at(node);
+
+    return !target.children.isEmpty() || (list ? target.field >= 0 : target.list >= 0);
+}
+
+int JsonProjection::compilePath(const QString &path)
+{
+    int node = 0;
+
+    foreach (const QString &segment, path.split(QLatin1Char('.'))) {
+        int child = m_nodes.at(node).children.value(segment, -1);
+
+        if (child < 0) {
+            child = m_nodes.count();
+            m_nodes.append(Node());
+            m_nodes[node].children.insert(segment, child);
+        }
+
+        node = child;
+    }
+
+    return node;
+}
+
+/*!
+  \internal
+
+  Walks the members of the object the reader is positioned on, descending
+  only into members that lead to a requested field.
+*/
+void JsonProjection::walk(JsonReader &reader, int node, QVariantMap *record) const
+{
+    while (reader.readNext() == JsonReader::Name) {
+        const int child = m_nodes.at(node).children.value(reader.name(), -1);
+        reader.readNext();
+
+        if (child < 0) {
+            reader.skipCurrent();
+            continue;
+        }
+
+        const Node &current = m_nodes.at(child);
+        const JsonReader::TokenType type = reader.tokenType();
+
+        if (type == JsonReader::BeginObject && !current.children.isEmpty()) {
+            walk(reader, child, record);
+        }
+        else if (type == JsonReader::BeginArray && current.list >= 0) {
+            const JsonProjection *element = m_listElements.at(current.list).data();
+            QVariantList list;
+
+            while (reader.readNext() != JsonReader::EndArray && !reader.hasError()) {
+                QVariantMap elementRecord;
+
+                if (element->project(reader, &elementRecord)) {
+                    list.append(elementRecord);
+                }
+            }
+
+            record->insert(m_listKeys.at(current.list), list);
+        }
+        else if (current.field >= 0 && reader.isScalar()) {
+            record->insert(m_fieldKeys.at(current.field),
+                           m_mode == StringValues ? QVariant(reader.text()) : reader.value());
+        }
+        else if (current.field >= 0 && m_mode == NativeValues) {
+            record->insert(m_fieldKeys.at(current.field), reader.readCurrent());
+        }
+        else {
+            reader.skipCurrent();
+        }
+    }
+}
+
+void JsonProjection::insertDefaults(QVariantMap *record) const
+{
+    if (m_mode != StringValues) {
+        return;
+    }
+
+    foreach (const QString &key, m_fieldKeys) {
+        record->insert(key, QString(""));
+    }
+
+    foreach (const QString &key, m_listKeys) {
+        record->insert(key, QVariantList());
+    }
+}
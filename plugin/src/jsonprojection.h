@@ -0,0 +1,64 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#ifndef JSONPROJECTION_H
+#define JSONPROJECTION_H
+
+#include <QtCore/QHash>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVariant>
+#include <QtCore/QVector>
+
+class JsonReader;
+
+class JsonProjection
+{
+public:
+
+    enum ValueMode {
+        NativeValues,
+        StringValues
+    };
+
+    explicit JsonProjection(ValueMode mode = NativeValues);
+
+public:
+
+    void addField(const QString &path, const QString &key);
+    void addList(const QString &path, const QString &key, const JsonProjection &element);
+
+    bool project(JsonReader &reader, QVariantMap *record) const;
+    QVariantMap projectObject(const QByteArray &data, const QString &path = QString()) const;
+    QVariantList projectList(const QByteArray &data, const QString &path = QString()) const;
+    QVariantList projectRecords(const QList<QByteArray> &records) const;
+
+    static bool findPath(JsonReader &reader, const QString &path);
+
+private:
+
+    struct Node {
+        Node() : field(-1), list(-1) {}
+
+        QHash<QString, int> children;
+        int field;
+        int list;
+    };
+
+    bool overlaps(const QString &path, bool list) const;
+    int compilePath(const QString &path);
+    void walk(JsonReader &reader, int node, QVariantMap *record) const;
+    void insertDefaults(QVariantMap *record) const;
+
+private: // Data
+
+    ValueMode m_mode;
+    QVector<Node> m_nodes;
+    QStringList m_fieldKeys;
+    QStringList m_listKeys;
+    QList<QSharedPointer<JsonProjection> > m_listElements;
+};
+
+#endif // JSONPROJECTION_H
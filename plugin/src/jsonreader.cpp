@@ -0,0 +1,691 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include "jsonreader.h"
+
+#include <QtCore/QtGlobal>
+
+// Constants
+namespace {
+    // Deeper documents are rejected rather than walked, so that a hostile
+    // reply cannot exhaust the stack in readCurrent().
+    const int MaxDepth = 256;
+}
+
+// Inline utility functions definitions.
+namespace {
+
+    /*!
+      \internal
+
+      Returns the value of hexadecimal digit \a c or -1 if \a c is not one.
+    */
+    inline int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    inline bool isDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+}
+
+/*!
+  \class JsonReader
+  \brief The JsonReader class is a pull parser for JSON documents.
+
+  JsonReader reads the raw reply bytes directly without a script engine and
+  without building a document tree. The document is consumed one token at a
+  time with readNext(); subtrees that are not needed can be skipped with
+  skipCurrent() without decoding them, and subtrees that are needed as a whole
+  can be converted to QVariant with readCurrent(). Documents nested deeper
+  than 256 objects and arrays are treated as malformed.
+
+  The reader never copies the document: it keeps a shallow (implicitly
+  shared) reference to the data given in the constructor.
+*/
+
+/*!
+  \internal
+
+  Constructor. Creates a reader for the JSON document in \a data.
+*/
+JsonReader::JsonReader(const QByteArray &data)
+    : m_data(data),
+      m_pos(m_data.constData()),
+      m_end(m_data.constData() + m_data.size()),
+      m_state(ExpectValue),
+      m_tokenType(NoToken),
+      m_bool(false)
+{
+}
+
+/*!
+  \internal
+
+  Reads the next token and returns its type. Returns Invalid if the document
+  is malformed and EndDocument after the top-level value has been read.
+*/
+JsonReader::TokenType JsonReader::readNext()
+{
+    if (m_tokenType == Invalid || m_tokenType == EndDocument) {
+        return m_tokenType;
+    }
+
+    skipWhitespace();
+
+    switch (m_state) {
+    case ExpectValue:
+        return readValue();
+    case ExpectFirstMember:
+        if (m_pos < m_end && *m_pos == '}') {
+            return endContainer('}');
+        }
+        return readName();
+    case ExpectMemberValue:
+        if (m_pos == m_end || *m_pos != ':') {
+            return setError(QLatin1String("Expected ':' after member name."));
+        }
+        ++m_pos;
+        skipWhitespace();
+        return readValue();
+    case ExpectFirstElement:
+        if (m_pos < m_end && *m_pos == ']') {
+            return endContainer(']');
+        }
+        return readValue();
+    case ExpectCommaOrEnd:
+        if (m_pos == m_end) {
+            return setError(QLatin1String("Unexpected end of data."));
+        }
+        if (*m_pos == ',') {
+            ++m_pos;
+            skipWhitespace();
+
+            if (m_containers.last() == '{') {
+                return readName();
+            }
+            return readValue();
+        }
+        return endContainer(*m_pos);
+    case Done:
+        if (m_pos != m_end) {
+            return setError(QLatin1String("Unexpected data after the document."));
+        }
+        m_tokenType = EndDocument;
+        break;
+    }
+
+    return m_tokenType;
+}
+
+/*!
+  \internal
+
+  Returns the type of the current token.
+*/
+JsonReader::TokenType JsonReader::tokenType() const
+{
+    return m_tokenType;
+}
+
+/*!
+  \internal
+
+  Returns true if the current token is a string, number, boolean or null.
+*/
+bool JsonReader::isScalar() const
+{
+    return m_tokenType == String || m_tokenType == Number ||
+            m_tokenType == Bool || m_tokenType == Null;
+}
+
+/*!
+  \internal
+
+  Returns true if the whole document has been read or an error has occurred.
+*/
+bool JsonReader::atEnd() const
+{
+    return m_tokenType == EndDocument || m_tokenType == Invalid;
+}
+
+/*!
+  \internal
+
+  Returns true if the document was found to be malformed.
+*/
+bool JsonReader::hasError() const
+{
+    return m_tokenType == Invalid;
+}
+
+/*!
+  \internal
+
+  Returns a description of the error or an empty string if there was none.
+*/
+QString JsonReader::errorString() const
+{
+    return m_errorString;
+}
+
+/*!
+  \internal
+
+  Returns the amount of objects and arrays enclosing the current position.
+*/
+int JsonReader::depth() const
+{
+    return m_containers.size();
+}
+
+/*!
+  \internal
+
+  Returns the name of the latest object member read.
+*/
+QString JsonReader::name() const
+{
+    return m_name;
+}
+
+/*!
+  \internal
+
+  Returns the current scalar token in textual form. Booleans and null are
+  returned as "true", "false" and "null" respectively.
+*/
+QString JsonReader::text() const
+{
+    switch (m_tokenType) {
+    case String:
+    case Number:
+        return m_text;
+    case Name:
+        return m_name;
+    case Bool:
+        return m_bool ? QLatin1String("true") : QLatin1String("false");
+    case Null:
+        return QLatin1String("null");
+    default:
+        break;
+    }
+
+    return QString();
+}
+
+/*!
+  \internal
+
+  Returns the current scalar token as a QVariant. Integral numbers are
+  returned as int or qlonglong so that 64-bit identifiers keep their exact
+  value; other numbers are returned as double. Null is returned as an invalid
+  QVariant.
+*/
+QVariant JsonReader::value() const
+{
+    switch (m_tokenType) {
+    case String:
+        return m_text;
+    case Name:
+        return m_name;
+    case Bool:
+        return m_bool;
+    case Number: {
+        bool ok = false;
+
+        if (!m_text.contains(QLatin1Char('.')) &&
+            !m_text.contains(QLatin1Char('e')) &&
+            !m_text.contains(QLatin1Char('E'))) {
+            const qlonglong number = m_text.toLongLong(&ok);
+
+            if (ok) {
+                if (qlonglong(int(number)) == number) {
+                    return int(number);
+                }
+                return number;
+            }
+        }
+
+        return m_text.toDouble();
+    }
+    default:
+        break;
+    }
+
+    return QVariant();
+}
+
+/*!
+  \internal
+
+  Advances to the value of the member \a name in the current object and
+  returns true. The reader must be positioned on BeginObject or on the value
+  of a previous member of the same object. Members before the match are
+  skipped without decoding. Returns false if the object ends without a match,
+  in which case the reader is positioned on EndObject.
+*/
+bool JsonReader::findMember(const QString &name)
+{
+    forever {
+        if (readNext() != Name) {
+            return false;
+        }
+
+        if (m_name == name) {
+            return readNext() != Invalid;
+        }
+
+        readNext();
+
+        if (!skipCurrent()) {
+            return false;
+        }
+    }
+}
+
+/*!
+  \internal
+
+  Skips the value starting at the current token. For objects and arrays the
+  reader is advanced to the matching end token by scanning the raw bytes; no
+  strings are decoded and no values are built. If the current token is a
+  member name, its value is skipped. Returns false on error, including
+  nesting beyond the depth limit of the reader.
+*/
+bool JsonReader::skipCurrent()
+{
+    if (m_tokenType == Name) {
+        readNext();
+    }
+
+    if (m_tokenType != BeginObject && m_tokenType != BeginArray) {
+        return m_tokenType != Invalid;
+    }
+
+    int level = 1;
+
+    while (m_pos < m_end) {
+        const char c = *m_pos;
+
+        if (c == '"') {
+            if (!skipString()) {
+                setError(QLatin1String("Unterminated string."));
+                return false;
+            }
+            continue;
+        }
+
+        if (c == '{' || c == '[') {
+            if (m_containers.size() + level++ > MaxDepth) {
+                setError(QLatin1String("Maximum nesting depth exceeded."));
+                return false;
+            }
+        }
+        else if (c == '}' || c == ']') {
+            if (--level == 0) {
+                return endContainer(c) != Invalid;
+            }
+        }
+
+        ++m_pos;
+    }
+
+    setError(QLatin1String("Unexpected end of data."));
+    return false;
+}
+
+/*!
+  \internal
+
+  Reads the value starting at the current token and returns it as a QVariant:
+  objects become QVariantMap and arrays QVariantList. The reader is left on
+  the last token of the value. The recursion is bounded by the depth limit,
+  which readNext() enforces for every object and array it enters.
+*/
+QVariant JsonReader::readCurrent()
+{
+    switch (m_tokenType) {
+    case BeginObject: {
+        QVariantMap map;
+
+        while (readNext() == Name) {
+            const QString key = m_name;
+            readNext();
+            map.insert(key, readCurrent());
+        }
+
+        return map;
+    }
+    case BeginArray: {
+        QVariantList list;
+
+        while (readNext() != EndArray && m_tokenType != Invalid) {
+            list.append(readCurrent());
+        }
+
+        return list;
+    }
+    default:
+        break;
+    }
+
+    return value();
+}
+
+JsonReader::TokenType JsonReader::readValue()
+{
+    if (m_pos == m_end) {
+        return setError(QLatin1String("Unexpected end of data."));
+    }
+
+    if ((*m_pos == '{' || *m_pos == '[') && m_containers.size() >= MaxDepth) {
+        return setError(QLatin1String("Maximum nesting depth exceeded."));
+    }
+
+    switch (*m_pos) {
+    case '{':
+        ++m_pos;
+        m_containers.append('{');
+        m_state = ExpectFirstMember;
+        m_tokenType = BeginObject;
+        break;
+    case '[':
+        ++m_pos;
+        m_containers.append('[');
+        m_state = ExpectFirstElement;
+        m_tokenType = BeginArray;
+        break;
+    case '"':
+        if (readString(&m_text) == Invalid) {
+            return Invalid;
+        }
+        valueCompleted();
+        m_tokenType = String;
+        break;
+    case 't':
+        m_bool = true;
+        return readLiteral("true", 4, Bool);
+    case 'f':
+        m_bool = false;
+        return readLiteral("false", 5, Bool);
+    case 'n':
+        return readLiteral("null", 4, Null);
+    default:
+        return readNumber();
+    }
+
+    return m_tokenType;
+}
+
+JsonReader::TokenType JsonReader::readName()
+{
+    if (m_pos == m_end || *m_pos != '"') {
+        return setError(QLatin1String("Expected member name."));
+    }
+
+    if (readString(&m_name) == Invalid) {
+        return Invalid;
+    }
+
+    m_state = ExpectMemberValue;
+    m_tokenType = Name;
+    return m_tokenType;
+}
+
+/*!
+  \internal
+
+  Reads the string starting at the current position into \a target. Runs of
+  characters without escapes are decoded from UTF-8 in one go.
+*/
+JsonReader::TokenType JsonReader::readString(QString *target)
+{
+    ++m_pos; // Opening quote.
+    const char *run = m_pos;
+
+    while (m_pos < m_end && *m_pos != '"' && *m_pos != '\\') {
+        ++m_pos;
+    }
+
+    if (m_pos < m_end && *m_pos == '"') {
+        // Fast path: no escape sequences.
+        *target = QString::fromUtf8(run, int(m_pos - run));
+        ++m_pos;
+        return String;
+    }
+
+    QString result = QString::fromUtf8(run, int(m_pos - run));
+
+    while (m_pos < m_end) {
+        const char c = *m_pos;
+
+        if (c == '"') {
+            ++m_pos;
+            *target = result;
+            return String;
+        }
+
+        if (c != '\\') {
+            run = m_pos;
+
+            while (m_pos < m_end && *m_pos != '"' && *m_pos != '\\') {
+                ++m_pos;
+            }
+
+            result.append(QString::fromUtf8(run, int(m_pos - run)));
+            continue;
+        }
+
+        if (++m_pos == m_end) {
+            break;
+        }
+
+        const char escaped = *m_pos++;
+
+        switch (escaped) {
+        case '"':
+        case '\\':
+        case '/':
+            result.append(QLatin1Char(escaped));
+            break;
+        case 'b':
+            result.append(QLatin1Char('\b'));
+            break;
+        case 'f':
+            result.append(QLatin1Char('\f'));
+            break;
+        case 'n':
+            result.append(QLatin1Char('\n'));
+            break;
+        case 'r':
+            result.append(QLatin1Char('\r'));
+            break;
+        case 't':
+            result.append(QLatin1Char('\t'));
+            break;
+        case 'u': {
+            if (m_end - m_pos < 4) {
+                return setError(QLatin1String("Invalid unicode escape sequence."));
+            }
+
+            ushort code = 0;
+
+            for (int i = 0; i < 4; ++i) {
+                const int digit = hexValue(m_pos[i]);
+                if (digit < 0) {
+                    return setError(QLatin1String("Invalid unicode escape sequence."));
+                }
+                code = (code << 4) | digit;
+            }
+
+            m_pos += 4;
+            // Surrogate pairs arrive as two escapes and end up as two UTF-16
+            // code units next to each other, which is what QString expects.
+            result.append(QChar(code));
+            break;
+        }
+        default:
+            return setError(QLatin1String("Invalid escape sequence."));
+        }
+    }
+
+    return setError(QLatin1String("Unterminated string."));
+}
+
+/*!
+  \internal
+
+  Reads the number starting at the current position. The number must follow
+  the JSON grammar: an optional minus sign, an integer part without leading
+  zeros, an optional fraction and an optional exponent.
+*/
+JsonReader::TokenType JsonReader::readNumber()
+{
+    const char *start = m_pos;
+
+    if (m_pos < m_end && *m_pos == '-') {
+        ++m_pos;
+    }
+
+    if (m_pos == m_end || !isDigit(*m_pos)) {
+        return setError(QLatin1String("Unexpected character."));
+    }
+
+    if (*m_pos == '0') {
+        ++m_pos;
+    }
+    else {
+        while (m_pos < m_end && isDigit(*m_pos)) {
+            ++m_pos;
+        }
+    }
+
+    if (m_pos < m_end && *m_pos == '.') {
+        ++m_pos;
+
+        if (m_pos == m_end || !isDigit(*m_pos)) {
+            return setError(QLatin1String("Invalid number."));
+        }
+
+        while (m_pos < m_end && isDigit(*m_pos)) {
+            ++m_pos;
+        }
+    }
+
+    if (m_pos < m_end && (*m_pos == 'e' || *m_pos == 'E')) {
+        ++m_pos;
+
+        if (m_pos < m_end && (*m_pos == '+' || *m_pos == '-')) {
+            ++m_pos;
+        }
+
+        if (m_pos == m_end || !isDigit(*m_pos)) {
+            return setError(QLatin1String("Invalid number."));
+        }
+
+        while (m_pos < m_end && isDigit(*m_pos)) {
+            ++m_pos;
+        }
+    }
+
+    if (m_pos < m_end && (isDigit(*m_pos) || *m_pos == '.' || *m_pos == '+' ||
+                          *m_pos == '-' || *m_pos == 'e' || *m_pos == 'E')) {
+        // For example a leading zero followed by digits.
+        return setError(QLatin1String("Invalid number."));
+    }
+
+    m_text = QString::fromLatin1(start, int(m_pos - start));
+    valueCompleted();
+    m_tokenType = Number;
+    return m_tokenType;
+}
+
+JsonReader::TokenType JsonReader::readLiteral(const char *literal, int length, TokenType type)
+{
+    if (m_end - m_pos < length || qstrncmp(m_pos, literal, length) != 0) {
+        return setError(QLatin1String("Unexpected character."));
+    }
+
+    m_pos += length;
+    valueCompleted();
+    m_tokenType = type;
+    return m_tokenType;
+}
+
+JsonReader::TokenType JsonReader::endContainer(char closing)
+{
+    if (m_containers.isEmpty()) {
+        return setError(QLatin1String("Unexpected character."));
+    }
+
+    const char opening = m_containers.last();
+
+    if ((opening == '{' && closing != '}') || (opening == '[' && closing != ']')) {
+        return setError(QLatin1String("Unexpected character."));
+    }
+
+    ++m_pos;
+    m_containers.remove(m_containers.size() - 1);
+    valueCompleted();
+    m_tokenType = (opening == '{') ? EndObject : EndArray;
+    return m_tokenType;
+}
+
+JsonReader::TokenType JsonReader::setError(const QString &errorString)
+{
+    m_errorString = errorString;
+    m_tokenType = Invalid;
+    m_pos = m_end;
+    return m_tokenType;
+}
+
+/*!
+  \internal
+
+  Advances past the string starting at the current position without decoding
+  it. Returns false if the string is not terminated.
+*/
+bool JsonReader::skipString()
+{
+    ++m_pos; // Opening quote.
+
+    while (m_pos < m_end) {
+        if (*m_pos == '\\') {
+            if (m_end - m_pos < 2) {
+                return false;
+            }
+            m_pos += 2;
+        }
+        else if (*m_pos++ == '"') {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void JsonReader::valueCompleted()
+{
+    m_state = m_containers.isEmpty() ? Done : ExpectCommaOrEnd;
+}
+
+void JsonReader::skipWhitespace()
+{
+    while (m_pos < m_end &&
+           (*m_pos == ' ' || *m_pos == '\n' || *m_pos == '\r' || *m_pos == '\t')) {
+        ++m_pos;
+    }
+}
@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#ifndef JSONREADER_H
+#define JSONREADER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QVariant>
+#include <QtCore/QVector>
+
+class JsonReader
+{
+public:
+
+    enum TokenType {
+        NoToken = 0,
+        Invalid,
+        BeginObject,
+        EndObject,
+        BeginArray,
+        EndArray,
+        Name,
+        String,
+        Number,
+        Bool,
+        Null,
+        EndDocument
+    };
+
+    explicit JsonReader(const QByteArray &data);
+
+public:
+
+    TokenType readNext();
+    TokenType tokenType() const;
+
+    bool isScalar() const;
+    bool atEnd() const;
+    bool hasError() const;
+    QString errorString() const;
+    int depth() const;
+
+    QString name() const;
+    QString text() const;
+    QVariant value() const;
+
+    bool findMember(const QString &name);
+    bool skipCurrent();
+    QVariant readCurrent();
+
+private:
+
+    enum State {
+        ExpectValue,
+        ExpectFirstMember,
+        ExpectMemberValue,
+        ExpectFirstElement,
+        ExpectCommaOrEnd,
+        Done
+    };
+
+    TokenType readValue();
+    TokenType readName();
+    TokenType readString(QString *target);
+    TokenType readNumber();
+    TokenType readLiteral(const char *literal, int length, TokenType type);
+    TokenType endContainer(char closing);
+    TokenType setError(const QString &errorString);
+    bool skipString();
+    void valueCompleted();
+    void skipWhitespace();
+
+private: // Data
+
+    QByteArray m_data;
+    const char *m_pos;
+    const char *m_end;
+
+    QVector<char> m_containers;
+    State m_state;
+    TokenType m_tokenType;
+
+    QString m_name;
+    QString m_text;
+    bool m_bool;
+    QString m_errorString;
+};
+
+#endif // JSONREADER_H
@@ -0,0 +1,223 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include "jsonrecordsplitter.h"
+
+/*!
+  \class JsonRecordSplitter
+  \brief The JsonRecordSplitter class cuts the records out of a JSON reply
+         while it is still being received.
+
+  The records are the elements of the top-level array of the reply, such as
+  the tweets of a Twitter timeline, or the elements of an array member of
+  the top-level object, such as the "data" array of a Graph API edge. Each
+  chunk of the reply is given to append() as it arrives, which returns the
+  records that were closed by it. A record can then be projected on its own
+  with JsonProjection, so that the first records are delivered long before
+  the last byte of the reply has arrived.
+
+  The splitter only follows the structure of the JSON: strings, escapes and
+  nesting. The records are validated when they are parsed. Elements that
+  are not objects or arrays are skipped. Only the bytes of the record being
+  received are kept, so the reply is not buffered as a whole.
+
+  count() scans a whole reply only to count its records, without copying
+  them or building any values.
+*/
+
+/*!
+  \internal
+
+  Constructor. The records are the elements of the \a member array of the
+  top-level object, or of the top-level array if \a member is empty.
+*/
+JsonRecordSplitter::JsonRecordSplitter(const QString &member)
+    : m_member(member.toUtf8()),
+      m_pos(0),
+      m_depth(0),
+      m_stringStart(-1),
+      m_recordStart(-1),
+      m_recordDepth(0),
+      m_inString(false),
+      m_escape(false),
+      m_topObject(false),
+      m_complete(false)
+{
+}
+
+/*!
+  \internal
+
+  Scans \a data, the next chunk of the reply, and returns the records that
+  were completed by it.
+*/
+QList<QByteArray> JsonRecordSplitter::append(const QByteArray &data)
+{
+    QList<QByteArray> records;
+
+    if (m_complete) {
+        return records;
+    }
+
+    m_buffer.append(data);
+    scan(&records);
+    discardScanned();
+
+    return records;
+}
+
+/*!
+  \internal
+
+  Returns true once the array of the records has been closed, or the reply
+  turned out not to contain it.
+*/
+bool JsonRecordSplitter::isComplete() const
+{
+    return m_complete;
+}
+
+/*!
+  \internal
+
+  Returns the number of records in \a data, a whole reply. The records are
+  the elements of the \a member array of the top-level object, or of the
+  top-level array if \a member is empty.
+*/
+int JsonRecordSplitter::count(const QByteArray &data, const QString &member)
+{
+    JsonRecordSplitter splitter(member);
+    splitter.m_buffer = data;
+
+    return splitter.scan(0);
+}
+
+/*!
+  \internal
+
+  Scans the buffer from where the previous scan stopped. The completed
+  records are appended to \a records, or only counted if it is 0. Returns
+  the number of records completed.
+*/
+int JsonRecordSplitter::scan(QList<QByteArray> *records)
+{
+    int completed = 0;
+    const char *bytes = m_buffer.constData();
+    const int size = m_buffer.size();
+
+    for (; m_pos < size && !m_complete; m_pos++) {
+        const char c = bytes[m_pos];
+
+        if (m_inString) {
+            if (m_escape) {
+                m_escape = false;
+            }
+            else if (c == '\\') {
+                m_escape = true;
+            }
+            else if (c == '"') {
+                m_inString = false;
+
+                // The member names of the top-level object.
+                if (m_depth == 1 && m_topObject) {
+                    m_lastString = m_buffer.mid(m_stringStart, m_pos - m_stringStart);
+                }
+
+                m_stringStart = -1;
+            }
+
+            continue;
+        }
+
+        switch (c) {
+        case '"':
+            m_inString = true;
+            m_stringStart = m_pos + 1;
+            break;
+        case ':':
+            if (m_depth == 1) {
+                m_key = m_lastString;
+            }
+            break;
+        case '{':
+        case '[':
+            if (m_depth == 0) {
+                m_topObject = c == '{';
+
+                if (m_member.isEmpty() && c == '[') {
+                    m_recordDepth = 1;
+                }
+            }
+            else if (m_recordDepth == 0) {
+                if (m_depth == 1 && m_topObject && c == '[' &&
+                    !m_member.isEmpty() && m_key == m_member) {
+                    m_recordDepth = 2;
+                }
+            }
+            else if (m_depth == m_recordDepth) {
+                m_recordStart = m_pos;
+            }
+
+            m_depth++;
+            break;
+        case '}':
+        case ']':
+            m_depth--;
+
+            if (m_recordDepth > 0 && m_depth == m_recordDepth && m_recordStart >= 0) {
+                if (records) {
+                    records->append(m_buffer.mid(m_recordStart, m_pos + 1 - m_recordStart));
+                }
+
+                m_recordStart = -1;
+                completed++;
+            }
+            else if (m_recordDepth > 0 && m_depth < m_recordDepth) {
+                // The array of the records has been closed.
+                m_complete = true;
+            }
+            else if (m_depth < 0) {
+                m_complete = true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    return completed;
+}
+
+/*!
+  \internal
+
+  Drops the scanned bytes that are not part of an unfinished record or
+  member name.
+*/
+void JsonRecordSplitter::discardScanned()
+{
+    int keep = m_pos;
+
+    if (m_recordStart >= 0) {
+        keep = m_recordStart;
+    }
+    else if (m_stringStart >= 0) {
+        keep = m_stringStart;
+    }
+
+    if (m_complete) {
+        keep = m_buffer.size();
+    }
+
+    m_buffer.remove(0, keep);
+    m_pos -= keep;
+
+    if (m_recordStart >= 0) {
+        m_recordStart -= keep;
+    }
+
+    if (m_stringStart >= 0) {
+        m_stringStart -= keep;
+    }
+}
@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#ifndef JSONRECORDSPLITTER_H
+#define JSONRECORDSPLITTER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+class JsonRecordSplitter
+{
+public:
+
+    explicit JsonRecordSplitter(const QString &member = QString());
+
+public:
+
+    QList<QByteArray> append(const QByteArray &data);
+    bool isComplete() const;
+
+    static int count(const QByteArray &data, const QString &member = QString());
+
+private:
+
+    int scan(QList<QByteArray> *records);
+    void discardScanned();
+
+private: // Data
+
+    QByteArray m_member;
+    QByteArray m_buffer;    // The bytes not scanned or still needed.
+    QByteArray m_lastString;
+    QByteArray m_key;
+    int m_pos;
+    int m_depth;
+    int m_stringStart;
+    int m_recordStart;
+    int m_recordDepth;
+    bool m_inString;
+    bool m_escape;
+    bool m_topObject;
+    bool m_complete;
+};
+
+#endif // JSONRECORDSPLITTER_H
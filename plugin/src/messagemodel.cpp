@@ -0,0 +1,390 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include "messagemodel.h"
+#include <QtCore/QDateTime>
+#include <QtCore/QLocale>
+#include <QtCore/QPair>
+#include <QtCore/QtAlgorithms>
+
+// Constants
+namespace {
+    const QString IdStr("id");
+    const QString TextStr("text");
+    const QString TimeStr("time");
+    const QString UrlStr("url");
+    const QString UserStr("user");
+
+    // The format of the times in Twitter replies.
+    const QString TwitterTimeFormat("ddd MMM dd HH:mm:ss +0000 yyyy");
+}
+
+/*!
+  \class MessageModel
+  \brief The MessageModel class is a list model of the retrieved messages,
+         newest first.
+
+  The connections add the messages they retrieve to the model, so that a
+  QML view can show them without holding the message lists given to the
+  completion signals. The model keeps only the fields of its roles, each in
+  a column of its own: the strings are kept without the QVariant and map
+  around them, and the time as a plain Unix time. The views read the fields
+  of the visible rows only, instead of the whole list being converted to a
+  JavaScript array.
+
+  The roles are "id", "text", "time", "url" and "user". Each role reads the
+  member of the same name from the message objects unless setRoleKey() gives
+  it another one; "url" is left empty unless the connection sets its key,
+  since the networks keep the link of a message in different places. A
+  message already in the model, by id, is not added again.
+
+  The model is filled only while it is \c active, so that the messages are
+  not kept both in the model and in the lists of the completion signals. An
+  active model is filled with Rows built on the parse worker, and the
+  completion signals that would have repeated the messages carry an empty
+  list instead.
+*/
+
+/*!
+  \internal
+
+  Constructor.
+*/
+MessageModel::MessageModel(QObject *parent)
+    : QAbstractListModel(parent),
+      m_active(false)
+{
+    m_keys.id = IdStr;
+    m_keys.text = TextStr;
+    m_keys.time = TimeStr;
+    m_keys.userName = UserStr;
+
+    QHash<int, QByteArray> roles;
+    roles.insert(IdRole, IdStr.toAscii());
+    roles.insert(TextRole, TextStr.toAscii());
+    roles.insert(TimeRole, TimeStr.toAscii());
+    roles.insert(UrlRole, UrlStr.toAscii());
+    roles.insert(UserNameRole, UserStr.toAscii());
+    setRoleNames(roles);
+}
+
+int MessageModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_ids.count();
+}
+
+QVariant MessageModel::data(const QModelIndex &index, int role) const
+{
+    const int row = index.row();
+
+    if (!index.isValid() || row < 0 || row >= m_ids.count()) {
+        return QVariant();
+    }
+
+    switch (role) {
+    case IdRole:
+        return m_ids.at(row);
+    case Qt::DisplayRole:
+    case TextRole:
+        return m_texts.at(row);
+    case TimeRole:
+        return m_times.at(row);
+    case UrlRole:
+        return m_urls.at(row);
+    case UserNameRole:
+        return m_userNames.at(row);
+    default:
+        return QVariant();
+    }
+}
+
+/*!
+  \internal
+
+  Returns the number of messages.
+*/
+int MessageModel::count() const
+{
+    return m_ids.count();
+}
+
+/*!
+  \internal
+
+  Returns true if the connections fill the model with the messages they
+  retrieve. The default is false.
+*/
+bool MessageModel::isActive() const
+{
+    return m_active;
+}
+
+void MessageModel::setActive(bool active)
+{
+    if (m_active != active) {
+        m_active = active;
+        emit activeChanged(m_active);
+    }
+}
+
+/*!
+  \internal
+
+  Returns the members of the message objects read into the roles, for
+  building Rows on a worker thread.
+*/
+MessageModel::RoleKeys MessageModel::roleKeys() const
+{
+    return m_keys;
+}
+
+/*!
+  \internal
+
+  Sets the member of the message objects that is read into \a role to
+  \a key. An empty key leaves the role empty.
+*/
+void MessageModel::setRoleKey(Role role, const QString &key)
+{
+    switch (role) {
+    case IdRole:
+        m_keys.id = key;
+        break;
+    case TextRole:
+        m_keys.text = key;
+        break;
+    case TimeRole:
+        m_keys.time = key;
+        break;
+    case UrlRole:
+        m_keys.url = key;
+        break;
+    case UserNameRole:
+        m_keys.userName = key;
+        break;
+    }
+}
+
+/*!
+  \internal
+
+  Adds \a messages, message objects in the format of
+  SocialConnection::retrieveMessagesCompleted(), to the model in time
+  order. See addRows().
+*/
+void MessageModel::addMessages(const QVariantList &messages)
+{
+    Rows rows;
+
+    foreach (const QVariant &message, messages) {
+        rows.append(message.toMap(), m_keys);
+    }
+
+    addRows(rows);
+}
+
+/*!
+  \internal
+
+  Adds \a rows, built with the keys of roleKeys(), to the model in time
+  order. Messages without an id and messages already in the model are
+  skipped.
+*/
+void MessageModel::addRows(const Rows &rows)
+{
+    QVector<QPair<uint, int> > order;
+
+    for (int i = 0; i < rows.count(); i++) {
+        const QString &id = rows.ids.at(i);
+
+        if (id.isEmpty() || m_knownIds.contains(id)) {
+            continue;
+        }
+
+        m_knownIds.insert(id);
+
+        // Newest first; messages of the same time keep their order.
+        order.append(qMakePair(rows.times.at(i), -i));
+    }
+
+    if (order.isEmpty()) {
+        return;
+    }
+
+    qStableSort(order.begin(), order.end(), qGreater<QPair<uint, int> >());
+
+    const int first = m_ids.count();
+    const bool older = m_times.isEmpty() || order.first().first <= m_times.last();
+
+    if (older) {
+        // The common case of a page of older messages is added as a block.
+        beginInsertRows(QModelIndex(), first, first + order.count() - 1);
+    }
+
+    for (int i = 0; i < order.count(); i++) {
+        const int index = -order.at(i).second;
+        const uint time = order.at(i).first;
+        const int row = older ? first + i : rowForTime(time);
+
+        if (!older) {
+            beginInsertRows(QModelIndex(), row, row);
+        }
+
+        m_ids.insert(row, rows.ids.at(index));
+        m_texts.insert(row, rows.texts.at(index));
+        m_times.insert(row, time);
+        m_urls.insert(row, rows.urls.at(index));
+        m_userNames.insert(row, rows.userNames.at(index));
+
+        if (!older) {
+            endInsertRows();
+        }
+    }
+
+    if (older) {
+        endInsertRows();
+    }
+
+    emit countChanged(m_ids.count());
+}
+
+/*!
+  \internal
+
+  Returns the message at \a row as an object with the role names as its
+  keys, or an empty object if there is no such row.
+*/
+QVariantMap MessageModel::get(int row) const
+{
+    QVariantMap message;
+
+    if (row < 0 || row >= m_ids.count()) {
+        return message;
+    }
+
+    message.insert(IdStr, m_ids.at(row));
+    message.insert(TextStr, m_texts.at(row));
+    message.insert(TimeStr, m_times.at(row));
+    message.insert(UrlStr, m_urls.at(row));
+    message.insert(UserStr, m_userNames.at(row));
+
+    return message;
+}
+
+/*!
+  \internal
+
+  Removes all the messages.
+*/
+void MessageModel::clear()
+{
+    if (m_ids.isEmpty()) {
+        return;
+    }
+
+    beginResetModel();
+    m_ids.clear();
+    m_texts.clear();
+    m_times.clear();
+    m_urls.clear();
+    m_userNames.clear();
+    m_knownIds.clear();
+    endResetModel();
+
+    emit countChanged(0);
+}
+
+/*!
+  \internal
+
+  Returns \a value, a Unix time, a time as given by Twitter or an ISO 8601
+  time in UTC, in seconds since the epoch, or 0 if it is none of them.
+*/
+uint MessageModel::toTime(const QVariant &value)
+{
+    bool ok = false;
+    const uint seconds = value.toString().toUInt(&ok);
+
+    if (ok) {
+        return seconds;
+    }
+
+    QDateTime time = QLocale::c().toDateTime(value.toString(), TwitterTimeFormat);
+
+    if (!time.isValid()) {
+        time = QDateTime::fromString(value.toString().left(19), Qt::ISODate);
+    }
+
+    if (!time.isValid()) {
+        return 0;
+    }
+
+    time.setTimeSpec(Qt::UTC);
+    return time.toTime_t();
+}
+
+/*!
+  \internal
+
+  Returns the number of messages.
+*/
+int MessageModel::Rows::count() const
+{
+    return ids.count();
+}
+
+/*!
+  \internal
+
+  Appends the fields of \a message read with \a keys. Reads no state of a
+  model, so it runs on a worker thread.
+*/
+void MessageModel::Rows::append(const QVariantMap &message, const RoleKeys &keys)
+{
+    ids.append(message.value(keys.id).toString());
+    texts.append(message.value(keys.text).toString());
+    times.append(toTime(message.value(keys.time)));
+    urls.append(keys.url.isEmpty() ? QString() : message.value(keys.url).toString());
+    userNames.append(keys.userName.isEmpty() ? QString()
+                                             : message.value(keys.userName).toString());
+}
+
+/*!
+  \internal
+
+  Appends the messages of \a rows.
+*/
+void MessageModel::Rows::append(const Rows &rows)
+{
+    ids += rows.ids;
+    texts += rows.texts;
+    times += rows.times;
+    urls += rows.urls;
+    userNames += rows.userNames;
+}
+
+/*!
+  \internal
+
+  Returns the row a message of \a time is inserted at: after the messages
+  that are as new or newer.
+*/
+int MessageModel::rowForTime(uint time) const
+{
+    int low = 0;
+    int high = m_times.count();
+
+    while (low < high) {
+        const int middle = (low + high) / 2;
+
+        if (m_times.at(middle) >= time) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#ifndef MESSAGEMODEL_H
+#define MESSAGEMODEL_H
+
+#include <QtCore/QAbstractListModel>
+#include <QtCore/QMetaType>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QVariant>
+#include <QtCore/QVector>
+
+class MessageModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+    Q_PROPERTY(bool active READ isActive WRITE setActive NOTIFY activeChanged)
+    Q_ENUMS(Role)
+
+public:
+
+    enum Role {
+        IdRole = Qt::UserRole + 1,
+        TextRole,
+        TimeRole,
+        UrlRole,
+        UserNameRole
+    };
+
+    // The keys of the message objects read into each role.
+    struct RoleKeys {
+        QString id;
+        QString text;
+        QString time;
+        QString url;
+        QString userName;
+    };
+
+    // Messages reduced to the fields of the roles, column by column, as
+    // stored by the model. Built on a worker thread instead of a list of
+    // message objects while the model is active.
+    struct Rows {
+        int count() const;
+        void append(const QVariantMap &message, const RoleKeys &keys);
+        void append(const Rows &rows);
+
+        QVector<QString> ids;
+        QVector<QString> texts;
+        QVector<uint> times;
+        QVector<QString> urls;
+        QVector<QString> userNames;
+    };
+
+    explicit MessageModel(QObject *parent = 0);
+
+public: // Reimplemented from QAbstractListModel.
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+public:
+
+    int count() const;
+
+    bool isActive() const;
+    void setActive(bool active);
+
+    RoleKeys roleKeys() const;
+    void setRoleKey(Role role, const QString &key);
+
+    void addMessages(const QVariantList &messages);
+    void addRows(const Rows &rows);
+
+    Q_INVOKABLE QVariantMap get(int row) const;
+    Q_INVOKABLE void clear();
+
+    static uint toTime(const QVariant &value);
+
+signals:
+
+    void countChanged(int count);
+    void activeChanged(bool active);
+
+private:
+
+    int rowForTime(uint time) const;
+
+private: // Data
+
+    // The messages column by column, newest first.
+    QVector<QString> m_ids;
+    QVector<QString> m_texts;
+    QVector<uint> m_times;
+    QVector<QString> m_urls;
+    QVector<QString> m_userNames;
+    QSet<QString> m_knownIds;
+
+    RoleKeys m_keys;
+    bool m_active;
+};
+
+Q_DECLARE_METATYPE(MessageModel::Rows)
+
+#endif // MESSAGEMODEL_H
@@ -0,0 +1,195 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include "multipartdevice.h"
+#include <QtCore/QFile>
+
+/*!
+  \class MultipartDevice
+  \brief The MultipartDevice class is a read-only device concatenating
+         bytes in memory and files into a single request body.
+
+  The files are read from disk as the body is sent, so the memory used by an
+  upload does not depend on the size of the files. The device is random
+  access and knows its size, which lets QNetworkAccessManager stream it
+  without buffering it first and rewind it to resend the body.
+*/
+
+/*!
+  \internal
+
+  Constructor.
+*/
+MultipartDevice::MultipartDevice(QObject *parent)
+    : QIODevice(parent),
+      m_size(0),
+      m_position(0)
+{
+}
+
+/*!
+  \internal
+
+  Appends \a data to the content.
+*/
+void MultipartDevice::addData(const QByteArray &data)
+{
+    Part part;
+    part.data = data;
+    part.size = data.size();
+    m_parts.append(part);
+    m_size += part.size;
+}
+
+/*!
+  \internal
+
+  Appends \a length bytes of the file \a fileName starting from \a offset,
+  or the rest of the file if \a length is negative. The file is opened at
+  once and read as the device is read. Returns false if the file cannot be
+  opened or the range is not within the file.
+*/
+bool MultipartDevice::addFile(const QString &fileName, qint64 offset, qint64 length)
+{
+    QFile *file = new QFile(fileName, this);
+
+    if (!file->open(QIODevice::ReadOnly) || offset < 0 || offset > file->size() ||
+        (length >= 0 && offset + length > file->size())) {
+        delete file;
+        return false;
+    }
+
+    Part part;
+    part.file = file;
+    part.offset = offset;
+    part.size = length >= 0 ? length : file->size() - offset;
+    m_parts.append(part);
+    m_size += part.size;
+
+    return true;
+}
+
+/*!
+  \internal
+
+  Opens the device for reading. Only QIODevice::ReadOnly is supported.
+*/
+bool MultipartDevice::open(OpenMode mode)
+{
+    if (mode & QIODevice::WriteOnly) {
+        return false;
+    }
+
+    m_position = 0;
+
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+/*!
+  \internal
+
+  Closes the device and the files.
+*/
+void MultipartDevice::close()
+{
+    foreach (const Part &part, m_parts) {
+        if (part.file) {
+            part.file->close();
+        }
+    }
+
+    QIODevice::close();
+}
+
+/*!
+  \internal
+
+  Returns false; the device is random access.
+*/
+bool MultipartDevice::isSequential() const
+{
+    return false;
+}
+
+/*!
+  \internal
+
+  Returns the total size of the content.
+*/
+qint64 MultipartDevice::size() const
+{
+    return m_size;
+}
+
+/*!
+  \internal
+
+  Moves to \a pos in the content.
+*/
+bool MultipartDevice::seek(qint64 pos)
+{
+    if (pos < 0 || pos > m_size) {
+        return false;
+    }
+
+    m_position = pos;
+
+    return QIODevice::seek(pos);
+}
+
+/*!
+  \internal
+
+  Moves to the start of the content.
+*/
+bool MultipartDevice::reset()
+{
+    return seek(0);
+}
+
+qint64 MultipartDevice::readData(char *data, qint64 maxSize)
+{
+    if (m_position >= m_size) {
+        return -1;
+    }
+
+    qint64 read = 0;
+    qint64 partStart = 0;
+
+    for (int i = 0; i < m_parts.count() && read < maxSize; i++) {
+        const Part &part = m_parts.at(i);
+        const qint64 partEnd = partStart + part.size;
+
+        if (m_position < partEnd) {
+            const qint64 offset = m_position - partStart;
+            const qint64 count = qMin(maxSize - read, part.size - offset);
+
+            if (part.file) {
+                if (!part.file->seek(part.offset + offset) ||
+                    part.file->read(data + read, count) != count) {
+                    setErrorString(part.file->errorString());
+                    return read > 0 ? read : -1;
+                }
+            }
+            else {
+                memcpy(data + read, part.data.constData() + offset, count);
+            }
+
+            read += count;
+            m_position += count;
+        }
+
+        partStart = partEnd;
+    }
+
+    return read;
+}
+
+qint64 MultipartDevice::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(maxSize)
+
+    return -1;
+}
@@ -0,0 +1,60 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#ifndef MULTIPARTDEVICE_H
+#define MULTIPARTDEVICE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QIODevice>
+#include <QtCore/QList>
+
+class QFile;
+
+class MultipartDevice : public QIODevice
+{
+    Q_OBJECT
+
+public:
+
+    explicit MultipartDevice(QObject *parent = 0);
+
+public:
+
+    void addData(const QByteArray &data);
+    bool addFile(const QString &fileName, qint64 offset = 0, qint64 length = -1);
+
+public: // Reimplemented from QIODevice.
+
+    bool open(OpenMode mode);
+    void close();
+    bool isSequential() const;
+    qint64 size() const;
+    bool seek(qint64 pos);
+    bool reset();
+
+protected:
+
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+
+    // A part of the content: either bytes in memory or a whole file.
+    struct Part {
+        Part() : file(0), offset(0), size(0) {}
+
+        QByteArray data;
+        QFile *file; // Owned by the device
+        qint64 offset;
+        qint64 size;
+    };
+
+private: // Data
+
+    QList<Part> m_parts;
+    qint64 m_size;
+    qint64 m_position;
+};
+
+#endif // MULTIPARTDEVICE_H
@@ -0,0 +1,557 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include "networktransport.h"
+#include "responsecache.h"
+#include "transportreply.h"
+#include <QtCore/QCoreApplication>
+#include <QtCore/QPointer>
+#include <QtCore/QTimer>
+#include <QtCore/QUrl>
+#include <QtNetwork/QNetworkRequest>
+
+// Constants
+namespace {
+    // QNetworkAccessManager opens at most this many connections per host.
+    const int ConnectionsPerHost = 6;
+
+    // Seconds an idle keep-alive connection is kept open by
+    // QNetworkAccessManager before it is closed.
+    const int KeepAliveTimeout = 120;
+
+    // A failed request is sent again at most this many times.
+    const int DefaultMaxRetries = 3;
+
+    // Requests per second started to a single host in the long run, and
+    // the number that can be started at once after an idle period.
+    const double DefaultRequestRate = 10.0;
+    const int RequestBurst = 10;
+
+    const char *RequestsKey = "requests";
+    const char *HandshakesKey = "handshakes";
+    const char *PeakKey = "peak";
+    const char *BytesSentKey = "bytesSent";
+    const char *BytesReceivedKey = "bytesReceived";
+    const char *HostsKey = "hosts";
+    const char *CacheHitsKey = "cacheHits";
+    const char *CacheMissesKey = "cacheMisses";
+    const char *BytesSavedKey = "bytesSaved";
+    const char *RetriesKey = "retries";
+}
+
+/*!
+  \class NetworkTransport
+  \brief The NetworkTransport class is the process-wide network transport
+         shared by all the social connections.
+
+  All the connections send their requests through a single
+  QNetworkAccessManager, so the sockets and TLS sessions to a host are reused
+  across connection objects and accounts instead of each of them opening a
+  pool of its own.
+
+  The number of requests in flight to a single host is limited by
+  maxRequestsPerHost(). Further requests are queued and started as the
+  earlier ones complete. The returned replies are TransportReply objects
+  that can be used like any QNetworkReply, also while they are queued.
+
+  The transport also keeps statistics of the workload. Since
+  QNetworkAccessManager does not report its connections, the number of
+  TCP/TLS handshakes is estimated from the number of requests in flight to
+  each host: a new connection is counted whenever more requests are in
+  flight than there are connections kept alive to the host.
+
+  The responses to GET requests are cached on disk by ResponseCache. How
+  the cache is used is controlled by the QNetworkRequest::CacheLoadControl
+  attribute of each request. The APIs of the connections mark their
+  responses private or no-store, so they are only cached for the requests
+  given the account they are made for with CacheScopeAttribute; see
+  TransportReply.
+
+  A request failing with a transient error is sent again, up to
+  maxRetries() times, after an exponential backoff with random jitter. A
+  wait given by the server with a Retry-After header or the
+  x-rate-limit-reset header of Twitter is honored instead, and later
+  requests to the rate limited host or path are held back until it is
+  over. The requests started to a host are further limited by a token
+  bucket refilled at requestRate(), so that a burst of requests is spread
+  out instead of running into the rate limit of the server.
+*/
+
+/*!
+  \internal
+
+  Returns the transport instance, creating it on first use.
+*/
+NetworkTransport *NetworkTransport::instance()
+{
+    static QPointer<NetworkTransport> transport;
+
+    if (transport.isNull()) {
+        transport = new NetworkTransport(QCoreApplication::instance());
+    }
+
+    return transport;
+}
+
+/*!
+  \internal
+
+  Constructor.
+*/
+NetworkTransport::NetworkTransport(QObject *parent)
+    : QObject(parent),
+      m_networkAccess(new QNetworkAccessManager(this)),
+      m_cache(new ResponseCache(m_networkAccess)),
+      m_timer(new QTimer(this)),
+      m_maxRequestsPerHost(ConnectionsPerHost),
+      m_maxRetries(DefaultMaxRetries),
+      m_requestRate(DefaultRequestRate),
+      m_retries(0),
+      m_bytesSent(0),
+      m_bytesReceived(0),
+      m_cacheHits(0),
+      m_cacheMisses(0),
+      m_bytesSaved(0)
+{
+    m_networkAccess->setCache(m_cache);
+
+    // The backoff is jittered so that clients failing together do not retry
+    // together.
+    qsrand(QDateTime::currentDateTime().toTime_t());
+
+    m_timer->setSingleShot(true);
+    connect(m_timer, SIGNAL(timeout()), this, SLOT(startPending()));
+}
+
+/*!
+  \internal
+
+  Destructor. Deletes the replies that have not been deleted by their
+  users.
+*/
+NetworkTransport::~NetworkTransport()
+{
+    foreach (TransportReply *reply, findChildren<TransportReply *>()) {
+        delete reply;
+    }
+}
+
+/*!
+  \internal
+
+  Returns the shared network access manager.
+*/
+QNetworkAccessManager *NetworkTransport::networkAccessManager() const
+{
+    return m_networkAccess;
+}
+
+/*!
+  \internal
+
+  Returns the response cache of the transport.
+*/
+ResponseCache *NetworkTransport::cache() const
+{
+    return m_cache;
+}
+
+/*!
+  \internal
+
+  Returns the maximum number of requests in flight to a single host.
+*/
+int NetworkTransport::maxRequestsPerHost() const
+{
+    return m_maxRequestsPerHost;
+}
+
+/*!
+  \internal
+
+  Sets the maximum number of requests in flight to a single host. Requests
+  already in flight are not affected.
+*/
+void NetworkTransport::setMaxRequestsPerHost(int maxRequestsPerHost)
+{
+    m_maxRequestsPerHost = qMax(1, maxRequestsPerHost);
+    startPending();
+}
+
+/*!
+  \internal
+
+  Returns the number of times a request failing with a transient error is
+  sent again.
+*/
+int NetworkTransport::maxRetries() const
+{
+    return m_maxRetries;
+}
+
+/*!
+  \internal
+
+  Sets the number of times a request failing with a transient error is sent
+  again. With 0 requests are never retried.
+*/
+void NetworkTransport::setMaxRetries(int maxRetries)
+{
+    m_maxRetries = qMax(0, maxRetries);
+}
+
+/*!
+  \internal
+
+  Returns the number of requests per second that can be started to a single
+  host in the long run.
+*/
+double NetworkTransport::requestRate() const
+{
+    return m_requestRate;
+}
+
+/*!
+  \internal
+
+  Sets the number of requests per second that can be started to a single
+  host in the long run. With 0 the rate is not limited.
+*/
+void NetworkTransport::setRequestRate(double requestRate)
+{
+    m_requestRate = qMax(0.0, requestRate);
+    startPending();
+}
+
+/*!
+  \internal
+
+  Sends a GET \a request.
+*/
+QNetworkReply *NetworkTransport::get(const QNetworkRequest &request)
+{
+    return enqueue(new TransportReply(QNetworkAccessManager::GetOperation,
+                                      request, QByteArray(), 0, this));
+}
+
+/*!
+  \internal
+
+  Sends a POST \a request with \a data as the body.
+*/
+QNetworkReply *NetworkTransport::post(const QNetworkRequest &request, const QByteArray &data)
+{
+    return enqueue(new TransportReply(QNetworkAccessManager::PostOperation,
+                                      request, data, 0, this));
+}
+
+/*!
+  \internal
+
+  Sends a POST \a request with the contents of \a device as the body. The
+  device must stay open until the reply has finished.
+*/
+QNetworkReply *NetworkTransport::post(const QNetworkRequest &request, QIODevice *device)
+{
+    return enqueue(new TransportReply(QNetworkAccessManager::PostOperation,
+                                      request, QByteArray(), device, this));
+}
+
+/*!
+  \internal
+
+  Sends a DELETE \a request.
+*/
+QNetworkReply *NetworkTransport::deleteResource(const QNetworkRequest &request)
+{
+    return enqueue(new TransportReply(QNetworkAccessManager::DeleteOperation,
+                                      request, QByteArray(), 0, this));
+}
+
+/*!
+  \internal
+
+  Returns the statistics collected since the transport was created or the
+  statistics were last reset. The map contains the total number of
+  requests, estimated handshakes, retries, bytes sent and received, the
+  cache hits and misses of GET requests and the bytes read from the cache
+  instead of the network, and a map of the request figures for each host.
+*/
+QVariantMap NetworkTransport::statistics() const
+{
+    QVariantMap statistics;
+    QVariantMap hosts;
+    int requests = 0;
+    int handshakes = 0;
+
+    QHashIterator<QString, Host> i(m_hosts);
+
+    while (i.hasNext()) {
+        i.next();
+        const Host &host = i.value();
+
+        QVariantMap hostStatistics;
+        hostStatistics.insert(RequestsKey, host.requests);
+        hostStatistics.insert(HandshakesKey, host.handshakes);
+        hostStatistics.insert(PeakKey, host.peak);
+        hosts.insert(i.key(), hostStatistics);
+
+        requests += host.requests;
+        handshakes += host.handshakes;
+    }
+
+    statistics.insert(RequestsKey, requests);
+    statistics.insert(HandshakesKey, handshakes);
+    statistics.insert(RetriesKey, m_retries);
+    statistics.insert(BytesSentKey, m_bytesSent);
+    statistics.insert(BytesReceivedKey, m_bytesReceived);
+    statistics.insert(CacheHitsKey, m_cacheHits);
+    statistics.insert(CacheMissesKey, m_cacheMisses);
+    statistics.insert(BytesSavedKey, m_bytesSaved);
+    statistics.insert(HostsKey, hosts);
+
+    return statistics;
+}
+
+/*!
+  \internal
+
+  Resets the collected statistics. The connections estimated to be kept
+  alive are remembered, so that a workload measured after the reset is not
+  charged for connections opened before it.
+*/
+void NetworkTransport::resetStatistics()
+{
+    QMutableHashIterator<QString, Host> i(m_hosts);
+
+    while (i.hasNext()) {
+        Host &host = i.next().value();
+        host.requests = 0;
+        host.handshakes = 0;
+        host.peak = host.active;
+    }
+
+    m_retries = 0;
+    m_bytesSent = 0;
+    m_bytesReceived = 0;
+    m_cacheHits = 0;
+    m_cacheMisses = 0;
+    m_bytesSaved = 0;
+}
+
+/*!
+  \internal
+
+  Starts \a reply if it can be started to its host now, otherwise queues
+  it, unless it is answered from the cache.
+*/
+QNetworkReply *NetworkTransport::enqueue(TransportReply *reply)
+{
+    // A response read from the cache takes no slot or token.
+    if (reply->loadFromCache()) {
+        return reply;
+    }
+
+    m_hosts[hostKey(reply->request().url())].pending.enqueue(reply);
+    startPending();
+
+    return reply;
+}
+
+/*!
+  \internal
+
+  Starts the queued requests that have a free slot and a token of their
+  host and are not held back by a rate limit or a retry backoff, and
+  schedules the next call for the earliest request held back.
+*/
+void NetworkTransport::startPending()
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    qint64 next = 0;
+
+    QMutableHashIterator<QString, Host> i(m_hosts);
+
+    while (i.hasNext()) {
+        Host &host = i.next().value();
+        refill(host, now);
+
+        QMutableHashIterator<QString, qint64> blocked(host.blockedPaths);
+
+        while (blocked.hasNext()) {
+            if (blocked.next().value() <= now) {
+                blocked.remove();
+            }
+        }
+
+        int index = 0;
+
+        while (index < host.pending.count() && host.active < m_maxRequestsPerHost) {
+            TransportReply *reply = host.pending.at(index);
+            qint64 startAt = qMax(reply->m_notBefore, host.blockedUntil);
+            startAt = qMax(startAt, host.blockedPaths.value(reply->request().url().path()));
+
+            if (startAt <= now && m_requestRate > 0 && host.tokens < 1) {
+                // The bucket holds back all the requests to the host.
+                startAt = now + qint64((1 - host.tokens) * 1000 / m_requestRate) + 1;
+                next = next ? qMin(next, startAt) : startAt;
+                break;
+            }
+
+            if (startAt > now) {
+                next = next ? qMin(next, startAt) : startAt;
+                index++;
+                continue;
+            }
+
+            host.pending.removeAt(index);
+
+            // Without a rate the bucket is not used, and is not run dry
+            // for the time a rate is set again.
+            if (m_requestRate > 0) {
+                host.tokens = qMax(0.0, host.tokens - 1);
+            }
+
+            startReply(host, reply);
+        }
+    }
+
+    if (next) {
+        m_timer->start(int(qMax<qint64>(0, next - now)));
+    }
+    else {
+        m_timer->stop();
+    }
+}
+
+void NetworkTransport::startReply(Host &host, TransportReply *reply)
+{
+    const QDateTime now = QDateTime::currentDateTime();
+
+    // Connections left idle for too long have been closed meanwhile.
+    if (host.active == 0 && host.lastActive.isValid() &&
+        host.lastActive.secsTo(now) > KeepAliveTimeout) {
+        host.connections = 0;
+    }
+
+    host.active++;
+    host.requests++;
+    host.peak = qMax(host.peak, host.active);
+
+    if (host.active > host.connections && host.connections < ConnectionsPerHost) {
+        host.connections++;
+        host.handshakes++;
+    }
+
+    m_bytesSent += reply->m_device ? reply->m_device->size() : reply->m_data.size();
+
+    reply->start();
+}
+
+/*!
+  \internal
+
+  Releases the slot of a finished \a reply and starts the next queued
+  request to the same host.
+*/
+void NetworkTransport::releaseReply(TransportReply *reply)
+{
+    Host &host = m_hosts[hostKey(reply->request().url())];
+    host.active--;
+    host.lastActive = QDateTime::currentDateTime();
+
+    startPending();
+}
+
+/*!
+  \internal
+
+  Releases the slot of the failed \a reply and queues it to be sent again
+  after \a delay milliseconds, ahead of the requests queued after it.
+*/
+void NetworkTransport::retryReply(TransportReply *reply, int delay)
+{
+    Host &host = m_hosts[hostKey(reply->request().url())];
+    host.active--;
+    host.lastActive = QDateTime::currentDateTime();
+    host.pending.prepend(reply);
+    m_retries++;
+
+    reply->m_notBefore = QDateTime::currentMSecsSinceEpoch() + delay;
+    startPending();
+}
+
+/*!
+  \internal
+
+  Removes a queued \a reply that was aborted before it was started.
+*/
+void NetworkTransport::cancelReply(TransportReply *reply)
+{
+    m_hosts[hostKey(reply->request().url())].pending.removeAll(reply);
+}
+
+/*!
+  \internal
+
+  Holds back the requests to the host of \a url, or only to its path unless
+  \a wholeHost is true, until the rate limit is reset at \a until
+  milliseconds since the epoch.
+*/
+void NetworkTransport::blockRequests(const QUrl &url, qint64 until, bool wholeHost)
+{
+    Host &host = m_hosts[hostKey(url)];
+
+    if (wholeHost) {
+        host.blockedUntil = qMax(host.blockedUntil, until);
+    }
+    else {
+        host.blockedPaths[url.path()] = qMax(host.blockedPaths.value(url.path()), until);
+    }
+}
+
+/*!
+  \internal
+
+  Adds the tokens earned by \a host since it was last refilled. A host
+  seen for the first time starts with a full bucket.
+*/
+void NetworkTransport::refill(Host &host, qint64 now) const
+{
+    if (host.refilled == 0) {
+        host.tokens = RequestBurst;
+    }
+    else if (m_requestRate > 0) {
+        host.tokens = qBound<double>(0, host.tokens + (now - host.refilled) * m_requestRate / 1000,
+                                     RequestBurst);
+    }
+
+    host.refilled = now;
+}
+
+void NetworkTransport::addReceivedBytes(qint64 bytes, bool fromCache)
+{
+    if (fromCache) {
+        m_bytesSaved += bytes;
+    }
+    else {
+        m_bytesReceived += bytes;
+    }
+}
+
+void NetworkTransport::addCacheResult(bool hit)
+{
+    if (hit) {
+        m_cacheHits++;
+    }
+    else {
+        m_cacheMisses++;
+    }
+}
+
+QString NetworkTransport::hostKey(const QUrl &url)
+{
+    return QString("%1://%2:%3").arg(url.scheme()).arg(url.host())
+            .arg(url.port(url.scheme() == "https" ? 443 : 80));
+}
@@ -0,0 +1,136 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#ifndef NETWORKTRANSPORT_H
+#define NETWORKTRANSPORT_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QQueue>
+#include <QtCore/QVariantMap>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkRequest>
+
+class QIODevice;
+class QNetworkReply;
+class QTimer;
+class ResponseCache;
+class TransportReply;
+
+class NetworkTransport : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    // Request attributes understood by the transport.
+    enum Attribute {
+        // A QVariantList of the "error.code" values of a JSON error response
+        // that mean the request was rate limited and can be retried.
+        RateLimitCodesAttribute = QNetworkRequest::User + 1,
+
+        // The milliseconds an attempt may go without sending or receiving
+        // data before it is aborted with QNetworkReply::TimeoutError.
+        TimeoutAttribute = QNetworkRequest::User + 2,
+
+        // A QString identifying the account a GET request is made for, such
+        // as its access token. The response is cached for that account only.
+        CacheScopeAttribute = QNetworkRequest::User + 3,
+
+        // The number of times the request is sent again after a transient
+        // error, instead of maxRetries(). 0 for requests retried by their
+        // users.
+        MaxRetriesAttribute = QNetworkRequest::User + 4,
+
+        // The milliseconds the request may take in all, counted from the
+        // call to the transport and including the time it is queued or
+        // waits for a retry, before it is aborted with
+        // QNetworkReply::TimeoutError.
+        DeadlineAttribute = QNetworkRequest::User + 5
+    };
+
+    static NetworkTransport *instance();
+    virtual ~NetworkTransport();
+
+public:
+
+    QNetworkAccessManager *networkAccessManager() const;
+    ResponseCache *cache() const;
+
+    int maxRequestsPerHost() const;
+    void setMaxRequestsPerHost(int maxRequestsPerHost);
+
+    int maxRetries() const;
+    void setMaxRetries(int maxRetries);
+
+    double requestRate() const;
+    void setRequestRate(double requestRate);
+
+    QNetworkReply *get(const QNetworkRequest &request);
+    QNetworkReply *post(const QNetworkRequest &request, const QByteArray &data);
+    QNetworkReply *post(const QNetworkRequest &request, QIODevice *device);
+    QNetworkReply *deleteResource(const QNetworkRequest &request);
+
+    QVariantMap statistics() const;
+    void resetStatistics();
+
+private slots:
+
+    void startPending();
+
+private:
+
+    explicit NetworkTransport(QObject *parent = 0);
+
+    // Bookkeeping of the requests to a single host.
+    struct Host {
+        Host() : active(0), connections(0), requests(0), handshakes(0), peak(0),
+                 tokens(0), refilled(0), blockedUntil(0) {}
+
+        int active;                     // Requests in flight.
+        int connections;                // Estimated open connections.
+        int requests;                   // Requests started.
+        int handshakes;                 // Estimated connection setups.
+        int peak;                       // Most requests in flight at once.
+        QDateTime lastActive;
+        QQueue<TransportReply *> pending;
+        double tokens;                  // Requests that can be started now.
+        qint64 refilled;                // Milliseconds since the epoch.
+        qint64 blockedUntil;            // Rate limit of the whole host.
+        QHash<QString, qint64> blockedPaths; // Rate limits of single paths.
+    };
+
+    QNetworkReply *enqueue(TransportReply *reply);
+    void startReply(Host &host, TransportReply *reply);
+    void releaseReply(TransportReply *reply);
+    void retryReply(TransportReply *reply, int delay);
+    void cancelReply(TransportReply *reply);
+    void blockRequests(const QUrl &url, qint64 until, bool wholeHost);
+    void refill(Host &host, qint64 now) const;
+    void addReceivedBytes(qint64 bytes, bool fromCache);
+    void addCacheResult(bool hit);
+    static QString hostKey(const QUrl &url);
+
+    friend class TransportReply;
+
+private: // Data
+
+    QNetworkAccessManager *m_networkAccess; // Owned
+    ResponseCache *m_cache; // Owned by m_networkAccess
+    QTimer *m_timer; // Owned
+    int m_maxRequestsPerHost;
+    int m_maxRetries;
+    double m_requestRate;
+    QHash<QString, Host> m_hosts;
+    int m_retries;
+    qint64 m_bytesSent;
+    qint64 m_bytesReceived;
+    int m_cacheHits;
+    int m_cacheMisses;
+    qint64 m_bytesSaved;
+};
+
+#endif // NETWORKTRANSPORT_H
@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include "parsequeue.h"
+#include <QtCore/QFutureWatcher>
+
+/*!
+  \class ParseQueue
+  \brief The ParseQueue class delivers the results of replies parsed on a
+         worker thread back to the thread of the connection.
+
+  A connection starts the parsing of a reply with QtConcurrent::run(), so
+  that the JSON is decoded and the records built on a worker thread of the
+  global QThreadPool rather than on the GUI thread, and hands the future to
+  enqueue() together with a context identifying the operation. finished() is
+  emitted with the context and the parsed records on the thread of the
+  queue once the parsing is over.
+
+  The parse function must not touch the state of the connection, except for
+  data that stays constant while the queue is active. Passing a copy of a
+  JsonProjection, which shares its compiled paths, is the common way.
+
+  isActive() stays true until finished() is emitted for the last job, so a
+  connection can keep \c busy set while its replies are being parsed and
+  clear it before the completion signal, as SocialConnection requires. A
+  connection that is canceled calls cancel(), which drops the replies still
+  being parsed and returns their contexts, so that the connection can fail
+  their operations.
+*/
+
+/*!
+  \internal
+
+  Constructor.
+*/
+ParseQueue::ParseQueue(QObject *parent)
+    : QObject(parent)
+{
+}
+
+/*!
+  \internal
+
+  Destructor. Waits for the replies being parsed; their results are
+  dropped.
+*/
+ParseQueue::~ParseQueue()
+{
+    foreach (QObject *object, m_jobs.keys()) {
+        static_cast<QFutureWatcher<QVariantList> *>(object)->waitForFinished();
+    }
+}
+
+/*!
+  \internal
+
+  Returns true while replies are being parsed.
+*/
+bool ParseQueue::isActive() const
+{
+    foreach (const Job &job, m_jobs) {
+        if (!job.canceled) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*!
+  \internal
+
+  Emits finished() with \a context and the result of \a future once it has
+  finished.
+*/
+void ParseQueue::enqueue(const QFuture<QVariantList> &future, const QVariant &context)
+{
+    QFutureWatcher<QVariantList> *watcher = new QFutureWatcher<QVariantList>(this);
+    Job job;
+    job.context = context;
+    m_jobs.insert(watcher, job);
+
+    connect(watcher, SIGNAL(finished()), this, SLOT(onJobFinished()));
+    watcher->setFuture(future);
+}
+
+/*!
+  \internal
+
+  Cancels the replies being parsed and returns their contexts. Their
+  parsing runs to the end, but the results are dropped and finished() is
+  not emitted for them.
+*/
+QVariantList ParseQueue::cancel()
+{
+    QVariantList contexts;
+    QHash<QObject *, Job>::iterator i = m_jobs.begin();
+
+    for (; i != m_jobs.end(); ++i) {
+        if (!i->canceled) {
+            i->canceled = true;
+            contexts.append(i->context);
+        }
+    }
+
+    return contexts;
+}
+
+/*!
+  \internal
+*/
+void ParseQueue::onJobFinished()
+{
+    QFutureWatcher<QVariantList> *watcher =
+            static_cast<QFutureWatcher<QVariantList> *>(sender());
+    const Job job = m_jobs.take(watcher);
+    watcher->deleteLater();
+
+    if (job.canceled) {
+        return;
+    }
+
+    emit finished(job.context, watcher->result());
+}
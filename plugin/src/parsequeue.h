@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#ifndef PARSEQUEUE_H
+#define PARSEQUEUE_H
+
+#include <QtCore/QFuture>
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QVariant>
+
+class ParseQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit ParseQueue(QObject *parent = 0);
+    virtual ~ParseQueue();
+
+public:
+
+    bool isActive() const;
+
+    void enqueue(const QFuture<QVariantList> &future, const QVariant &context);
+    QVariantList cancel();
+
+signals:
+
+    void finished(const QVariant &context, const QVariantList &result);
+
+private slots:
+
+    void onJobFinished();
+
+private:
+
+    struct Job {
+        Job() : canceled(false) {}
+
+        QVariant context;
+        bool canceled;
+    };
+
+private: // Data
+
+    QHash<QObject *, Job> m_jobs; // Keyed by the owned future watchers.
+};
+
+#endif // PARSEQUEUE_H
@@ -0,0 +1,232 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include "progressmonitor.h"
+#include <QtCore/QTimer>
+#include <QtNetwork/QNetworkReply>
+
+// Constants
+namespace {
+    const int DefaultInterval = 250; // ms
+
+    const char *BytesSentKey = "bytesSent";
+    const char *BytesToSendKey = "bytesToSend";
+    const char *BytesReceivedKey = "bytesReceived";
+    const char *BytesToReceiveKey = "bytesToReceive";
+    const char *ThroughputKey = "throughput";
+    const char *AverageThroughputKey = "averageThroughput";
+    const char *FinishedKey = "finished";
+}
+
+/*!
+  \class ProgressMonitor
+  \brief The ProgressMonitor class reports the upload and download progress
+         of the requests of a social connection.
+
+  The progress of a tracked reply is not reported on every
+  QNetworkReply::uploadProgress() and downloadProgress() signal. Instead the
+  replies that have made progress are reported together once per
+  interval(), so that a large transfer costs the QML engine a few signal
+  handler calls per second at most. The final progress of a reply is
+  always reported as it finishes.
+
+  The throughput is in bytes per second, counting both directions. The
+  instantaneous throughput is measured since the previous report of the
+  reply and the average one since the reply was tracked.
+*/
+
+/*!
+  \internal
+
+  Constructor.
+*/
+ProgressMonitor::ProgressMonitor(QObject *parent)
+    : QObject(parent),
+      m_timer(new QTimer(this))
+{
+    m_timer->setInterval(DefaultInterval);
+    m_timer->setSingleShot(true);
+    connect(m_timer, SIGNAL(timeout()), this, SLOT(emitChanged()));
+}
+
+/*!
+  \internal
+
+  Returns the minimum time in milliseconds between two progress reports of
+  a reply.
+*/
+int ProgressMonitor::interval() const
+{
+    return m_timer->interval();
+}
+
+/*!
+  \internal
+
+  Sets the minimum time in milliseconds between two progress reports of a
+  reply. With 0 every change is reported at once.
+*/
+void ProgressMonitor::setInterval(int interval)
+{
+    m_timer->setInterval(qMax(0, interval));
+}
+
+/*!
+  \internal
+
+  Starts reporting the progress of \a reply as the progress of the request
+  \a requestId. A reply tracked again also reports the progress of the
+  other requests it carries.
+*/
+void ProgressMonitor::track(QNetworkReply *reply, const QVariant &requestId)
+{
+    if (!reply) {
+        return;
+    }
+
+    if (m_transfers.contains(reply)) {
+        m_transfers[reply].requestIds.append(requestId);
+        return;
+    }
+
+    Transfer &transfer = m_transfers[reply];
+    transfer.requestIds.append(requestId);
+    transfer.started.start();
+
+    connect(reply, SIGNAL(uploadProgress(qint64,qint64)),
+            this, SLOT(onUploadProgress(qint64,qint64)));
+    connect(reply, SIGNAL(downloadProgress(qint64,qint64)),
+            this, SLOT(onDownloadProgress(qint64,qint64)));
+    connect(reply, SIGNAL(finished()), this, SLOT(onFinished()));
+    connect(reply, SIGNAL(destroyed(QObject*)), this, SLOT(onDestroyed(QObject*)));
+}
+
+/*!
+  \internal
+*/
+void ProgressMonitor::onUploadProgress(qint64 bytesSent, qint64 bytesTotal)
+{
+    QHash<QObject *, Transfer>::iterator i = m_transfers.find(sender());
+
+    if (i != m_transfers.end()) {
+        i->bytesSent = bytesSent;
+        i->bytesToSend = bytesTotal;
+        updated(*i);
+    }
+}
+
+/*!
+  \internal
+*/
+void ProgressMonitor::onDownloadProgress(qint64 bytesReceived, qint64 bytesTotal)
+{
+    QHash<QObject *, Transfer>::iterator i = m_transfers.find(sender());
+
+    if (i != m_transfers.end()) {
+        i->bytesReceived = bytesReceived;
+        i->bytesToReceive = bytesTotal;
+        updated(*i);
+    }
+}
+
+/*!
+  \internal
+
+  Reports the final progress of the finished reply.
+*/
+void ProgressMonitor::onFinished()
+{
+    QObject *reply = sender();
+
+    if (!m_transfers.contains(reply)) {
+        return;
+    }
+
+    Transfer transfer = m_transfers.take(reply);
+    reply->disconnect(this);
+    emitProgress(transfer, true);
+}
+
+/*!
+  \internal
+
+  Forgets a reply deleted before it finished.
+*/
+void ProgressMonitor::onDestroyed(QObject *reply)
+{
+    m_transfers.remove(reply);
+}
+
+/*!
+  \internal
+
+  Reports the progress of the replies changed since the last report.
+*/
+void ProgressMonitor::emitChanged()
+{
+    // The handlers may track new replies, so the changed ones are looked up
+    // one at a time.
+    foreach (QObject *reply, m_transfers.keys()) {
+        QHash<QObject *, Transfer>::iterator i = m_transfers.find(reply);
+
+        if (i != m_transfers.end() && i->changed) {
+            emitProgress(*i, false);
+        }
+    }
+}
+
+/*!
+  \internal
+
+  Marks \a transfer changed and schedules the next report.
+*/
+void ProgressMonitor::updated(Transfer &transfer)
+{
+    transfer.changed = true;
+
+    if (m_timer->interval() == 0) {
+        emitProgress(transfer, false);
+    }
+    else if (!m_timer->isActive()) {
+        m_timer->start();
+    }
+}
+
+/*!
+  \internal
+
+  Emits progress() for each request carried by the reply of \a transfer.
+*/
+void ProgressMonitor::emitProgress(Transfer &transfer, bool finished)
+{
+    const qint64 elapsed = transfer.started.elapsed();
+    const qint64 bytes = transfer.bytesSent + transfer.bytesReceived;
+    const qint64 interval = elapsed - transfer.lastElapsed;
+
+    // A retried reply counts its bytes from zero again.
+    if (bytes < transfer.lastBytes) {
+        transfer.lastBytes = 0;
+    }
+
+    QVariantMap report;
+    report.insert(BytesSentKey, transfer.bytesSent);
+    report.insert(BytesToSendKey, transfer.bytesToSend);
+    report.insert(BytesReceivedKey, transfer.bytesReceived);
+    report.insert(BytesToReceiveKey, transfer.bytesToReceive);
+    report.insert(ThroughputKey,
+                   interval > 0 ? (bytes - transfer.lastBytes) * 1000.0 / interval : 0.0);
+    report.insert(AverageThroughputKey, elapsed > 0 ? bytes * 1000.0 / elapsed : 0.0);
+    report.insert(FinishedKey, finished);
+
+    transfer.lastBytes = bytes;
+    transfer.lastElapsed = elapsed;
+    transfer.changed = false;
+
+    // Copied, the handlers may track or finish replies.
+    const QVariantList requestIds = transfer.requestIds;
+
+    foreach (const QVariant &requestId, requestIds) {
+        emit progress(requestId, report);
+    }
+}
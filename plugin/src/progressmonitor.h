@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#ifndef PROGRESSMONITOR_H
+#define PROGRESSMONITOR_H
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QVariant>
+#include <QtCore/QVariantList>
+#include <QtCore/QVariantMap>
+
+class QNetworkReply;
+class QTimer;
+
+class ProgressMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit ProgressMonitor(QObject *parent = 0);
+
+public:
+
+    int interval() const;
+    void setInterval(int interval);
+
+    void track(QNetworkReply *reply, const QVariant &requestId);
+
+signals:
+
+    void progress(const QVariant &requestId, const QVariantMap &progress);
+
+private slots:
+
+    void onUploadProgress(qint64 bytesSent, qint64 bytesTotal);
+    void onDownloadProgress(qint64 bytesReceived, qint64 bytesTotal);
+    void onFinished();
+    void onDestroyed(QObject *reply);
+    void emitChanged();
+
+private:
+
+    // The progress of a single reply. A batch reply carries several
+    // requests.
+    struct Transfer {
+        Transfer() : bytesSent(0), bytesToSend(-1), bytesReceived(0),
+                     bytesToReceive(-1), lastBytes(0), lastElapsed(0),
+                     changed(false) {}
+
+        QVariantList requestIds;
+        qint64 bytesSent;
+        qint64 bytesToSend;
+        qint64 bytesReceived;
+        qint64 bytesToReceive;
+        QElapsedTimer started;
+        qint64 lastBytes;       // Bytes transferred at the last emission.
+        qint64 lastElapsed;     // Milliseconds at the last emission.
+        bool changed;
+    };
+
+    void updated(Transfer &transfer);
+    void emitProgress(Transfer &transfer, bool finished);
+
+private: // Data
+
+    QHash<QObject *, Transfer> m_transfers;
+    QTimer *m_timer; // Owned
+};
+
+#endif // PROGRESSMONITOR_H
@@ -0,0 +1,157 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include "responsecache.h"
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMap>
+#include <QtCore/QPair>
+#include <QtGui/QDesktopServices>
+
+// Constants
+namespace {
+    const char *CacheSubdirectory = "/socialconnect";
+
+    // QNetworkDiskCache writes the entries still being received into this
+    // subdirectory, and names the files of the entries with this suffix.
+    const char *PreparedSubdirectory = "prepared/";
+    const char *EntrySuffix = ".d";
+
+    // The default limit of the cache size in bytes.
+    const qint64 DefaultMaximumSize = 10 * 1024 * 1024;
+
+    // An expiring cache is trimmed to this percentage of the limit, so that
+    // every insertion does not have to scan the cache.
+    const int ExpireTargetPercent = 90;
+}
+
+/*!
+  \class ResponseCache
+  \brief The ResponseCache class is the on-disk cache of the responses to
+         the GET requests of all the connections.
+
+  The cache is installed on the network access manager of NetworkTransport,
+  which revalidates stale entries with conditional requests using the ETag
+  and Last-Modified validators stored with them. A 304 Not Modified response
+  is answered from the cache. The responses of the account specific
+  requests are stored by TransportReply, under keys of their own.
+
+  Unlike QNetworkDiskCache, which discards the oldest entries, the cache
+  evicts the least recently used entries once maximumCacheSize() is
+  exceeded. The use order is tracked in memory; entries not used since the
+  cache was created are ordered by their modification time.
+*/
+
+/*!
+  \internal
+
+  Constructor.
+*/
+ResponseCache::ResponseCache(QObject *parent)
+    : QNetworkDiskCache(parent)
+{
+    setCacheDirectory(QDesktopServices::storageLocation(QDesktopServices::CacheLocation)
+                      + CacheSubdirectory);
+    setMaximumCacheSize(DefaultMaximumSize);
+}
+
+/*!
+  \internal
+
+  Returns the cached data of \a url and marks the entry as used.
+*/
+QIODevice *ResponseCache::data(const QUrl &url)
+{
+    QIODevice *device = QNetworkDiskCache::data(url);
+
+    if (device) {
+        m_lastUsed.insert(url.toString(), QDateTime::currentDateTime());
+    }
+
+    return device;
+}
+
+/*!
+  \internal
+
+  Prepares a new entry described by \a metaData and marks it as used.
+*/
+QIODevice *ResponseCache::prepare(const QNetworkCacheMetaData &metaData)
+{
+    QIODevice *device = QNetworkDiskCache::prepare(metaData);
+
+    if (device) {
+        m_lastUsed.insert(metaData.url().toString(), QDateTime::currentDateTime());
+    }
+
+    return device;
+}
+
+/*!
+  \internal
+
+  Removes the entry of \a url.
+*/
+bool ResponseCache::remove(const QUrl &url)
+{
+    m_lastUsed.remove(url.toString());
+    return QNetworkDiskCache::remove(url);
+}
+
+/*!
+  \internal
+
+  Evicts the least recently used entries until the cache is below its
+  limit. Returns the resulting size of the cache. The entries still being
+  received are not counted.
+*/
+qint64 ResponseCache::expire()
+{
+    if (cacheDirectory().isEmpty()) {
+        return 0;
+    }
+
+    // The entries by their last use, with their sizes.
+    QMultiMap<QDateTime, QPair<QUrl, qint64> > entries;
+    qint64 totalSize = 0;
+    const QString preparedPath = cacheDirectory() + PreparedSubdirectory;
+
+    QDirIterator i(cacheDirectory(), QDir::Files | QDir::NoDotAndDotDot,
+                   QDirIterator::Subdirectories);
+
+    while (i.hasNext()) {
+        const QString path = i.next();
+        const QFileInfo info = i.fileInfo();
+
+        if (path.startsWith(preparedPath) || !path.endsWith(EntrySuffix)) {
+            continue;
+        }
+
+        totalSize += info.size();
+
+        const QNetworkCacheMetaData metaData = fileMetaData(path);
+
+        if (!metaData.isValid()) {
+            continue;
+        }
+
+        const QDateTime lastUsed = m_lastUsed.value(metaData.url().toString(),
+                                                    info.lastModified());
+        entries.insert(lastUsed, qMakePair(metaData.url(), info.size()));
+    }
+
+    const qint64 target = maximumCacheSize() * ExpireTargetPercent / 100;
+    QMapIterator<QDateTime, QPair<QUrl, qint64> > entry(entries);
+
+    while (totalSize > target && entry.hasNext()) {
+        entry.next();
+
+        if (remove(entry.value().first)) {
+            totalSize -= entry.value().second;
+        }
+    }
+
+    return totalSize;
+}
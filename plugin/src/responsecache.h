@@ -0,0 +1,37 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#ifndef RESPONSECACHE_H
+#define RESPONSECACHE_H
+
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtNetwork/QNetworkDiskCache>
+
+class ResponseCache : public QNetworkDiskCache
+{
+    Q_OBJECT
+
+public:
+
+    explicit ResponseCache(QObject *parent = 0);
+
+public: // Reimplemented from QNetworkDiskCache.
+
+    QIODevice *data(const QUrl &url);
+    QIODevice *prepare(const QNetworkCacheMetaData &metaData);
+    bool remove(const QUrl &url);
+
+protected:
+
+    qint64 expire();
+
+private: // Data
+
+    // The time each entry was last used since the cache was created.
+    QHash<QString, QDateTime> m_lastUsed;
+};
+
+#endif // RESPONSECACHE_H
@@ -5,6 +5,7 @@
 #include <QtDeclarative/QtDeclarative>
 #include <QtCore/QtPlugin>
 
+#include "messagemodel.h"
 #include "socialconnectplugin.h"
 #include "webinterface.h"
 
@@ -18,6 +19,8 @@
 void SocialConnectPlugin::registerTypes(const char *uri)
 {
     qmlRegisterType<WebInterface>(uri, 1, 0, "WebInterface");
+    qmlRegisterUncreatableType<MessageModel>(uri, 1, 0, "MessageModel",
+                                             "MessageModel is provided by the connections");
     qmlRegisterType<TwitterConnection>(uri, 1, 0, "TwitterConnection");
     qmlRegisterType<FacebookConnection>(uri, 1, 0, "FacebookConnection");
 
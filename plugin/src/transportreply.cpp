@@ -0,0 +1,772 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include "transportreply.h"
+#include "jsonprojection.h"
+#include "jsonreader.h"
+#include "networktransport.h"
+#include "responsecache.h"
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QList>
+#include <QtCore/QLocale>
+#include <QtCore/QTimer>
+#include <QtNetwork/QNetworkRequest>
+
+// Constants
+namespace {
+    // The reply attributes copied from the underlying network reply.
+    const QNetworkRequest::Attribute CopiedAttributes[] = {
+        QNetworkRequest::HttpStatusCodeAttribute,
+        QNetworkRequest::HttpReasonPhraseAttribute,
+        QNetworkRequest::RedirectionTargetAttribute,
+        QNetworkRequest::ConnectionEncryptedAttribute,
+        QNetworkRequest::SourceIsFromCacheAttribute,
+        QNetworkRequest::HttpPipeliningWasUsedAttribute
+    };
+
+    // The backoff before the first retry in milliseconds. It is doubled for
+    // each further retry up to MaxRetryDelay.
+    const int InitialRetryDelay = 1000;
+    const int MaxRetryDelay = 32000;
+
+    // A request is not retried if the server asks to wait longer than this
+    // many milliseconds; it fails instead.
+    const int MaxRetryAfter = 60000;
+
+    const char *RetryAfterHeader = "Retry-After";
+    const char *RateLimitRemainingHeader = "x-rate-limit-remaining";
+    const char *RateLimitResetHeader = "x-rate-limit-reset";
+    const char *HttpDateFormat = "ddd, dd MMM yyyy hh:mm:ss 'GMT'";
+    const char *ETagHeader = "ETag";
+    const char *LastModifiedHeader = "Last-Modified";
+    const char *IfNoneMatchHeader = "If-None-Match";
+    const char *IfModifiedSinceHeader = "If-Modified-Since";
+}
+
+/*!
+  \class TransportReply
+  \brief The TransportReply class is the reply returned by NetworkTransport.
+
+  The reply stands in for the QNetworkReply of the request from the moment
+  the request is handed to the transport, also while it is waiting for a
+  free slot to its host. Once started, the data, metadata and signals of the
+  underlying reply are forwarded through it.
+
+  A request that fails with a transient error is sent again by the
+  transport. The response of an attempt that may be retried is held back,
+  so the user of the reply only sees the last attempt. A POST request is
+  only retried if the server has certainly not acted on it: the connection
+  was refused, or the server answered 429 Too Many Requests, 503 Service
+  Unavailable, or with one of the rate limit error codes given with the
+  NetworkTransport::RateLimitCodesAttribute of the request. A body read
+  from a sequential device cannot be sent again. A request that is retried
+  by its user is given a NetworkTransport::MaxRetriesAttribute of 0.
+
+  An attempt that sends and receives nothing for the time given with the
+  NetworkTransport::TimeoutAttribute of the request is aborted, and fails
+  with QNetworkReply::TimeoutError. The timeout is restarted by any
+  progress, so a large upload does not time out as long as it moves. A
+  request that has not finished within the time given with the
+  NetworkTransport::DeadlineAttribute, counted from the call to the
+  transport, fails the same way wherever it is: in flight, queued or
+  waiting for a retry. A request that has timed out is not retried; its
+  time has been spent already.
+
+  The responses to GET requests with the
+  NetworkTransport::CacheScopeAttribute are cached by the reply itself
+  instead of QNetworkAccessManager. The APIs mark their responses private
+  or no-store, which QNetworkAccessManager honors by not caching them at
+  all, yet a response is safe to keep for the account it was made for. The
+  entries are keyed by a hash of the scope together with the URL, so a
+  response is never served to another account. The QNetworkRequest::
+  CacheLoadControlAttribute of the request is honored: PreferNetwork
+  revalidates the entry with its ETag or Last-Modified validator, and
+  PreferCache and AlwaysCache read it without a request.
+*/
+
+/*!
+  \internal
+
+  Constructor. Either \a data or \a device is sent as the body of the
+  request.
+*/
+TransportReply::TransportReply(QNetworkAccessManager::Operation operation,
+                               const QNetworkRequest &request,
+                               const QByteArray &data,
+                               QIODevice *device,
+                               NetworkTransport *transport)
+    : QNetworkReply(transport),
+      m_transport(transport),
+      m_reply(0),
+      m_data(data),
+      m_device(device),
+      m_timer(new QTimer(this)),
+      m_deadlineTimer(new QTimer(this)),
+      m_notBefore(0),
+      m_attempts(0),
+      m_queued(true),
+      m_holding(false),
+      m_delivered(false),
+      m_timedOut(false),
+      m_revalidating(false),
+      m_fromCache(false)
+{
+    setOperation(operation);
+    setRequest(request);
+    setUrl(request.url());
+    setOpenMode(QIODevice::ReadOnly);
+
+    const QString scope = request.attribute(
+            QNetworkRequest::Attribute(NetworkTransport::CacheScopeAttribute)).toString();
+
+    if (operation == QNetworkAccessManager::GetOperation && !scope.isEmpty()) {
+        // The user name of the URL is not sent, only stored with the entry.
+        m_cacheUrl = request.url();
+        m_cacheUrl.setUserName(QString::fromLatin1(
+                QCryptographicHash::hash(scope.toUtf8(), QCryptographicHash::Sha1).toHex()));
+    }
+
+    m_timer->setSingleShot(true);
+    m_timer->setInterval(request.attribute(
+            QNetworkRequest::Attribute(NetworkTransport::TimeoutAttribute)).toInt());
+    connect(m_timer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+
+    // The deadline runs from the call, also while the request is queued.
+    const int deadline = request.attribute(
+            QNetworkRequest::Attribute(NetworkTransport::DeadlineAttribute)).toInt();
+    m_deadlineTimer->setSingleShot(true);
+    connect(m_deadlineTimer, SIGNAL(timeout()), this, SLOT(onDeadline()));
+
+    if (deadline > 0) {
+        m_deadlineTimer->start(deadline);
+    }
+}
+
+/*!
+  \internal
+
+  Destructor. A reply deleted before it has finished gives up its slot.
+*/
+TransportReply::~TransportReply()
+{
+    if (m_reply) {
+        m_reply->disconnect(this);
+    }
+
+    if (m_queued) {
+        m_transport->cancelReply(this);
+    }
+    else if (!isFinished()) {
+        m_transport->releaseReply(this);
+    }
+}
+
+/*!
+  \internal
+
+  Aborts the request. A queued request is removed from the queue and
+  finishes with QNetworkReply::OperationCanceledError.
+*/
+void TransportReply::abort()
+{
+    if (m_reply) {
+        m_reply->abort();
+    }
+    else if (m_queued) {
+        cancel();
+    }
+}
+
+/*!
+  \internal
+
+  Returns the number of bytes available for reading.
+*/
+qint64 TransportReply::bytesAvailable() const
+{
+    return m_buffer.size() + QNetworkReply::bytesAvailable();
+}
+
+/*!
+  \internal
+
+  Returns true; the reply is read as a stream.
+*/
+bool TransportReply::isSequential() const
+{
+    return true;
+}
+
+/*!
+  \internal
+
+  Reads at most \a maxSize bytes of the received data into \a data.
+*/
+qint64 TransportReply::readData(char *data, qint64 maxSize)
+{
+    if (m_buffer.isEmpty()) {
+        return isFinished() ? -1 : 0;
+    }
+
+    const qint64 count = qMin(maxSize, qint64(m_buffer.size()));
+    memcpy(data, m_buffer.constData(), count);
+    m_buffer.remove(0, count);
+
+    return count;
+}
+
+/*!
+  \internal
+
+  Starts the request with the shared network access manager.
+*/
+void TransportReply::start()
+{
+    QNetworkAccessManager *networkAccess = m_transport->networkAccessManager();
+    QNetworkRequest networkRequest(request());
+    m_queued = false;
+    m_timedOut = false;
+    m_attempts++;
+
+    if (m_device && m_attempts > 1) {
+        m_device->reset();
+    }
+
+    if (m_cacheUrl.isValid()) {
+        // The entry of the URL alone could be served to any account.
+        networkRequest.setAttribute(QNetworkRequest::CacheLoadControlAttribute,
+                                    QNetworkRequest::AlwaysNetwork);
+        networkRequest.setAttribute(QNetworkRequest::CacheSaveControlAttribute, false);
+
+        const QNetworkCacheMetaData metaData = m_transport->cache()->metaData(m_cacheUrl);
+        const int loadControl = request().attribute(QNetworkRequest::CacheLoadControlAttribute,
+                                                    QNetworkRequest::PreferNetwork).toInt();
+        m_revalidating = false;
+
+        if (metaData.isValid() && loadControl != QNetworkRequest::AlwaysNetwork) {
+            foreach (const QNetworkCacheMetaData::RawHeader &header, metaData.rawHeaders()) {
+                if (qstricmp(header.first, ETagHeader) == 0) {
+                    networkRequest.setRawHeader(IfNoneMatchHeader, header.second);
+                    m_revalidating = true;
+                }
+                else if (qstricmp(header.first, LastModifiedHeader) == 0) {
+                    networkRequest.setRawHeader(IfModifiedSinceHeader, header.second);
+                    m_revalidating = true;
+                }
+            }
+        }
+    }
+
+    switch (operation()) {
+    case QNetworkAccessManager::PostOperation:
+        m_reply = m_device ? networkAccess->post(networkRequest, m_device)
+                           : networkAccess->post(networkRequest, m_data);
+        break;
+    case QNetworkAccessManager::DeleteOperation:
+        m_reply = networkAccess->deleteResource(networkRequest);
+        break;
+    default:
+        m_reply = networkAccess->get(networkRequest);
+        break;
+    }
+
+    m_reply->setParent(this);
+
+    connect(m_reply, SIGNAL(metaDataChanged()), this, SLOT(onMetaDataChanged()));
+    connect(m_reply, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(m_reply, SIGNAL(finished()), this, SLOT(onFinished()));
+    connect(m_reply, SIGNAL(downloadProgress(qint64,qint64)),
+            this, SIGNAL(downloadProgress(qint64,qint64)));
+    connect(m_reply, SIGNAL(uploadProgress(qint64,qint64)),
+            this, SIGNAL(uploadProgress(qint64,qint64)));
+#ifndef QT_NO_OPENSSL
+    connect(m_reply, SIGNAL(sslErrors(QList<QSslError>)),
+            this, SIGNAL(sslErrors(QList<QSslError>)));
+#endif
+
+    if (m_timer->interval() > 0) {
+        connect(m_reply, SIGNAL(downloadProgress(qint64,qint64)), this, SLOT(onProgress()));
+        connect(m_reply, SIGNAL(uploadProgress(qint64,qint64)), this, SLOT(onProgress()));
+        m_timer->start();
+    }
+}
+
+/*!
+  \internal
+
+  Finishes a queued request without starting it.
+*/
+void TransportReply::cancel()
+{
+    failQueued(QNetworkReply::OperationCanceledError, tr("Operation canceled"));
+}
+
+/*!
+  \internal
+
+  Removes the queued request from the queue and finishes it with \a code
+  and \a errorString.
+*/
+void TransportReply::failQueued(QNetworkReply::NetworkError code, const QString &errorString)
+{
+    m_transport->cancelReply(this);
+    m_queued = false;
+    m_deadlineTimer->stop();
+
+    setError(code, errorString);
+    setFinished(true);
+    emit error(code);
+    emit finished();
+}
+
+bool TransportReply::isFromCache() const
+{
+    return m_reply->attribute(QNetworkRequest::SourceIsFromCacheAttribute).toBool();
+}
+
+/*!
+  \internal
+
+  Reads the response from the cache if the request prefers it and the
+  cache has it, or fails the request if it may only be read from the
+  cache. Returns true if the request is not to be sent.
+*/
+bool TransportReply::loadFromCache()
+{
+    const int loadControl = request().attribute(QNetworkRequest::CacheLoadControlAttribute,
+                                                QNetworkRequest::PreferNetwork).toInt();
+
+    if (!m_cacheUrl.isValid() || (loadControl != QNetworkRequest::PreferCache &&
+                                  loadControl != QNetworkRequest::AlwaysCache)) {
+        return false;
+    }
+
+    QIODevice *device = m_transport->cache()->data(m_cacheUrl);
+
+    if (device) {
+        m_buffer = device->readAll();
+        delete device;
+
+        copyCachedMetaData(m_transport->cache()->metaData(m_cacheUrl));
+        m_fromCache = true;
+        m_transport->addReceivedBytes(m_buffer.size(), true);
+        m_transport->addCacheResult(true);
+    }
+    else if (loadControl == QNetworkRequest::AlwaysCache) {
+        setError(QNetworkReply::ContentNotFoundError, tr("The response is not in the cache"));
+    }
+    else {
+        return false;
+    }
+
+    // The signals are emitted once the caller has connected to them.
+    m_queued = false;
+    setFinished(true);
+    QMetaObject::invokeMethod(this, "onCacheLoaded", Qt::QueuedConnection);
+
+    return true;
+}
+
+/*!
+  \internal
+
+  Stores the response of the finished attempt in the cache.
+*/
+void TransportReply::storeInCache()
+{
+    QNetworkCacheMetaData::RawHeaderList headers;
+
+    foreach (const QByteArray &header, m_reply->rawHeaderList()) {
+        headers.append(qMakePair(header, m_reply->rawHeader(header)));
+    }
+
+    QNetworkCacheMetaData metaData;
+    metaData.setUrl(m_cacheUrl);
+    metaData.setRawHeaders(headers);
+    metaData.setSaveToDisk(true);
+
+    ResponseCache *cache = m_transport->cache();
+    QIODevice *device = cache->prepare(metaData);
+
+    if (device) {
+        device->write(m_body);
+        cache->insert(device);
+    }
+}
+
+/*!
+  \internal
+
+  Returns the error of the current attempt.
+*/
+QNetworkReply::NetworkError TransportReply::attemptError() const
+{
+    return m_timedOut ? QNetworkReply::TimeoutError : m_reply->error();
+}
+
+/*!
+  \internal
+
+  Returns the HTTP status code of the current attempt, 0 if there is none.
+*/
+int TransportReply::statusCode() const
+{
+    return m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+}
+
+/*!
+  \internal
+
+  Returns the number of times the request may be sent again, given with the
+  NetworkTransport::MaxRetriesAttribute of the request or by the transport.
+*/
+int TransportReply::maxRetries() const
+{
+    const QVariant maxRetries = request().attribute(
+            QNetworkRequest::Attribute(NetworkTransport::MaxRetriesAttribute));
+
+    return maxRetries.isValid() ? qMax(0, maxRetries.toInt()) : m_transport->maxRetries();
+}
+
+/*!
+  \internal
+
+  Returns true if the failed attempt can be retried. An attempt whose
+  response has partly been delivered to a reader that parses it as it
+  arrives is not retried, since the response would be read twice.
+*/
+bool TransportReply::isRetryable() const
+{
+    if (m_attempts > maxRetries() || (m_device && m_device->isSequential()) ||
+        m_delivered) {
+        return false;
+    }
+
+    const bool idempotent = operation() != QNetworkAccessManager::PostOperation;
+
+    switch (attemptError()) {
+    case QNetworkReply::ConnectionRefusedError:
+    case QNetworkReply::TemporaryNetworkFailureError:
+        return true;
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::ProxyTimeoutError:
+    case QNetworkReply::UnknownNetworkError:
+        return idempotent;
+    default:
+        break;
+    }
+
+    switch (statusCode()) {
+    case 420: // Twitter's older "Enhance Your Calm".
+    case 429:
+    case 503:
+        return true;
+    case 500:
+    case 502:
+    case 504:
+        return idempotent;
+    default:
+        break;
+    }
+
+    return isRateLimited();
+}
+
+/*!
+  \internal
+
+  Returns true if the held back error response carries one of the rate
+  limit error codes of the request.
+*/
+bool TransportReply::isRateLimited() const
+{
+    const QNetworkRequest::Attribute attribute =
+            QNetworkRequest::Attribute(NetworkTransport::RateLimitCodesAttribute);
+    const QVariantList codes = request().attribute(attribute).toList();
+
+    if (codes.isEmpty() || m_heldBuffer.isEmpty()) {
+        return false;
+    }
+
+    JsonReader reader(m_heldBuffer);
+
+    return JsonProjection::findPath(reader, "error.code") &&
+           codes.contains(reader.value().toInt());
+}
+
+/*!
+  \internal
+
+  Returns the milliseconds to wait before the next attempt. The wait until
+  \a resetAt given by the server is honored, otherwise the backoff is
+  doubled for each attempt and jittered. Returns -1 if the server asks to
+  wait too long.
+*/
+int TransportReply::retryDelay(qint64 resetAt) const
+{
+    if (resetAt > 0) {
+        const qint64 delay = resetAt - QDateTime::currentMSecsSinceEpoch();
+        return delay > MaxRetryAfter ? -1 : int(qMax<qint64>(0, delay));
+    }
+
+    const int backoff = qMin(MaxRetryDelay, InitialRetryDelay << qMin(m_attempts - 1, 5));
+
+    return backoff / 2 + qrand() % (backoff / 2 + 1);
+}
+
+/*!
+  \internal
+
+  Returns the time in milliseconds since the epoch until which the server
+  asks not to be sent requests, or 0 if it does not. Twitter tells when the
+  rate limit window of the endpoint is reset.
+*/
+qint64 TransportReply::retryAt() const
+{
+    const QByteArray retryAfter = m_reply->rawHeader(RetryAfterHeader).trimmed();
+
+    if (!retryAfter.isEmpty()) {
+        bool ok = false;
+        const int seconds = retryAfter.toInt(&ok);
+
+        if (ok) {
+            return QDateTime::currentMSecsSinceEpoch() + seconds * qint64(1000);
+        }
+
+        QDateTime date = QLocale::c().toDateTime(QString::fromLatin1(retryAfter), HttpDateFormat);
+        date.setTimeSpec(Qt::UTC);
+
+        if (date.isValid()) {
+            return date.toMSecsSinceEpoch();
+        }
+    }
+
+    if (statusCode() == 429 || m_reply->rawHeader(RateLimitRemainingHeader) == "0") {
+        return m_reply->rawHeader(RateLimitResetHeader).toLongLong() * 1000;
+    }
+
+    return 0;
+}
+
+void TransportReply::copyMetaData()
+{
+    foreach (const QByteArray &header, m_reply->rawHeaderList()) {
+        setRawHeader(header, m_reply->rawHeader(header));
+    }
+
+    const int count = sizeof(CopiedAttributes) / sizeof(CopiedAttributes[0]);
+
+    for (int i = 0; i < count; i++) {
+        setAttribute(CopiedAttributes[i], m_reply->attribute(CopiedAttributes[i]));
+    }
+
+    setUrl(m_reply->url());
+}
+
+void TransportReply::copyCachedMetaData(const QNetworkCacheMetaData &metaData)
+{
+    foreach (const QNetworkCacheMetaData::RawHeader &header, metaData.rawHeaders()) {
+        setRawHeader(header.first, header.second);
+    }
+
+    // Only successful responses are cached.
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+    setAttribute(QNetworkRequest::SourceIsFromCacheAttribute, true);
+}
+
+void TransportReply::onMetaDataChanged()
+{
+    // An error response is held back while the attempt may be retried. So
+    // is a 304 Not Modified, which is answered from the cache.
+    m_holding = (statusCode() >= 400 && m_attempts <= maxRetries()) ||
+                (m_revalidating && statusCode() == 304);
+
+    if (!m_holding) {
+        copyMetaData();
+        emit metaDataChanged();
+    }
+}
+
+void TransportReply::onReadyRead()
+{
+    const QByteArray data = m_reply->readAll();
+
+    if (data.isEmpty()) {
+        return;
+    }
+
+    m_transport->addReceivedBytes(data.size(), isFromCache());
+
+    if (m_holding) {
+        m_heldBuffer.append(data);
+    }
+    else {
+        if (m_cacheUrl.isValid()) {
+            m_body.append(data);
+        }
+
+        m_buffer.append(data);
+        m_delivered = true;
+        emit readyRead();
+    }
+}
+
+void TransportReply::onFinished()
+{
+    m_timer->stop();
+
+    const QByteArray data = m_reply->readAll();
+
+    if (!data.isEmpty()) {
+        m_transport->addReceivedBytes(data.size(), isFromCache());
+    }
+
+    m_heldBuffer.append(data);
+
+    // Later requests wait for a rate limit to be reset instead of failing.
+    const qint64 resetAt = retryAt();
+
+    if (resetAt > QDateTime::currentMSecsSinceEpoch()) {
+        m_transport->blockRequests(request().url(), resetAt,
+                                   !m_reply->hasRawHeader(RateLimitResetHeader));
+    }
+
+    const QNetworkReply::NetworkError code = attemptError();
+
+    if (code != QNetworkReply::NoError && isRetryable()) {
+        const int delay = retryDelay(resetAt);
+
+        if (delay >= 0) {
+            m_reply->disconnect(this);
+            m_reply->deleteLater();
+            m_reply = 0;
+            m_heldBuffer.clear();
+            m_body.clear();
+            m_holding = false;
+            m_queued = true;
+            m_transport->retryReply(this, delay);
+            return;
+        }
+    }
+
+    if (m_revalidating && code == QNetworkReply::NoError && statusCode() == 304) {
+        QIODevice *device = m_transport->cache()->data(m_cacheUrl);
+
+        if (device) {
+            m_heldBuffer = device->readAll();
+            delete device;
+            m_fromCache = true;
+            m_transport->addReceivedBytes(m_heldBuffer.size(), true);
+        }
+    }
+    else if (m_cacheUrl.isValid() && code == QNetworkReply::NoError && statusCode() == 200) {
+        m_body.append(m_heldBuffer);
+        storeInCache();
+    }
+
+    m_body.clear();
+    m_deadlineTimer->stop();
+
+    const bool received = !m_heldBuffer.isEmpty();
+    m_buffer.append(m_heldBuffer);
+    m_heldBuffer.clear();
+    m_data.clear();
+
+    copyMetaData();
+
+    if (m_fromCache) {
+        copyCachedMetaData(m_transport->cache()->metaData(m_cacheUrl));
+    }
+
+    if (m_holding) {
+        emit metaDataChanged();
+    }
+
+    if (code != QNetworkReply::NoError) {
+        setError(code, m_timedOut ? tr("Operation timed out") : m_reply->errorString());
+        emit error(code);
+    }
+
+    if (operation() == QNetworkAccessManager::GetOperation && code == QNetworkReply::NoError) {
+        m_transport->addCacheResult(m_fromCache || isFromCache());
+    }
+
+    setFinished(true);
+    m_transport->releaseReply(this);
+
+    if (received) {
+        emit readyRead();
+    }
+
+    emit finished();
+}
+
+void TransportReply::onProgress()
+{
+    if (m_timer->isActive()) {
+        m_timer->start();
+    }
+}
+
+/*!
+  \internal
+
+  Aborts the attempt that has stalled. It finishes with
+  QNetworkReply::TimeoutError.
+*/
+void TransportReply::onTimeout()
+{
+    qWarning() << "TransportReply - Request timed out:" << request().url().toString();
+
+    m_timedOut = true;
+    m_reply->abort();
+}
+
+/*!
+  \internal
+
+  Ends the request whose deadline has passed with
+  QNetworkReply::TimeoutError, whether it is in flight or still queued.
+*/
+void TransportReply::onDeadline()
+{
+    if (isFinished()) {
+        return;
+    }
+
+    qWarning() << "TransportReply - Request deadline passed:" << request().url().toString();
+
+    if (m_reply) {
+        m_timer->stop();
+        m_timedOut = true;
+        m_reply->abort();
+    }
+    else if (m_queued) {
+        failQueued(QNetworkReply::TimeoutError, tr("Operation timed out"));
+    }
+}
+
+/*!
+  \internal
+
+  Emits the signals of a request answered from the cache without being
+  sent.
+*/
+void TransportReply::onCacheLoaded()
+{
+    if (error() != QNetworkReply::NoError) {
+        emit error(error());
+    }
+    else {
+        emit metaDataChanged();
+    }
+
+    if (!m_buffer.isEmpty()) {
+        emit readyRead();
+    }
+
+    emit finished();
+}
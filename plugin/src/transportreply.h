@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#ifndef TRANSPORTREPLY_H
+#define TRANSPORTREPLY_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QPointer>
+#include <QtCore/QUrl>
+#include <QtNetwork/QAbstractNetworkCache>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+
+class NetworkTransport;
+class QTimer;
+
+class TransportReply : public QNetworkReply
+{
+    Q_OBJECT
+
+public:
+
+    explicit TransportReply(QNetworkAccessManager::Operation operation,
+                            const QNetworkRequest &request,
+                            const QByteArray &data,
+                            QIODevice *device,
+                            NetworkTransport *transport);
+    virtual ~TransportReply();
+
+public: // Reimplemented from QNetworkReply and QIODevice.
+
+    void abort();
+    qint64 bytesAvailable() const;
+    bool isSequential() const;
+
+protected:
+
+    qint64 readData(char *data, qint64 maxSize);
+
+private slots:
+
+    void onMetaDataChanged();
+    void onReadyRead();
+    void onFinished();
+    void onProgress();
+    void onTimeout();
+    void onDeadline();
+    void onCacheLoaded();
+
+private:
+
+    void start();
+    void cancel();
+    void failQueued(QNetworkReply::NetworkError code, const QString &errorString);
+    void copyMetaData();
+    void copyCachedMetaData(const QNetworkCacheMetaData &metaData);
+    bool loadFromCache();
+    void storeInCache();
+    bool isFromCache() const;
+    QNetworkReply::NetworkError attemptError() const;
+    int statusCode() const;
+    int maxRetries() const;
+    bool isRetryable() const;
+    bool isRateLimited() const;
+    int retryDelay(qint64 resetAt) const;
+    qint64 retryAt() const;
+
+    friend class NetworkTransport;
+
+private: // Data
+
+    NetworkTransport *m_transport; // Not owned
+    QNetworkReply *m_reply; // Owned
+    QByteArray m_data;
+    QPointer<QIODevice> m_device; // Not owned
+    QTimer *m_timer; // Owned
+    QTimer *m_deadlineTimer; // Owned
+    QByteArray m_buffer;
+    QByteArray m_heldBuffer; // The response of an attempt that may be retried.
+    qint64 m_notBefore; // Milliseconds since the epoch.
+    int m_attempts;
+    bool m_queued;
+    bool m_holding;
+    bool m_delivered; // Part of the response has been read already.
+    bool m_timedOut;
+    QUrl m_cacheUrl; // The key of the cache entry, if the reply is cached.
+    QByteArray m_body; // The response to be cached.
+    bool m_revalidating;
+    bool m_fromCache;
+};
+
+#endif // TRANSPORTREPLY_H
@@ -8,16 +8,22 @@
 
 #include "twitterconnection.h"
 
+#include <QDateTime>
 #include <QDebug>
+#include <QFileInfo>
 #include <QMap>
 #include <QNetworkReply>
 #include <QSettings>
 #include <QStringList>
-#include <QScriptEngine>
-#include <QScriptValue>
-#include <QScriptValueIterator>
+#include <QTimer>
 #include <QUrl>
+#include <QtConcurrentRun>
 
+#include "jsonreader.h"
+#include "messagemodel.h"
+#include "multipartdevice.h"
+#include "networktransport.h"
+#include "parsequeue.h"
 #include "twitterconstants.h"
 #include "twitterrequest.h"
 #include "webinterface.h"
@@ -80,13 +86,100 @@
     {Twitter authentication documentation} for further details.
  */
 
+/*!
+    \property TwitterConnection::maxConcurrentRequests
+
+    This property holds the maximum number of requests that are in flight at
+    the same time. Further requests wait in a queue until one of the ongoing
+    requests completes. The default value is 4.
+ */
+
+/*!
+    \property TwitterConnection::queueDepth
+
+    This property holds the number of requests waiting in the queue for a
+    free slot.
+ */
+
+/*!
+    \property TwitterConnection::inFlightCount
+
+    This property holds the number of requests currently in flight.
+ */
+
+/*!
+    \property TwitterConnection::maxParallelSegments
+
+    This property holds the maximum number of segments of a GIF or a video
+    that are uploaded at the same time. The segments also share the slots
+    limited by maxConcurrentRequests. The default value is 2.
+ */
+
+// Returns the MIME type of a file to upload and sets the media category the
+// file is uploaded as.
+static QString mediaType(const QFileInfo &fileInfo, QString *mediaCategory)
+{
+    const QString suffix = fileInfo.suffix().toLower();
+
+    if (suffix == "gif") {
+        *mediaCategory = "tweet_gif";
+        return "image/gif";
+    }
+    else if (suffix == "mp4") {
+        *mediaCategory = "tweet_video";
+        return "video/mp4";
+    }
+    else if (suffix == "mov") {
+        *mediaCategory = "tweet_video";
+        return "video/quicktime";
+    }
+
+    *mediaCategory = "tweet_image";
+    return suffix == "png" ? "image/png" : "image/jpeg";
+}
+
 TwitterConnection::TwitterConnection(QObject *parent) :
     SocialConnection(parent),
     m_twitterRequest(new TwitterRequest(this)),
-    m_ongoingRequest(0),
+    m_streamCount(0),
+    m_maxConcurrentRequests(MAX_CONCURRENT_REQUESTS),
+    m_mediaStatusTimer(new QTimer(this)),
+    m_maxParallelSegments(MAX_PARALLEL_SEGMENTS),
+    m_mediaProjection(JsonProjection::StringValues),
+    m_messageProjection(JsonProjection::StringValues),
+    m_parseQueue(new ParseQueue(this)),
     m_state(NotLogged)
 {
-
+    connect(m_parseQueue, SIGNAL(finished(QVariant,QVariantList)),
+            this, SLOT(onReplyParsed(QVariant,QVariantList)));
+
+    m_mediaStatusTimer->setSingleShot(true);
+    connect(m_mediaStatusTimer, SIGNAL(timeout()), this, SLOT(checkMediaStatus()));
+
+    // Key paths of the media upload responses.
+    m_mediaProjection.addField(MEDIA_ID_STRING, MEDIA_ID_STRING);
+    m_mediaProjection.addField(MEDIA_PROCESSING_STATE, "state");
+    m_mediaProjection.addField(MEDIA_PROCESSING_CHECK_AFTER, "check_after_secs");
+
+    // Key paths of a tweet that end up in the retrieved messages.
+    m_messageProjection.addField(MESSAGE_ID, MESSAGE_ID);
+    m_messageProjection.addField(MESSAGE_TEXT, MESSAGE_TEXT);
+    m_messageProjection.addField(MESSAGE_COORDINATES, MESSAGE_COORDINATES);
+    m_messageProjection.addField(MESSAGE_FAVORITED, MESSAGE_FAVORITED);
+    m_messageProjection.addField(MESSAGE_CREATED_AT, MESSAGE_CREATED_AT);
+    m_messageProjection.addField(MESSAGE_TRUNCATED, MESSAGE_TRUNCATED);
+    m_messageProjection.addField("user.profile_image_url", MESSAGE_USER_IMAGE);
+    m_messageProjection.addField("user.location", MESSAGE_USER_LOCATION);
+    m_messageProjection.addField("user.name", MESSAGE_USER_NAME);
+    m_messageProjection.addField("user.verified", MESSAGE_USER_VERIFIED);
+    m_messageProjection.addField("user.url", MESSAGE_USER_URL);
+    m_messageProjection.addField("user.description", MESSAGE_USER_DESCRIPTION);
+
+    // The retrieved tweets kept for the views. A tweet has no url of its
+    // own; "user_url" is the website of its author.
+    messageModel()->setRoleKey(MessageModel::TimeRole, MESSAGE_CREATED_AT);
+    messageModel()->setRoleKey(MessageModel::UrlRole, QString());
+    messageModel()->setRoleKey(MessageModel::UserNameRole, MESSAGE_USER_NAME);
 }
 
 QString TwitterConnection::consumerKey() const
@@ -158,6 +251,51 @@ void TwitterConnection::setCallbackUrl(const QString &callbackUrl)
     }
 }
 
+int TwitterConnection::maxConcurrentRequests() const
+{
+    return m_maxConcurrentRequests;
+}
+
+void TwitterConnection::setMaxConcurrentRequests(int maxConcurrentRequests)
+{
+    maxConcurrentRequests = qMax(1, maxConcurrentRequests);
+
+    if (m_maxConcurrentRequests != maxConcurrentRequests) {
+        m_maxConcurrentRequests = maxConcurrentRequests;
+        emit maxConcurrentRequestsChanged(m_maxConcurrentRequests);
+        dispatchRequests();
+    }
+}
+
+int TwitterConnection::queueDepth() const
+{
+    return m_queue.count();
+}
+
+int TwitterConnection::inFlightCount() const
+{
+    return m_replies.count();
+}
+
+int TwitterConnection::maxParallelSegments() const
+{
+    return m_maxParallelSegments;
+}
+
+void TwitterConnection::setMaxParallelSegments(int maxParallelSegments)
+{
+    maxParallelSegments = qMax(1, maxParallelSegments);
+
+    if (m_maxParallelSegments != maxParallelSegments) {
+        m_maxParallelSegments = maxParallelSegments;
+        emit maxParallelSegmentsChanged(m_maxParallelSegments);
+
+        if (m_media.active && !m_media.mediaId.isEmpty()) {
+            scheduleSegments();
+        }
+    }
+}
+
 TwitterConnection::State TwitterConnection::state() const
 {
     return m_state;
@@ -174,19 +312,15 @@ bool TwitterConnection::authenticate()
 {
     bool ret = false;
 
-    if (authenticated() || state() != NotLogged || busy()) {
+    if (authenticated() || state() != NotLogged) {
         ret = authenticated();
-        qWarning() << "State already logged / busy. Skipping. Authenticated:" << ret;
+        qWarning() << "State already logged / authenticating. Skipping. Authenticated:" << ret;
     }
     else  {
         setState(AcquiringRequestToken);
-        setBusy(true);
-        setTransmitting(true);
 
         QNetworkRequest req = m_twitterRequest->createRequestTokenRequest(m_callbackUrl);
-        m_ongoingRequest = m_networkManager.post(req, QByteArray());
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onRequestTokenReply()));
+        enqueueRequest(RequestToken, req, true);
 
         ret = true;
     }
@@ -197,9 +331,18 @@ bool TwitterConnection::authenticate()
 bool TwitterConnection::deauthenticate()
 {
     clearAllMembers();
+
+    // The watermarks belong to the user signing out.
+    for (int timeline = UserTimeline; timeline <= HomeTimeline; timeline++) {
+        const bool active = m_timelines[timeline].active;
+        m_timelines[timeline] = TimelineSync();
+        m_timelines[timeline].active = active;
+    }
+
     setState(NotLogged);
     setName("");
     setAuthenticated(false);
+    setCompletionStatus(Succeeded);
 
     QMetaObject::invokeMethod(this, "deauthenticateCompleted",
                               Qt::QueuedConnection, Q_ARG(bool, true));
@@ -207,13 +350,13 @@ bool TwitterConnection::deauthenticate()
     return true;
 }
 
-void TwitterConnection::onRequestTokenReply()
+void TwitterConnection::onRequestTokenReply(QNetworkReply *reply)
 {
     bool success = false;
-    const int requestError = m_ongoingRequest->error();
+    const int requestError = reply->error();
 
     if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
+        QByteArray data = reply->readAll();
         QList<QByteArray> fields = data.split('&');
         foreach (QByteArray field, fields) {
             QString key;
@@ -239,13 +382,13 @@ void TwitterConnection::onRequestTokenReply()
             }
         }
     }
-    deleteReply();
+    deleteReply(reply);
 
     if (!m_requestToken.isEmpty() && !m_requestTokenSecret.isEmpty() && success) {
         QUrl url(AUTHENTICATE_URL);
         url.addEncodedQueryItem(OAUTH_TOKEN, m_requestToken.toUtf8());
         setState(Authorizing);
-        setTransmitting(false);     // Not anymore transmitting, but still "Busy"!
+        updateActivity();           // Not anymore transmitting, but still "Busy"!
         setAuthenticated(false);    // TODO: Is this in the right place??
         WebInterface *webInterface = qobject_cast<WebInterface*>(SocialConnection::webInterface());
         webInterface->setActive(true);
@@ -259,24 +402,20 @@ void TwitterConnection::onRequestTokenReply()
 void TwitterConnection::acquireAccessToken()
 {
     setState(AcquiringAccessToken);
-    setBusy(true);
-    setTransmitting(true);
 
     QNetworkRequest req = m_twitterRequest->createAccessTokenRequest(m_verifier);
-    m_ongoingRequest = m_networkManager.post(req, QByteArray());
-    connect(m_ongoingRequest, SIGNAL(finished()),
-            this, SLOT(onAccessTokenReply()));
+    enqueueRequest(AccessToken, req, true);
 }
 
-void TwitterConnection::onAccessTokenReply()
+void TwitterConnection::onAccessTokenReply(QNetworkReply *reply)
 {
     m_accessToken.clear();
     m_accessTokenSecret.clear();
-    const int requestError = m_ongoingRequest->error();
-    QString errorStr = m_ongoingRequest->errorString();
+    const int requestError = reply->error();
+    QString errorStr = reply->errorString();
 
     if (requestError == QNetworkReply::NoError) {
-        QByteArray data = m_ongoingRequest->readAll();
+        QByteArray data = reply->readAll();
         QList<QByteArray> fields = data.split('&');
 
         foreach (QByteArray field, fields) {
@@ -303,7 +442,7 @@ void TwitterConnection::onAccessTokenReply()
             }
         }
     }
-    deleteReply();
+    deleteReply(reply);
 
     if (m_accessToken.isEmpty() || m_accessTokenSecret.isEmpty()) {
         authenticationFailed("No access token received, nwReplyError:" + errorStr,
@@ -318,17 +457,18 @@ void TwitterConnection::onUrlChanged(const QUrl &url)
 {
     SocialConnection::onUrlChanged(url);
 
-    if (busy() && !url.isEmpty() && url.toString().startsWith(m_callbackUrl)) {
+    if (state() == Authorizing && !url.isEmpty() && url.toString().startsWith(m_callbackUrl)) {
         m_verifier = url.queryItemValue(OAUTH_VERIFIER);
         WebInterface *webInterface = qobject_cast<WebInterface*>(SocialConnection::webInterface());
         webInterface->setActive(false);
 
-        if (!m_verifier.isEmpty() && m_state == Authorizing) {
+        if (!m_verifier.isEmpty()) {
             acquireAccessToken();
         }
         else {
             // No access token gotten, but still redirected => user wanted to
             // return to the application without signing in.
+            setCompletionStatus(Canceled);
             authenticationFailed("Incorrect redirection. Authentication cancelled.");
         }
     }
@@ -350,18 +490,26 @@ void TwitterConnection::onUrlChanged(const QUrl &url)
         \li "description" (n/a)
     \endlist
 
-    Keys and values for uploading a picture:
+    Keys and values for uploading a picture, a GIF or a video:
     \list
         \li "text" (mandatory) : "Your tweet message."
         \li "url" (mandatory) : "file:///path/to/your/picture.png"
         \li "description" (n/a)
     \endlist
+
+    GIFs, videos and pictures larger than 3 MB are uploaded in segments of
+    1 MB, up to maxParallelSegments of them at a time. A segment that fails
+    is sent again on its own. The tweet is posted once the media has been
+    uploaded and processed. Only one such upload is in progress at a time;
+    the ones posted meanwhile wait for their turn, and each of them is
+    completed with a postMessageCompleted() signal of its own. A picture
+    larger than \c maximumImageSize is scaled down before it is uploaded.
  */
 bool TwitterConnection::postMessage(const QVariantMap &message)
 {
     bool ret = false;
 
-    if (!authenticated() || state() != Logged || busy() ) {
+    if (!authenticated() || state() != Logged) {
         qWarning() << "Cannot send message while not authenticated/logged";
     }
     else {
@@ -370,15 +518,22 @@ bool TwitterConnection::postMessage(const QVariantMap &message)
 
         if (!messageStatus.isEmpty()) {
             ret = true;
-            setBusy(true);
-            setTransmitting(true);
 
-            QByteArray content;
-            QNetworkRequest req = m_twitterRequest->createPostMessageRequest
-                    (messageStatus, fileUrl, &content);
-            m_ongoingRequest = m_networkManager.post(req, content);
-            connect(m_ongoingRequest, SIGNAL(finished()),
-                    this, SLOT(onPostMessageReply()));
+            if (fileUrl.isEmpty()) {
+                QByteArray content;
+                QNetworkRequest req = m_twitterRequest->createPostMessageRequest
+                        (messageStatus, &content);
+                enqueueRequest(PostMessage, req, true, content);
+            }
+            else if (processImage(fileUrl, messageStatus)) {
+                // The picture is uploaded once it has been scaled down.
+                updateActivity();
+            }
+            else if (!postMedia(messageStatus, fileUrl)) {
+                setCompletionStatus(Failed);
+                QMetaObject::invokeMethod(this, "postMessageCompleted", Qt::QueuedConnection,
+                                          Q_ARG(bool, false));
+            }
         }
         else {
             qWarning() << "Status message missing. It is ALWAYS required!";
@@ -388,127 +543,591 @@ bool TwitterConnection::postMessage(const QVariantMap &message)
     return ret;
 }
 
-void TwitterConnection::onPostMessageReply()
+bool TwitterConnection::postMedia(const QString &text, const QUrl &fileUrl)
 {
-    const int requestError = checkReplyErrors();
-    deleteReply();
+    QFileInfo fileInfo(fileUrl.toLocalFile());
+    QString mediaCategory;
+    mediaType(fileInfo, &mediaCategory);
+
+    if (mediaCategory != "tweet_image" || fileInfo.size() > MEDIA_SIMPLE_UPLOAD_LIMIT) {
+        // The segments are read from the file until the upload is over.
+        if (!startMediaUpload(text, fileUrl, callTimeout())) {
+            releaseImage(fileUrl);
+            return false;
+        }
+
+        return true;
+    }
+
+    // The image is streamed from the file.
+    MultipartDevice *content = new MultipartDevice(this);
+    QNetworkRequest req = m_twitterRequest->createPostMediaRequest
+            (text, fileUrl, content);
+
+    if (req.url().isEmpty()) {
+        delete content;
+        return false;
+    }
+
+    content->open(QIODevice::ReadOnly);
+    releaseImage(fileUrl, content);
+    enqueueRequest(PostMessage, req, true, QByteArray(), content);
+
+    return true;
+}
+
+void TwitterConnection::onImageProcessed(const QVariant &context, const QUrl &fileUrl)
+{
+    if (fileUrl.isEmpty() || !postMedia(context.toString(), fileUrl)) {
+        updateActivity();
+        setCompletionStatus(fileUrl.isEmpty() ? Canceled : Failed);
+        emit postMessageCompleted(false);
+    }
+}
+
+void TwitterConnection::onPostMessageReply(QNetworkReply *reply)
+{
+    const int requestError = checkReplyErrors(reply);
+    deleteReply(reply);
     emit postMessageCompleted(requestError == QNetworkReply::NoError);
 }
 
+bool TwitterConnection::startMediaUpload(const QString &text, const QUrl &fileUrl, int timeout)
+{
+    const QFileInfo fileInfo(fileUrl.toLocalFile());
+
+    if (!fileInfo.isFile() || !fileInfo.isReadable() || fileInfo.size() <= 0) {
+        qWarning() << "Cannot read file:" << fileInfo.filePath();
+        return false;
+    }
+
+    if (m_media.active) {
+        // Started once the upload in progress is over.
+        MediaUpload waiting;
+        waiting.text = text;
+        waiting.fileUrl = fileUrl;
+        waiting.timeout = timeout;
+        m_mediaQueue.enqueue(waiting);
+        return true;
+    }
+
+    m_media = MediaUpload();
+    m_media.active = true;
+    m_media.text = text;
+    m_media.fileUrl = fileUrl;
+    m_media.timeout = timeout;
+    m_media.fileName = fileInfo.absoluteFilePath();
+    m_media.size = fileInfo.size();
+    m_media.segmentCount = (m_media.size + MEDIA_SEGMENT_SIZE - 1) / MEDIA_SEGMENT_SIZE;
+
+    QString mediaCategory;
+    const QString type = mediaType(fileInfo, &mediaCategory);
+
+    QByteArray content;
+    QNetworkRequest req = m_twitterRequest->createMediaInitRequest(
+                m_media.size, type, mediaCategory, &content);
+    enqueueMediaRequest(MediaInit, req, true, content);
+
+    return true;
+}
+
+void TwitterConnection::onMediaInitReply(QNetworkReply *reply)
+{
+    const int requestError = checkReplyErrors(reply);
+    const QVariantMap media = m_mediaProjection.projectObject(reply->readAll());
+    deleteReply(reply);
+
+    if (!m_media.active) {
+        return;
+    }
+
+    m_media.mediaId = media.value(MEDIA_ID_STRING).toString();
+
+    if (requestError != QNetworkReply::NoError || m_media.mediaId.isEmpty()) {
+        qWarning() << "Media upload could not be started, error:" << requestError;
+        failMediaUpload();
+        return;
+    }
+
+    scheduleSegments();
+}
+
+void TwitterConnection::scheduleSegments()
+{
+    // Segments to be sent again go first, so that a segment is not left
+    // behind for long.
+    while (m_media.pendingSegments < m_maxParallelSegments &&
+           (!m_media.failedSegments.isEmpty() || m_media.nextSegment < m_media.segmentCount)) {
+        const int segment = m_media.failedSegments.isEmpty()
+                ? m_media.nextSegment++
+                : m_media.failedSegments.takeFirst();
+        const qint64 offset = (qint64)segment * MEDIA_SEGMENT_SIZE;
+        const qint64 length = qMin((qint64)MEDIA_SEGMENT_SIZE, m_media.size - offset);
+
+        MultipartDevice *content = new MultipartDevice(this);
+        QNetworkRequest req = m_twitterRequest->createMediaAppendRequest(
+                    m_media.mediaId, segment, m_media.fileName, offset, length, content);
+
+        if (req.url().isEmpty()) {
+            delete content;
+            failMediaUpload();
+            return;
+        }
+
+        content->open(QIODevice::ReadOnly);
+        ++m_media.pendingSegments;
+        enqueueMediaRequest(MediaAppend, req, true, QByteArray(), content, segment);
+    }
+}
+
+void TwitterConnection::onMediaAppendReply(QNetworkReply *reply, int segment)
+{
+    const int requestError = checkReplyErrors(reply);
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    deleteReply(reply);
+
+    if (!m_media.active) {
+        return;
+    }
+
+    --m_media.pendingSegments;
+
+    if (requestError == QNetworkReply::NoError) {
+        ++m_media.completedSegments;
+
+        if (m_media.completedSegments == m_media.segmentCount) {
+            QByteArray content;
+            QNetworkRequest req = m_twitterRequest->createMediaFinalizeRequest(
+                        m_media.mediaId, &content);
+            enqueueMediaRequest(MediaFinalize, req, true, content);
+        }
+        else {
+            scheduleSegments();
+        }
+
+        return;
+    }
+
+    // A segment lost to the network or to a server error is sent again on
+    // its own. A rejected segment fails the whole upload.
+    const bool retryable = requestError != QNetworkReply::OperationCanceledError &&
+            (status < 400 || status >= 500);
+
+    if (retryable && m_media.retries.value(segment) < MAX_SEGMENT_RETRIES) {
+        qWarning() << "Media segment" << segment << "failed, retrying. Error:" << requestError;
+        ++m_media.retries[segment];
+        m_media.failedSegments.append(segment);
+        scheduleSegments();
+    }
+    else {
+        qWarning() << "Media segment" << segment << "failed, error:" << requestError;
+        failMediaUpload();
+    }
+}
+
+void TwitterConnection::onMediaProcessingReply(QNetworkReply *reply)
+{
+    const int requestError = checkReplyErrors(reply);
+    const QVariantMap media = m_mediaProjection.projectObject(reply->readAll());
+    deleteReply(reply);
+
+    if (!m_media.active) {
+        return;
+    }
+
+    if (requestError != QNetworkReply::NoError) {
+        qWarning() << "Media upload could not be finished, error:" << requestError;
+        failMediaUpload();
+        return;
+    }
+
+    const QString state = media.value("state").toString();
+
+    // GIFs and videos are processed before they can be posted. Check again
+    // when Twitter asks to.
+    if (state == MEDIA_STATE_PENDING || state == MEDIA_STATE_IN_PROGRESS) {
+        int checkAfter = media.value("check_after_secs").toInt();
+
+        if (checkAfter <= 0) {
+            checkAfter = MEDIA_STATUS_CHECK_INTERVAL;
+        }
+
+        m_mediaStatusTimer->start(checkAfter * 1000);
+        return;
+    }
+
+    if (state == MEDIA_STATE_FAILED) {
+        qWarning() << "Media processing failed";
+        failMediaUpload();
+        return;
+    }
+
+    // The media is ready, post the tweet with it.
+    QByteArray content;
+    QNetworkRequest req = m_twitterRequest->createPostMessageRequest(
+                m_media.text, &content, m_media.mediaId);
+    enqueueMediaRequest(PostMessage, req, true, content);
+    endMediaUpload();
+}
+
+/*!
+    \internal
+
+    Ends the media upload in progress: its file is not needed any more, and
+    the next upload waiting can be started.
+*/
+void TwitterConnection::endMediaUpload()
+{
+    releaseImage(m_media.fileUrl);
+    m_media = MediaUpload();
+
+    if (!m_mediaQueue.isEmpty()) {
+        QMetaObject::invokeMethod(this, "startNextMediaUpload", Qt::QueuedConnection);
+    }
+}
+
+void TwitterConnection::startNextMediaUpload()
+{
+    // A waiting upload whose file has gone meanwhile fails on its own.
+    while (!m_media.active && !m_mediaQueue.isEmpty()) {
+        const MediaUpload next = m_mediaQueue.dequeue();
+
+        if (!startMediaUpload(next.text, next.fileUrl, next.timeout)) {
+            releaseImage(next.fileUrl);
+            updateActivity();
+            setCompletionStatus(Failed);
+            emit postMessageCompleted(false);
+        }
+    }
+
+    updateActivity();
+}
+
+void TwitterConnection::checkMediaStatus()
+{
+    if (!m_media.active) {
+        return;
+    }
+
+    QNetworkRequest req = m_twitterRequest->createMediaStatusRequest(m_media.mediaId);
+    req.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::AlwaysNetwork);
+    enqueueMediaRequest(MediaStatus, req, false);
+}
+
+void TwitterConnection::failMediaUpload()
+{
+    if (!m_media.active) {
+        return;
+    }
+
+    endMediaUpload();
+    m_mediaStatusTimer->stop();
+
+    // Drop the queued requests of the upload and abort the ones in flight.
+    // The media upload operations are the last ones in Operation.
+    QQueue<QueuedRequest> queue;
+
+    foreach (const QueuedRequest &queued, m_queue) {
+        if (queued.operation >= MediaInit) {
+            delete queued.device;
+        }
+        else {
+            queue.enqueue(queued);
+        }
+    }
+
+    if (queue.count() != m_queue.count()) {
+        m_queue.swap(queue);
+        emit queueDepthChanged(m_queue.count());
+    }
+
+    foreach (QNetworkReply *reply, m_replies.keys()) {
+        if (m_replies.value(reply) >= MediaInit && reply->isRunning()) {
+            reply->abort();
+        }
+    }
+
+    // A failed upload is not reported as a success even if its last
+    // request was.
+    if (completionStatus() == Succeeded) {
+        setCompletionStatus(Failed);
+    }
+
+    updateActivity();
+    emit postMessageCompleted(false);
+}
+
 bool TwitterConnection::retrieveMessageCount()
 {
     bool ret = false;
 
-    if (!authenticated() || state() != Logged || busy() ) {
+    if (!authenticated() || state() != Logged) {
         qWarning() << "Cannot retrieve message count not authenticated/logged";
     }
     else {
         ret = true;
-        setBusy(true);
-        setTransmitting(true);
 
         QNetworkRequest req = m_twitterRequest->createRetrieveMessageCountRequest();
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onRetrieveMessageCountReply()));
+        enqueueRequest(RetrieveMessageCount, req, false);
     }
 
     return ret;
 }
 
-void TwitterConnection::onRetrieveMessageCountReply()
+void TwitterConnection::onRetrieveMessageCountReply(QNetworkReply *reply)
 {
-    const int requestError = checkReplyErrors();
+    const int requestError = checkReplyErrors(reply);
 
-    QByteArray result = m_ongoingRequest->readAll();
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("(" + QString(result) + ")");
+    QByteArray result = reply->readAll();
+    JsonReader reader(result);
+    int count = 0;
+
+    if (JsonProjection::findPath(reader, MESSAGE_COUNT)) {
+        count = reader.value().toInt();
+    }
 
-    deleteReply();
-    emit retrieveMessageCountCompleted(requestError == QNetworkReply::NoError,
-                scValue.property(MESSAGE_COUNT).toInteger());
+    deleteReply(reply);
+    emit retrieveMessageCountCompleted(requestError == QNetworkReply::NoError, count);
 }
 
 bool TwitterConnection::retrieveMessages(const QString &from, const QString &to, int max)
 {
     bool ret = false;
 
-    if (!authenticated() || state() != Logged || busy() ) {
+    if (!authenticated() || state() != Logged) {
         qWarning() << "Cannot retrieve messages while not authenticated/logged";
     }
     else {
         ret = true;
-        setBusy(true);
-        setTransmitting(true);
 
         QNetworkRequest req = m_twitterRequest->createRetrieveMessagesRequest(
                     name(), from, to, max);
-        m_ongoingRequest = m_networkManager.get(req);
-        connect(m_ongoingRequest, SIGNAL(finished()),
-                this, SLOT(onRetrieveMessagesReply()));
+        enqueueRequest(RetrieveMessages, req, false);
     }
 
     return ret;
 }
 
-void TwitterConnection::onRetrieveMessagesReply()
+void TwitterConnection::onRetrieveMessagesReply(QNetworkReply *reply)
+{
+    const int requestError = checkReplyErrors(reply);
+    const int stream = m_streamIds.take(reply);
+
+    if (requestError == QNetworkReply::NoError) {
+        readMessages(reply, stream);
+    }
+
+    deleteReply(reply);
+
+    if (requestError != QNetworkReply::NoError) {
+        m_messageStreams.remove(stream);
+        emit retrieveMessagesCompleted(false, QVariantList());
+        return;
+    }
+
+    m_messageStreams[stream].finished = true;
+
+    if (m_messageStreams.value(stream).pendingBatches == 0) {
+        completeMessages(stream);
+    }
+    else {
+        // Busy stays set until the last batch has been projected.
+        updateActivity();
+    }
+}
+
+void TwitterConnection::onReplyReadyRead()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    // An error response is not a timeline; it is left to onReplyFinished().
+    if (!reply || !m_streamIds.contains(reply) ||
+        reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() >= 400) {
+        return;
+    }
+
+    readMessages(reply, m_streamIds.value(reply));
+}
+
+void TwitterConnection::readMessages(QNetworkReply *reply, int stream)
+{
+    MessageStream &messageStream = m_messageStreams[stream];
+    const QList<QByteArray> records = messageStream.splitter.append(reply->readAll());
+
+    if (records.isEmpty()) {
+        return;
+    }
+
+    const QVariantList context = QVariantList() << RetrieveMessages << stream
+                                                << messageStream.batchCount;
+
+    // Only cutting the records out is done here; the worker gets a copy of
+    // the projection, sharing its compiled paths.
+    if (messageStream.rows) {
+        m_parseQueue->enqueue(QtConcurrent::run(this, &TwitterConnection::projectRows, records,
+                                                messageModel()->roleKeys()),
+                              context);
+    }
+    else {
+        m_parseQueue->enqueue(QtConcurrent::run(m_messageProjection,
+                                                &JsonProjection::projectRecords, records),
+                              context);
+    }
+
+    messageStream.batchCount++;
+    messageStream.pendingBatches++;
+}
+
+void TwitterConnection::onMessagesParsed(int stream, int batch, const QVariantList &messages)
 {
-    const int requestError = checkReplyErrors();
-    QByteArray result = m_ongoingRequest->readAll();
-    deleteReply();
+    // The call has already failed if the reply did.
+    if (!m_messageStreams.contains(stream)) {
+        updateActivity();
+        return;
+    }
+
+    MessageStream &messageStream = m_messageStreams[stream];
+    messageStream.batches.insert(batch, messages);
+    messageStream.pendingBatches--;
+
+    if (!messageStream.rows && !messages.isEmpty()) {
+        emit messagesReceived(messages);
+    }
 
-    emit retrieveMessagesCompleted(requestError == QNetworkReply::NoError,
-                                   parseRetrievedMessages(result));
+    if (messageStream.finished && messageStream.pendingBatches == 0) {
+        completeMessages(stream);
+    }
 }
 
-QVariantList TwitterConnection::parseRetrievedMessages(const QByteArray &result)
+void TwitterConnection::completeMessages(int stream)
 {
-    QVariantList list;
-    QScriptEngine engine;
-    QScriptValue scValue = engine.evaluate("(" + QString(result) + ")");
-    QScriptValueIterator it(scValue);
+    const MessageStream messageStream = m_messageStreams.take(stream);
+    MessageModel::Rows rows;
+    QVariantList messages;
+
+    // The batches may be projected out of order; the call gets the tweets
+    // in the order of the reply.
+    foreach (const QVariantList &batch, messageStream.batches) {
+        if (messageStream.rows) {
+            rows.append(batch.value(0).value<MessageModel::Rows>());
+        }
+        else {
+            messages += batch;
+        }
+    }
 
-    while (it.hasNext()) {
-        it.next();
+    updateActivity();
+    setCompletionStatus(Succeeded);
 
-        QVariantMap message;
-        message.insert(MESSAGE_ID, it.value().property(MESSAGE_ID).toString());
-        message.insert(MESSAGE_TEXT, it.value().property(MESSAGE_TEXT).toString());
-        message.insert(MESSAGE_COORDINATES, it.value().property(MESSAGE_COORDINATES).toString());
-        message.insert(MESSAGE_FAVORITED, it.value().property(MESSAGE_FAVORITED).toString());
-        message.insert(MESSAGE_CREATED_AT, it.value().property(MESSAGE_CREATED_AT).toString());
-        message.insert(MESSAGE_TRUNCATED, it.value().property(MESSAGE_TRUNCATED).toString());
-        message.insert(MESSAGE_USER_IMAGE, it.value().property("user").property("profile_image_url").toString());
-        message.insert(MESSAGE_USER_LOCATION, it.value().property("user").property("location").toString());
-        message.insert(MESSAGE_USER_NAME, it.value().property("user").property("name").toString());
-        message.insert(MESSAGE_USER_VERIFIED, it.value().property("user").property("verified").toString());
-        message.insert(MESSAGE_USER_URL, it.value().property("user").property("url").toString());
-        message.insert(MESSAGE_USER_DESCRIPTION, it.value().property("user").property("description").toString());
+    // An active model holds the tweets instead of the completion signal.
+    if (messageStream.rows) {
+        messageModel()->addRows(rows);
+    }
 
-        list.append(message);
+    emit retrieveMessagesCompleted(true, messages);
+}
+
+QVariantList TwitterConnection::projectRows(const QList<QByteArray> &records,
+                                            const MessageModel::RoleKeys &keys) const
+{
+    MessageModel::Rows rows;
+
+    // Each tweet is reduced to the fields of the model as soon as it has
+    // been projected.
+    foreach (const QByteArray &record, records) {
+        rows.append(m_messageProjection.projectObject(record), keys);
     }
 
-    return list;
+    return QVariantList() << QVariant::fromValue(rows);
+}
+
+void TwitterConnection::parseRetrievedMessages(Operation operation, const QByteArray &result,
+                                               int tag)
+{
+    // The worker gets a copy of the projection, sharing its compiled paths.
+    m_parseQueue->enqueue(QtConcurrent::run(m_messageProjection, &JsonProjection::projectList,
+                                            result, QString()),
+                          QVariantList() << operation << tag);
+    updateActivity();
+}
+
+void TwitterConnection::onReplyParsed(const QVariant &context, const QVariantList &messages)
+{
+    const QVariantList operation = context.toList();
+
+    switch (operation.at(0).toInt()) {
+    case RetrieveMessages:
+        onMessagesParsed(operation.at(1).toInt(), operation.at(2).toInt(), messages);
+        break;
+    case SyncTimeline:
+        updateActivity();
+        setCompletionStatus(Succeeded);
+        onTimelineParsed(operation.at(1).toInt(), messages);
+        break;
+    default:
+        break;
+    }
 }
 
 void TwitterConnection::cancel()
 {
-    if (m_ongoingRequest != 0 && m_ongoingRequest->isRunning()) {
-        qWarning() << "Request ongoing, aborting!";
-        m_ongoingRequest->abort();
+    // Drop the queued requests first so that aborting the ongoing ones does
+    // not start them.
+    QQueue<QueuedRequest> queue;
+    queue.swap(m_queue);
+
+    if (!queue.isEmpty()) {
+        emit queueDepthChanged(0);
     }
-    // Not busy or transmitting anymore
-    setTransmitting(false);
-    setBusy(false);
+
+    foreach (QNetworkReply *reply, m_replies.keys()) {
+        if (reply->isRunning()) {
+            qWarning() << "Request ongoing, aborting!";
+            reply->abort();
+        }
+    }
+
+    setCompletionStatus(Canceled);
+
+    foreach (const QueuedRequest &queued, queue) {
+        delete queued.device;
+        emitFailure(queued.operation, queued.tag);
+    }
+
+    // The replies still being parsed are dropped, and their operations fail.
+    // The batches of a retrieveMessages reply fail the call once.
+    foreach (const QVariant &context, m_parseQueue->cancel()) {
+        const QVariantList operation = context.toList();
+
+        if (operation.at(0).toInt() != RetrieveMessages) {
+            emitFailure(Operation(operation.at(0).toInt()), operation.at(1).toInt());
+        }
+        else if (m_messageStreams.remove(operation.at(1).toInt())) {
+            emitFailure(RetrieveMessages, -1);
+        }
+    }
+
+    updateActivity();
 
     // If we were in the middle of authentication process, reset the state
     if (state() != Logged && state() != NotLogged) {
         clearAllMembers();
         setState(NotLogged);
+        updateActivity();
         WebInterface *webInterface = qobject_cast<WebInterface*>(SocialConnection::webInterface());
         webInterface->setActive(false);
         emit authenticateCompleted(false);
     }
+
+    // The uploads waiting for their turn are not started. A media upload
+    // waiting for processing has nothing in flight.
+    while (!m_mediaQueue.isEmpty()) {
+        releaseImage(m_mediaQueue.dequeue().fileUrl);
+        emit postMessageCompleted(false);
+    }
+
+    failMediaUpload();
+    cancelImageProcessing();
 }
 
 bool TwitterConnection::storeCredentials()
@@ -551,9 +1170,13 @@ void TwitterConnection::authenticationFailed(const QString &errorMsg, const int
     qWarning() << errorMsg << (errorCode ? QString::number(errorCode) : QString(""));
 
     clearAllMembers();
-    setTransmitting(false);
-    setBusy(false);
     setState(NotLogged);
+    updateActivity();
+
+    if (completionStatus() == Succeeded) {
+        setCompletionStatus(Failed);
+    }
+
     emit authenticateCompleted(false);
 }
 
@@ -562,18 +1185,17 @@ void TwitterConnection::authenticationSucceeded()
     m_verifier.clear();
     m_requestToken.clear();
     m_requestTokenSecret.clear();
-    setTransmitting(false);
-    setBusy(false);
     setState(Logged);
+    updateActivity();
     setAuthenticated(true);
+    setCompletionStatus(Succeeded);
     emit authenticateCompleted(true);
 }
 
-int TwitterConnection::checkReplyErrors()
+int TwitterConnection::checkReplyErrors(QNetworkReply *reply)
 {
-    setTransmitting(false);
-    setBusy(false);
-    const int requestError = m_ongoingRequest->error();
+    const int requestError = reply->error();
+    setCompletionStatus(replyStatus(reply));
 
     if (requestError == QNetworkReply::AuthenticationRequiredError) {
         setState(NotLogged);
@@ -594,11 +1216,240 @@ void TwitterConnection::clearAllMembers()
     m_twitterRequest->setAccessTokenSecret("");
 }
 
-void TwitterConnection::deleteReply()
+void TwitterConnection::deleteReply(QNetworkReply *reply)
 {
-    m_ongoingRequest->close();
-    m_ongoingRequest->deleteLater();
-    m_ongoingRequest = 0;
+    reply->close();
+    reply->deleteLater();
+}
+
+void TwitterConnection::enqueueRequest(Operation operation,
+                                       const QNetworkRequest &request,
+                                       bool post,
+                                       const QByteArray &content,
+                                       QIODevice *device,
+                                       int tag)
+{
+    QueuedRequest queued;
+    queued.operation = operation;
+    queued.request = request;
+    queued.content = content;
+    queued.device = device;
+    queued.post = post;
+    queued.tag = tag;
+
+    // The cache policy in effect when the request was made applies, unless
+    // the request has its own. So does the timeout. The responses are
+    // cached for the account only.
+    if (!post && !request.attribute(QNetworkRequest::CacheLoadControlAttribute).isValid()) {
+        queued.request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, cachePolicy());
+    }
+
+    if (!post) {
+        queued.request.setAttribute(
+                QNetworkRequest::Attribute(NetworkTransport::CacheScopeAttribute), m_accessToken);
+    }
+
+    const QNetworkRequest::Attribute timeoutAttribute =
+            QNetworkRequest::Attribute(NetworkTransport::TimeoutAttribute);
+    const QNetworkRequest::Attribute deadlineAttribute =
+            QNetworkRequest::Attribute(NetworkTransport::DeadlineAttribute);
+
+    if (!request.attribute(timeoutAttribute).isValid() &&
+        !request.attribute(deadlineAttribute).isValid()) {
+        applyRequestTimeout(queued.request, device != 0);
+    }
+
+    queued.enqueued = QDateTime::currentMSecsSinceEpoch();
+
+    m_queue.enqueue(queued);
+    emit queueDepthChanged(m_queue.count());
+
+    dispatchRequests();
+    updateActivity();
+}
+
+/*!
+    \internal
+
+    Queues a request of the media upload in progress. Its requests are made
+    after postMessage() has returned, so they are given the timeout of the
+    post instead of callTimeout().
+*/
+void TwitterConnection::enqueueMediaRequest(Operation operation,
+                                            QNetworkRequest request,
+                                            bool post,
+                                            const QByteArray &content,
+                                            QIODevice *device,
+                                            int tag)
+{
+    setRequestTimeout(request, m_media.timeout, device != 0);
+    enqueueRequest(operation, request, post, content, device, tag);
+}
+
+void TwitterConnection::dispatchRequests()
+{
+    if (m_queue.isEmpty() || m_replies.count() >= m_maxConcurrentRequests) {
+        return;
+    }
+
+    while (!m_queue.isEmpty() && m_replies.count() < m_maxConcurrentRequests) {
+        const QueuedRequest queued = m_queue.dequeue();
+        QNetworkRequest request(queued.request);
+        QNetworkReply *reply = 0;
+
+        // The time spent in the queue counts against the deadline; one
+        // already passed times the request out at once.
+        const QNetworkRequest::Attribute deadlineAttribute =
+                QNetworkRequest::Attribute(NetworkTransport::DeadlineAttribute);
+        const int deadline = request.attribute(deadlineAttribute).toInt();
+
+        if (deadline > 0) {
+            const qint64 waited = QDateTime::currentMSecsSinceEpoch() - queued.enqueued;
+            request.setAttribute(deadlineAttribute, int(qMax<qint64>(1, deadline - waited)));
+        }
+
+        if (queued.device) {
+            reply = NetworkTransport::instance()->post(request, queued.device);
+            // The device is deleted together with the reply.
+            queued.device->setParent(reply);
+        }
+        else {
+            reply = queued.post
+                    ? NetworkTransport::instance()->post(request, queued.content)
+                    : NetworkTransport::instance()->get(request);
+        }
+
+        m_replies.insert(reply, queued.operation);
+        trackProgress(reply, operationName(queued.operation));
+
+        if (queued.tag >= 0) {
+            m_replyTags.insert(reply, queued.tag);
+        }
+
+        connect(reply, SIGNAL(finished()), this, SLOT(onReplyFinished()));
+
+        if (queued.operation == RetrieveMessages) {
+            MessageStream stream;
+            stream.rows = messageModel()->isActive();
+            m_streamIds.insert(reply, ++m_streamCount);
+            m_messageStreams.insert(m_streamCount, stream);
+            connect(reply, SIGNAL(readyRead()), this, SLOT(onReplyReadyRead()));
+        }
+    }
+
+    emit queueDepthChanged(m_queue.count());
+    emit inFlightCountChanged(m_replies.count());
+}
+
+void TwitterConnection::updateActivity()
+{
+    const bool authenticating = state() != Logged && state() != NotLogged;
+    setBusy(authenticating || processingImages() || m_media.active ||
+            !m_mediaQueue.isEmpty() || !m_queue.isEmpty() || !m_replies.isEmpty() ||
+            m_parseQueue->isActive());
+    setTransmitting(!m_replies.isEmpty());
+}
+
+void TwitterConnection::onReplyFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (!reply || !m_replies.contains(reply)) {
+        return;
+    }
+
+    const Operation operation = m_replies.take(reply);
+    const int tag = m_replyTags.take(reply);
+    emit inFlightCountChanged(m_replies.count());
+
+    // Let the next queued request take the slot before the completion is
+    // reported, so that busy stays set while the queue is not empty.
+    dispatchRequests();
+    updateActivity();
+
+    switch (operation) {
+    case RequestToken:
+        onRequestTokenReply(reply);
+        break;
+    case AccessToken:
+        onAccessTokenReply(reply);
+        break;
+    case PostMessage:
+        onPostMessageReply(reply);
+        break;
+    case RetrieveMessages:
+        onRetrieveMessagesReply(reply);
+        break;
+    case RetrieveMessageCount:
+        onRetrieveMessageCountReply(reply);
+        break;
+    case SendDirectMessage:
+        onSendDirectMessageReply(reply);
+        break;
+    case MediaInit:
+        onMediaInitReply(reply);
+        break;
+    case MediaAppend:
+        onMediaAppendReply(reply, tag);
+        break;
+    case MediaFinalize:
+    case MediaStatus:
+        onMediaProcessingReply(reply);
+        break;
+    case SyncTimeline:
+        onSyncTimelineReply(reply, tag);
+        break;
+    }
+}
+
+void TwitterConnection::emitFailure(Operation operation, int tag)
+{
+    switch (operation) {
+    case RequestToken:
+    case AccessToken:
+        authenticationFailed("Authentication cancelled.");
+        break;
+    case PostMessage:
+        emit postMessageCompleted(false);
+        break;
+    case RetrieveMessages:
+        emit retrieveMessagesCompleted(false, QVariantList());
+        break;
+    case RetrieveMessageCount:
+        emit retrieveMessageCountCompleted(false, 0);
+        break;
+    case SendDirectMessage:
+        emit sendDirectMessageCompleted(false);
+        break;
+    case MediaInit:
+    case MediaAppend:
+    case MediaFinalize:
+    case MediaStatus:
+        failMediaUpload();
+        break;
+    case SyncTimeline:
+        m_timelines[tag].active = false;
+        emit syncTimelineCompleted(false, tag, QVariantList(), !m_timelines[tag].gaps.isEmpty());
+        break;
+    }
+}
+
+QString TwitterConnection::operationName(Operation operation)
+{
+    switch (operation) {
+    case RequestToken:
+    case AccessToken:
+        return "authenticate";
+    case RetrieveMessages:
+    case SyncTimeline:
+        return "retrieveMessages";
+    case RetrieveMessageCount:
+        return "retrieveMessageCount";
+    case SendDirectMessage:
+        return "sendDirectMessage";
+    default:
+        return "postMessage";
+    }
 }
 
 /*!
@@ -606,19 +1457,14 @@ void TwitterConnection::deleteReply()
 */
 bool TwitterConnection::retrieveHomeTimeline(const QString &from, const QString &to, int max)
 {
-    if (!authenticated() || state() != Logged || busy()) {
+    if (!authenticated() || state() != Logged) {
         qWarning() << "Cannot retrieve messages while not authenticated/logged";
         return false;
     }
 
-    setBusy(true);
-    setTransmitting(true);
-
     QNetworkRequest req = m_twitterRequest->createRetrieveMessagesRequest(
                 name(), from, to, max, HOME_TIMELINE_URL);
-    m_ongoingRequest = m_networkManager.get(req);
-    connect(m_ongoingRequest, SIGNAL(finished()),
-            this, SLOT(onRetrieveMessagesReply()));
+    enqueueRequest(RetrieveMessages, req, false);
 
     return true;
 }
@@ -628,27 +1474,240 @@ bool TwitterConnection::retrieveHomeTimeline(const QString &from, const QString
 */
 bool TwitterConnection::sendDirectMessage(const QString &to, const QString &message)
 {
-    if (!authenticated() || state() != Logged || busy()) {
+    if (!authenticated() || state() != Logged) {
         qWarning() << "Cannot send messages while not authenticated/logged";
         return false;
     }
 
-    setBusy(true);
-    setTransmitting(true);
-
     QByteArray content;
     QNetworkRequest req = m_twitterRequest->createSendDirectMessageRequest(to, message, &content);
-
-    m_ongoingRequest = m_networkManager.post(req, content);
-    connect(m_ongoingRequest, SIGNAL(finished()),
-            this, SLOT(onSendDirectMessageReply()));
+    enqueueRequest(SendDirectMessage, req, true, content);
 
     return true;
 }
 
-void TwitterConnection::onSendDirectMessageReply()
+void TwitterConnection::onSendDirectMessageReply(QNetworkReply *reply)
 {
-    const int requestError = checkReplyErrors();
-    deleteReply();
+    const int requestError = checkReplyErrors(reply);
+    deleteReply(reply);
     emit sendDirectMessageCompleted(requestError == QNetworkReply::NoError);
 }
+
+/*!
+    \enum TwitterConnection::Timeline
+
+    This enum specifies a timeline kept in sync with syncTimeline().
+
+    \value UserTimeline
+           The tweets of the user.
+    \value HomeTimeline
+           The tweets of the user and the users they follow.
+ */
+
+/*!
+    \fn void TwitterConnection::syncTimelineCompleted(bool success, int timeline,
+    const QVariantList &messages, bool gaps)
+
+    A syncTimeline() or backfillTimeline() of \a timeline has been completed.
+    Success of the operation is indicated by \a success. \a messages holds
+    only the tweets not delivered before, newest first, in the format of
+    retrieveMessagesCompleted(); it is empty while the messageModel is
+    active, which gets the tweets instead. \a gaps is true if there are
+    tweets between the oldest and the newest one that backfillTimeline() has
+    yet to retrieve.
+ */
+
+/*!
+    Retrieves up to \a max tweets of \a timeline, either UserTimeline or
+    HomeTimeline, that are newer than the newest tweet retrieved from it so
+    far. The first sync retrieves the latest tweets.
+
+    Only the new tweets are delivered with syncTimelineCompleted(). If
+    Twitter returns a full page of \a max tweets, more new tweets may be
+    left, and the tweets between are left as a gap that backfillTimeline()
+    retrieves later.
+
+    Only one sync or backfill of a timeline can be in progress at a time.
+    Returns true if the operation was successfully started; otherwise
+    returns false.
+*/
+bool TwitterConnection::syncTimeline(int timeline, int max)
+{
+    if (!isTimeline(timeline)) {
+        return false;
+    }
+
+    return requestTimeline(timeline, IdRange(m_timelines[timeline].newestId, 0), max);
+}
+
+/*!
+    Retrieves up to \a max tweets of \a timeline that have not been
+    retrieved yet. The newest gap left by syncTimeline() is filled first.
+    Without gaps, the tweets older than the oldest one retrieved so far are
+    retrieved.
+
+    The tweets are delivered with syncTimelineCompleted(). Returns true if
+    the operation was successfully started; otherwise, for example if the
+    oldest tweet of the timeline has already been retrieved, returns false.
+*/
+bool TwitterConnection::backfillTimeline(int timeline, int max)
+{
+    if (!isTimeline(timeline)) {
+        return false;
+    }
+
+    const TimelineSync &sync = m_timelines[timeline];
+
+    if (!sync.gaps.isEmpty()) {
+        return requestTimeline(timeline, sync.gaps.first(), max);
+    }
+    else if (sync.newestId == 0) {
+        return requestTimeline(timeline, IdRange(0, 0), max);
+    }
+    else if (sync.complete) {
+        qWarning() << "The whole timeline has already been retrieved";
+        return false;
+    }
+
+    return requestTimeline(timeline, IdRange(0, sync.oldestId - 1), max);
+}
+
+/*!
+    Forgets the tweets retrieved from \a timeline, so that the next
+    syncTimeline() starts over from the latest tweets. Returns false if a
+    sync or backfill of the timeline is in progress; otherwise returns true.
+*/
+bool TwitterConnection::resetTimeline(int timeline)
+{
+    if (!isTimeline(timeline) || m_timelines[timeline].active) {
+        return false;
+    }
+
+    m_timelines[timeline] = TimelineSync();
+    return true;
+}
+
+bool TwitterConnection::isTimeline(int timeline) const
+{
+    if (timeline != UserTimeline && timeline != HomeTimeline) {
+        qWarning() << "Unknown timeline" << timeline;
+        return false;
+    }
+
+    return true;
+}
+
+bool TwitterConnection::requestTimeline(int timeline, const IdRange &range, int max)
+{
+    if (!authenticated() || state() != Logged) {
+        qWarning() << "Cannot retrieve messages while not authenticated/logged";
+        return false;
+    }
+
+    TimelineSync &sync = m_timelines[timeline];
+
+    if (sync.active) {
+        qWarning() << "Timeline" << timeline << "is already being retrieved";
+        return false;
+    }
+
+    const QString from = range.first ? QString::number(range.first) : QString();
+    const QString to = range.second ? QString::number(range.second) : QString();
+    QNetworkRequest req = m_twitterRequest->createRetrieveMessagesRequest(
+                name(), from, to, max,
+                timeline == HomeTimeline ? HOME_TIMELINE_URL : USER_TIMELINE_URL);
+
+    sync.active = true;
+    sync.requested = range;
+    sync.requestedMax = max;
+    enqueueRequest(SyncTimeline, req, false, QByteArray(), 0, timeline);
+
+    return true;
+}
+
+void TwitterConnection::onSyncTimelineReply(QNetworkReply *reply, int timeline)
+{
+    const int requestError = checkReplyErrors(reply);
+    QByteArray result = reply->readAll();
+    deleteReply(reply);
+
+    if (requestError != QNetworkReply::NoError) {
+        m_timelines[timeline].active = false;
+        emit syncTimelineCompleted(false, timeline, QVariantList(),
+                                   !m_timelines[timeline].gaps.isEmpty());
+        return;
+    }
+
+    // The timeline stays active until the tweets have been parsed.
+    parseRetrievedMessages(SyncTimeline, result, timeline);
+}
+
+void TwitterConnection::onTimelineParsed(int timeline, const QVariantList &received)
+{
+    TimelineSync &sync = m_timelines[timeline];
+    const IdRange range = sync.requested;
+    sync.active = false;
+
+    QVariantList messages;
+    quint64 newest = 0;
+    quint64 oldest = 0;
+
+    // Tweets outside the requested range have been delivered before.
+    foreach (const QVariant &message, received) {
+        const quint64 id = message.toMap().value(MESSAGE_ID).toString().toULongLong();
+
+        if (id == 0 || id <= range.first || (range.second && id > range.second)) {
+            continue;
+        }
+
+        messages.append(message);
+        newest = qMax(newest, id);
+        oldest = oldest ? qMin(oldest, id) : id;
+    }
+
+    // A full page may have left tweets of the range behind it. The page is
+    // counted as Twitter returned it, before the tweets outside the range
+    // are dropped.
+    const bool partial = received.count() >= sync.requestedMax && !messages.isEmpty() &&
+                         oldest - 1 > range.first;
+
+    if (range.second == 0) {
+        // The newest tweets. The first sync sets both watermarks; the tweets
+        // older than it are history rather than a gap.
+        if (!messages.isEmpty()) {
+            if (sync.newestId == 0) {
+                sync.oldestId = oldest;
+            }
+            else if (partial) {
+                sync.gaps.prepend(IdRange(range.first, oldest - 1));
+            }
+
+            sync.newestId = newest;
+        }
+    }
+    else if (range.first == 0) {
+        // The tweets older than the oldest one so far.
+        if (messages.isEmpty()) {
+            sync.complete = true;
+        }
+        else {
+            sync.oldestId = oldest;
+        }
+    }
+    else {
+        sync.gaps.removeOne(range);
+
+        if (partial) {
+            sync.gaps.prepend(IdRange(range.first, oldest - 1));
+        }
+    }
+
+    // An active model holds the tweets instead of the completion signal.
+    if (messageModel()->isActive()) {
+        messageModel()->addMessages(messages);
+        emit syncTimelineCompleted(true, timeline, QVariantList(), !sync.gaps.isEmpty());
+        return;
+    }
+
+    emit syncTimelineCompleted(true, timeline, messages, !sync.gaps.isEmpty());
+}
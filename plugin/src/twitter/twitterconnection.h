@@ -9,12 +9,25 @@
 #ifndef TWITTERCONNECTION_H
 #define TWITTERCONNECTION_H
 
-#include <QNetworkAccessManager>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QNetworkRequest>
+#include <QPair>
+#include <QQueue>
 #include <QString>
 #include <QVariantMap>
 
+#include "jsonprojection.h"
+#include "jsonrecordsplitter.h"
+#include "messagemodel.h"
 #include "socialconnection.h"
 
+class QFileInfo;
+class QIODevice;
+class QNetworkReply;
+class ParseQueue;
+class QTimer;
 class TwitterRequest;
 
 
@@ -27,8 +40,19 @@ class TwitterConnection : public SocialConnection
     Q_PROPERTY(QString accessToken READ accessToken WRITE setAccessToken NOTIFY accessTokenChanged)
     Q_PROPERTY(QString accessTokenSecret READ accessTokenSecret WRITE setAccessTokenSecret NOTIFY accessTokenSecretChanged)
     Q_PROPERTY(QString callbackUrl READ callbackUrl WRITE setCallbackUrl NOTIFY callbackUrlChanged)
+    Q_PROPERTY(int maxConcurrentRequests READ maxConcurrentRequests WRITE setMaxConcurrentRequests NOTIFY maxConcurrentRequestsChanged)
+    Q_PROPERTY(int queueDepth READ queueDepth NOTIFY queueDepthChanged)
+    Q_PROPERTY(int inFlightCount READ inFlightCount NOTIFY inFlightCountChanged)
+    Q_PROPERTY(int maxParallelSegments READ maxParallelSegments WRITE setMaxParallelSegments NOTIFY maxParallelSegmentsChanged)
+    Q_ENUMS(Timeline)
 
 public:
+    // The timelines kept in sync with syncTimeline().
+    enum Timeline {
+        UserTimeline = 0,
+        HomeTimeline
+    };
+
     explicit TwitterConnection(QObject *parent = 0);
 
 public:
@@ -47,6 +71,15 @@ public:
     QString callbackUrl() const;
     void setCallbackUrl(const QString &callbackUrl);
 
+    int maxConcurrentRequests() const;
+    void setMaxConcurrentRequests(int maxConcurrentRequests);
+
+    int queueDepth() const;
+    int inFlightCount() const;
+
+    int maxParallelSegments() const;
+    void setMaxParallelSegments(int maxParallelSegments);
+
     // Virtual method implementations from the SocialConnect base class.
     bool authenticate();
     bool deauthenticate();
@@ -63,6 +96,9 @@ public slots:
     // Twitter specific API
     bool retrieveHomeTimeline(const QString &from, const QString &to, int max);
     bool sendDirectMessage(const QString &to, const QString &message);
+    bool syncTimeline(int timeline, int max);
+    bool backfillTimeline(int timeline, int max);
+    bool resetTimeline(int timeline);
 
 signals:
     void consumerKeyChanged(QString consumerKey);
@@ -70,25 +106,160 @@ signals:
     void accessTokenChanged(QString accessToken);
     void accessTokenSecretChanged(QString accessTokenSecret);
     void callbackUrlChanged(QString callbackUrl);
+    void maxConcurrentRequestsChanged(int maxConcurrentRequests);
+    void queueDepthChanged(int queueDepth);
+    void inFlightCountChanged(int inFlightCount);
+    void maxParallelSegmentsChanged(int maxParallelSegments);
 
     // Twitter specific API
     void sendDirectMessageCompleted(bool success);
+    void syncTimelineCompleted(bool success, int timeline, const QVariantList &messages, bool gaps);
 
 protected slots:
     void onUrlChanged(const QUrl &url);
+    void onImageProcessed(const QVariant &context, const QUrl &fileUrl);
 
 private slots:
-    void onRequestTokenReply();
-    void onAccessTokenReply();
-    void onPostMessageReply();
-    void onRetrieveMessagesReply();
-    void onRetrieveMessageCountReply();
-
-    // Twitter specific API
-    void onSendDirectMessageReply();
+    void onReplyFinished();
+    void onReplyReadyRead();
+    void onReplyParsed(const QVariant &context, const QVariantList &messages);
+    void checkMediaStatus();
+    void startNextMediaUpload();
 
 private:    // Members
 
+    // The operations a queued or in-flight request belongs to.
+    enum Operation {
+        RequestToken = 0,
+        AccessToken,
+        PostMessage,
+        RetrieveMessages,
+        RetrieveMessageCount,
+        SendDirectMessage,
+        MediaInit,
+        MediaAppend,
+        MediaFinalize,
+        MediaStatus,
+        SyncTimeline
+    };
+
+    // A request waiting in the queue for a free slot.
+    struct QueuedRequest {
+        Operation operation;
+        QNetworkRequest request;
+        QByteArray content;
+        QIODevice *device;  // Owned until the request is sent
+        bool post;
+        int tag;            // Media segment of an APPEND or the timeline of
+                            // a sync, otherwise -1
+        qint64 enqueued;    // Milliseconds since the epoch
+    };
+
+    // The chunked media upload in progress. The segments are read from the
+    // file only when they are queued.
+    struct MediaUpload {
+        MediaUpload() : active(false), timeout(0), size(0), segmentCount(0),
+                        nextSegment(0), pendingSegments(0), completedSegments(0) {}
+
+        bool active;
+        QString text;
+        QUrl fileUrl;               // Released once the upload is over
+        int timeout;                // The callTimeout() of the post
+        QString fileName;
+        qint64 size;
+        QString mediaId;
+        int segmentCount;
+        int nextSegment;            // First segment never queued
+        int pendingSegments;        // Segments queued or in flight
+        int completedSegments;
+        QList<int> failedSegments;  // Segments waiting to be sent again
+        QHash<int, int> retries;
+    };
+
+    // A range of tweet ids of a timeline: greater than the first id and at
+    // most the second one. Zero leaves that end open.
+    typedef QPair<quint64, quint64> IdRange;
+
+    // The newest and oldest tweet retrieved from a timeline, and the ranges
+    // between them not retrieved yet, newest first. Only one request of a
+    // timeline is in flight at a time.
+    struct TimelineSync {
+        TimelineSync() : newestId(0), oldestId(0), active(false), complete(false),
+                         requestedMax(0) {}
+
+        quint64 newestId;
+        quint64 oldestId;
+        QList<IdRange> gaps;
+        bool active;
+        bool complete;              // The oldest tweet has been retrieved
+        IdRange requested;
+        int requestedMax;           // The page size of the request
+    };
+
+    // The tweets of a retrieveMessages reply read so far. The reply is read
+    // as it arrives, and each batch of complete tweets is projected on a
+    // worker thread, into MessageModel::Rows if the model is active.
+    struct MessageStream {
+        MessageStream() : batchCount(0), pendingBatches(0), finished(false), rows(false) {}
+
+        JsonRecordSplitter splitter;
+        QMap<int, QVariantList> batches;    // Projected batches by index
+        int batchCount;
+        int pendingBatches;                 // Batches being projected
+        bool finished;                      // The reply has been read
+        bool rows;                          // The batches are Rows
+    };
+
+    // Queues a request and starts it as soon as the number of requests in
+    // flight allows. A POST sends either the content or the device. The
+    // callTimeout() applies unless the request has a timeout of its own.
+    void enqueueRequest(Operation operation, const QNetworkRequest &request,
+                        bool post, const QByteArray &content = QByteArray(),
+                        QIODevice *device = 0, int tag = -1);
+    void dispatchRequests();
+
+    // Updates busy & transmitting to reflect the authentication state, the
+    // queue and the requests in flight.
+    void updateActivity();
+
+    // Reports the failure of a request dropped from the queue.
+    void emitFailure(Operation operation, int tag = -1);
+
+    // The SocialConnection operation name an operation reports progress as.
+    static QString operationName(Operation operation);
+
+    // Reply handlers, called with the finished reply of each operation.
+    void onRequestTokenReply(QNetworkReply *reply);
+    void onAccessTokenReply(QNetworkReply *reply);
+    void onPostMessageReply(QNetworkReply *reply);
+    void onRetrieveMessagesReply(QNetworkReply *reply);
+    void onRetrieveMessageCountReply(QNetworkReply *reply);
+
+    // Twitter specific API
+    void onSendDirectMessageReply(QNetworkReply *reply);
+
+    // Timeline sync: each request retrieves one range of ids, and the
+    // watermarks and gaps are updated from the tweets in the reply.
+    bool isTimeline(int timeline) const;
+    bool requestTimeline(int timeline, const IdRange &range, int max);
+    void onSyncTimelineReply(QNetworkReply *reply, int timeline);
+    void onTimelineParsed(int timeline, const QVariantList &received);
+
+    // Chunked media upload: INIT, the APPEND of each segment, FINALIZE and
+    // STATUS until the media has been processed. Finally the status update
+    // is posted with the media id.
+    bool postMedia(const QString &text, const QUrl &fileUrl);
+    bool startMediaUpload(const QString &text, const QUrl &fileUrl, int timeout);
+    void enqueueMediaRequest(Operation operation, QNetworkRequest request,
+                             bool post, const QByteArray &content = QByteArray(),
+                             QIODevice *device = 0, int tag = -1);
+    void endMediaUpload();
+    void scheduleSegments();
+    void failMediaUpload();
+    void onMediaInitReply(QNetworkReply *reply);
+    void onMediaAppendReply(QNetworkReply *reply, int segment);
+    void onMediaProcessingReply(QNetworkReply *reply);
+
     // Twitter login internal state tracking and setters & getters for it.
     enum State {
         NotLogged = 0,
@@ -111,15 +282,27 @@ private:    // Members
 
     // Check if the reply had some errors. Currently only reacts to
     // "401 Unauthorized" by setting the state to NotLogged & unauthenticated.
-    int checkReplyErrors();
-
-    // Closes the QNetworkReply & nullifies the pointer. Should be called
-    // always after each request completed signal handler.
-    void deleteReply();
-
-    // Traverses the retrieveMessages reply and creates a messagelist in the
-    // specified format. See socialconnection.h for details.
-    QVariantList parseRetrievedMessages(const QByteArray &result);
+    int checkReplyErrors(QNetworkReply *reply);
+
+    // Closes the QNetworkReply. Should be called always after each request
+    // completed signal handler.
+    void deleteReply(QNetworkReply *reply);
+
+    // Reads the tweets of a retrieveMessages reply that have arrived and
+    // sends them to be projected on a worker thread. Each batch of message
+    // objects is reported with messagesReceived() in onMessagesParsed(), and
+    // the call completes once the reply has been read and every batch
+    // projected. projectRows() builds the batches for an active model.
+    void readMessages(QNetworkReply *reply, int stream);
+    void onMessagesParsed(int stream, int batch, const QVariantList &messages);
+    void completeMessages(int stream);
+    QVariantList projectRows(const QList<QByteArray> &records,
+                             const MessageModel::RoleKeys &keys) const;
+
+    // Traverses the timeline reply on a worker thread and reports the
+    // messagelist in the specified format with onReplyParsed(). See
+    // socialconnection.h for details.
+    void parseRetrievedMessages(Operation operation, const QByteArray &result, int tag = -1);
 
     // A helper method for clearing the XXXToken etc. QString members.
     void clearAllMembers();
@@ -128,8 +311,27 @@ private:    // Data
 
     TwitterRequest *m_twitterRequest;
 
-    QNetworkReply *m_ongoingRequest;
-    QNetworkAccessManager m_networkManager;
+    // Requests waiting for a free slot and the operations of the replies in
+    // flight.
+    QQueue<QueuedRequest> m_queue;
+    QHash<QNetworkReply*, Operation> m_replies;
+    QHash<QNetworkReply*, int> m_replyTags;
+    QHash<int, MessageStream> m_messageStreams;
+    QHash<QNetworkReply*, int> m_streamIds;
+    int m_streamCount;
+    int m_maxConcurrentRequests;
+
+    MediaUpload m_media;
+    QQueue<MediaUpload> m_mediaQueue; // Uploads waiting for m_media
+    QTimer *m_mediaStatusTimer;
+    int m_maxParallelSegments;
+    JsonProjection m_mediaProjection;
+
+    // Compiled key paths of the fields read from each retrieved tweet.
+    JsonProjection m_messageProjection;
+    ParseQueue *m_parseQueue; // Owned
+
+    TimelineSync m_timelines[HomeTimeline + 1];
 
     QString m_consumerKey;
     QString m_consumerSecret;
@@ -19,6 +19,8 @@
 #define USER_TIMELINE_URL "http://api.twitter.com/1/statuses/user_timeline.json"
 #define HOME_TIMELINE_URL "http://api.twitter.com/1/statuses/home_timeline.json"
 #define DIRECT_MESSAGE_URL "https://api.twitter.com/1/direct_messages/new.json"
+#define MEDIA_UPLOAD_URL "https://upload.twitter.com/1.1/media/upload.json"
+#define MEDIA_UPDATE_URL "https://api.twitter.com/1.1/statuses/update.json"
 
 // OAuth request parameter string defines & Twitter request parameter defines.
 #define OAUTH_CALLBACK "oauth_callback"
@@ -38,6 +40,37 @@
 #define TWITTER_USER_ID "user_id"
 #define TWITTER_MAX_ID "max_id"
 #define TWITTER_SINCE_ID "since_id"
+#define TWITTER_MEDIA_IDS "media_ids"
+
+// Chunked media upload parameter defines.
+#define MEDIA_COMMAND "command"
+#define MEDIA_COMMAND_INIT "INIT"
+#define MEDIA_COMMAND_APPEND "APPEND"
+#define MEDIA_COMMAND_FINALIZE "FINALIZE"
+#define MEDIA_COMMAND_STATUS "STATUS"
+#define MEDIA_TOTAL_BYTES "total_bytes"
+#define MEDIA_TYPE "media_type"
+#define MEDIA_CATEGORY "media_category"
+#define MEDIA_ID "media_id"
+#define MEDIA_ID_STRING "media_id_string"
+#define MEDIA_SEGMENT_INDEX "segment_index"
+#define MEDIA_DATA "media"
+#define MEDIA_PROCESSING_STATE "processing_info.state"
+#define MEDIA_PROCESSING_CHECK_AFTER "processing_info.check_after_secs"
+#define MEDIA_STATE_PENDING "pending"
+#define MEDIA_STATE_IN_PROGRESS "in_progress"
+#define MEDIA_STATE_FAILED "failed"
+
+// Request queue defaults.
+#define MAX_CONCURRENT_REQUESTS 4
+
+// Chunked media upload defaults. Files larger than the simple upload limit,
+// and GIFs and videos of any size, are uploaded in segments.
+#define MEDIA_SIMPLE_UPLOAD_LIMIT (3 * 1024 * 1024)
+#define MEDIA_SEGMENT_SIZE (1024 * 1024)
+#define MAX_PARALLEL_SEGMENTS 2
+#define MAX_SEGMENT_RETRIES 3
+#define MEDIA_STATUS_CHECK_INTERVAL 5
 
 // Defines for QSettings.
 #define SETTINGS_ACCESS_TOKEN "access_token"
@@ -9,23 +9,24 @@
 #include "twitterrequest.h"
 
 #include "twitterconstants.h"
+#include "multipartdevice.h"
 #include <QDateTime>
 #include <QDebug>
-#include <QFile>
 #include <QFileInfo>
 #include <QStringList>
 
 // A Helper function to generate a correct kind of request for image uploads.
+// The image is not read into memory; the content device reads it from the
+// file while the request is sent.
 //
 // %1 Status update text.
-// %2 Uploaded image file name.
-// %3 Image's file suffix (e.g. jpg).
-// %4 Image data in binary format.
-QByteArray createImageUploadContent(const QString & bound,
-                                    const QString &text,
-                                    const QString &fileName,
-                                    const QString &fileSuffix,
-                                    const QByteArray &fileData)
+// %2 Uploaded image file.
+//
+// Returns false if the image cannot be read.
+bool createImageUploadContent(MultipartDevice *device,
+                              const QString & bound,
+                              const QString &text,
+                              const QFileInfo &fileInfo)
 {
     QByteArray content;
 
@@ -40,14 +41,27 @@ QByteArray createImageUploadContent(const QString & bound,
     // And add the file content (image) to the first HTTP (multi)part.
     content += "--" + bound.toAscii() + "\r\n";
     content += "Content-Disposition: form-data; name=\"media[]\"; filename=\""
-            + fileName.toAscii() + "\"\r\n";
+            + fileInfo.fileName().toAscii() + "\"\r\n";
     content += "Content-Transfer-Encoding: binary\r\n";
-    content += "Content-Type: image/" + fileSuffix.toLower() + "\r\n";
-    content += "\r\n" + fileData + "\r\n";
+    content += "Content-Type: image/" + fileInfo.suffix().toLower() + "\r\n";
+    content += "\r\n";
+    device->addData(content);
+
+    if (!fileInfo.exists()) {
+        qWarning() << "File not found:" << fileInfo.filePath();
+        return false;
+    }
+    else if (!device->addFile(fileInfo.filePath())) {
+        qWarning() << "Cannot open file:" << fileInfo.filePath();
+        return false;
+    }
+
+    content = "\r\n";
     content += "\r\n";
     content += "--" + bound.toAscii() + "--";
+    device->addData(content);
 
-    return content;
+    return true;
 }
 
 TwitterRequest::TwitterRequest(QObject *parent) :
@@ -141,67 +155,178 @@ QNetworkRequest TwitterRequest::createRetrieveMessagesRequest(
 }
 
 QNetworkRequest TwitterRequest::createPostMessageRequest(const QString &text,
-                                                         const QUrl &fileUrl,
-                                                         QByteArray *retContent)
+                                                         QByteArray *retContent,
+                                                         const QString &mediaIds)
 {
-    QByteArray content;
-    QNetworkRequest req;
+    // A status update with media uploaded in advance refers to it by id.
+    if (!mediaIds.isEmpty()) {
+        QVariantMap params;
+        params.insert(TWITTER_STATUS_UPDATE, text.normalized(QString::NormalizationForm_C));
+        params.insert(TWITTER_MEDIA_IDS, mediaIds);
 
-    if (!fileUrl.isEmpty()) {
-        // Status update with a picture included.
-        QString file = fileUrl.toLocalFile();
-        QFileInfo fileInfo(file);
-        QByteArray fileData = handleFile(file);
-        const QString bound = "WaB33xxDoEd";    // Just some random string.
-
-        // Create the request body content with an internal helper function.
-        content = createImageUploadContent(
-                    bound, text, fileInfo.fileName(), fileInfo.suffix(), fileData);
-
-        // Create the request with the OAuth Authorization. The image POSTs have
-        // only the oauth_* -fields in the signature.
-        req = createRequest(QUrl(UPDATE_WITH_MEDIA_URL), HTTP_POST);
-        req.setRawHeader(HTTP_HEADER_HOST, HTTP_HEADER_VALUE_TWITTER_UPLOAD);
-        req.setRawHeader(HTTP_HEADER_CONTENT_TYPE,
-                         HTTP_HEADER_VALUE_FORM_DATA_BOUNDARY + bound.toAscii());
-        req.setRawHeader(HTTP_HEADER_CONTENT_LENGTH,
-                         QString::number(content.length()).toAscii());
+        return createFormRequest(QUrl(MEDIA_UPDATE_URL), params, retContent);
     }
-    else {
-        // Normal status update (without any files).
-        QVariantMap params;
-        params.insert(TWITTER_STATUS_UPDATE, text);
 
-        QByteArray encodedMsg = QUrl::toPercentEncoding(
-                    text.normalized(QString::NormalizationForm_C));
-        content = QByteArray(TWITTER_STATUS_UPDATE).append("=").append(encodedMsg);
+    // Normal status update (without any files).
+    QVariantMap params;
+    params.insert(TWITTER_STATUS_UPDATE, text);
+
+    QByteArray encodedMsg = QUrl::toPercentEncoding(
+                text.normalized(QString::NormalizationForm_C));
+    *retContent = QByteArray(TWITTER_STATUS_UPDATE).append("=").append(encodedMsg);
+
+    // Create the request. The message has to be part of the signature.
+    QNetworkRequest req = createRequest(QUrl(UPDATE_URL), HTTP_POST, params);
+    req.setRawHeader(HTTP_HEADER_HOST, HTTP_HEADER_VALUE_TWITTER_API);
+    req.setRawHeader(HTTP_HEADER_CONTENT_TYPE, HTTP_HEADER_VALUE_FORM_URLENCODED);
+
+    return req;
+}
+
+QNetworkRequest TwitterRequest::createPostMediaRequest(const QString &text,
+                                                       const QUrl &fileUrl,
+                                                       MultipartDevice *content)
+{
+    // Status update with a picture included.
+    QFileInfo fileInfo(fileUrl.toLocalFile());
+    const QString bound = "WaB33xxDoEd";    // Just some random string.
 
-        // Create the request. The message has to be part of the signature.
-        req = createRequest(QUrl(UPDATE_URL), HTTP_POST, params);
-        req.setRawHeader(HTTP_HEADER_HOST, HTTP_HEADER_VALUE_TWITTER_API);
-        req.setRawHeader(HTTP_HEADER_CONTENT_TYPE, HTTP_HEADER_VALUE_FORM_URLENCODED);
+    // Fill the request body content with an internal helper function.
+    if (!createImageUploadContent(content, bound, text, fileInfo)) {
+        return QNetworkRequest();
     }
 
-    *retContent = content;
+    // Create the request with the OAuth Authorization. The image POSTs have
+    // only the oauth_* -fields in the signature. The length of the body is
+    // known without reading the image.
+    QNetworkRequest req = createRequest(QUrl(UPDATE_WITH_MEDIA_URL), HTTP_POST);
+    req.setRawHeader(HTTP_HEADER_HOST, HTTP_HEADER_VALUE_TWITTER_UPLOAD);
+    req.setRawHeader(HTTP_HEADER_CONTENT_TYPE,
+                     HTTP_HEADER_VALUE_FORM_DATA_BOUNDARY + bound.toAscii());
+    req.setRawHeader(HTTP_HEADER_CONTENT_LENGTH,
+                     QString::number(content->size()).toAscii());
+
     return req;
 }
 
-// Method for adding raw file data for the requests.
-QByteArray TwitterRequest::handleFile(const QString &filePath)
+QNetworkRequest TwitterRequest::createMediaInitRequest(qint64 totalBytes,
+                                                       const QString &mediaType,
+                                                       const QString &mediaCategory,
+                                                       QByteArray *retContent)
 {
-    QFile file(filePath);
+    QVariantMap params;
+    params.insert(MEDIA_COMMAND, MEDIA_COMMAND_INIT);
+    params.insert(MEDIA_TOTAL_BYTES, QString::number(totalBytes));
+    params.insert(MEDIA_TYPE, mediaType);
 
-    if (!file.exists()) {
-        qWarning() << "File not found:" << filePath;
-        return QByteArray();
+    if (!mediaCategory.isEmpty()) {
+        params.insert(MEDIA_CATEGORY, mediaCategory);
     }
 
-    if (!file.open(QIODevice::ReadOnly)) {
-        qWarning() << "Cannot open file:" << filePath;
-        return QByteArray();
+    QNetworkRequest req = createFormRequest(QUrl(MEDIA_UPLOAD_URL), params, retContent);
+    req.setRawHeader(HTTP_HEADER_HOST, HTTP_HEADER_VALUE_TWITTER_UPLOAD);
+
+    return req;
+}
+
+QNetworkRequest TwitterRequest::createMediaAppendRequest(const QString &mediaId,
+                                                         int segmentIndex,
+                                                         const QString &fileName,
+                                                         qint64 offset,
+                                                         qint64 length,
+                                                         MultipartDevice *content)
+{
+    const QByteArray bound = "Tw33tSeGm3nTxXoEd";    // Just some random string.
+    QByteArray part;
+
+    part = "--" + bound + "\r\n";
+    part += "Content-Disposition: form-data; name=\"" MEDIA_COMMAND "\"\r\n\r\n";
+    part += MEDIA_COMMAND_APPEND "\r\n";
+    part += "--" + bound + "\r\n";
+    part += "Content-Disposition: form-data; name=\"" MEDIA_ID "\"\r\n\r\n";
+    part += mediaId.toAscii() + "\r\n";
+    part += "--" + bound + "\r\n";
+    part += "Content-Disposition: form-data; name=\"" MEDIA_SEGMENT_INDEX "\"\r\n\r\n";
+    part += QByteArray::number(segmentIndex) + "\r\n";
+    part += "--" + bound + "\r\n";
+    part += "Content-Disposition: form-data; name=\"" MEDIA_DATA "\"; filename=\"blob\"\r\n";
+    part += "Content-Type: application/octet-stream\r\n";
+    part += "\r\n";
+    content->addData(part);
+
+    // Only this segment of the file is read, while the request is sent.
+    if (!content->addFile(fileName, offset, length)) {
+        qWarning() << "Cannot read segment" << segmentIndex << "of" << fileName;
+        return QNetworkRequest();
     }
 
-    return file.readAll();
+    content->addData("\r\n--" + bound + "--\r\n");
+
+    // As with the image uploads, only the oauth_* -fields are signed.
+    QNetworkRequest req = createRequest(QUrl(MEDIA_UPLOAD_URL), HTTP_POST);
+    req.setRawHeader(HTTP_HEADER_HOST, HTTP_HEADER_VALUE_TWITTER_UPLOAD);
+    req.setRawHeader(HTTP_HEADER_CONTENT_TYPE, HTTP_HEADER_VALUE_FORM_DATA_BOUNDARY + bound);
+    req.setRawHeader(HTTP_HEADER_CONTENT_LENGTH, QString::number(content->size()).toAscii());
+
+    return req;
+}
+
+QNetworkRequest TwitterRequest::createMediaFinalizeRequest(const QString &mediaId,
+                                                           QByteArray *retContent)
+{
+    QVariantMap params;
+    params.insert(MEDIA_COMMAND, MEDIA_COMMAND_FINALIZE);
+    params.insert(MEDIA_ID, mediaId);
+
+    QNetworkRequest req = createFormRequest(QUrl(MEDIA_UPLOAD_URL), params, retContent);
+    req.setRawHeader(HTTP_HEADER_HOST, HTTP_HEADER_VALUE_TWITTER_UPLOAD);
+
+    return req;
+}
+
+QNetworkRequest TwitterRequest::createMediaStatusRequest(const QString &mediaId)
+{
+    QVariantMap params;
+    params.insert(MEDIA_COMMAND, MEDIA_COMMAND_STATUS);
+    params.insert(MEDIA_ID, mediaId);
+
+    // Create the request. The URL parameters have to be part of the signature.
+    QUrl url(MEDIA_UPLOAD_URL);
+    QNetworkRequest req = createRequest(url, HTTP_GET, params);
+
+    url.addEncodedQueryItem(MEDIA_COMMAND, MEDIA_COMMAND_STATUS);
+    url.addEncodedQueryItem(MEDIA_ID, mediaId.toAscii());
+
+    req.setUrl(url);
+    req.setRawHeader(HTTP_HEADER_HOST, HTTP_HEADER_VALUE_TWITTER_UPLOAD);
+
+    return req;
+}
+
+// Creates a form-urlencoded POST request. All the parameters are part of the
+// signature.
+QNetworkRequest TwitterRequest::createFormRequest(const QUrl &requestUrl,
+                                                  const QVariantMap &params,
+                                                  QByteArray *retContent)
+{
+    QByteArray content;
+    QVariantMap::const_iterator i = params.constBegin();
+
+    while (i != params.constEnd()) {
+        if (!content.isEmpty()) {
+            content += "&";
+        }
+        content += i.key().toAscii() + "=" + QUrl::toPercentEncoding(i.value().toString());
+        ++i;
+    }
+
+    *retContent = content;
+
+    QNetworkRequest req = createRequest(requestUrl, HTTP_POST, params);
+    req.setRawHeader(HTTP_HEADER_HOST, HTTP_HEADER_VALUE_TWITTER_API);
+    req.setRawHeader(HTTP_HEADER_CONTENT_TYPE, HTTP_HEADER_VALUE_FORM_URLENCODED);
+
+    return req;
 }
 
 QNetworkRequest TwitterRequest::createRequest(const QUrl& requestUrl,
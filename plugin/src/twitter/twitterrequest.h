@@ -17,6 +17,8 @@
 
 #include "twitterconstants.h"
 
+class MultipartDevice;
+
 class TwitterRequest : public QObject
 {
     Q_OBJECT
@@ -39,8 +41,28 @@ public:
                                                   int count,
                                                   const QString &timeline = USER_TIMELINE_URL);
     QNetworkRequest createPostMessageRequest(const QString &text,
-                                             const QUrl &fileUrl,
-                                             QByteArray *retContent);
+                                             QByteArray *retContent,
+                                             const QString &mediaIds = QString());
+    QNetworkRequest createPostMediaRequest(const QString &text,
+                                           const QUrl &fileUrl,
+                                           MultipartDevice *content);
+
+    // Chunked media upload. The segment content is read from the file while
+    // the request is sent; an invalid request is returned if the file cannot
+    // be read.
+    QNetworkRequest createMediaInitRequest(qint64 totalBytes,
+                                           const QString &mediaType,
+                                           const QString &mediaCategory,
+                                           QByteArray *retContent);
+    QNetworkRequest createMediaAppendRequest(const QString &mediaId,
+                                             int segmentIndex,
+                                             const QString &fileName,
+                                             qint64 offset,
+                                             qint64 length,
+                                             MultipartDevice *content);
+    QNetworkRequest createMediaFinalizeRequest(const QString &mediaId,
+                                               QByteArray *retContent);
+    QNetworkRequest createMediaStatusRequest(const QString &mediaId);
 
     // Twitter specific API
     QNetworkRequest createSendDirectMessageRequest(const QString &to, const QString &message, QByteArray *retContent);
@@ -49,8 +71,9 @@ public:
 private: // Members
     QNetworkRequest createRequest(const QUrl& requestUrl, const QString httpMethod,
                                   QVariantMap params = QVariantMap());
+    QNetworkRequest createFormRequest(const QUrl &requestUrl, const QVariantMap &params,
+                                      QByteArray *retContent);
 
-    QByteArray handleFile(const QString &filePath);
     QString generateAuthHeader(const QMap<QString, QString> &requestHeaders);
     QString createSignatureBaseString(QString url,
                                       QMap<QString, QString> requestTokens,
@@ -1,3 +1,3 @@
 TEMPLATE = subdirs
-SUBDIRS += plugin
+SUBDIRS += plugin tests
 OTHER_FILES = README
@@ -0,0 +1,4 @@
+# Copyright (c) 2012-2014 Microsoft Mobile.
+
+TEMPLATE = subdirs
+SUBDIRS += facebook facebookvideoupload jsonreader transportreply
@@ -0,0 +1,21 @@
+# Copyright (c) 2012-2014 Microsoft Mobile.
+
+TEMPLATE = app
+TARGET = tst_facebook
+QT += network testlib
+CONFIG += testcase
+
+include(../transport.pri)
+
+INCLUDEPATH += $$PLUGIN_SRC/facebook
+
+HEADERS += \
+    $$PLUGIN_SRC/facebook/facebook.h \
+    $$PLUGIN_SRC/facebook/facebookreply.h \
+    $$PLUGIN_SRC/facebook/facebookrequest.h
+
+SOURCES += \
+    $$PLUGIN_SRC/facebook/facebook.cpp \
+    $$PLUGIN_SRC/facebook/facebookreply.cpp \
+    $$PLUGIN_SRC/facebook/facebookrequest.cpp \
+    tst_facebook.cpp
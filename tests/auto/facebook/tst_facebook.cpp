@@ -0,0 +1,677 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QRegExp>
+#include <QtCore/QSet>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QTime>
+#include <QtCore/QUrl>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <QtTest/QSignalSpy>
+#include <QtTest/QtTest>
+#include "facebook.h"
+#include "jsonreader.h"
+#include "networktransport.h"
+
+// Constants
+namespace {
+    // Enough requests to keep every connection to the host busy and the
+    // rest queued in the transport.
+    const int StressRequestCount = 400;
+
+    // Every this many requests of the stress test is answered with an error.
+    const int StressFailureInterval = 10;
+
+    // Sent one after another, alternating between two connections.
+    const int SequentialRequestCount = 20;
+
+    // The Graph API accepts at most this many operations in one batch.
+    const int MaxBatchSize = 50;
+
+    // The size of the photo posted by the upload test, and how much the
+    // memory of the test may grow while it is sent.
+    const qint64 UploadSize = 64 * 1024 * 1024;
+    const qint64 MaxUploadGrowth = 16 * 1024 * 1024;
+
+    // Bodies larger than this are counted and dropped by the server as they
+    // arrive instead of being buffered.
+    const int MaxBufferedBody = 1024 * 1024;
+
+    // The longest time in milliseconds a test waits for a signal.
+    const int WaitTimeout = 20000;
+}
+
+
+/*
+  A stand-in for the Graph API. A request for a path starting with
+  "/missing" is answered with an OAuth error and 400 Bad Request, one for a
+  path starting with "/limited" with the application rate limit error the
+  first time, and any other with the path as the id of the object. A POST
+  to the root is a batch request, whose operations are answered in the same
+  way. The body of an upload is not kept, so that it does not add to the
+  memory of the test.
+*/
+class GraphServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+
+    explicit GraphServer(QObject *parent = 0);
+
+public:
+
+    int requestCount() const;
+    int connectionCount() const;
+    QList<int> batchSizes() const;
+    qint64 uploadedBytes() const;
+
+private slots:
+
+    void onNewConnection();
+    void onReadyRead();
+
+private:
+
+    void handleRequest(QTcpSocket *socket, const QString &path, const QByteArray &body);
+    QByteArray handleBatch(const QByteArray &body);
+    int respond(const QString &path, QByteArray *response);
+    static void writeResponse(QTcpSocket *socket, int status, const QByteArray &response);
+
+private: // Data
+
+    QHash<QTcpSocket *, QByteArray> m_buffers;
+    int m_requestCount;
+    int m_connectionCount;
+    QList<int> m_batchSizes; // The operations of each batch request.
+    QSet<QString> m_limited; // The paths answered with the rate limit.
+    QHash<QTcpSocket *, qint64> m_uploads; // The body left of each upload.
+    QHash<QTcpSocket *, QString> m_uploadPaths;
+    qint64 m_uploadedBytes;
+};
+
+GraphServer::GraphServer(QObject *parent)
+    : QTcpServer(parent),
+      m_requestCount(0),
+      m_connectionCount(0),
+      m_uploadedBytes(0)
+{
+    connect(this, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+}
+
+int GraphServer::requestCount() const
+{
+    return m_requestCount;
+}
+
+int GraphServer::connectionCount() const
+{
+    return m_connectionCount;
+}
+
+QList<int> GraphServer::batchSizes() const
+{
+    return m_batchSizes;
+}
+
+qint64 GraphServer::uploadedBytes() const
+{
+    return m_uploadedBytes;
+}
+
+void GraphServer::onNewConnection()
+{
+    while (hasPendingConnections()) {
+        QTcpSocket *socket = nextPendingConnection();
+        m_connectionCount++;
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void GraphServer::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    QByteArray &buffer = m_buffers[socket];
+    buffer.append(socket->readAll());
+
+    // The connection is kept alive, so it may carry several requests.
+    forever {
+        if (m_uploads.contains(socket)) {
+            qint64 &remaining = m_uploads[socket];
+            const int dropped = int(qMin<qint64>(remaining, buffer.size()));
+            buffer.remove(0, dropped);
+            m_uploadedBytes += dropped;
+            remaining -= dropped;
+
+            if (remaining > 0) {
+                return;
+            }
+
+            m_uploads.remove(socket);
+            handleRequest(socket, m_uploadPaths.take(socket), QByteArray());
+            continue;
+        }
+
+        const int headerEnd = buffer.indexOf("\r\n\r\n");
+
+        if (headerEnd < 0) {
+            return;
+        }
+
+        const QString header = QString::fromLatin1(buffer.left(headerEnd));
+        QRegExp contentLength("content-length:\\s*(\\d+)", Qt::CaseInsensitive);
+        const int length = contentLength.indexIn(header) >= 0
+                ? contentLength.cap(1).toInt() : 0;
+
+        // The request line is "<method> <path>?<query> HTTP/1.1".
+        const QString path = header.section(QLatin1Char(' '), 1, 1)
+                .section(QLatin1Char('?'), 0, 0);
+
+        if (length > MaxBufferedBody) {
+            buffer.remove(0, headerEnd + 4);
+            m_uploads.insert(socket, length);
+            m_uploadPaths.insert(socket, path);
+            continue;
+        }
+
+        if (buffer.size() < headerEnd + 4 + length) {
+            return;
+        }
+
+        const QByteArray body = buffer.mid(headerEnd + 4, length);
+        buffer.remove(0, headerEnd + 4 + length);
+        handleRequest(socket, path, body);
+    }
+}
+
+void GraphServer::handleRequest(QTcpSocket *socket, const QString &path, const QByteArray &body)
+{
+    m_requestCount++;
+
+    if (path == "/") {
+        writeResponse(socket, 200, handleBatch(body));
+        return;
+    }
+
+    QByteArray response;
+    const int status = respond(path.mid(1), &response);
+    writeResponse(socket, status, response);
+}
+
+/*
+  Returns the response to the batch request with the form \a body: the
+  code and body of each operation, in the order of the operations.
+*/
+QByteArray GraphServer::handleBatch(const QByteArray &body)
+{
+    QUrl form;
+    form.setEncodedQuery(body);
+    JsonReader reader(QByteArray::fromPercentEncoding(form.encodedQueryItemValue("batch")));
+    QByteArray responses("[");
+    int count = 0;
+
+    if (reader.readNext() == JsonReader::BeginArray) {
+        while (reader.readNext() == JsonReader::BeginObject) {
+            const QVariantMap operation = reader.readCurrent().toMap();
+            const QString path = operation.value("relative_url").toString()
+                    .section(QLatin1Char('?'), 0, 0);
+            QByteArray response;
+            const int status = respond(path.startsWith("/") ? path.mid(1) : path, &response);
+
+            response.replace("\\", "\\\\");
+            response.replace("\"", "\\\"");
+
+            if (count++ > 0) {
+                responses.append(',');
+            }
+
+            responses.append(QString("{\"code\":%1,\"body\":\"").arg(status).toAscii());
+            responses.append(response);
+            responses.append("\"}");
+        }
+    }
+
+    m_batchSizes.append(count);
+
+    return responses + "]";
+}
+
+/*
+  Writes the response to a request for the object \a name to \a response
+  and returns its HTTP status.
+*/
+int GraphServer::respond(const QString &name, QByteArray *response)
+{
+    if (name.startsWith("missing")) {
+        *response = "{\"error\":{\"message\":\"Unsupported get request.\","
+                    "\"type\":\"GraphMethodException\",\"code\":100}}";
+        return 400;
+    }
+
+    if (name.startsWith("limited") && !m_limited.contains(name)) {
+        m_limited.insert(name);
+        *response = "{\"error\":{\"message\":\"Application request limit reached\","
+                    "\"type\":\"OAuthException\",\"code\":4}}";
+        return 400;
+    }
+
+    *response = QString("{\"id\":\"%1\"}").arg(name).toUtf8();
+    return 200;
+}
+
+void GraphServer::writeResponse(QTcpSocket *socket, int status, const QByteArray &response)
+{
+    socket->write(QString("HTTP/1.1 %1 %2\r\n").arg(status)
+                  .arg(status == 200 ? "OK" : "Bad Request").toAscii());
+    socket->write("Content-Type: application/json\r\n");
+    socket->write(QString("Content-Length: %1\r\n\r\n").arg(response.size()).toAscii());
+    socket->write(response);
+}
+
+
+class tst_Facebook : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void init();
+    void cleanup();
+
+    void everyRequestCompletesOnce();
+    void connectionsShareSockets();
+    void batchIsSentAsOnePost();
+    void batchIsSplitAtMaxBatchSize();
+    void batchFailureReachesOnlyItsCaller();
+    void batchRetriesRateLimitedOperation();
+    void uploadKeepsMemoryBounded();
+
+private:
+
+    static bool waitFor(QSignalSpy &spy, int count = 1);
+    bool waitForOutcomes(int count) const;
+    QHash<int, int> outcomeCounts() const;
+    void sendBatch(const QStringList &paths);
+    void verifyCompleted(int requestId, const QString &name) const;
+    static qint64 residentSize();
+
+private: // Data
+
+    GraphServer *m_server;
+    Facebook *m_facebook;
+    QSignalSpy *m_completed;
+    QSignalSpy *m_failed;
+    double m_requestRate;
+};
+
+void tst_Facebook::init()
+{
+    m_server = new GraphServer(this);
+    QVERIFY(m_server->listen(QHostAddress::LocalHost));
+
+    // The requests are not spread out over time, so that a few hundred of
+    // them complete within the wait of a test.
+    m_requestRate = NetworkTransport::instance()->requestRate();
+    NetworkTransport::instance()->setRequestRate(0);
+
+    m_facebook = new Facebook(this);
+    m_facebook->setGraphUrl(QString("http://127.0.0.1:%1/").arg(m_server->serverPort()));
+    m_facebook->setAccessToken("token");
+
+    m_completed = new QSignalSpy(m_facebook, SIGNAL(requestCompleted(QVariant,QByteArray)));
+    m_failed = new QSignalSpy(m_facebook, SIGNAL(requestFailed(QVariant,QString)));
+}
+
+void tst_Facebook::cleanup()
+{
+    NetworkTransport::instance()->setRequestRate(m_requestRate);
+    delete m_completed;
+    delete m_failed;
+    delete m_facebook;
+    delete m_server;
+}
+
+/*
+  Several hundred requests sent at once each complete or fail exactly once,
+  with the response of their own path, and the book-keeping of the pending
+  replies is empty afterwards.
+*/
+void tst_Facebook::everyRequestCompletesOnce()
+{
+    for (int i = 0; i < StressRequestCount; i++) {
+        const QString path = (i % StressFailureInterval == 0)
+                ? QString("missing%1").arg(i) : QString("object%1").arg(i);
+        QVERIFY(m_facebook->request(i, path, FacebookConnection::HTTPGet, QVariantMap(),
+                                    QNetworkRequest::AlwaysNetwork));
+    }
+
+    QVERIFY(waitForOutcomes(StressRequestCount));
+
+    // Late duplicates would arrive within the next turns of the event loop.
+    QTest::qWait(200);
+
+    const QHash<int, int> counts = outcomeCounts();
+    QCOMPARE(counts.count(), StressRequestCount);
+
+    foreach (int count, counts) {
+        QCOMPARE(count, 1);
+    }
+
+    QCOMPARE(m_failed->count(), StressRequestCount / StressFailureInterval);
+    QCOMPARE(m_server->requestCount(), StressRequestCount);
+
+    for (int i = 0; i < m_completed->count(); i++) {
+        const QList<QVariant> arguments = m_completed->at(i);
+        QCOMPARE(QString::fromUtf8(arguments.at(1).toByteArray()),
+                 QString("{\"id\":\"object%1\"}").arg(arguments.at(0).toInt()));
+    }
+
+    for (int i = 0; i < m_failed->count(); i++) {
+        QCOMPARE(m_failed->at(i).at(0).toInt() % StressFailureInterval, 0);
+    }
+
+    QVERIFY(m_facebook->m_pendingReplies.isEmpty());
+    QVERIFY(m_facebook->m_activeRequests.isEmpty());
+    QVERIFY(m_facebook->m_batchReplies.isEmpty());
+}
+
+/*
+  Requests sent one after another by two connections reuse a single socket
+  of the shared transport, and the transport estimates as many handshakes
+  as the server has accepted connections.
+*/
+void tst_Facebook::connectionsShareSockets()
+{
+    Facebook other;
+    other.setGraphUrl(m_facebook->graphUrl());
+    other.setAccessToken("other token");
+    QSignalSpy otherCompleted(&other, SIGNAL(requestCompleted(QVariant,QByteArray)));
+
+    for (int i = 0; i < SequentialRequestCount; i++) {
+        const bool first = (i % 2 == 0);
+        Facebook *facebook = first ? m_facebook : &other;
+        QSignalSpy &completed = first ? *m_completed : otherCompleted;
+        const int count = completed.count();
+
+        QVERIFY(facebook->request(i, QString("object%1").arg(i), FacebookConnection::HTTPGet,
+                                  QVariantMap(), QNetworkRequest::AlwaysNetwork));
+        QVERIFY(waitFor(completed, count + 1));
+    }
+
+    QCOMPARE(m_failed->count(), 0);
+    QCOMPARE(m_server->requestCount(), SequentialRequestCount);
+    QCOMPARE(m_server->connectionCount(), 1);
+
+    const QVariantMap hosts = NetworkTransport::instance()->statistics().value("hosts").toMap();
+    const QVariantMap host = hosts.value(QString("http://127.0.0.1:%1")
+                                         .arg(m_server->serverPort())).toMap();
+    QCOMPARE(host.value("requests").toInt(), SequentialRequestCount);
+    QCOMPARE(host.value("handshakes").toInt(), m_server->connectionCount());
+}
+
+/*
+  The requests made between beginBatch() and endBatch() are sent as the
+  operations of a single POST, and each response reaches the caller of its
+  own operation.
+*/
+void tst_Facebook::batchIsSentAsOnePost()
+{
+    QStringList paths;
+
+    for (int i = 0; i < 10; i++) {
+        paths << QString("object%1").arg(i);
+    }
+
+    sendBatch(paths);
+
+    QCOMPARE(m_server->requestCount(), 1);
+    QCOMPARE(m_server->batchSizes(), QList<int>() << paths.count());
+    QCOMPARE(m_failed->count(), 0);
+
+    for (int i = 0; i < paths.count(); i++) {
+        verifyCompleted(i, paths.at(i));
+    }
+
+    QVERIFY(m_facebook->m_batchReplies.isEmpty());
+}
+
+/*
+  A batch of more requests than the Graph API accepts at once is split into
+  batches of MaxBatchSize operations.
+*/
+void tst_Facebook::batchIsSplitAtMaxBatchSize()
+{
+    const int count = 2 * MaxBatchSize + 20;
+    QStringList paths;
+
+    for (int i = 0; i < count; i++) {
+        paths << QString("object%1").arg(i);
+    }
+
+    sendBatch(paths);
+
+    // The batches may arrive in any order on the connections to the host.
+    QList<int> sizes = m_server->batchSizes();
+    qSort(sizes);
+    QCOMPARE(sizes, QList<int>() << count - 2 * MaxBatchSize << MaxBatchSize << MaxBatchSize);
+    QCOMPARE(m_completed->count(), count);
+
+    for (int i = 0; i < count; i++) {
+        verifyCompleted(i, paths.at(i));
+    }
+}
+
+/*
+  An operation failing within a successful batch fails its own request
+  only, with the error message of its response.
+*/
+void tst_Facebook::batchFailureReachesOnlyItsCaller()
+{
+    sendBatch(QStringList() << "object0" << "object1" << "missing2" << "object3");
+
+    QCOMPARE(m_server->requestCount(), 1);
+    QCOMPARE(m_failed->count(), 1);
+    QCOMPARE(m_failed->at(0).at(0).toInt(), 2);
+    QCOMPARE(m_failed->at(0).at(1).toString(), QString("Unsupported get request."));
+    QCOMPARE(m_completed->count(), 3);
+
+    verifyCompleted(0, "object0");
+    verifyCompleted(1, "object1");
+    verifyCompleted(3, "object3");
+}
+
+/*
+  An operation rate limited within a successful batch is sent again on its
+  own, and completes.
+*/
+void tst_Facebook::batchRetriesRateLimitedOperation()
+{
+    sendBatch(QStringList() << "object0" << "limited1" << "object2");
+
+    QCOMPARE(m_failed->count(), 0);
+    QCOMPARE(m_completed->count(), 3);
+    QCOMPARE(m_server->batchSizes(), QList<int>() << 3);
+    QCOMPARE(m_server->requestCount(), 2);
+
+    verifyCompleted(0, "object0");
+    verifyCompleted(1, "limited1");
+    verifyCompleted(2, "object2");
+}
+
+/*
+  A large photo is posted through MultipartDevice, which reads the file as
+  the request is sent: the memory of the test grows by a fraction of the
+  size of the file.
+*/
+void tst_Facebook::uploadKeepsMemoryBounded()
+{
+    if (residentSize() < 0) {
+        QSKIP("The resident size of the process is not known on this platform.", SkipAll);
+    }
+
+    QTemporaryFile photo(QDir::temp().filePath("tst_facebook-XXXXXX.jpg"));
+    QVERIFY(photo.open());
+    const QByteArray chunk(1024 * 1024, 'p');
+
+    for (qint64 written = 0; written < UploadSize; written += chunk.size()) {
+        QCOMPARE(photo.write(chunk), qint64(chunk.size()));
+    }
+
+    photo.close();
+
+    QVariantMap parameters;
+    parameters.insert("message", "Upload");
+    parameters.insert("picture", QUrl::fromLocalFile(photo.fileName()).toString());
+
+    const qint64 baseline = residentSize();
+    qint64 peak = baseline;
+
+    QVERIFY(m_facebook->request(1, "me/photos", FacebookConnection::HTTPPost, parameters));
+
+    QTime time;
+    time.start();
+
+    while (m_completed->count() + m_failed->count() == 0 && time.elapsed() < WaitTimeout) {
+        QTest::qWait(10);
+        peak = qMax(peak, residentSize());
+    }
+
+    QCOMPARE(m_failed->count(), 0);
+    verifyCompleted(1, "me/photos");
+    QVERIFY(m_server->uploadedBytes() > UploadSize);
+
+    qDebug() << "Uploaded:" << m_server->uploadedBytes() << "bytes, memory grew by"
+             << peak - baseline << "bytes";
+    QVERIFY(peak - baseline < MaxUploadGrowth);
+}
+
+bool tst_Facebook::waitFor(QSignalSpy &spy, int count)
+{
+    QTime time;
+    time.start();
+
+    while (spy.count() < count && time.elapsed() < WaitTimeout) {
+        QTest::qWait(50);
+    }
+
+    return spy.count() >= count;
+}
+
+bool tst_Facebook::waitForOutcomes(int count) const
+{
+    QTime time;
+    time.start();
+
+    while (m_completed->count() + m_failed->count() < count && time.elapsed() < WaitTimeout) {
+        QTest::qWait(50);
+    }
+
+    return m_completed->count() + m_failed->count() >= count;
+}
+
+/*
+  Returns the number of times each request id has completed or failed.
+*/
+QHash<int, int> tst_Facebook::outcomeCounts() const
+{
+    QHash<int, int> counts;
+
+    for (int i = 0; i < m_completed->count(); i++) {
+        counts[m_completed->at(i).at(0).toInt()]++;
+    }
+
+    for (int i = 0; i < m_failed->count(); i++) {
+        counts[m_failed->at(i).at(0).toInt()]++;
+    }
+
+    return counts;
+}
+
+/*
+  Makes a request for each of \a paths within a batch, the index as its
+  request id, and waits for all of them to complete or fail.
+*/
+void tst_Facebook::sendBatch(const QStringList &paths)
+{
+    m_facebook->beginBatch();
+
+    for (int i = 0; i < paths.count(); i++) {
+        QVERIFY(m_facebook->request(i, paths.at(i), FacebookConnection::HTTPGet, QVariantMap()));
+    }
+
+    // Nothing is sent before the batch ends, unless it is full.
+    if (paths.count() < MaxBatchSize) {
+        QTest::qWait(100);
+        QCOMPARE(m_server->requestCount(), 0);
+    }
+
+    m_facebook->endBatch();
+
+    QVERIFY(waitForOutcomes(paths.count()));
+    QCOMPARE(outcomeCounts().count(), paths.count());
+}
+
+/*
+  Verifies that the request \a requestId has completed once, with the
+  response for the object \a name.
+*/
+void tst_Facebook::verifyCompleted(int requestId, const QString &name) const
+{
+    int count = 0;
+
+    for (int i = 0; i < m_completed->count(); i++) {
+        const QList<QVariant> arguments = m_completed->at(i);
+
+        if (arguments.at(0).toInt() == requestId) {
+            QCOMPARE(QString::fromUtf8(arguments.at(1).toByteArray()),
+                     QString("{\"id\":\"%1\"}").arg(name));
+            count++;
+        }
+    }
+
+    QCOMPARE(count, 1);
+}
+
+/*
+  Returns the resident set size of the process in bytes, or -1 if it
+  cannot be read.
+*/
+qint64 tst_Facebook::residentSize()
+{
+#ifdef Q_OS_LINUX
+    QFile status("/proc/self/status");
+
+    if (status.open(QIODevice::ReadOnly)) {
+        // The file reports no size, so it is read a line at a time.
+        QByteArray line = status.readLine();
+
+        while (!line.isEmpty()) {
+            // For example "VmRSS:	    5120 kB".
+            if (line.startsWith("VmRSS:")) {
+                return line.mid(6).trimmed().split(' ').first().toLongLong() * 1024;
+            }
+
+            line = status.readLine();
+        }
+    }
+#endif
+
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    // The requests need no display, only an event loop.
+    QCoreApplication app(argc, argv);
+    tst_Facebook test;
+
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_facebook.moc"
@@ -0,0 +1,17 @@
+# Copyright (c) 2012-2014 Microsoft Mobile.
+
+TEMPLATE = app
+TARGET = tst_facebookvideoupload
+QT += network testlib
+CONFIG += testcase
+
+include(../transport.pri)
+
+INCLUDEPATH += $$PLUGIN_SRC/facebook
+
+HEADERS += \
+    $$PLUGIN_SRC/facebook/facebookvideoupload.h
+
+SOURCES += \
+    $$PLUGIN_SRC/facebook/facebookvideoupload.cpp \
+    tst_facebookvideoupload.cpp
@@ -0,0 +1,335 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QHash>
+#include <QtCore/QRegExp>
+#include <QtCore/QSettings>
+#include <QtCore/QStringList>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QTime>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <QtTest/QSignalSpy>
+#include <QtTest/QtTest>
+#include "facebookvideoupload.h"
+
+// Constants
+namespace {
+    // The size of the uploaded file; it is sent in a single chunk.
+    const qint64 FileSize = 100 * 1024;
+
+    // The longest time in milliseconds a test waits for a signal.
+    const int WaitTimeout = 20000;
+
+    const char *SessionGroup = "facebook_video_uploads";
+}
+
+
+/*
+  A stand-in for the Graph API video endpoint. Each phase of the upload is
+  answered as the server would, unless the test has asked the request to
+  fail with an HTTP status or not to be answered at all.
+*/
+class StandInServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+
+    explicit StandInServer(QObject *parent = 0);
+
+public:
+
+    QStringList phases() const;
+    void failRequest(int index, int status);
+    void holdRequest(int index);
+
+signals:
+
+    void requestReceived(int index, const QString &phase);
+
+private slots:
+
+    void onNewConnection();
+    void onReadyRead();
+
+private:
+
+    void handleRequest(QTcpSocket *socket, const QByteArray &body);
+    static QString formField(const QByteArray &body, const QString &name);
+
+private: // Data
+
+    QHash<QTcpSocket *, QByteArray> m_buffers;
+    QStringList m_phases; // The upload_phase of each request received.
+    QHash<int, int> m_failures;
+    QList<int> m_held;
+};
+
+StandInServer::StandInServer(QObject *parent)
+    : QTcpServer(parent)
+{
+    connect(this, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+}
+
+QStringList StandInServer::phases() const
+{
+    return m_phases;
+}
+
+void StandInServer::failRequest(int index, int status)
+{
+    m_failures.insert(index, status);
+}
+
+void StandInServer::holdRequest(int index)
+{
+    m_held.append(index);
+}
+
+void StandInServer::onNewConnection()
+{
+    while (hasPendingConnections()) {
+        QTcpSocket *socket = nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void StandInServer::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    QByteArray &buffer = m_buffers[socket];
+    buffer.append(socket->readAll());
+
+    // The connection is kept alive, so it may carry several requests.
+    forever {
+        const int headerEnd = buffer.indexOf("\r\n\r\n");
+
+        if (headerEnd < 0) {
+            return;
+        }
+
+        QRegExp contentLength("content-length:\\s*(\\d+)", Qt::CaseInsensitive);
+        const int length = contentLength.indexIn(QString::fromLatin1(buffer.left(headerEnd))) >= 0
+                ? contentLength.cap(1).toInt() : 0;
+
+        if (buffer.size() < headerEnd + 4 + length) {
+            return;
+        }
+
+        const QByteArray body = buffer.mid(headerEnd + 4, length);
+        buffer.remove(0, headerEnd + 4 + length);
+        handleRequest(socket, body);
+    }
+}
+
+void StandInServer::handleRequest(QTcpSocket *socket, const QByteArray &body)
+{
+    const int index = m_phases.count();
+    const QString phase = formField(body, "upload_phase");
+    m_phases.append(phase);
+    emit requestReceived(index, phase);
+
+    if (m_held.contains(index)) {
+        return;
+    }
+
+    const int status = m_failures.value(index, 200);
+    QByteArray response;
+    QByteArray reason = "OK";
+
+    if (status != 200) {
+        response = "{\"error\":{\"message\":\"Injected failure\"}}";
+        reason = "Injected failure";
+    }
+    else if (phase == "start") {
+        response = QString("{\"upload_session_id\":\"1\",\"video_id\":\"2\","
+                           "\"start_offset\":\"0\",\"end_offset\":\"%1\"}")
+                .arg(FileSize).toAscii();
+    }
+    else if (phase == "transfer") {
+        response = QString("{\"start_offset\":\"%1\",\"end_offset\":\"%1\"}")
+                .arg(FileSize).toAscii();
+    }
+    else {
+        response = "{\"success\":true}";
+    }
+
+    socket->write(QString("HTTP/1.1 %1 ").arg(status).toAscii() + reason + "\r\n");
+    socket->write("Content-Type: application/json\r\n");
+    socket->write(QString("Content-Length: %1\r\n\r\n").arg(response.size()).toAscii());
+    socket->write(response);
+}
+
+QString StandInServer::formField(const QByteArray &body, const QString &name)
+{
+    const QByteArray header = QString("name=\"%1\"\r\n\r\n").arg(name).toAscii();
+    const int start = body.indexOf(header);
+
+    if (start < 0) {
+        return QString();
+    }
+
+    const int valueStart = start + header.size();
+    return QString::fromUtf8(body.mid(valueStart, body.indexOf("\r\n", valueStart) - valueStart));
+}
+
+
+class tst_FacebookVideoUpload : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void retriesFailedChunkOnce();
+    void restartsRejectedStoredSession();
+    void failsRejectedNewSession();
+
+private:
+
+    static bool waitFor(QSignalSpy &spy, int count = 1);
+    static void clearSessions();
+
+private: // Data
+
+    QTemporaryFile m_file;
+    StandInServer *m_server;
+    FacebookVideoUpload *m_upload;
+};
+
+void tst_FacebookVideoUpload::initTestCase()
+{
+    // The sessions are stored in the settings of the test.
+    QCoreApplication::setOrganizationName("socialconnect-tests");
+    QCoreApplication::setApplicationName("tst_facebookvideoupload");
+
+    QVERIFY(m_file.open());
+    QCOMPARE(m_file.write(QByteArray(FileSize, 'v')), FileSize);
+    m_file.flush();
+}
+
+void tst_FacebookVideoUpload::init()
+{
+    clearSessions();
+
+    m_server = new StandInServer(this);
+    QVERIFY(m_server->listen(QHostAddress::LocalHost));
+
+    m_upload = new FacebookVideoUpload(this);
+    m_upload->setGraphVideoUrl(QString("http://127.0.0.1:%1/me/videos")
+                               .arg(m_server->serverPort()));
+}
+
+void tst_FacebookVideoUpload::cleanup()
+{
+    delete m_upload;
+    delete m_server;
+    clearSessions();
+}
+
+/*
+  A chunk failing with 503 Service Unavailable is sent again by the upload
+  only: every request that reaches the server has been started by the
+  upload, none by the transport retrying it.
+*/
+void tst_FacebookVideoUpload::retriesFailedChunkOnce()
+{
+    QSignalSpy started(m_upload, SIGNAL(requestStarted(QNetworkReply*)));
+    QSignalSpy finished(m_upload, SIGNAL(finished(bool,QString,QString)));
+    m_server->failRequest(1, 503);
+
+    QVERIFY(m_upload->start("token", m_file.fileName(), QVariantMap()));
+    QVERIFY(waitFor(finished));
+
+    QCOMPARE(finished.at(0).at(0).toBool(), true);
+    QCOMPARE(finished.at(0).at(1).toString(), QString("2"));
+    QCOMPARE(m_server->phases(),
+             QStringList() << "start" << "transfer" << "transfer" << "finish");
+    QCOMPARE(started.count(), m_server->phases().count());
+}
+
+/*
+  A stored session that the server rejects with 400 Bad Request is replaced
+  with a new session, and the upload completes.
+*/
+void tst_FacebookVideoUpload::restartsRejectedStoredSession()
+{
+    QSignalSpy received(m_server, SIGNAL(requestReceived(int,QString)));
+    QSignalSpy finished(m_upload, SIGNAL(finished(bool,QString,QString)));
+
+    // The first attempt is canceled while its chunk is in flight, which
+    // keeps the session.
+    m_server->holdRequest(1);
+    QVERIFY(m_upload->start("token", m_file.fileName(), QVariantMap()));
+    QVERIFY(waitFor(received, 2));
+    m_upload->cancel();
+    QCOMPARE(finished.count(), 1);
+    QCOMPARE(finished.at(0).at(0).toBool(), false);
+
+    // The resumed chunk is rejected, as with an expired session.
+    m_server->failRequest(2, 400);
+    QVERIFY(m_upload->start("token", m_file.fileName(), QVariantMap()));
+    QVERIFY(waitFor(finished, 2));
+
+    QCOMPARE(finished.at(1).at(0).toBool(), true);
+    QCOMPARE(m_server->phases(),
+             QStringList() << "start" << "transfer"
+                           << "transfer" << "start" << "transfer" << "finish");
+}
+
+/*
+  A session opened by the upload itself is not restarted when the server
+  rejects it; the upload fails and forgets the session.
+*/
+void tst_FacebookVideoUpload::failsRejectedNewSession()
+{
+    QSignalSpy finished(m_upload, SIGNAL(finished(bool,QString,QString)));
+    m_server->failRequest(1, 400);
+
+    QVERIFY(m_upload->start("token", m_file.fileName(), QVariantMap()));
+    QVERIFY(waitFor(finished));
+
+    QCOMPARE(finished.at(0).at(0).toBool(), false);
+    QCOMPARE(finished.at(0).at(2).toString(), QString("Injected failure"));
+    QCOMPARE(m_server->phases(), QStringList() << "start" << "transfer");
+
+    QSettings settings;
+    settings.beginGroup(SessionGroup);
+    QVERIFY(settings.childKeys().isEmpty());
+}
+
+bool tst_FacebookVideoUpload::waitFor(QSignalSpy &spy, int count)
+{
+    QTime time;
+    time.start();
+
+    while (spy.count() < count && time.elapsed() < WaitTimeout) {
+        QTest::qWait(50);
+    }
+
+    return spy.count() >= count;
+}
+
+void tst_FacebookVideoUpload::clearSessions()
+{
+    QSettings settings;
+    settings.remove(SessionGroup);
+}
+
+int main(int argc, char *argv[])
+{
+    // The upload needs no display, only an event loop.
+    QCoreApplication app(argc, argv);
+    tst_FacebookVideoUpload test;
+
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_facebookvideoupload.moc"
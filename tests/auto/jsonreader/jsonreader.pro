@@ -0,0 +1,17 @@
+# Copyright (c) 2012-2014 Microsoft Mobile.
+
+TEMPLATE = app
+TARGET = tst_jsonreader
+QT -= gui
+QT += testlib
+CONFIG += testcase
+
+PLUGIN_SRC = $$PWD/../../../plugin/src
+INCLUDEPATH += $$PLUGIN_SRC
+
+HEADERS += \
+    $$PLUGIN_SRC/jsonreader.h
+
+SOURCES += \
+    $$PLUGIN_SRC/jsonreader.cpp \
+    tst_jsonreader.cpp
@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include <QtCore/QCoreApplication>
+#include <QtTest/QtTest>
+#include "jsonreader.h"
+
+/*
+  Checks that JsonReader rejects malformed numbers and documents nested
+  beyond its depth limit, both when reading and when skipping values.
+*/
+class tst_JsonReader : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void number_data();
+    void number();
+
+    void readCurrentDepth_data();
+    void readCurrentDepth();
+
+    void skipCurrentDepth_data();
+    void skipCurrentDepth();
+
+private:
+
+    static QByteArray nested(int depth);
+};
+
+void tst_JsonReader::number_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("zero") << QByteArray("[0]") << true;
+    QTest::newRow("negative") << QByteArray("[-12]") << true;
+    QTest::newRow("fraction") << QByteArray("[0.5]") << true;
+    QTest::newRow("exponent") << QByteArray("[1.5e-3]") << true;
+    QTest::newRow("64-bit id") << QByteArray("[100001234567890123]") << true;
+    QTest::newRow("leading zero") << QByteArray("[012]") << false;
+    QTest::newRow("leading plus") << QByteArray("[+1]") << false;
+    QTest::newRow("lone minus") << QByteArray("[-]") << false;
+    QTest::newRow("empty fraction") << QByteArray("[1.]") << false;
+    QTest::newRow("leading point") << QByteArray("[.5]") << false;
+    QTest::newRow("empty exponent") << QByteArray("[1e]") << false;
+    QTest::newRow("two signs") << QByteArray("[1--2]") << false;
+    QTest::newRow("two points") << QByteArray("[1.2.3]") << false;
+}
+
+void tst_JsonReader::number()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(bool, valid);
+
+    JsonReader reader(data);
+    reader.readNext();
+    reader.readCurrent();
+
+    QCOMPARE(!reader.hasError(), valid);
+}
+
+void tst_JsonReader::readCurrentDepth_data()
+{
+    QTest::addColumn<int>("depth");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("at the limit") << 256 << true;
+    QTest::newRow("over the limit") << 257 << false;
+    QTest::newRow("far over the limit") << 100000 << false;
+}
+
+void tst_JsonReader::readCurrentDepth()
+{
+    QFETCH(int, depth);
+    QFETCH(bool, valid);
+
+    JsonReader reader(nested(depth));
+    reader.readNext();
+    reader.readCurrent();
+
+    QCOMPARE(!reader.hasError(), valid);
+}
+
+void tst_JsonReader::skipCurrentDepth_data()
+{
+    readCurrentDepth_data();
+}
+
+void tst_JsonReader::skipCurrentDepth()
+{
+    QFETCH(int, depth);
+    QFETCH(bool, valid);
+
+    // The outermost object is entered with readNext(), the rest is skipped.
+    JsonReader reader("{\"a\":" + nested(depth - 1) + "}");
+    QVERIFY(JsonReader::BeginObject == reader.readNext());
+    QVERIFY(JsonReader::Name == reader.readNext());
+
+    QCOMPARE(reader.skipCurrent(), valid);
+    QCOMPARE(!reader.hasError(), valid);
+}
+
+/*
+  Returns an array nested \a depth levels deep.
+*/
+QByteArray tst_JsonReader::nested(int depth)
+{
+    return QByteArray(depth, '[') + QByteArray(depth, ']');
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    tst_JsonReader test;
+
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_jsonreader.moc"
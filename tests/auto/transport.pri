@@ -0,0 +1,25 @@
+# Copyright (c) 2012-2014 Microsoft Mobile.
+#
+# The network transport of the plugin, built into the tests that send
+# requests through it.
+
+PLUGIN_SRC = $$PWD/../../plugin/src
+
+QT += network
+INCLUDEPATH += $$PLUGIN_SRC
+
+HEADERS += \
+    $$PLUGIN_SRC/jsonreader.h \
+    $$PLUGIN_SRC/jsonprojection.h \
+    $$PLUGIN_SRC/multipartdevice.h \
+    $$PLUGIN_SRC/networktransport.h \
+    $$PLUGIN_SRC/responsecache.h \
+    $$PLUGIN_SRC/transportreply.h
+
+SOURCES += \
+    $$PLUGIN_SRC/jsonreader.cpp \
+    $$PLUGIN_SRC/jsonprojection.cpp \
+    $$PLUGIN_SRC/multipartdevice.cpp \
+    $$PLUGIN_SRC/networktransport.cpp \
+    $$PLUGIN_SRC/responsecache.cpp \
+    $$PLUGIN_SRC/transportreply.cpp
@@ -0,0 +1,11 @@
+# Copyright (c) 2012-2014 Microsoft Mobile.
+
+TEMPLATE = app
+TARGET = tst_transportreply
+QT += network testlib
+CONFIG += testcase
+
+include(../transport.pri)
+
+SOURCES += \
+    tst_transportreply.cpp
@@ -0,0 +1,721 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QRegExp>
+#include <QtCore/QTime>
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <QtTest/QSignalSpy>
+#include <QtTest/QtTest>
+#include "networktransport.h"
+
+// Constants
+namespace {
+    const int Deadline = 500; // ms
+    const int Timeout = 300; // ms
+
+    // The error response of the Graph API to a request over the rate limit
+    // of the application, and to an invalid one.
+    const char *RateLimitedBody =
+            "{\"error\":{\"message\":\"(#4) Application request limit reached\","
+            "\"type\":\"OAuthException\",\"code\":4}}";
+    const char *InvalidBody =
+            "{\"error\":{\"message\":\"(#100) Invalid parameter\","
+            "\"type\":\"OAuthException\",\"code\":100}}";
+
+    // The slack allowed for timers firing late or early, in milliseconds.
+    const int Slack = 100;
+
+    // The longest time in milliseconds a test waits for a signal.
+    const int WaitTimeout = 20000;
+}
+
+
+/*
+  A server that accepts connections and reads the requests sent on them,
+  but never answers.
+*/
+class SilentServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+
+    explicit SilentServer(QObject *parent = 0);
+
+public:
+
+    int requestCount() const;
+
+private slots:
+
+    void onNewConnection();
+    void onReadyRead();
+
+private: // Data
+
+    QHash<QTcpSocket *, QByteArray> m_buffers;
+    int m_requestCount;
+};
+
+SilentServer::SilentServer(QObject *parent)
+    : QTcpServer(parent),
+      m_requestCount(0)
+{
+    connect(this, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+}
+
+int SilentServer::requestCount() const
+{
+    return m_requestCount;
+}
+
+void SilentServer::onNewConnection()
+{
+    while (hasPendingConnections()) {
+        QTcpSocket *socket = nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void SilentServer::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    QByteArray &buffer = m_buffers[socket];
+    buffer.append(socket->readAll());
+
+    // The requests have no body, so each ends with its header.
+    int headerEnd = buffer.indexOf("\r\n\r\n");
+
+    while (headerEnd >= 0) {
+        m_requestCount++;
+        buffer.remove(0, headerEnd + 4);
+        headerEnd = buffer.indexOf("\r\n\r\n");
+    }
+}
+
+
+/*
+  A server that answers the requests to each path with the responses
+  scripted for it, in order, and with 200 OK once they run out. The time
+  each request arrives and its body are recorded.
+*/
+class ScriptedServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+
+    explicit ScriptedServer(QObject *parent = 0);
+
+public:
+
+    void addResponse(const QString &path, int status,
+                     const QByteArray &headers = QByteArray(),
+                     const QByteArray &body = QByteArray());
+
+    int requestCount(const QString &path) const;
+    QList<qint64> arrivals(const QString &path) const; // ms since the epoch
+    QList<QByteArray> bodies(const QString &path) const;
+
+private slots:
+
+    void onNewConnection();
+    void onReadyRead();
+
+private:
+
+    // A scripted response; the headers end with "\r\n" each.
+    struct Response {
+        int status;
+        QByteArray headers;
+        QByteArray body;
+    };
+
+    void respond(QTcpSocket *socket, const QString &path);
+
+private: // Data
+
+    QHash<QTcpSocket *, QByteArray> m_buffers;
+    QHash<QString, QList<Response> > m_script;
+    QHash<QString, QList<qint64> > m_arrivals;
+    QHash<QString, QList<QByteArray> > m_bodies;
+};
+
+ScriptedServer::ScriptedServer(QObject *parent)
+    : QTcpServer(parent)
+{
+    connect(this, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+}
+
+void ScriptedServer::addResponse(const QString &path, int status,
+                                 const QByteArray &headers, const QByteArray &body)
+{
+    Response response;
+    response.status = status;
+    response.headers = headers;
+    response.body = body;
+    m_script[path].append(response);
+}
+
+int ScriptedServer::requestCount(const QString &path) const
+{
+    return m_arrivals.value(path).count();
+}
+
+QList<qint64> ScriptedServer::arrivals(const QString &path) const
+{
+    return m_arrivals.value(path);
+}
+
+QList<QByteArray> ScriptedServer::bodies(const QString &path) const
+{
+    return m_bodies.value(path);
+}
+
+void ScriptedServer::onNewConnection()
+{
+    while (hasPendingConnections()) {
+        QTcpSocket *socket = nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void ScriptedServer::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    QByteArray &buffer = m_buffers[socket];
+    buffer.append(socket->readAll());
+
+    // The connection is kept alive, so it may carry several requests.
+    forever {
+        const int headerEnd = buffer.indexOf("\r\n\r\n");
+
+        if (headerEnd < 0) {
+            return;
+        }
+
+        const QString header = QString::fromLatin1(buffer.left(headerEnd));
+        QRegExp contentLength("content-length:\\s*(\\d+)", Qt::CaseInsensitive);
+        const int length = contentLength.indexIn(header) >= 0
+                ? contentLength.cap(1).toInt() : 0;
+
+        if (buffer.size() < headerEnd + 4 + length) {
+            return;
+        }
+
+        // The request line is "<method> <path>?<query> HTTP/1.1".
+        const QString path = header.section(QLatin1Char(' '), 1, 1)
+                .section(QLatin1Char('?'), 0, 0);
+
+        m_arrivals[path].append(QDateTime::currentMSecsSinceEpoch());
+        m_bodies[path].append(buffer.mid(headerEnd + 4, length));
+        buffer.remove(0, headerEnd + 4 + length);
+        respond(socket, path);
+    }
+}
+
+void ScriptedServer::respond(QTcpSocket *socket, const QString &path)
+{
+    QList<Response> &script = m_script[path];
+    Response response;
+
+    if (script.isEmpty()) {
+        response.status = 200;
+        response.body = "{\"id\":\"1\"}";
+    }
+    else {
+        response = script.takeFirst();
+    }
+
+    socket->write("HTTP/1.1 " + QByteArray::number(response.status) + " Scripted\r\n"
+                  "Content-Type: application/json\r\n"
+                  "Content-Length: " + QByteArray::number(response.body.size()) + "\r\n" +
+                  response.headers + "\r\n" + response.body);
+}
+
+
+class tst_TransportReply : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void init();
+    void cleanup();
+
+    void deadlineAbortsSilentRequest();
+    void deadlineCountsQueuedTime();
+    void stalledRequestIsNotRetried();
+
+    void getRetriedOnServerError_data();
+    void getRetriedOnServerError();
+    void retriesStopAtMaxRetries();
+    void postNotRetriedOnServerError();
+    void postRetriedOnRateLimit_data();
+    void postRetriedOnRateLimit();
+    void retryAfterBlocksHost();
+    void rateLimitResetBlocksPath();
+    void rateLimitCodeIsRetried_data();
+    void rateLimitCodeIsRetried();
+    void requestRateSpreadsBurst();
+
+private:
+
+    QNetworkRequest silentRequest(const QString &path) const;
+    QNetworkRequest scriptedRequest(const QString &path) const;
+    static bool waitFor(QSignalSpy &spy, int count = 1);
+    static int statusCode(QNetworkReply *reply);
+
+private: // Data
+
+    SilentServer *m_server;
+    ScriptedServer *m_scriptedServer;
+    int m_maxRequestsPerHost;
+    double m_requestRate;
+};
+
+void tst_TransportReply::init()
+{
+    m_server = new SilentServer(this);
+    QVERIFY(m_server->listen(QHostAddress::LocalHost));
+
+    m_scriptedServer = new ScriptedServer(this);
+    QVERIFY(m_scriptedServer->listen(QHostAddress::LocalHost));
+
+    m_maxRequestsPerHost = NetworkTransport::instance()->maxRequestsPerHost();
+
+    // Only requestRateSpreadsBurst() tests the token bucket.
+    m_requestRate = NetworkTransport::instance()->requestRate();
+    NetworkTransport::instance()->setRequestRate(0);
+}
+
+void tst_TransportReply::cleanup()
+{
+    NetworkTransport::instance()->setMaxRequestsPerHost(m_maxRequestsPerHost);
+    NetworkTransport::instance()->setRequestRate(m_requestRate);
+    delete m_server;
+    delete m_scriptedServer;
+}
+
+/*
+  A request the server never answers fails with a timeout once its
+  deadline has passed, and is not sent again.
+*/
+void tst_TransportReply::deadlineAbortsSilentRequest()
+{
+    QNetworkRequest request = silentRequest("/silent");
+    request.setAttribute(QNetworkRequest::Attribute(NetworkTransport::DeadlineAttribute),
+                         Deadline);
+
+    QElapsedTimer timer;
+    timer.start();
+    QNetworkReply *reply = NetworkTransport::instance()->get(request);
+    QSignalSpy finished(reply, SIGNAL(finished()));
+
+    QVERIFY(waitFor(finished));
+
+    QCOMPARE(reply->error(), QNetworkReply::TimeoutError);
+    QVERIFY(timer.elapsed() >= Deadline - 50);
+    QCOMPARE(m_server->requestCount(), 1);
+
+    delete reply;
+}
+
+/*
+  The deadline runs from the call, so a request stuck in the queue behind
+  another one times out without being sent.
+*/
+void tst_TransportReply::deadlineCountsQueuedTime()
+{
+    NetworkTransport::instance()->setMaxRequestsPerHost(1);
+
+    // Holds the only slot to the host; it has no timeout of its own.
+    QNetworkReply *blocking = NetworkTransport::instance()->get(silentRequest("/blocking"));
+
+    QNetworkRequest request = silentRequest("/queued");
+    request.setAttribute(QNetworkRequest::Attribute(NetworkTransport::DeadlineAttribute),
+                         Deadline);
+    QNetworkReply *reply = NetworkTransport::instance()->get(request);
+    QSignalSpy finished(reply, SIGNAL(finished()));
+
+    QVERIFY(waitFor(finished));
+
+    QCOMPARE(reply->error(), QNetworkReply::TimeoutError);
+    QVERIFY(!blocking->isFinished());
+    QCOMPARE(m_server->requestCount(), 1);
+
+    blocking->abort();
+    delete blocking;
+    delete reply;
+}
+
+/*
+  A request that stalls for the inactivity timeout fails with a timeout and
+  is not retried, although a GET could be.
+*/
+void tst_TransportReply::stalledRequestIsNotRetried()
+{
+    QNetworkRequest request = silentRequest("/stalled");
+    request.setAttribute(QNetworkRequest::Attribute(NetworkTransport::TimeoutAttribute),
+                         Timeout);
+    request.setAttribute(QNetworkRequest::Attribute(NetworkTransport::MaxRetriesAttribute), 3);
+
+    QNetworkReply *reply = NetworkTransport::instance()->get(request);
+    QSignalSpy finished(reply, SIGNAL(finished()));
+
+    QVERIFY(waitFor(finished));
+
+    QCOMPARE(reply->error(), QNetworkReply::TimeoutError);
+    QCOMPARE(m_server->requestCount(), 1);
+
+    delete reply;
+}
+
+void tst_TransportReply::getRetriedOnServerError_data()
+{
+    QTest::addColumn<int>("status");
+
+    QTest::newRow("500 Internal Server Error") << 500;
+    QTest::newRow("502 Bad Gateway") << 502;
+    QTest::newRow("503 Service Unavailable") << 503;
+    QTest::newRow("504 Gateway Timeout") << 504;
+}
+
+/*
+  A GET answered with a server error is sent again, and the error response
+  is not seen by the user of the reply.
+*/
+void tst_TransportReply::getRetriedOnServerError()
+{
+    QFETCH(int, status);
+
+    // Retry-After: 0 skips the backoff.
+    m_scriptedServer->addResponse("/flaky", status, "Retry-After: 0\r\n");
+    m_scriptedServer->addResponse("/flaky", status, "Retry-After: 0\r\n");
+
+    QNetworkReply *reply = NetworkTransport::instance()->get(scriptedRequest("/flaky"));
+    QSignalSpy finished(reply, SIGNAL(finished()));
+
+    QVERIFY(waitFor(finished));
+
+    QCOMPARE(reply->error(), QNetworkReply::NoError);
+    QCOMPARE(statusCode(reply), 200);
+    QCOMPARE(reply->readAll(), QByteArray("{\"id\":\"1\"}"));
+    QCOMPARE(m_scriptedServer->requestCount("/flaky"), 3);
+
+    delete reply;
+}
+
+/*
+  A request that keeps failing is sent MaxRetriesAttribute times more, and
+  then fails with the last response.
+*/
+void tst_TransportReply::retriesStopAtMaxRetries()
+{
+    for (int i = 0; i < 5; i++) {
+        m_scriptedServer->addResponse("/down", 503, "Retry-After: 0\r\n", "down");
+    }
+
+    QNetworkRequest request = scriptedRequest("/down");
+    request.setAttribute(QNetworkRequest::Attribute(NetworkTransport::MaxRetriesAttribute), 2);
+
+    QNetworkReply *reply = NetworkTransport::instance()->get(request);
+    QSignalSpy finished(reply, SIGNAL(finished()));
+
+    QVERIFY(waitFor(finished));
+
+    QVERIFY(reply->error() != QNetworkReply::NoError);
+    QCOMPARE(statusCode(reply), 503);
+    QCOMPARE(reply->readAll(), QByteArray("down"));
+    QCOMPARE(m_scriptedServer->requestCount("/down"), 3);
+
+    delete reply;
+}
+
+/*
+  The server may have acted on a POST it answered with 500, so the POST is
+  not sent again.
+*/
+void tst_TransportReply::postNotRetriedOnServerError()
+{
+    m_scriptedServer->addResponse("/feed", 500, "Retry-After: 0\r\n");
+
+    QNetworkReply *reply = NetworkTransport::instance()->post(scriptedRequest("/feed"),
+                                                              QByteArray("message=Hello"));
+    QSignalSpy finished(reply, SIGNAL(finished()));
+
+    QVERIFY(waitFor(finished));
+
+    QVERIFY(reply->error() != QNetworkReply::NoError);
+    QCOMPARE(statusCode(reply), 500);
+    QCOMPARE(m_scriptedServer->requestCount("/feed"), 1);
+
+    delete reply;
+}
+
+void tst_TransportReply::postRetriedOnRateLimit_data()
+{
+    QTest::addColumn<int>("status");
+
+    QTest::newRow("429 Too Many Requests") << 429;
+    QTest::newRow("503 Service Unavailable") << 503;
+}
+
+/*
+  A POST refused with 429 or 503 was not acted on, so it is sent again with
+  the same body.
+*/
+void tst_TransportReply::postRetriedOnRateLimit()
+{
+    QFETCH(int, status);
+
+    m_scriptedServer->addResponse("/feed", status, "Retry-After: 0\r\n");
+
+    QNetworkReply *reply = NetworkTransport::instance()->post(scriptedRequest("/feed"),
+                                                              QByteArray("message=Hello"));
+    QSignalSpy finished(reply, SIGNAL(finished()));
+
+    QVERIFY(waitFor(finished));
+
+    QCOMPARE(reply->error(), QNetworkReply::NoError);
+    QCOMPARE(m_scriptedServer->requestCount("/feed"), 2);
+    QCOMPARE(m_scriptedServer->bodies("/feed").last(), QByteArray("message=Hello"));
+
+    delete reply;
+}
+
+/*
+  A Retry-After header delays the retry, and holds back a request to
+  another path of the host made meanwhile.
+*/
+void tst_TransportReply::retryAfterBlocksHost()
+{
+    m_scriptedServer->addResponse("/limited", 503, "Retry-After: 1\r\n");
+
+    QNetworkReply *limited = NetworkTransport::instance()->get(scriptedRequest("/limited"));
+    QSignalSpy limitedFinished(limited, SIGNAL(finished()));
+
+    // The other request is made once the first response has been handled.
+    QTime time;
+    time.start();
+
+    while (m_scriptedServer->requestCount("/limited") == 0 && time.elapsed() < WaitTimeout) {
+        QTest::qWait(10);
+    }
+
+    QTest::qWait(Slack);
+
+    QNetworkReply *other = NetworkTransport::instance()->get(scriptedRequest("/other"));
+    QSignalSpy otherFinished(other, SIGNAL(finished()));
+
+    QVERIFY(waitFor(limitedFinished));
+    QVERIFY(waitFor(otherFinished));
+
+    QCOMPARE(limited->error(), QNetworkReply::NoError);
+    QCOMPARE(other->error(), QNetworkReply::NoError);
+
+    const QList<qint64> arrivals = m_scriptedServer->arrivals("/limited");
+    QCOMPARE(arrivals.count(), 2);
+    QVERIFY(arrivals.at(1) - arrivals.at(0) >= 1000 - Slack);
+    QVERIFY(m_scriptedServer->arrivals("/other").first() - arrivals.at(0) >= 1000 - Slack);
+
+    delete limited;
+    delete other;
+}
+
+/*
+  Twitter's x-rate-limit-reset header holds back the requests to the
+  rate limited path until the reset, but not those to other paths.
+*/
+void tst_TransportReply::rateLimitResetBlocksPath()
+{
+    // The reset is given in whole seconds since the epoch.
+    const qint64 resetAt = (QDateTime::currentMSecsSinceEpoch() / 1000 + 2) * 1000;
+    m_scriptedServer->addResponse("/timeline", 429,
+                                  "x-rate-limit-remaining: 0\r\n"
+                                  "x-rate-limit-reset: " + QByteArray::number(resetAt / 1000) +
+                                  "\r\n");
+
+    QNetworkReply *limited = NetworkTransport::instance()->get(scriptedRequest("/timeline"));
+    QSignalSpy limitedFinished(limited, SIGNAL(finished()));
+
+    QTime time;
+    time.start();
+
+    while (m_scriptedServer->requestCount("/timeline") == 0 && time.elapsed() < WaitTimeout) {
+        QTest::qWait(10);
+    }
+
+    QTest::qWait(Slack);
+
+    const qint64 sentAt = QDateTime::currentMSecsSinceEpoch();
+    QNetworkReply *samePath = NetworkTransport::instance()->get(
+            scriptedRequest("/timeline?since_id=1"));
+    QNetworkReply *otherPath = NetworkTransport::instance()->get(scriptedRequest("/mentions"));
+    QSignalSpy samePathFinished(samePath, SIGNAL(finished()));
+    QSignalSpy otherPathFinished(otherPath, SIGNAL(finished()));
+
+    QVERIFY(waitFor(limitedFinished));
+    QVERIFY(waitFor(samePathFinished));
+    QVERIFY(waitFor(otherPathFinished));
+
+    QCOMPARE(limited->error(), QNetworkReply::NoError);
+    QCOMPARE(samePath->error(), QNetworkReply::NoError);
+    QCOMPARE(otherPath->error(), QNetworkReply::NoError);
+
+    // The retry and the request to the same path wait for the reset.
+    const QList<qint64> arrivals = m_scriptedServer->arrivals("/timeline");
+    QCOMPARE(arrivals.count(), 3);
+    QVERIFY(arrivals.at(1) >= resetAt - Slack);
+    QVERIFY(arrivals.at(2) >= resetAt - Slack);
+
+    QVERIFY(m_scriptedServer->arrivals("/mentions").first() - sentAt < 1000);
+
+    delete limited;
+    delete samePath;
+    delete otherPath;
+}
+
+void tst_TransportReply::rateLimitCodeIsRetried_data()
+{
+    QTest::addColumn<QByteArray>("body");
+    QTest::addColumn<QVariantList>("codes");
+    QTest::addColumn<int>("requests");
+
+    const QVariantList codes = QVariantList() << 4 << 17;
+
+    QTest::newRow("rate limit code") << QByteArray(RateLimitedBody) << codes << 2;
+    QTest::newRow("other code") << QByteArray(InvalidBody) << codes << 1;
+    QTest::newRow("no codes given") << QByteArray(RateLimitedBody) << QVariantList() << 1;
+}
+
+/*
+  The Graph API answers a rate limited request with 400 and an error code
+  in the body. The request is retried if the code is one of the
+  RateLimitCodesAttribute of the request.
+*/
+void tst_TransportReply::rateLimitCodeIsRetried()
+{
+    QFETCH(QByteArray, body);
+    QFETCH(QVariantList, codes);
+    QFETCH(int, requests);
+
+    m_scriptedServer->addResponse("/me/feed", 400, "Retry-After: 0\r\n", body);
+
+    QNetworkRequest request = scriptedRequest("/me/feed");
+
+    if (!codes.isEmpty()) {
+        request.setAttribute(QNetworkRequest::Attribute(NetworkTransport::RateLimitCodesAttribute),
+                             codes);
+    }
+
+    QNetworkReply *reply = NetworkTransport::instance()->get(request);
+    QSignalSpy finished(reply, SIGNAL(finished()));
+
+    QVERIFY(waitFor(finished));
+
+    QCOMPARE(m_scriptedServer->requestCount("/me/feed"), requests);
+
+    if (requests > 1) {
+        QCOMPARE(reply->error(), QNetworkReply::NoError);
+    }
+    else {
+        // The error response reaches the user of the reply.
+        QCOMPARE(statusCode(reply), 400);
+        QCOMPARE(reply->readAll(), body);
+    }
+
+    delete reply;
+}
+
+/*
+  A burst of requests beyond the bucket of the host is spread out at the
+  request rate.
+*/
+void tst_TransportReply::requestRateSpreadsBurst()
+{
+    // The bucket holds 10 requests; the last of 15 waits for 5 tokens.
+    const int count = 15;
+    NetworkTransport::instance()->setRequestRate(10);
+
+    QList<QNetworkReply *> replies;
+    QList<QSignalSpy *> spies;
+
+    for (int i = 0; i < count; i++) {
+        QNetworkReply *reply = NetworkTransport::instance()->get(scriptedRequest("/burst"));
+        replies.append(reply);
+        spies.append(new QSignalSpy(reply, SIGNAL(finished())));
+    }
+
+    for (int i = 0; i < count; i++) {
+        QVERIFY(waitFor(*spies.at(i)));
+        QCOMPARE(replies.at(i)->error(), QNetworkReply::NoError);
+    }
+
+    const QList<qint64> arrivals = m_scriptedServer->arrivals("/burst");
+    QCOMPARE(arrivals.count(), count);
+    QVERIFY(arrivals.last() - arrivals.first() >= 500 - Slack);
+
+    qDeleteAll(spies);
+    qDeleteAll(replies);
+}
+
+QNetworkRequest tst_TransportReply::silentRequest(const QString &path) const
+{
+    QNetworkRequest request(QUrl(QString("http://127.0.0.1:%1%2")
+                                 .arg(m_server->serverPort()).arg(path)));
+
+    // Each request reaches the server.
+    request.setAttribute(QNetworkRequest::CacheLoadControlAttribute,
+                         QNetworkRequest::AlwaysNetwork);
+
+    return request;
+}
+
+QNetworkRequest tst_TransportReply::scriptedRequest(const QString &path) const
+{
+    QNetworkRequest request(QUrl(QString("http://127.0.0.1:%1%2")
+                                 .arg(m_scriptedServer->serverPort()).arg(path)));
+    request.setAttribute(QNetworkRequest::CacheLoadControlAttribute,
+                         QNetworkRequest::AlwaysNetwork);
+
+    return request;
+}
+
+bool tst_TransportReply::waitFor(QSignalSpy &spy, int count)
+{
+    QTime time;
+    time.start();
+
+    while (spy.count() < count && time.elapsed() < WaitTimeout) {
+        QTest::qWait(50);
+    }
+
+    return spy.count() >= count;
+}
+
+int tst_TransportReply::statusCode(QNetworkReply *reply)
+{
+    return reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+}
+
+int main(int argc, char *argv[])
+{
+    // The transport needs no display, only an event loop.
+    QCoreApplication app(argc, argv);
+    tst_TransportReply test;
+
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_transportreply.moc"
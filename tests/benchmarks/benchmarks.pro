@@ -0,0 +1,4 @@
+# Copyright (c) 2012-2014 Microsoft Mobile.
+
+TEMPLATE = subdirs
+SUBDIRS += imageprocessor jsonreader messagemodel parsequeue twitterupload
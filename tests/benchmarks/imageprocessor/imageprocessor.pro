@@ -0,0 +1,16 @@
+# Copyright (c) 2012-2014 Microsoft Mobile.
+
+TEMPLATE = app
+TARGET = tst_bench_imageprocessor
+QT += testlib
+CONFIG += testcase
+
+PLUGIN_SRC = $$PWD/../../../plugin/src
+INCLUDEPATH += $$PLUGIN_SRC
+
+HEADERS += \
+    $$PLUGIN_SRC/imageprocessor.h
+
+SOURCES += \
+    $$PLUGIN_SRC/imageprocessor.cpp \
+    tst_bench_imageprocessor.cpp
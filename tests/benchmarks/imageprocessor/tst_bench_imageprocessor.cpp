@@ -0,0 +1,202 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include <QtCore/QBuffer>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QStringList>
+#include <QtCore/QTemporaryFile>
+#include <QtGui/QImage>
+#include <QtGui/QImageWriter>
+#include <QtGui/QPainter>
+#include <QtTest/QtTest>
+#include "imageprocessor.h"
+
+// Constants
+namespace {
+    // An 8 MP camera photo.
+    const int PhotoWidth = 3264;
+    const int PhotoHeight = 2448;
+
+    const int Quality = 85;
+
+    // Written into the Exif segment of the photo, to be found in an output
+    // that still has it.
+    const char *Location = "GPS 60.1699N 24.9384E";
+}
+
+
+/*
+  Measures the time ImageProcessor::processFile() takes to scale down and
+  encode a photo, or only to drop its metadata, and reports the bytes it
+  saves. Every output is checked to have lost the location of the photo.
+*/
+class tst_bench_ImageProcessor : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void initTestCase();
+    void cleanupTestCase();
+
+    void processFile_data();
+    void processFile();
+
+private:
+
+    static QByteArray createPhoto(const QSize &size, const char *format);
+    static QByteArray insertExif(const QByteArray &jpeg);
+    static bool hasLocation(const QString &fileName);
+
+private: // Data
+
+    QTemporaryFile m_jpegFile;
+    QTemporaryFile m_pngFile;
+};
+
+void tst_bench_ImageProcessor::initTestCase()
+{
+    QVERIFY(m_jpegFile.open());
+    m_jpegFile.write(insertExif(createPhoto(QSize(PhotoWidth, PhotoHeight), "jpg")));
+    m_jpegFile.close();
+
+    // Named as the photo picker would name it.
+    m_pngFile.setFileTemplate(QDir::temp().filePath("tst_bench_imageprocessor-XXXXXX.png"));
+    QVERIFY(m_pngFile.open());
+    m_pngFile.write(createPhoto(QSize(PhotoWidth / 3, PhotoHeight / 3), "png"));
+    m_pngFile.close();
+
+    QVERIFY(hasLocation(m_jpegFile.fileName()));
+}
+
+void tst_bench_ImageProcessor::cleanupTestCase()
+{
+    m_jpegFile.remove();
+    m_pngFile.remove();
+}
+
+void tst_bench_ImageProcessor::processFile_data()
+{
+    QTest::addColumn<QString>("fileName");
+    QTest::addColumn<int>("maximumSize");
+
+    QTest::newRow("8 MP JPEG, scaled to 1024") << m_jpegFile.fileName() << 1024;
+    QTest::newRow("8 MP JPEG, scaled to 2048") << m_jpegFile.fileName() << 2048;
+    QTest::newRow("8 MP JPEG, metadata only") << m_jpegFile.fileName() << 4096;
+    QTest::newRow("1 MP PNG, encoded again") << m_pngFile.fileName() << 4096;
+}
+
+void tst_bench_ImageProcessor::processFile()
+{
+    QFETCH(QString, fileName);
+    QFETCH(int, maximumSize);
+
+    ImageProcessor::Result result;
+    QStringList written;
+
+    QBENCHMARK {
+        result = ImageProcessor::processFile(fileName, maximumSize, Quality);
+        written.append(result.fileName);
+    }
+
+    const bool located = hasLocation(result.fileName);
+    const QImage image(result.fileName);
+
+    foreach (const QString &output, written) {
+        if (output != fileName) {
+            QFile::remove(output);
+        }
+    }
+
+    QVERIFY(result.temporary);
+    QVERIFY(!located);
+    QVERIFY(!image.isNull());
+    QVERIFY(image.width() <= maximumSize && image.height() <= maximumSize);
+
+    qDebug() << "Bytes:" << result.originalSize << "->" << result.size
+             << "saved:" << result.originalSize - result.size;
+}
+
+/*
+  Returns a photo-like image of \a size encoded in \a format: a gradient
+  with fine detail, which does not compress away.
+*/
+QByteArray tst_bench_ImageProcessor::createPhoto(const QSize &size, const char *format)
+{
+    QImage image(size, QImage::Format_RGB32);
+    QPainter painter(&image);
+    QLinearGradient gradient(0, 0, size.width(), size.height());
+    gradient.setColorAt(0, QColor(40, 90, 160));
+    gradient.setColorAt(1, QColor(220, 180, 90));
+    painter.fillRect(image.rect(), gradient);
+    painter.end();
+
+    qsrand(1);
+
+    for (int y = 0; y < size.height(); y++) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+
+        for (int x = 0; x < size.width(); x++) {
+            const int noise = qrand() % 24 - 12;
+            const QRgb pixel = line[x];
+            line[x] = qRgb(qBound(0, qRed(pixel) + noise, 255),
+                           qBound(0, qGreen(pixel) + noise, 255),
+                           qBound(0, qBlue(pixel) + noise, 255));
+        }
+    }
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QImageWriter writer(&buffer, format);
+    writer.setQuality(95);
+    writer.write(image);
+
+    return data;
+}
+
+/*
+  Returns \a jpeg with an Exif segment after its start of image marker. The
+  segment holds an upright orientation and the location string.
+*/
+QByteArray tst_bench_ImageProcessor::insertExif(const QByteArray &jpeg)
+{
+    // A little endian TIFF header and a directory of a single entry, the
+    // orientation 1, followed by the location.
+    QByteArray exif("Exif\0\0", 6);
+    exif.append("II*\0", 4);
+    exif.append("\x08\0\0\0", 4);
+    exif.append("\x01\0", 2);
+    exif.append("\x12\x01\x03\0\x01\0\0\0\x01\0\0\0", 12);
+    exif.append("\0\0\0\0", 4);
+    exif.append(Location);
+
+    const int length = exif.size() + 2;
+    QByteArray segment("\xFF\xE1", 2);
+    segment.append(char(length >> 8));
+    segment.append(char(length & 0xFF));
+    segment.append(exif);
+
+    return jpeg.left(2) + segment + jpeg.mid(2);
+}
+
+bool tst_bench_ImageProcessor::hasLocation(const QString &fileName)
+{
+    QFile file(fileName);
+
+    return file.open(QIODevice::ReadOnly) && file.readAll().contains(Location);
+}
+
+int main(int argc, char *argv[])
+{
+    // The image plugins are loaded by the application; no display is
+    // needed.
+    QCoreApplication app(argc, argv);
+    tst_bench_ImageProcessor test;
+
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_bench_imageprocessor.moc"
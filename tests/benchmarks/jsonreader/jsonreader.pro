@@ -0,0 +1,25 @@
+# Copyright (c) 2012-2014 Microsoft Mobile.
+
+TEMPLATE = app
+TARGET = tst_bench_jsonreader
+QT -= gui
+QT += testlib
+CONFIG += testcase
+
+DEFINES += SRCDIR=\\\"$$PWD/\\\"
+
+PLUGIN_SRC = $$PWD/../../../plugin/src
+INCLUDEPATH += $$PLUGIN_SRC
+
+HEADERS += \
+    $$PLUGIN_SRC/jsonprojection.h \
+    $$PLUGIN_SRC/jsonreader.h
+
+SOURCES += \
+    $$PLUGIN_SRC/jsonprojection.cpp \
+    $$PLUGIN_SRC/jsonreader.cpp \
+    tst_bench_jsonreader.cpp
+
+OTHER_FILES += \
+    data/fql_stream.json \
+    data/graph_feed.json
@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtTest/QtTest>
+#include "jsonprojection.h"
+#include "jsonreader.h"
+
+/*
+  Measures JsonReader on recorded replies of the services: a page of an FQL
+  stream query, as retrieved by FacebookConnection, and a page of a Graph API
+  home feed. The document is read into a tree of QVariants, skipped as a
+  whole, and projected to the fields the message list shows. The recordings
+  are kept in the data directory, with user identifiers and texts replaced.
+*/
+class tst_bench_JsonReader : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void readCurrent_data();
+    void readCurrent();
+
+    void skipCurrent_data();
+    void skipCurrent();
+
+    void projectList_data();
+    void projectList();
+
+private:
+
+    static QByteArray payload(const QString &fileName);
+    static void addPayloadRows();
+};
+
+void tst_bench_JsonReader::readCurrent_data()
+{
+    addPayloadRows();
+}
+
+void tst_bench_JsonReader::readCurrent()
+{
+    QFETCH(QByteArray, data);
+
+    QVariant document;
+
+    QBENCHMARK {
+        JsonReader reader(data);
+        reader.readNext();
+        document = reader.readCurrent();
+        QVERIFY(!reader.hasError());
+    }
+
+    QCOMPARE(document.toMap().value("data").toList().count(), 100);
+}
+
+void tst_bench_JsonReader::skipCurrent_data()
+{
+    addPayloadRows();
+}
+
+void tst_bench_JsonReader::skipCurrent()
+{
+    QFETCH(QByteArray, data);
+
+    QBENCHMARK {
+        JsonReader reader(data);
+        reader.readNext();
+        QVERIFY(reader.skipCurrent());
+        QCOMPARE(reader.readNext(), JsonReader::EndDocument);
+    }
+}
+
+void tst_bench_JsonReader::projectList_data()
+{
+    addPayloadRows();
+}
+
+void tst_bench_JsonReader::projectList()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(QString, idPath);
+    QFETCH(QString, urlPath);
+    QFETCH(QString, descriptionPath);
+
+    // As FacebookDataManager projects the posts.
+    JsonProjection projection;
+    projection.addField("message", "text");
+    projection.addField(idPath, "id");
+    projection.addField("created_time", "time");
+    projection.addField(urlPath, "url");
+    projection.addField(descriptionPath, "description");
+
+    QVariantList posts;
+
+    QBENCHMARK {
+        posts = projection.projectList(data, "data");
+    }
+
+    QCOMPARE(posts.count(), 100);
+    QVERIFY(!posts.first().toMap().value("id").toString().isEmpty());
+
+    qDebug() << "Bytes:" << data.size();
+}
+
+QByteArray tst_bench_JsonReader::payload(const QString &fileName)
+{
+    QFile file(QLatin1String(SRCDIR "data/") + fileName);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot open" << file.fileName();
+        return QByteArray();
+    }
+
+    return file.readAll();
+}
+
+void tst_bench_JsonReader::addPayloadRows()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<QString>("idPath");
+    QTest::addColumn<QString>("urlPath");
+    QTest::addColumn<QString>("descriptionPath");
+
+    QTest::newRow("FQL stream") << payload("fql_stream.json")
+        << "post_id" << "attachment.href" << "attachment.description";
+    QTest::newRow("Graph API feed") << payload("graph_feed.json")
+        << "id" << "link" << "description";
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    tst_bench_JsonReader test;
+
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_bench_jsonreader.moc"
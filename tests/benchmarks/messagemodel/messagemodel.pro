@@ -0,0 +1,17 @@
+# Copyright (c) 2012-2014 Microsoft Mobile.
+
+TEMPLATE = app
+TARGET = tst_bench_messagemodel
+QT -= gui
+QT += testlib
+CONFIG += testcase
+
+PLUGIN_SRC = $$PWD/../../../plugin/src
+INCLUDEPATH += $$PLUGIN_SRC
+
+HEADERS += \
+    $$PLUGIN_SRC/messagemodel.h
+
+SOURCES += \
+    $$PLUGIN_SRC/messagemodel.cpp \
+    tst_bench_messagemodel.cpp
@@ -0,0 +1,226 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtTest/QtTest>
+#include "messagemodel.h"
+
+// Constants
+namespace {
+    const int MessageCount = 10000;
+
+    // The fields of the message objects, as the roles of the model.
+    const QString IdStr("id");
+    const QString TextStr("text");
+    const QString TimeStr("time");
+    const QString UrlStr("url");
+    const QString UserStr("user");
+}
+
+
+/*
+  Compares the store of MessageModel, the fields of the roles column by
+  column, with the QVariantList of QVariantMaps the messages were kept in
+  before the model, for 10000 messages: the memory each takes, and the time
+  it takes to read every field of every message, as a view scrolled through
+  the whole list does.
+*/
+class tst_bench_MessageModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void memory();
+
+    void read_data();
+    void read();
+
+private:
+
+    static QVariantList createMessages();
+    static QString copy(const QVariant &value);
+    static qint64 residentSize();
+};
+
+/*
+  The growth of the memory of the process is logged when each store is
+  filled. The messages are built first, so the growth is that of the store
+  alone; both stores copy the strings instead of sharing them with the
+  messages.
+*/
+void tst_bench_MessageModel::memory()
+{
+    if (residentSize() < 0) {
+        QSKIP("The resident size of the process is not known on this platform.", SkipAll);
+    }
+
+    const QVariantList messages = createMessages();
+
+    // The messages as they used to be kept: each field copied into a map
+    // of its own, as the projection builds them.
+    qint64 baseline = residentSize();
+    QVariantList list;
+
+    foreach (const QVariant &message, messages) {
+        const QVariantMap map = message.toMap();
+        QVariantMap stored;
+
+        foreach (const QString &key, map.keys()) {
+            stored.insert(key, copy(map.value(key)));
+        }
+
+        list.append(stored);
+    }
+
+    const qint64 listGrowth = residentSize() - baseline;
+
+    baseline = residentSize();
+    MessageModel model;
+    MessageModel::Rows rows;
+
+    foreach (const QVariant &message, messages) {
+        const QVariantMap map = message.toMap();
+        rows.ids.append(copy(map.value(IdStr)));
+        rows.texts.append(copy(map.value(TextStr)));
+        rows.times.append(MessageModel::toTime(map.value(TimeStr)));
+        rows.urls.append(copy(map.value(UrlStr)));
+        rows.userNames.append(copy(map.value(UserStr)));
+    }
+
+    model.addRows(rows);
+    rows = MessageModel::Rows();
+
+    const qint64 modelGrowth = residentSize() - baseline;
+
+    QCOMPARE(list.count(), MessageCount);
+    QCOMPARE(model.count(), MessageCount);
+
+    qDebug() << "QVariantList of QVariantMaps:" << listGrowth / 1024 << "kB,"
+             << "MessageModel:" << modelGrowth / 1024 << "kB";
+}
+
+void tst_bench_MessageModel::read_data()
+{
+    QTest::addColumn<bool>("model");
+
+    QTest::newRow("MessageModel") << true;
+    QTest::newRow("QVariantList of QVariantMaps") << false;
+}
+
+void tst_bench_MessageModel::read()
+{
+    QFETCH(bool, model);
+
+    const QVariantList messages = createMessages();
+
+    MessageModel messageModel;
+    messageModel.setRoleKey(MessageModel::UrlRole, UrlStr);
+    messageModel.addMessages(messages);
+    QCOMPARE(messageModel.count(), MessageCount);
+
+    const QList<int> roles = QList<int>() << MessageModel::IdRole << MessageModel::TextRole
+        << MessageModel::TimeRole << MessageModel::UrlRole << MessageModel::UserNameRole;
+    const QStringList keys = QStringList() << IdStr << TextStr << TimeStr << UrlStr << UserStr;
+    int characters = 0;
+
+    if (model) {
+        QBENCHMARK {
+            characters = 0;
+
+            for (int row = 0; row < MessageCount; row++) {
+                const QModelIndex index = messageModel.index(row);
+
+                foreach (int role, roles) {
+                    characters += messageModel.data(index, role).toString().size();
+                }
+            }
+        }
+    }
+    else {
+        QBENCHMARK {
+            characters = 0;
+
+            for (int row = 0; row < MessageCount; row++) {
+                const QVariantMap message = messages.at(row).toMap();
+
+                foreach (const QString &key, keys) {
+                    characters += message.value(key).toString().size();
+                }
+            }
+        }
+    }
+
+    QVERIFY(characters > 0);
+}
+
+/*
+  Returns MessageCount message objects as the connections retrieve them,
+  newest first, with strings of their own.
+*/
+QVariantList tst_bench_MessageModel::createMessages()
+{
+    QVariantList messages;
+    const uint newest = 1388534400; // 2014-01-01
+
+    for (int i = 0; i < MessageCount; i++) {
+        QVariantMap message;
+        message.insert(IdStr, QString("16831545807_%1").arg(100000000 + i));
+        message.insert(TextStr, QString("Cafe with friends at the lake, message %1").arg(i));
+        message.insert(TimeStr, QString::number(newest - i * 60));
+        message.insert(UrlStr, QString("https://www.example.com/story/%1").arg(i));
+        message.insert(UserStr, QString("Friend %1").arg(i % 100));
+        messages.append(message);
+    }
+
+    return messages;
+}
+
+/*
+  Returns a deep copy of the string in \a value.
+*/
+QString tst_bench_MessageModel::copy(const QVariant &value)
+{
+    const QString string = value.toString();
+
+    return QString(string.unicode(), string.size());
+}
+
+/*
+  Returns the resident set size of the process in bytes, or -1 if it
+  cannot be read.
+*/
+qint64 tst_bench_MessageModel::residentSize()
+{
+#ifdef Q_OS_LINUX
+    QFile status("/proc/self/status");
+
+    if (status.open(QIODevice::ReadOnly)) {
+        // The file reports no size, so it is read a line at a time.
+        QByteArray line = status.readLine();
+
+        while (!line.isEmpty()) {
+            // For example "VmRSS:	    5120 kB".
+            if (line.startsWith("VmRSS:")) {
+                return line.mid(6).trimmed().split(' ').first().toLongLong() * 1024;
+            }
+
+            line = status.readLine();
+        }
+    }
+#endif
+
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    tst_bench_MessageModel test;
+
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_bench_messagemodel.moc"
@@ -0,0 +1,21 @@
+# Copyright (c) 2012-2014 Microsoft Mobile.
+
+TEMPLATE = app
+TARGET = tst_bench_parsequeue
+QT -= gui
+QT += testlib
+CONFIG += testcase
+
+PLUGIN_SRC = $$PWD/../../../plugin/src
+INCLUDEPATH += $$PLUGIN_SRC
+
+HEADERS += \
+    $$PLUGIN_SRC/jsonprojection.h \
+    $$PLUGIN_SRC/jsonreader.h \
+    $$PLUGIN_SRC/parsequeue.h
+
+SOURCES += \
+    $$PLUGIN_SRC/jsonprojection.cpp \
+    $$PLUGIN_SRC/jsonreader.cpp \
+    $$PLUGIN_SRC/parsequeue.cpp \
+    tst_bench_parsequeue.cpp
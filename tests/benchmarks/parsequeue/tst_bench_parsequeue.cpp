@@ -0,0 +1,223 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QTimer>
+#include <QtCore/QtConcurrentRun>
+#include <QtTest/QSignalSpy>
+#include <QtTest/QtTest>
+#include "jsonprojection.h"
+#include "parsequeue.h"
+
+// Constants
+namespace {
+    // The event loop is expected to run once a frame at 60 fps.
+    const int FrameInterval = 16; // ms
+
+    // The time the event loop is watched before and after the parsing.
+    const int IdleTime = 100; // ms
+
+    // The longest time in milliseconds the parsing may take.
+    const int WaitTimeout = 60000;
+}
+
+
+/*
+  Ticks once a frame and records the longest time between two ticks, that
+  is the longest time the event loop was kept from running.
+*/
+class FrameClock : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit FrameClock(QObject *parent = 0);
+
+public:
+
+    void start();
+    void stop();
+    int longestGap() const;
+
+private slots:
+
+    void onTick();
+
+private: // Data
+
+    QTimer m_timer;
+    QElapsedTimer m_sinceTick;
+    int m_longestGap;
+};
+
+FrameClock::FrameClock(QObject *parent)
+    : QObject(parent),
+      m_longestGap(0)
+{
+    m_timer.setInterval(FrameInterval);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(onTick()));
+}
+
+void FrameClock::start()
+{
+    m_longestGap = 0;
+    m_sinceTick.start();
+    m_timer.start();
+}
+
+void FrameClock::stop()
+{
+    m_timer.stop();
+    onTick();
+}
+
+int FrameClock::longestGap() const
+{
+    return m_longestGap;
+}
+
+void FrameClock::onTick()
+{
+    m_longestGap = qMax(m_longestGap, int(m_sinceTick.restart()));
+}
+
+
+/*
+  Measures the longest time the event loop stalls while a large Graph API
+  feed is projected to the fields the message list shows: on a worker
+  thread through ParseQueue, as the connections parse their replies, or on
+  the thread of the event loop, as the replies were parsed before the
+  queue. The stall is reported as the result; the time the whole parsing
+  takes is logged.
+*/
+class tst_bench_ParseQueue : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void initTestCase();
+
+    void longestStall_data();
+    void longestStall();
+
+private:
+
+    static QByteArray createFeed(int posts);
+
+private: // Data
+
+    JsonProjection m_projection;
+};
+
+void tst_bench_ParseQueue::initTestCase()
+{
+    // As FacebookDataManager projects the posts.
+    m_projection.addField("message", "text");
+    m_projection.addField("id", "id");
+    m_projection.addField("created_time", "time");
+    m_projection.addField("link", "url");
+    m_projection.addField("description", "description");
+}
+
+void tst_bench_ParseQueue::longestStall_data()
+{
+    QTest::addColumn<int>("posts");
+    QTest::addColumn<bool>("queued");
+
+    QTest::newRow("1000 posts, ParseQueue") << 1000 << true;
+    QTest::newRow("1000 posts, event loop thread") << 1000 << false;
+    QTest::newRow("10000 posts, ParseQueue") << 10000 << true;
+    QTest::newRow("10000 posts, event loop thread") << 10000 << false;
+}
+
+void tst_bench_ParseQueue::longestStall()
+{
+    QFETCH(int, posts);
+    QFETCH(bool, queued);
+
+    const QByteArray feed = createFeed(posts);
+    QVariantList result;
+
+    FrameClock clock;
+    clock.start();
+    QTest::qWait(IdleTime);
+
+    QElapsedTimer parsing;
+    parsing.start();
+
+    if (queued) {
+        ParseQueue queue;
+        QSignalSpy finished(&queue, SIGNAL(finished(QVariant,QVariantList)));
+        queue.enqueue(QtConcurrent::run(m_projection, &JsonProjection::projectList,
+                                        feed, QString("data")),
+                      QVariant());
+
+        while (finished.isEmpty() && parsing.elapsed() < WaitTimeout) {
+            QTest::qWait(1);
+        }
+
+        QCOMPARE(finished.count(), 1);
+        result = finished.first().at(1).value<QVariantList>();
+    }
+    else {
+        result = m_projection.projectList(feed, "data");
+    }
+
+    const qint64 parsed = parsing.elapsed();
+    QTest::qWait(IdleTime);
+    clock.stop();
+
+    QCOMPARE(result.count(), posts);
+
+    QTest::setBenchmarkResult(clock.longestGap(), QTest::WalltimeMilliseconds);
+    qDebug() << "Parsed" << feed.size() << "bytes in" << parsed << "ms";
+}
+
+/*
+  Returns a page of a Graph API home feed with \a posts posts, each with
+  likes and comments that the projection skips.
+*/
+QByteArray tst_bench_ParseQueue::createFeed(int posts)
+{
+    QByteArray feed = "{\"data\":[";
+
+    for (int i = 0; i < posts; i++) {
+        const QByteArray id = QByteArray::number(i);
+
+        if (i > 0) {
+            feed += ',';
+        }
+
+        feed += "{\"id\":\"16831545807_" + id + "\","
+                "\"from\":{\"name\":\"A Friend\",\"id\":\"16831545807\"},"
+                "\"message\":\"Caf\\u00e9 with friends at the lake, post " + id + "\","
+                "\"link\":\"https://www.example.com/story/" + id + "\","
+                "\"description\":\"A night at the lake with friends and music\","
+                "\"type\":\"link\","
+                "\"created_time\":\"2014-01-01T00:00:00+0000\","
+                "\"likes\":{\"data\":[{\"id\":\"59645628430\",\"name\":\"A Like\"},"
+                "{\"id\":\"22008173821\",\"name\":\"Another Like\"}]},"
+                "\"comments\":{\"data\":[{\"id\":\"16831545807_" + id + "_1\","
+                "\"from\":{\"id\":\"17517806319\",\"name\":\"A Commenter\"},"
+                "\"message\":\"Great photos from the trip\",\"like_count\":2}]}}";
+    }
+
+    feed += "],\"paging\":{\"next\":\"https://graph.facebook.com/me/home?until=1\"}}";
+
+    return feed;
+}
+
+int main(int argc, char *argv[])
+{
+    // The parsing needs no display, only an event loop.
+    QCoreApplication app(argc, argv);
+    tst_bench_ParseQueue test;
+
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_bench_parsequeue.moc"
@@ -0,0 +1,285 @@
+/**
+ * Copyright (c) 2012-2014 Microsoft Mobile.
+ */
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QTemporaryFile>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <QtTest/QtTest>
+#include "multipartdevice.h"
+#include "twitterrequest.h"
+
+// Constants
+namespace {
+    // The longest time in milliseconds an upload may take.
+    const int WaitTimeout = 60000;
+
+    const qint64 MegaByte = 1024 * 1024;
+}
+
+
+/*
+  Receives uploads and drops their bodies as they arrive, so that the memory
+  of the process is only used by the sending side. The time the first byte
+  of a request arrives is recorded.
+*/
+class UploadServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+
+    explicit UploadServer(QObject *parent = 0);
+
+public:
+
+    void start();
+    int firstByteTime() const;
+    qint64 receivedBytes() const;
+
+private slots:
+
+    void onNewConnection();
+    void onReadyRead();
+
+private: // Data
+
+    QTime m_time;
+    int m_firstByteTime; // Milliseconds from start(), -1 until received.
+    qint64 m_receivedBytes;
+    QHash<QTcpSocket *, QByteArray> m_headers;
+    QHash<QTcpSocket *, qint64> m_remaining; // The body left of each upload.
+};
+
+UploadServer::UploadServer(QObject *parent)
+    : QTcpServer(parent),
+      m_firstByteTime(-1),
+      m_receivedBytes(0)
+{
+    connect(this, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+}
+
+void UploadServer::start()
+{
+    m_firstByteTime = -1;
+    m_receivedBytes = 0;
+    m_time.start();
+}
+
+int UploadServer::firstByteTime() const
+{
+    return m_firstByteTime;
+}
+
+qint64 UploadServer::receivedBytes() const
+{
+    return m_receivedBytes;
+}
+
+void UploadServer::onNewConnection()
+{
+    while (hasPendingConnections()) {
+        QTcpSocket *socket = nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void UploadServer::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    QByteArray data = socket->readAll();
+
+    if (m_firstByteTime < 0 && !data.isEmpty()) {
+        m_firstByteTime = m_time.elapsed();
+    }
+
+    m_receivedBytes += data.size();
+
+    if (!m_remaining.contains(socket)) {
+        QByteArray &header = m_headers[socket];
+        header.append(data);
+        const int headerEnd = header.indexOf("\r\n\r\n");
+
+        if (headerEnd < 0) {
+            return;
+        }
+
+        QRegExp contentLength("content-length:\\s*(\\d+)", Qt::CaseInsensitive);
+        contentLength.indexIn(QString::fromLatin1(header.left(headerEnd)));
+        m_remaining.insert(socket, contentLength.cap(1).toLongLong());
+        data = header.mid(headerEnd + 4);
+        m_headers.remove(socket);
+    }
+
+    qint64 &remaining = m_remaining[socket];
+    remaining -= data.size();
+
+    if (remaining <= 0) {
+        m_remaining.remove(socket);
+
+        const QByteArray response = "{\"id_str\":\"1\"}";
+        socket->write("HTTP/1.1 200 OK\r\n"
+                      "Content-Type: application/json\r\n"
+                      "Content-Length: " + QByteArray::number(response.size()) + "\r\n"
+                      "\r\n" + response);
+    }
+}
+
+
+/*
+  Measures the time from TwitterRequest::createPostMediaRequest() to the
+  first byte of the upload reaching the server, and the growth of the memory
+  of the process while the photo is sent. The body is either streamed from
+  the file by MultipartDevice, as TwitterConnection sends it, or read into
+  memory first, as the photos were sent before the device.
+*/
+class tst_bench_TwitterUpload : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void initTestCase();
+
+    void postMedia_data();
+    void postMedia();
+
+private:
+
+    static qint64 residentSize();
+
+private: // Data
+
+    UploadServer m_server;
+    QNetworkAccessManager m_manager;
+};
+
+void tst_bench_TwitterUpload::initTestCase()
+{
+    QVERIFY(m_server.listen(QHostAddress::LocalHost));
+}
+
+void tst_bench_TwitterUpload::postMedia_data()
+{
+    QTest::addColumn<qint64>("size");
+    QTest::addColumn<bool>("streamed");
+
+    QTest::newRow("1 MB, streamed") << MegaByte << true;
+    QTest::newRow("1 MB, buffered") << MegaByte << false;
+    QTest::newRow("16 MB, streamed") << 16 * MegaByte << true;
+    QTest::newRow("16 MB, buffered") << 16 * MegaByte << false;
+    QTest::newRow("64 MB, streamed") << 64 * MegaByte << true;
+    QTest::newRow("64 MB, buffered") << 64 * MegaByte << false;
+}
+
+void tst_bench_TwitterUpload::postMedia()
+{
+    QFETCH(qint64, size);
+    QFETCH(bool, streamed);
+
+    QTemporaryFile photo(QDir::temp().filePath("tst_bench_twitterupload-XXXXXX.jpg"));
+    QVERIFY(photo.open());
+    const QByteArray chunk(MegaByte, 'p');
+
+    for (qint64 written = 0; written < size; written += chunk.size()) {
+        QCOMPARE(photo.write(chunk), qint64(chunk.size()));
+    }
+
+    photo.close();
+
+    TwitterRequest twitterRequest;
+    twitterRequest.setConsumerKey("key");
+    twitterRequest.setConsumerSecret("secret");
+    twitterRequest.setAccessToken("token");
+    twitterRequest.setAccessTokenSecret("tokensecret");
+
+    const qint64 baseline = residentSize();
+    qint64 peak = baseline;
+
+    m_server.start();
+
+    MultipartDevice content;
+    QNetworkRequest request = twitterRequest.createPostMediaRequest(
+                "Upload", QUrl::fromLocalFile(photo.fileName()), &content);
+    QVERIFY(!request.url().isEmpty());
+
+    // Sent to the local server instead of the upload host.
+    QUrl url = request.url();
+    url.setScheme("http");
+    url.setHost("127.0.0.1");
+    url.setPort(m_server.serverPort());
+    request.setUrl(url);
+
+    QVERIFY(content.open(QIODevice::ReadOnly));
+    QNetworkReply *reply = 0;
+
+    if (streamed) {
+        reply = m_manager.post(request, &content);
+    }
+    else {
+        reply = m_manager.post(request, content.readAll());
+    }
+
+    QTime time;
+    time.start();
+
+    while (!reply->isFinished() && time.elapsed() < WaitTimeout) {
+        QTest::qWait(10);
+        peak = qMax(peak, residentSize());
+    }
+
+    QVERIFY(reply->isFinished());
+    QCOMPARE(reply->error(), QNetworkReply::NoError);
+    QVERIFY(m_server.receivedBytes() > size);
+    delete reply;
+
+    QTest::setBenchmarkResult(m_server.firstByteTime(), QTest::WalltimeMilliseconds);
+
+    if (baseline >= 0) {
+        qDebug() << "Upload took" << time.elapsed() << "ms, memory grew by"
+                 << (peak - baseline) / 1024 << "kB";
+    }
+}
+
+/*
+  Returns the resident set size of the process in bytes, or -1 if it
+  cannot be read.
+*/
+qint64 tst_bench_TwitterUpload::residentSize()
+{
+#ifdef Q_OS_LINUX
+    QFile status("/proc/self/status");
+
+    if (status.open(QIODevice::ReadOnly)) {
+        // The file reports no size, so it is read a line at a time.
+        QByteArray line = status.readLine();
+
+        while (!line.isEmpty()) {
+            // For example "VmRSS:	    5120 kB".
+            if (line.startsWith("VmRSS:")) {
+                return line.mid(6).trimmed().split(' ').first().toLongLong() * 1024;
+            }
+
+            line = status.readLine();
+        }
+    }
+#endif
+
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    // The uploads need no display, only an event loop.
+    QCoreApplication app(argc, argv);
+    tst_bench_TwitterUpload test;
+
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_bench_twitterupload.moc"
@@ -0,0 +1,20 @@
+# Copyright (c) 2012-2014 Microsoft Mobile.
+
+TEMPLATE = app
+TARGET = tst_bench_twitterupload
+QT -= gui
+QT += network testlib
+CONFIG += testcase
+
+PLUGIN_SRC = $$PWD/../../../plugin/src
+INCLUDEPATH += $$PLUGIN_SRC $$PLUGIN_SRC/twitter
+
+HEADERS += \
+    $$PLUGIN_SRC/multipartdevice.h \
+    $$PLUGIN_SRC/twitter/twitterconstants.h \
+    $$PLUGIN_SRC/twitter/twitterrequest.h
+
+SOURCES += \
+    $$PLUGIN_SRC/multipartdevice.cpp \
+    $$PLUGIN_SRC/twitter/twitterrequest.cpp \
+    tst_bench_twitterupload.cpp